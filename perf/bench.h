@@ -0,0 +1,154 @@
+/*
+    Copyright (c) 2013 Martin Sustrik  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#ifndef BENCH_H_INCLUDED
+#define BENCH_H_INCLUDED
+
+/*  Timing core of the microbenchmarks. Each case is run 'warmup' times
+    untimed and then 'reps' times timed. Every repetition executes 'ops'
+    operations; the cost of a single operation is computed per repetition
+    and the distribution over the repetitions is reported. Setup and
+    teardown functions, if present, are run before and after each of the
+    repetitions and are not accounted for. */
+
+#include "../src/utils/attr.h"
+#include "../src/utils/clock.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BENCH_DEFAULT_WARMUP 3
+#define BENCH_DEFAULT_REPS 20
+
+typedef void (bench_fn) (int ops);
+
+struct bench_case {
+    const char *name;
+    int ops;
+    bench_fn *setup;
+    bench_fn *run;
+    bench_fn *teardown;
+};
+
+struct bench {
+    int warmup;
+    int reps;
+    int nfilters;
+    char **filters;
+};
+
+static int bench_cmp (const void *a, const void *b)
+{
+    double da = *(const double*) a;
+    double db = *(const double*) b;
+
+    return da < db ? -1 : (da > db ? 1 : 0);
+}
+
+/*  Returns the value below which 'permille' thousandths of the sorted
+    samples lie. */
+static double bench_percentile (double *samples, int n, int permille)
+{
+    int i;
+
+    i = (int) (((long) n * permille + 999) / 1000) - 1;
+    return samples [i < 0 ? 0 : i];
+}
+
+static int GRID_UNUSED bench_init (struct bench *self, int argc, char *argv [])
+{
+    int i;
+
+    self->warmup = BENCH_DEFAULT_WARMUP;
+    self->reps = BENCH_DEFAULT_REPS;
+    self->nfilters = 0;
+    self->filters = argv + 1;
+    for (i = 1; i != argc; ++i) {
+        if (strcmp (argv [i], "-w") == 0 && i + 1 < argc)
+            self->warmup = atoi (argv [++i]);
+        else if (strcmp (argv [i], "-r") == 0 && i + 1 < argc)
+            self->reps = atoi (argv [++i]);
+        else if (argv [i][0] == '-')
+            return -1;
+        else
+            self->filters [self->nfilters++] = argv [i];
+    }
+    if (self->warmup < 0 || self->reps < 1)
+        return -1;
+
+    printf ("%-24s %9s %9s %9s %9s %9s %9s\n", "benchmark [ns/op]", "ops",
+        "mean", "min", "p50", "p90", "p99");
+    return 0;
+}
+
+static void GRID_UNUSED bench_run (struct bench *self,
+    const struct bench_case *c)
+{
+    int i;
+    int selected;
+    uint64_t start;
+    double *samples;
+    double sum;
+
+    /*  Without any filters all the cases are run. Otherwise the name
+        has to contain one of the filters. */
+    selected = self->nfilters == 0;
+    for (i = 0; i != self->nfilters; ++i)
+        if (strstr (c->name, self->filters [i]))
+            selected = 1;
+    if (!selected)
+        return;
+
+    samples = malloc (sizeof (double) * self->reps);
+    if (!samples) {
+        fprintf (stderr, "out of memory\n");
+        exit (1);
+    }
+
+    for (i = 0; i != self->warmup + self->reps; ++i) {
+        if (c->setup)
+            c->setup (c->ops);
+        start = grid_clock_ns ();
+        c->run (c->ops);
+        if (i >= self->warmup)
+            samples [i - self->warmup] =
+                (double) (grid_clock_ns () - start) / c->ops;
+        if (c->teardown)
+            c->teardown (c->ops);
+    }
+
+    sum = 0;
+    for (i = 0; i != self->reps; ++i)
+        sum += samples [i];
+    qsort (samples, self->reps, sizeof (double), bench_cmp);
+    printf ("%-24s %9d %9.1f %9.1f %9.1f %9.1f %9.1f\n", c->name, c->ops,
+        sum / self->reps, samples [0],
+        bench_percentile (samples, self->reps, 500),
+        bench_percentile (samples, self->reps, 900),
+        bench_percentile (samples, self->reps, 990));
+    fflush (stdout);
+
+    free (samples);
+}
+
+#endif
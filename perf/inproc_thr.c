@@ -0,0 +1,62 @@
+/*
+    Copyright (c) 2013 Martin Sustrik  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#include "perf.h"
+#include "../src/utils/thread.c"
+
+#define INPROC_THR_ADDR "inproc://inproc_thr"
+
+static size_t sz;
+static int count;
+static int proto;
+
+static void worker (GRID_UNUSED void *arg)
+{
+    struct perf_socks socks;
+
+    perf_thr_open (&socks, proto, INPROC_THR_ADDR, 0);
+    perf_thr_send (&socks, proto, sz, count);
+    grid_sleep (100);
+    perf_close (&socks);
+}
+
+int main (int argc, char *argv [])
+{
+    struct perf_socks socks;
+    struct grid_thread thread;
+
+    if (argc != 3 && argc != 4) {
+        printf ("usage: inproc_thr <msg-size> <msg-count> [<protocol>]\n");
+        return 1;
+    }
+    sz = perf_size (argv [1]);
+    count = (int) perf_size (argv [2]);
+    proto = perf_protocol (argc == 4 ? argv [3] : NULL);
+
+    perf_thr_open (&socks, proto, INPROC_THR_ADDR, 1);
+    grid_thread_init (&thread, worker, NULL);
+    perf_thr_recv (&socks, proto, sz, count);
+    grid_thread_term (&thread);
+    perf_close (&socks);
+
+    return 0;
+}
@@ -0,0 +1,535 @@
+/*
+    Copyright (c) 2013 Martin Sustrik  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+/*  Microbenchmarks of the core data structures. Usage:
+
+        micro [-w <warmup>] [-r <repetitions>] [<filter>...]
+
+    Only the benchmarks whose name contains one of the filters are run. */
+
+#include "../src/utils/err.c"
+#include "../src/utils/alloc.c"
+#include "../src/utils/atomic.c"
+#include "../src/utils/wire.c"
+#include "../src/utils/chunk.c"
+#include "../src/utils/chunkref.c"
+#include "../src/utils/msg.c"
+#include "../src/utils/list.c"
+#include "../src/utils/queue.c"
+#include "../src/utils/hash.c"
+#include "../src/utils/clock.c"
+#include "../src/aio/timerset.c"
+#include "../src/protocols/pubsub/trie.c"
+#include "../src/protocols/utils/priolist.c"
+#include "../src/transports/inproc/msgqueue.c"
+
+#include "bench.h"
+
+/*  Sizes of the workloads. */
+#define MICRO_TOPICS 10000
+#define MICRO_PIPES 65536
+#define MICRO_TIMERS 100000
+#define MICRO_TIMEROPS 1000
+#define MICRO_MSGS 100000
+#define MICRO_PRIOPIPES 64
+
+/*  Deterministic pseudo-random numbers so that the runs are comparable. */
+static uint32_t micro_seed = 1;
+
+static uint32_t micro_random ()
+{
+    micro_seed ^= micro_seed << 13;
+    micro_seed ^= micro_seed >> 17;
+    micro_seed ^= micro_seed << 5;
+    return micro_seed;
+}
+
+/******************************************************************************/
+/*  grid_trie                                                                 */
+/******************************************************************************/
+
+/*  Topics resemble market data subscriptions: a handful of common prefixes
+    followed by increasingly specific parts. */
+static char micro_topics [MICRO_TOPICS][32];
+static size_t micro_topiclens [MICRO_TOPICS];
+static struct grid_trie micro_trie;
+
+static void micro_topics_init ()
+{
+    int i;
+
+    for (i = 0; i != MICRO_TOPICS; ++i)
+        micro_topiclens [i] = sprintf (micro_topics [i], "md.%s.%c%c%c.%d",
+            i % 3 == 0 ? "eq" : (i % 3 == 1 ? "fx" : "fut"),
+            'A' + (int) (micro_random () % 26),
+            'A' + (int) (micro_random () % 26), 'A' + i % 26, i);
+}
+
+static void micro_trie_init (GRID_UNUSED int ops)
+{
+    grid_trie_init (&micro_trie);
+}
+
+static void micro_trie_fill (int ops)
+{
+    int i;
+
+    grid_trie_init (&micro_trie);
+    for (i = 0; i != ops; ++i)
+        grid_trie_subscribe (&micro_trie, (uint8_t*) micro_topics [i],
+            micro_topiclens [i]);
+}
+
+static void micro_trie_term (GRID_UNUSED int ops)
+{
+    grid_trie_term (&micro_trie);
+}
+
+static void micro_trie_subscribe (int ops)
+{
+    int i;
+
+    for (i = 0; i != ops; ++i)
+        grid_trie_subscribe (&micro_trie, (uint8_t*) micro_topics [i],
+            micro_topiclens [i]);
+}
+
+static void micro_trie_unsubscribe (int ops)
+{
+    int i;
+
+    for (i = 0; i != ops; ++i)
+        grid_trie_unsubscribe (&micro_trie, (uint8_t*) micro_topics [i],
+            micro_topiclens [i]);
+}
+
+static void micro_trie_match (int ops)
+{
+    int i;
+    char msg [64];
+    size_t sz;
+
+    /*  Every other message matches one of the subscriptions. */
+    for (i = 0; i != ops; ++i) {
+        sz = micro_topiclens [i];
+        memcpy (msg, micro_topics [i], sz);
+        if (i % 2)
+            msg [3] = 'x';
+        memcpy (msg + sz, "|payload", 8);
+        grid_trie_match (&micro_trie, (uint8_t*) msg, sz + 8);
+    }
+}
+
+/******************************************************************************/
+/*  grid_hash                                                                 */
+/******************************************************************************/
+
+/*  Keys are spread over the whole 32-bit range the way random pipe IDs
+    are, but without duplicates. */
+static struct grid_hash micro_hash;
+static struct grid_hash_item micro_hashitems [MICRO_PIPES];
+static uint32_t micro_hashkeys [MICRO_PIPES];
+
+static void micro_hash_keys_init ()
+{
+    int i;
+
+    for (i = 0; i != MICRO_PIPES; ++i)
+        micro_hashkeys [i] = (uint32_t) i * 2654435761u;
+}
+
+static void micro_hash_init (GRID_UNUSED int ops)
+{
+    int i;
+
+    grid_hash_init (&micro_hash);
+    for (i = 0; i != MICRO_PIPES; ++i)
+        grid_hash_item_init (&micro_hashitems [i]);
+}
+
+static void micro_hash_insert (int ops)
+{
+    int i;
+
+    for (i = 0; i != ops; ++i)
+        grid_hash_insert (&micro_hash, micro_hashkeys [i],
+            &micro_hashitems [i]);
+}
+
+static void micro_hash_fill (int ops)
+{
+    micro_hash_init (ops);
+    micro_hash_insert (ops);
+}
+
+static void micro_hash_erase (int ops)
+{
+    int i;
+
+    for (i = 0; i != ops; ++i)
+        grid_hash_erase (&micro_hash, &micro_hashitems [i]);
+}
+
+static void micro_hash_term (int ops)
+{
+    int i;
+
+    for (i = 0; i != ops; ++i)
+        grid_hash_item_term (&micro_hashitems [i]);
+    grid_hash_term (&micro_hash);
+}
+
+static void micro_hash_empty (int ops)
+{
+    micro_hash_erase (ops);
+    micro_hash_term (ops);
+}
+
+static void micro_hash_get (int ops)
+{
+    int i;
+
+    for (i = 0; i != ops; ++i)
+        grid_assert (grid_hash_get (&micro_hash,
+            micro_hashkeys [(i * 7919) % ops]));
+}
+
+/******************************************************************************/
+/*  grid_msgqueue                                                             */
+/******************************************************************************/
+
+static struct grid_msgqueue micro_msgqueue;
+
+static void micro_msgqueue_init (GRID_UNUSED int ops)
+{
+    grid_msgqueue_init (&micro_msgqueue, 1 << 30);
+}
+
+static void micro_msgqueue_term (GRID_UNUSED int ops)
+{
+    grid_msgqueue_term (&micro_msgqueue);
+}
+
+/*  Steady stream: each message is read right after it was written. */
+static void micro_msgqueue_stream (int ops)
+{
+    int i;
+    int rc;
+    struct grid_msg msg;
+
+    for (i = 0; i != ops; ++i) {
+        grid_msg_init (&msg, 64);
+        rc = grid_msgqueue_send (&micro_msgqueue, &msg, 0);
+        errnum_assert (rc >= 0, -rc);
+        rc = grid_msgqueue_recv (&micro_msgqueue, &msg, NULL);
+        errnum_assert (rc >= 0, -rc);
+        grid_msg_term (&msg);
+    }
+}
+
+/*  Burst: all the messages are written first, then all of them are read. */
+static void micro_msgqueue_burst (int ops)
+{
+    int i;
+    int rc;
+    struct grid_msg msg;
+
+    for (i = 0; i != ops; ++i) {
+        grid_msg_init (&msg, 64);
+        rc = grid_msgqueue_send (&micro_msgqueue, &msg, 0);
+        errnum_assert (rc >= 0, -rc);
+    }
+    for (i = 0; i != ops; ++i) {
+        rc = grid_msgqueue_recv (&micro_msgqueue, &msg, NULL);
+        errnum_assert (rc >= 0, -rc);
+        grid_msg_term (&msg);
+    }
+}
+
+/******************************************************************************/
+/*  grid_timerset                                                             */
+/******************************************************************************/
+
+static struct grid_timerset micro_timerset;
+static struct grid_timerset_hndl micro_timers [MICRO_TIMERS + MICRO_TIMEROPS];
+
+/*  Population of timers the operations are measured against, spread
+    between 100 and 200 seconds. They are added in descending order as
+    that doesn't require walking the list. */
+static void micro_timerset_fill (GRID_UNUSED int ops)
+{
+    int i;
+
+    grid_timerset_init (&micro_timerset);
+    for (i = 0; i != MICRO_TIMERS + MICRO_TIMEROPS; ++i)
+        grid_timerset_hndl_init (&micro_timers [i]);
+    for (i = 0; i != MICRO_TIMERS; ++i)
+        grid_timerset_add (&micro_timerset,
+            200000000 - (int64_t) i * 1000, &micro_timers [i]);
+}
+
+static void micro_timerset_term (GRID_UNUSED int ops)
+{
+    int i;
+
+    for (i = 0; i != MICRO_TIMERS + MICRO_TIMEROPS; ++i) {
+        grid_timerset_rm (&micro_timerset, &micro_timers [i]);
+        grid_timerset_hndl_term (&micro_timers [i]);
+    }
+    grid_timerset_term (&micro_timerset);
+}
+
+/*  New timers land at random positions within the population. */
+static void micro_timerset_add (int ops)
+{
+    int i;
+
+    for (i = 0; i != ops; ++i)
+        grid_timerset_add (&micro_timerset,
+            100000000 + (int64_t) (micro_random () % 100000000),
+            &micro_timers [MICRO_TIMERS + i]);
+}
+
+/*  Cancelled timers are picked at random as well. */
+static void micro_timerset_rm (int ops)
+{
+    int i;
+
+    for (i = 0; i != ops; ++i)
+        grid_timerset_rm (&micro_timerset,
+            &micro_timers [(i * 7919) % MICRO_TIMERS]);
+}
+
+/*  Worker thread's view: the next timeout is queried in each iteration. */
+static void micro_timerset_timeout (int ops)
+{
+    int i;
+
+    for (i = 0; i != ops; ++i)
+        grid_timerset_timeout (&micro_timerset);
+}
+
+/******************************************************************************/
+/*  grid_chunk                                                                */
+/******************************************************************************/
+
+static void micro_chunk_alloc (int ops)
+{
+    int i;
+    int rc;
+    void *chunk;
+
+    for (i = 0; i != ops; ++i) {
+        rc = grid_chunk_alloc (64, 0, &chunk);
+        errnum_assert (rc == 0, -rc);
+        grid_chunk_free (chunk);
+    }
+}
+
+static void micro_chunk_alloc_large (int ops)
+{
+    int i;
+    int rc;
+    void *chunk;
+
+    for (i = 0; i != ops; ++i) {
+        rc = grid_chunk_alloc (65536, 0, &chunk);
+        errnum_assert (rc == 0, -rc);
+        grid_chunk_free (chunk);
+    }
+}
+
+/*  Header stripping as done by the protocols: a few bytes at a time. */
+static void micro_chunk_trim (int ops)
+{
+    int i;
+    int rc;
+    void *chunk;
+
+    rc = grid_chunk_alloc (ops * 4 + 4, 0, &chunk);
+    errnum_assert (rc == 0, -rc);
+    for (i = 0; i != ops; ++i)
+        chunk = grid_chunk_trim (chunk, 4);
+    grid_chunk_free (chunk);
+}
+
+/*  Fan-out as done by pub and bus sockets: one chunk, many references. */
+static void micro_chunk_addref (int ops)
+{
+    int i;
+    int rc;
+    void *chunk;
+
+    rc = grid_chunk_alloc (64, 0, &chunk);
+    errnum_assert (rc == 0, -rc);
+    for (i = 0; i != ops; ++i) {
+        grid_chunk_addref (chunk, 1);
+        grid_chunk_free (chunk);
+    }
+    grid_chunk_free (chunk);
+}
+
+/******************************************************************************/
+/*  grid_queue and grid_list                                                  */
+/******************************************************************************/
+
+static struct grid_queue_item micro_queueitems [MICRO_MSGS];
+static struct grid_list_item micro_listitems [MICRO_MSGS];
+
+static void micro_queue (int ops)
+{
+    int i;
+    struct grid_queue queue;
+
+    grid_queue_init (&queue);
+    for (i = 0; i != ops; ++i) {
+        grid_queue_item_init (&micro_queueitems [i]);
+        grid_queue_push (&queue, &micro_queueitems [i]);
+    }
+    for (i = 0; i != ops; ++i)
+        grid_queue_item_term (grid_queue_pop (&queue));
+    grid_queue_term (&queue);
+}
+
+static void micro_list (int ops)
+{
+    int i;
+    struct grid_list list;
+
+    grid_list_init (&list);
+    for (i = 0; i != ops; ++i) {
+        grid_list_item_init (&micro_listitems [i]);
+        grid_list_insert (&list, &micro_listitems [i], grid_list_end (&list));
+    }
+
+    /*  Erase from the middle to exercise the links in both directions. */
+    for (i = 0; i != ops; ++i) {
+        grid_list_erase (&list, &micro_listitems [(i * 7919) % ops]);
+        grid_list_item_term (&micro_listitems [(i * 7919) % ops]);
+    }
+    grid_list_term (&list);
+}
+
+/******************************************************************************/
+/*  grid_priolist                                                             */
+/******************************************************************************/
+
+static struct grid_priolist micro_priolist;
+static struct grid_priolist_data micro_priodata [MICRO_PRIOPIPES];
+
+/*  Pipes are spread over the priorities, all of them active. */
+static void micro_priolist_init (GRID_UNUSED int ops)
+{
+    int i;
+
+    grid_priolist_init (&micro_priolist);
+    for (i = 0; i != MICRO_PRIOPIPES; ++i) {
+        grid_priolist_add (&micro_priolist, &micro_priodata [i],
+            (struct grid_pipe*) &micro_priodata [i], i % 4 + 1);
+        grid_priolist_activate (&micro_priolist, &micro_priodata [i]);
+    }
+}
+
+static void micro_priolist_term (GRID_UNUSED int ops)
+{
+    int i;
+
+    for (i = 0; i != MICRO_PRIOPIPES; ++i)
+        grid_priolist_rm (&micro_priolist, &micro_priodata [i]);
+    grid_priolist_term (&micro_priolist);
+}
+
+/*  Round-robin over the pipes, every pipe getting full once in a while as
+    happens with push sockets under load. */
+static void micro_priolist_advance (int ops)
+{
+    int i;
+    struct grid_pipe *pipe;
+    struct grid_priolist_data *data;
+
+    for (i = 0; i != ops; ++i) {
+        pipe = grid_priolist_getpipe (&micro_priolist);
+        grid_assert (pipe);
+        data = (struct grid_priolist_data*) pipe;
+        if (i % 16 == 0) {
+            grid_priolist_advance (&micro_priolist, 1);
+            grid_priolist_activate (&micro_priolist, data);
+        }
+        else
+            grid_priolist_advance (&micro_priolist, 0);
+    }
+}
+
+/******************************************************************************/
+
+static const struct bench_case micro_cases [] = {
+    {"trie/subscribe", MICRO_TOPICS,
+        micro_trie_init, micro_trie_subscribe, micro_trie_term},
+    {"trie/unsubscribe", MICRO_TOPICS,
+        micro_trie_fill, micro_trie_unsubscribe, micro_trie_term},
+    {"trie/match", MICRO_TOPICS,
+        micro_trie_fill, micro_trie_match, micro_trie_term},
+    {"hash/insert", MICRO_PIPES,
+        micro_hash_init, micro_hash_insert, micro_hash_empty},
+    {"hash/get", MICRO_PIPES,
+        micro_hash_fill, micro_hash_get, micro_hash_empty},
+    {"hash/erase", MICRO_PIPES,
+        micro_hash_fill, micro_hash_erase, micro_hash_term},
+    {"msgqueue/stream", MICRO_MSGS,
+        micro_msgqueue_init, micro_msgqueue_stream, micro_msgqueue_term},
+    {"msgqueue/burst", MICRO_MSGS,
+        micro_msgqueue_init, micro_msgqueue_burst, micro_msgqueue_term},
+    {"timerset/add", MICRO_TIMEROPS,
+        micro_timerset_fill, micro_timerset_add, micro_timerset_term},
+    {"timerset/rm", MICRO_TIMEROPS,
+        micro_timerset_fill, micro_timerset_rm, micro_timerset_term},
+    {"timerset/timeout", MICRO_TIMERS,
+        micro_timerset_fill, micro_timerset_timeout, micro_timerset_term},
+    {"chunk/alloc", MICRO_MSGS, NULL, micro_chunk_alloc, NULL},
+    {"chunk/alloc_large", MICRO_MSGS / 10, NULL, micro_chunk_alloc_large, NULL},
+    {"chunk/trim", MICRO_MSGS, NULL, micro_chunk_trim, NULL},
+    {"chunk/addref", MICRO_MSGS, NULL, micro_chunk_addref, NULL},
+    {"queue/push_pop", MICRO_MSGS, NULL, micro_queue, NULL},
+    {"list/insert_erase", MICRO_MSGS, NULL, micro_list, NULL},
+    {"priolist/advance", MICRO_MSGS,
+        micro_priolist_init, micro_priolist_advance, micro_priolist_term},
+};
+
+int main (int argc, char *argv [])
+{
+    struct bench bench;
+    size_t i;
+
+    if (bench_init (&bench, argc, argv) != 0) {
+        fprintf (stderr,
+            "usage: micro [-w <warmup>] [-r <repetitions>] [<filter>...]\n");
+        return 1;
+    }
+
+    micro_topics_init ();
+    micro_hash_keys_init ();
+
+    for (i = 0; i != sizeof (micro_cases) / sizeof (micro_cases [0]); ++i)
+        bench_run (&bench, &micro_cases [i]);
+
+    return 0;
+}
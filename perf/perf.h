@@ -0,0 +1,363 @@
+/*
+    Copyright (c) 2013 Martin Sustrik  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#ifndef PERF_H_INCLUDED
+#define PERF_H_INCLUDED
+
+/*  Helpers shared by the latency and throughput programs. The 'local' side
+    of each test binds to the address, the 'remote' side connects to it.
+
+    Latency tests need a way back from the local side to the remote one.
+    With bidirectional protocols (pair, reqrep) the same socket is used in
+    both directions. With unidirectional ones (pipeline, pubsub) there's
+    a second socket per side, bound to a derived address: port + 1 for TCP,
+    the address with '.r' appended for IPC and in-process transports. */
+
+#include "../src/grid.h"
+#include "../src/pair.h"
+#include "../src/pipeline.h"
+#include "../src/pubsub.h"
+#include "../src/reqrep.h"
+#include "../src/tcp.h"
+
+#include "../src/utils/attr.h"
+#include "../src/utils/err.c"
+#include "../src/utils/sleep.c"
+#include "../src/utils/clock.c"
+#include "../src/utils/histogram.c"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PERF_PAIR 1
+#define PERF_PIPELINE 2
+#define PERF_PUBSUB 3
+#define PERF_REQREP 4
+
+/*  Time allowed for the subscribers to connect before the publisher starts
+    sending. Messages published before that are dropped. */
+#define PERF_PUBSUB_SETTLE 1000
+
+#define PERF_MAXADDR 256
+
+struct perf_socks {
+    int in;
+    int out;
+};
+
+static int GRID_UNUSED perf_protocol (const char *name)
+{
+    if (!name || strcmp (name, "pair") == 0)
+        return PERF_PAIR;
+    if (strcmp (name, "pipeline") == 0)
+        return PERF_PIPELINE;
+    if (strcmp (name, "pubsub") == 0)
+        return PERF_PUBSUB;
+    if (strcmp (name, "reqrep") == 0)
+        return PERF_REQREP;
+    fprintf (stderr, "unknown protocol: %s "
+        "(expected pair, pipeline, pubsub or reqrep)\n", name);
+    exit (1);
+}
+
+static size_t GRID_UNUSED perf_size (const char *arg)
+{
+    long val;
+
+    val = atol (arg);
+    if (val < 1) {
+        fprintf (stderr, "invalid value: %s\n", arg);
+        exit (1);
+    }
+    return (size_t) val;
+}
+
+/*  Derives the address used for the way back in latency tests. */
+static void perf_reverse (const char *addr, char *buf, size_t len)
+{
+    const char *port;
+    int rc;
+
+    if (strncmp (addr, "tcp://", 6) == 0) {
+        port = strrchr (addr, ':');
+        grid_assert (port && port > addr + 5);
+        rc = snprintf (buf, len, "%.*s:%d", (int) (port - addr), addr,
+            atoi (port + 1) + 1);
+    }
+    else
+        rc = snprintf (buf, len, "%s.r", addr);
+    grid_assert (rc > 0 && (size_t) rc < len);
+}
+
+static int perf_socket (int protocol)
+{
+    int s;
+    int rc;
+    int opt;
+
+    s = grid_socket (AF_SP, protocol);
+    errno_assert (s != -1);
+    opt = 1;
+    rc = grid_setsockopt (s, GRID_TCP, GRID_TCP_NODELAY, &opt, sizeof (opt));
+    errno_assert (rc == 0);
+    if (protocol == GRID_SUB) {
+        rc = grid_setsockopt (s, GRID_SUB, GRID_SUB_SUBSCRIBE, "", 0);
+        errno_assert (rc == 0);
+    }
+    return s;
+}
+
+static void perf_attach (int s, const char *addr, int local)
+{
+    int rc;
+
+    rc = local ? grid_bind (s, addr) : grid_connect (s, addr);
+    errno_assert (rc >= 0);
+}
+
+/*  Opens the sockets for a latency test. Local side receives a message
+    and sends it back, remote side sends a message and waits for it. */
+static void GRID_UNUSED perf_lat_open (struct perf_socks *self, int proto,
+    const char *addr, int local)
+{
+    char rev [PERF_MAXADDR];
+
+    switch (proto) {
+    case PERF_PAIR:
+        self->in = self->out = perf_socket (GRID_PAIR);
+        perf_attach (self->in, addr, local);
+        return;
+    case PERF_REQREP:
+        self->in = self->out = perf_socket (local ? GRID_REP : GRID_REQ);
+        perf_attach (self->in, addr, local);
+        return;
+    case PERF_PIPELINE:
+        self->in = perf_socket (GRID_PULL);
+        self->out = perf_socket (GRID_PUSH);
+        break;
+    case PERF_PUBSUB:
+        self->in = perf_socket (GRID_SUB);
+        self->out = perf_socket (GRID_PUB);
+        break;
+    default:
+        grid_assert (0);
+    }
+
+    /*  Unidirectional protocols. Local side receives on the address itself
+        and replies to the reverse address, remote side the other way round. */
+    perf_reverse (addr, rev, sizeof (rev));
+    perf_attach (self->in, local ? addr : rev, local);
+    perf_attach (self->out, local ? rev : addr, local);
+    if (!local && proto == PERF_PUBSUB)
+        grid_sleep (PERF_PUBSUB_SETTLE);
+}
+
+/*  Opens the sockets for a throughput test. Local side receives the
+    messages, remote side sends them. With reqrep the remote side has to
+    wait for a reply to each request, so the result is the request rate. */
+static void GRID_UNUSED perf_thr_open (struct perf_socks *self, int proto,
+    const char *addr, int local)
+{
+    switch (proto) {
+    case PERF_PAIR:
+        self->in = self->out = perf_socket (GRID_PAIR);
+        break;
+    case PERF_REQREP:
+        self->in = self->out = perf_socket (local ? GRID_REP : GRID_REQ);
+        break;
+    case PERF_PIPELINE:
+        self->in = self->out = perf_socket (local ? GRID_PULL : GRID_PUSH);
+        break;
+    case PERF_PUBSUB:
+        self->in = self->out = perf_socket (local ? GRID_SUB : GRID_PUB);
+        break;
+    default:
+        grid_assert (0);
+    }
+    perf_attach (self->in, addr, local);
+    if (!local && proto == PERF_PUBSUB)
+        grid_sleep (PERF_PUBSUB_SETTLE);
+}
+
+static void GRID_UNUSED perf_close (struct perf_socks *self)
+{
+    int rc;
+
+    rc = grid_close (self->in);
+    errno_assert (rc == 0);
+    if (self->out != self->in) {
+        rc = grid_close (self->out);
+        errno_assert (rc == 0);
+    }
+}
+
+static void perf_recv (int s, void *buf, size_t sz)
+{
+    int nbytes;
+
+    nbytes = grid_recv (s, buf, sz, 0);
+    errno_assert (nbytes >= 0);
+    grid_assert ((size_t) nbytes == sz);
+}
+
+static void perf_send (int s, void *buf, size_t sz)
+{
+    int nbytes;
+
+    nbytes = grid_send (s, buf, sz, 0);
+    errno_assert (nbytes >= 0);
+    grid_assert ((size_t) nbytes == sz);
+}
+
+/*  Local side of the latency test. Echoes 'roundtrips' messages. */
+static void GRID_UNUSED perf_lat_echo (struct perf_socks *self, size_t sz,
+    int roundtrips)
+{
+    char *buf;
+    int i;
+
+    buf = malloc (sz);
+    alloc_assert (buf);
+    for (i = 0; i != roundtrips; ++i) {
+        perf_recv (self->in, buf, sz);
+        perf_send (self->out, buf, sz);
+    }
+    free (buf);
+}
+
+/*  Remote side of the latency test. Measures each of the round-trips and
+    prints the distribution. */
+static void GRID_UNUSED perf_lat_measure (struct perf_socks *self, size_t sz,
+    int roundtrips)
+{
+    char *buf;
+    int i;
+    uint64_t start;
+    uint64_t total;
+    struct grid_histogram hist;
+
+    buf = malloc (sz);
+    alloc_assert (buf);
+    memset (buf, 111, sz);
+    grid_histogram_init (&hist);
+    total = grid_clock_ns ();
+    for (i = 0; i != roundtrips; ++i) {
+        start = grid_clock_ns ();
+        perf_send (self->out, buf, sz);
+        perf_recv (self->in, buf, sz);
+        grid_histogram_record (&hist, grid_clock_ns () - start);
+    }
+    total = grid_clock_ns () - total;
+
+    printf ("message size: %d [B]\n", (int) sz);
+    printf ("roundtrip count: %d\n", roundtrips);
+    printf ("average one-way latency: %.3f [us]\n",
+        (double) total / (roundtrips * 2) / 1000);
+    printf ("roundtrip min: %.3f [us]\n", (double) hist.min / 1000);
+    printf ("roundtrip p50: %.3f [us]\n",
+        (double) grid_histogram_percentile (&hist, 500) / 1000);
+    printf ("roundtrip p90: %.3f [us]\n",
+        (double) grid_histogram_percentile (&hist, 900) / 1000);
+    printf ("roundtrip p99: %.3f [us]\n",
+        (double) grid_histogram_percentile (&hist, 990) / 1000);
+    printf ("roundtrip p99.9: %.3f [us]\n",
+        (double) grid_histogram_percentile (&hist, 999) / 1000);
+    printf ("roundtrip max: %.3f [us]\n", (double) hist.max / 1000);
+
+    grid_histogram_term (&hist);
+    free (buf);
+}
+
+/*  Local side of the throughput test. Receives 'count' messages and prints
+    the rate. The clock starts once the first message arrives. Publisher
+    drops messages when the subscriber can't keep up, so with pubsub the
+    test ends once no message arrives for PERF_PUBSUB_SETTLE milliseconds
+    and the number of lost messages is reported. */
+static void GRID_UNUSED perf_thr_recv (struct perf_socks *self, int proto,
+    size_t sz, int count)
+{
+    char *buf;
+    int i;
+    int rc;
+    int nbytes;
+    int timeo;
+    uint64_t start;
+    uint64_t elapsed;
+    double thr;
+
+    buf = malloc (sz);
+    alloc_assert (buf);
+    perf_recv (self->in, buf, sz);
+    if (proto == PERF_REQREP)
+        perf_send (self->out, buf, sz);
+    if (proto == PERF_PUBSUB) {
+        timeo = PERF_PUBSUB_SETTLE;
+        rc = grid_setsockopt (self->in, GRID_SOL_SOCKET, GRID_RCVTIMEO,
+            &timeo, sizeof (timeo));
+        errno_assert (rc == 0);
+    }
+    start = grid_clock_ns ();
+    elapsed = 0;
+    for (i = 1; i != count; ++i) {
+        nbytes = grid_recv (self->in, buf, sz, 0);
+        if (nbytes < 0 && grid_errno () == ETIMEDOUT)
+            break;
+        errno_assert (nbytes >= 0);
+        grid_assert ((size_t) nbytes == sz);
+        if (proto == PERF_REQREP)
+            perf_send (self->out, buf, sz);
+        elapsed = grid_clock_ns () - start;
+    }
+    if (elapsed == 0)
+        elapsed = 1;
+
+    thr = (double) (i - 1) * 1000000000 / elapsed;
+    printf ("message size: %d [B]\n", (int) sz);
+    printf ("message count: %d\n", count);
+    if (i != count)
+        printf ("messages lost: %d\n", count - i);
+    printf ("throughput: %.0f [msg/s]\n", thr);
+    printf ("throughput: %.3f [Mb/s]\n", thr * sz * 8 / 1000000);
+
+    free (buf);
+}
+
+/*  Remote side of the throughput test. Sends 'count' messages. */
+static void GRID_UNUSED perf_thr_send (struct perf_socks *self, int proto,
+    size_t sz, int count)
+{
+    char *buf;
+    int i;
+
+    buf = malloc (sz);
+    alloc_assert (buf);
+    memset (buf, 111, sz);
+    for (i = 0; i != count; ++i) {
+        perf_send (self->out, buf, sz);
+        if (proto == PERF_REQREP)
+            perf_recv (self->in, buf, sz);
+    }
+    free (buf);
+}
+
+#endif
@@ -0,0 +1,51 @@
+/*
+    Copyright (c) 2013 Martin Sustrik  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#include "perf.h"
+
+int main (int argc, char *argv [])
+{
+    const char *connect_to;
+    size_t sz;
+    int count;
+    int proto;
+    struct perf_socks socks;
+
+    if (argc != 4 && argc != 5) {
+        printf ("usage: remote_thr <connect-to> <msg-size> <msg-count> "
+            "[<protocol>]\n");
+        return 1;
+    }
+    connect_to = argv [1];
+    sz = perf_size (argv [2]);
+    count = (int) perf_size (argv [3]);
+    proto = perf_protocol (argc == 5 ? argv [4] : NULL);
+
+    perf_thr_open (&socks, proto, connect_to, 0);
+    perf_thr_send (&socks, proto, sz, count);
+
+    /*  Give the messages still in the pipeline time to be delivered. */
+    grid_sleep (1000);
+    perf_close (&socks);
+
+    return 0;
+}
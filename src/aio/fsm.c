@@ -24,6 +24,7 @@
 #include "ctx.h"
 
 #include "../utils/err.h"
+#include "../utils/trace.h"
 
 #include <stddef.h>
 
@@ -66,11 +67,20 @@ void grid_fsm_event_process (struct grid_fsm_event *self)
     grid_fsm_feed (self->fsm, src, type, srcptr);
 }
 
+/*  State recorded by the event tracing. Unless the derived state machine
+    reports its own state, the lifecycle state of the fsm is used. */
+#define grid_fsm_tracestate(self) \
+    ((self)->tracestate ? *(self)->tracestate : (self)->state)
+
 void grid_fsm_feed (struct grid_fsm *self, int src, int type, void *srcptr)
 {
     if (grid_slow (self->state != GRID_FSM_STATE_STOPPING)) {
+        grid_trace_event (self, self->fn, src, type,
+            grid_fsm_tracestate (self));
         self->fn (self, src, type, srcptr);
     } else {
+        grid_trace_event (self, self->shutdown_fn, src, type,
+            grid_fsm_tracestate (self));
         self->shutdown_fn (self, src, type, srcptr);
     }
 }
@@ -86,6 +96,7 @@ void grid_fsm_init_root (struct grid_fsm *self, grid_fsm_fn fn,
     self->owner = NULL;
     self->ctx = ctx;
     grid_fsm_event_init (&self->stopped);
+    grid_fsm_trace_state (self, NULL);
 }
 
 void grid_fsm_init (struct grid_fsm *self, grid_fsm_fn fn,
@@ -99,6 +110,7 @@ void grid_fsm_init (struct grid_fsm *self, grid_fsm_fn fn,
     self->owner = owner;
     self->ctx = owner->ctx;
     grid_fsm_event_init (&self->stopped);
+    grid_fsm_trace_state (self, NULL);
 }
 
 void grid_fsm_term (struct grid_fsm *self)
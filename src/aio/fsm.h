@@ -72,6 +72,11 @@ struct grid_fsm {
     struct grid_fsm *owner;
     struct grid_ctx *ctx;
     struct grid_fsm_event stopped;
+#if defined GRID_HAVE_TRACE
+    /*  State of the derived state machine, recorded by the event tracing.
+        NULL if the derived state machine doesn't report it. */
+    const int *tracestate;
+#endif
 };
 
 void grid_fsm_init_root (struct grid_fsm *self, grid_fsm_fn fn,
@@ -81,6 +86,14 @@ void grid_fsm_init (struct grid_fsm *self, grid_fsm_fn fn,
     int src, void *srcptr, struct grid_fsm *owner);
 void grid_fsm_term (struct grid_fsm *self);
 
+/*  Lets the event tracing record the state the derived state machine keeps in
+    'state' instead of the generic lifecycle state of the fsm object. */
+#if defined GRID_HAVE_TRACE
+#define grid_fsm_trace_state(self, state) ((self)->tracestate = (state))
+#else
+#define grid_fsm_trace_state(self, state) do {} while (0)
+#endif
+
 int grid_fsm_isidle (struct grid_fsm *self);
 void grid_fsm_start (struct grid_fsm *self);
 void grid_fsm_stop (struct grid_fsm *self);
@@ -23,6 +23,8 @@
 #ifndef GRID_POLLER_INCLUDED
 #define GRID_POLLER_INCLUDED
 
+#include "../utils/int.h"
+
 #define GRID_POLLER_IN 1
 #define GRID_POLLER_OUT 2
 #define GRID_POLLER_ERR 3
@@ -44,7 +46,11 @@ void grid_poller_set_in (struct grid_poller *self, struct grid_poller_hndl *hndl
 void grid_poller_reset_in (struct grid_poller *self, struct grid_poller_hndl *hndl);
 void grid_poller_set_out (struct grid_poller *self, struct grid_poller_hndl *hndl);
 void grid_poller_reset_out (struct grid_poller *self, struct grid_poller_hndl *hndl);
-int grid_poller_wait (struct grid_poller *self, int timeout);
+
+/*  Waits for events. Timeout is in microseconds, negative value meaning
+    'infinite'. Backends that can't sleep with sub-millisecond precision
+    round the timeout up. */
+int grid_poller_wait (struct grid_poller *self, int64_t timeout);
 int grid_poller_event (struct grid_poller *self, int *event,
     struct grid_poller_hndl **hndl);
 
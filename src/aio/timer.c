@@ -48,6 +48,7 @@ void grid_timer_init (struct grid_timer *self, int src, struct grid_fsm *owner)
     grid_fsm_init (&self->fsm, grid_timer_handler, grid_timer_shutdown,
         src, self, owner);
     self->state = GRID_TIMER_STATE_IDLE;
+    grid_fsm_trace_state (&self->fsm, &self->state);
     grid_worker_task_init (&self->start_task, GRID_TIMER_SRC_START_TASK,
         &self->fsm);
     grid_worker_task_init (&self->stop_task, GRID_TIMER_SRC_STOP_TASK, &self->fsm);
@@ -74,6 +75,11 @@ int grid_timer_isidle (struct grid_timer *self)
 }
 
 void grid_timer_start (struct grid_timer *self, int timeout)
+{
+    grid_timer_start_us (self, (int64_t) timeout * 1000);
+}
+
+void grid_timer_start_us (struct grid_timer *self, int64_t timeout)
 {
     /*  Negative timeout make no sense. */
     grid_assert (timeout >= 0);
@@ -37,14 +37,22 @@ struct grid_timer {
     struct grid_worker_timer wtimer;
     struct grid_fsm_event done;
     struct grid_worker *worker;
-    int timeout;
+
+    /*  Timeout in microseconds. */
+    int64_t timeout;
 };
 
 void grid_timer_init (struct grid_timer *self, int src, struct grid_fsm *owner);
 void grid_timer_term (struct grid_timer *self);
 
 int grid_timer_isidle (struct grid_timer *self);
+
+/*  Starts the timer. Timeout is in milliseconds. */
 void grid_timer_start (struct grid_timer *self, int timeout);
+
+/*  Same as grid_timer_start, with timeout in microseconds. */
+void grid_timer_start_us (struct grid_timer *self, int64_t timeout);
+
 void grid_timer_stop (struct grid_timer *self);
 
 #endif
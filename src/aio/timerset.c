@@ -28,17 +28,15 @@
 
 void grid_timerset_init (struct grid_timerset *self)
 {
-    grid_clock_init (&self->clock);
     grid_list_init (&self->timeouts);
 }
 
 void grid_timerset_term (struct grid_timerset *self)
 {
     grid_list_term (&self->timeouts);
-    grid_clock_term (&self->clock);
 }
 
-int grid_timerset_add (struct grid_timerset *self, int timeout,
+int grid_timerset_add (struct grid_timerset *self, int64_t timeout,
     struct grid_timerset_hndl *hndl)
 {
     struct grid_list_item *it;
@@ -46,7 +44,7 @@ int grid_timerset_add (struct grid_timerset *self, int timeout,
     int first;
 
     /*  Compute the instant when the timeout will be due. */
-    hndl->timeout = grid_clock_now (&self->clock) + timeout;
+    hndl->timeout = grid_clock_us () + timeout;
 
     /*  Insert it into the ordered list of timeouts. */
     for (it = grid_list_begin (&self->timeouts);
@@ -79,15 +77,15 @@ int grid_timerset_rm (struct grid_timerset *self, struct grid_timerset_hndl *hnd
     return first;
 }
 
-int grid_timerset_timeout (struct grid_timerset *self)
+int64_t grid_timerset_timeout (struct grid_timerset *self)
 {
-    int timeout;
+    int64_t timeout;
 
     if (grid_fast (grid_list_empty (&self->timeouts)))
         return -1;
 
-    timeout = (int) (grid_cont (grid_list_begin (&self->timeouts),
-        struct grid_timerset_hndl, list)->timeout - grid_clock_now (&self->clock));
+    timeout = (int64_t) (grid_cont (grid_list_begin (&self->timeouts),
+        struct grid_timerset_hndl, list)->timeout - grid_clock_us ());
     return timeout < 0 ? 0 : timeout;
 }
 
@@ -102,7 +100,7 @@ int grid_timerset_event (struct grid_timerset *self, struct grid_timerset_hndl *
     /*  If no timeout have expired yet, there's no event to return. */
     first = grid_cont (grid_list_begin (&self->timeouts),
         struct grid_timerset_hndl, list);
-    if (first->timeout > grid_clock_now (&self->clock))
+    if (first->timeout > grid_clock_us ())
         return -EAGAIN;
 
     /*  Return the first timeout and remove it from the list of active
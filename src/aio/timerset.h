@@ -27,7 +27,8 @@
 #include "../utils/list.h"
 
 /*  This class stores a list of timeouts and reports the next one to expire
-    along with the time till it happens. */
+    along with the time till it happens. All the intervals are expressed
+    in microseconds. */
 
 struct grid_timerset_hndl {
     struct grid_list_item list;
@@ -35,16 +36,15 @@ struct grid_timerset_hndl {
 };
 
 struct grid_timerset {
-    struct grid_clock clock;
     struct grid_list timeouts;
 };
 
 void grid_timerset_init (struct grid_timerset *self);
 void grid_timerset_term (struct grid_timerset *self);
-int grid_timerset_add (struct grid_timerset *self, int timeout,
+int grid_timerset_add (struct grid_timerset *self, int64_t timeout,
     struct grid_timerset_hndl *hndl);
 int grid_timerset_rm (struct grid_timerset *self, struct grid_timerset_hndl *hndl);
-int grid_timerset_timeout (struct grid_timerset *self);
+int64_t grid_timerset_timeout (struct grid_timerset *self);
 int grid_timerset_event (struct grid_timerset *self, struct grid_timerset_hndl **hndl);
 
 void grid_timerset_hndl_init (struct grid_timerset_hndl *self);
@@ -84,6 +84,7 @@ void grid_usock_init (struct grid_usock *self, int src, struct grid_fsm *owner)
     grid_fsm_init (&self->fsm, grid_usock_handler, grid_usock_shutdown,
         src, self, owner);
     self->state = GRID_USOCK_STATE_IDLE;
+    grid_fsm_trace_state (&self->fsm, &self->state);
 
     /*  Choose a worker thread to handle this socket. */
     self->worker = grid_fsm_choose_worker (&self->fsm);
@@ -75,7 +75,7 @@ void grid_worker_reset_out (struct grid_worker *self, struct grid_worker_fd *fd)
     grid_poller_reset_out (&((struct grid_worker*) self)->poller, &fd->hndl);
 }
 
-void grid_worker_add_timer (struct grid_worker *self, int timeout,
+void grid_worker_add_timer (struct grid_worker *self, int64_t timeout,
     struct grid_worker_timer *timer)
 {
     grid_timerset_add (&((struct grid_worker*) self)->timerset, timeout,
@@ -98,7 +98,7 @@ void grid_worker_term (struct grid_worker *self);
 void grid_worker_execute (struct grid_worker *self, struct grid_worker_task *task);
 void grid_worker_cancel (struct grid_worker *self, struct grid_worker_task *task);
 
-void grid_worker_add_timer (struct grid_worker *self, int timeout,
+void grid_worker_add_timer (struct grid_worker *self, int64_t timeout,
     struct grid_worker_timer *timer);
 void grid_worker_rm_timer (struct grid_worker *self,
     struct grid_worker_timer *timer);
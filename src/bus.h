@@ -31,6 +31,10 @@ extern "C" {
 
 #define GRID_BUS (GRID_PROTO_BUS * 16 + 0)
 
+#define GRID_BUS_FORWARD 1
+#define GRID_BUS_TTL 2
+#define GRID_BUS_DEDUP 3
+
 #ifdef __cplusplus
 }
 #endif
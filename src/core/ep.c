@@ -32,6 +32,7 @@
 #include "../utils/attr.h"
 
 #include <string.h>
+#include <stdio.h>
 
 #define GRID_EP_STATE_IDLE 1
 #define GRID_EP_STATE_ACTIVE 2
@@ -53,11 +54,17 @@ int grid_ep_init (struct grid_ep *self, int src, struct grid_sock *sock, int eid
     grid_fsm_init (&self->fsm, grid_ep_handler, grid_ep_shutdown,
         src, self, &sock->fsm);
     self->state = GRID_EP_STATE_IDLE;
+    grid_fsm_trace_state (&self->fsm, &self->state);
 
     self->epbase = NULL;
     self->sock = sock;
     self->eid = eid;
     self->last_errno = 0;
+    self->bind = bind ? 1 : 0;
+    self->transport = transport;
+    grid_list_init (&self->pipes);
+    self->statistics.connections = 0;
+    self->statistics.errors = 0;
     grid_list_item_init (&self->item);
     memcpy (&self->options, &sock->ep_template, sizeof(struct grid_ep_options));
 
@@ -74,6 +81,7 @@ int grid_ep_init (struct grid_ep *self, int src, struct grid_sock *sock, int eid
     /*  Endpoint creation failed. */
     if (rc < 0) {
         grid_list_item_term (&self->item);
+        grid_list_term (&self->pipes);
         grid_fsm_term (&self->fsm);
         return rc;
     }
@@ -86,6 +94,7 @@ void grid_ep_term (struct grid_ep *self)
     grid_assert_state (self, GRID_EP_STATE_IDLE);
 
     self->epbase->vfptr->destroy (self->epbase);
+    grid_list_term (&self->pipes);
     grid_list_item_term (&self->item);
     grid_fsm_term (&self->fsm);
 }
@@ -226,5 +235,68 @@ void grid_ep_clear_error (struct grid_ep *self)
 
 void grid_ep_stat_increment (struct grid_ep *self, int name, int increment)
 {
+    switch (name) {
+    case GRID_STAT_ESTABLISHED_CONNECTIONS:
+    case GRID_STAT_ACCEPTED_CONNECTIONS:
+        self->statistics.connections += increment;
+        break;
+    case GRID_STAT_CONNECT_ERRORS:
+    case GRID_STAT_BIND_ERRORS:
+    case GRID_STAT_ACCEPT_ERRORS:
+        self->statistics.errors += increment;
+        break;
+    }
     grid_sock_stat_increment (self->sock, name, increment);
 }
+
+int grid_ep_getstats (struct grid_ep *self, struct grid_ep_stats *stats,
+    struct grid_pipe_stats *pipes, int count)
+{
+    int rc;
+    int npipes;
+    struct grid_list_item *it;
+    struct grid_pipebase *pipebase;
+
+    npipes = 0;
+    for (it = grid_list_begin (&self->pipes);
+          it != grid_list_end (&self->pipes);
+          it = grid_list_next (&self->pipes, it)) {
+        if (pipes && npipes < count) {
+            pipebase = grid_cont (it, struct grid_pipebase, item);
+            grid_pipebase_stats (pipebase, &pipes [npipes]);
+        }
+        ++npipes;
+    }
+
+    if (stats) {
+        stats->eid = self->eid;
+        stats->bind = self->bind;
+        stats->pipes = npipes;
+        stats->last_errno = self->last_errno;
+        stats->connections = self->statistics.connections;
+
+        /*  Each connection established by a connecting endpoint, except for
+            the first one, is a reconnection. */
+        stats->reconnects = !self->bind && self->statistics.connections ?
+            self->statistics.connections - 1 : 0;
+        stats->errors = self->statistics.errors;
+        /*  Full address was checked not to exceed GRID_SOCKADDR_MAX when
+            the endpoint was created, thus it is never truncated. */
+        rc = snprintf (stats->addr, sizeof (stats->addr), "%s://%s",
+            self->transport->name, self->addr);
+        grid_assert (rc >= 0 && (size_t) rc < sizeof (stats->addr));
+    }
+
+    return npipes;
+}
+
+void grid_ep_latency_stop (struct grid_ep *self)
+{
+    struct grid_list_item *it;
+
+    for (it = grid_list_begin (&self->pipes);
+          it != grid_list_end (&self->pipes);
+          it = grid_list_next (&self->pipes, it))
+        grid_pipebase_latency_stop (grid_cont (it, struct grid_pipebase,
+            item));
+}
@@ -44,6 +44,21 @@ struct grid_ep {
 
     /*  Error state for endpoint */
     int last_errno;
+
+    /*  1 for bound endpoints, 0 for connected ones. */
+    int bind;
+
+    /*  The transport the endpoint belongs to. */
+    struct grid_transport *transport;
+
+    /*  Pipes that are currently established via this endpoint. */
+    struct grid_list pipes;
+
+    /*  Per-endpoint statistics. */
+    struct {
+        uint64_t connections;
+        uint64_t errors;
+    } statistics;
 };
 
 int grid_ep_init (struct grid_ep *self, int src, struct grid_sock *sock, int eid,
@@ -64,4 +79,14 @@ void grid_ep_set_error(struct grid_ep *self, int errnum);
 void grid_ep_clear_error(struct grid_ep *self);
 void grid_ep_stat_increment(struct grid_ep *self, int name, int increment);
 
+/*  Fills in the statistics of the endpoint and returns the number of pipes
+    currently established. If 'pipes' is not NULL, statistics of up to
+    'count' of those pipes are stored there. */
+int grid_ep_getstats (struct grid_ep *self, struct grid_ep_stats *stats,
+    struct grid_pipe_stats *pipes, int count);
+
+/*  Drops the latency histograms of all the pipes of the endpoint. Called
+    when the socket stops collecting latency statistics. */
+void grid_ep_latency_stop (struct grid_ep *self);
+
 #endif
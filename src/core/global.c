@@ -29,12 +29,14 @@
 #include "global.h"
 #include "sock.h"
 #include "ep.h"
+#include "stats.h"
 
 #include "../aio/pool.h"
 #include "../aio/timer.h"
 
 #include "../utils/err.h"
 #include "../utils/alloc.h"
+#include "../utils/atomic.h"
 #include "../utils/mutex.h"
 #include "../utils/list.h"
 #include "../utils/cont.h"
@@ -43,10 +45,12 @@
 #include "../utils/chunk.h"
 #include "../utils/msg.h"
 #include "../utils/attr.h"
+#include "../utils/trace.h"
 
 #include "../transports/inproc/inproc.h"
 #include "../transports/ipc/ipc.h"
 #include "../transports/tcp/tcp.h"
+#include "../transports/tcpmux/tcpmux.h"
 
 #include "../protocols/pair/pair.h"
 #include "../protocols/pair/xpair.h"
@@ -81,16 +85,24 @@
 #define GRID_HAVE_GMTIME_R
 
 
-/*  Max number of concurrent SP sockets. */
-#define GRID_MAX_SOCKETS 512
+/*  The socket table is split into chunks of GRID_SOCKS_CHUNK slots. Chunks
+    are allocated as more sockets are needed and are never moved or
+    deallocated, not even when the library terminates. */
+#define GRID_SOCKS_CHUNK 512
+#define GRID_SOCKS_MAXCHUNKS 2048
 
-/*  To save some space, list of unused socket slots uses uint16_t integers to
-    refer to individual sockets. If there's a need to more that 0x10000 sockets,
-    the type should be changed to uint32_t or int. */
-CT_ASSERT (GRID_MAX_SOCKETS <= 0x10000);
+/*  Max number of concurrent SP sockets. */
+#define GRID_MAX_SOCKETS (GRID_SOCKS_CHUNK * GRID_SOCKS_MAXCHUNKS)
 
 #define GRID_CTX_FLAG_ZOMBIE 1
 
+/*  Single slot of the socket table. The hold count of an empty slot is
+    GRID_SOCK_HOLDS_CLOSING so that no holds can be placed on it. */
+struct grid_global_slot {
+    struct grid_sock *sock;
+    struct grid_atomic holds;
+};
+
 #define GRID_GLOBAL_SRC_STAT_TIMER 1
 
 #define GRID_GLOBAL_STATE_IDLE           1
@@ -99,14 +111,21 @@ CT_ASSERT (GRID_MAX_SOCKETS <= 0x10000);
 
 struct grid_global {
 
+    /*  Set if the global context is initialised. */
+    int initialised;
+
     /*  The global table of existing sockets. The descriptor representing
-        the socket is the index to this table. This pointer is also used to
-        find out whether context is initialised. If it is NULL, context is
-        uninitialised. */
-    struct grid_sock **socks;
+        the socket is the index to this table. It's an array of pointers to
+        chunks of the table. Sockets are looked up without locking, thus the
+        chunks, once published, persist for the lifetime of the process. */
+    struct grid_global_slot *socks [GRID_SOCKS_MAXCHUNKS];
+
+    /*  Number of chunks of the socket table allocated so far. */
+    int nchunks;
 
     /*  Stack of unused file descriptors. */
-    uint16_t *unused;
+    int *unused;
+    int nunused;
 
     /*  Number of actual open sockets in the socket table. */
     size_t nsocks;
@@ -137,6 +156,11 @@ struct grid_global {
     /*  Special socket ids  */
     int statistics_socket;
 
+    /*  Format of data sent to the statistics socket. Either one of the
+        GRID_STATS_* formats, one message per interval, or zero for ESTP,
+        one message per counter. */
+    int statistics_format;
+
     /*  Application name for statistics  */
     char hostname[64];
     char appname[64];
@@ -161,17 +185,17 @@ static int grid_global_create_ep (struct grid_sock *, const char *addr, int bind
     does no locking by itself */
 static int grid_global_create_socket (int domain, int protocol);
 
+/*  Socket table-related private functions. */
+static int grid_global_grow (void);
+static struct grid_global_slot *grid_global_slot (int s);
+static int grid_global_collect (struct grid_stats *stats);
+
 /*  FSM callbacks  */
 static void grid_global_handler (struct grid_fsm *self,
     int src, int type, void *srcptr);
 static void grid_global_shutdown (struct grid_fsm *self,
     int src, int type, void *srcptr);
 
-/*  Socket holds. */
-static int grid_global_hold_socket(struct grid_sock **sockp, int s);
-static int grid_global_hold_socket_locked(struct grid_sock **sockp, int s);
-static void grid_global_rele_socket(struct grid_sock *);
-
 int grid_errno (void)
 {
     return grid_err_errno ();
@@ -184,14 +208,13 @@ const char *grid_strerror (int errnum)
 
 static void grid_global_init (void)
 {
-    int i;
     char *envvar;
     int rc;
     char *addr;
 
 
     /*  Check whether the library was already initialised. If so, do nothing. */
-    if (self.socks)
+    if (self.initialised)
         return;
 
     /*  Initialise the memory allocation subsystem. */
@@ -200,14 +223,17 @@ static void grid_global_init (void)
     /*  Seed the pseudo-random number generator. */
     grid_random_seed ();
 
-    /*  Allocate the global table of SP sockets. */
-    self.socks = grid_alloc ((sizeof (struct grid_sock*) * GRID_MAX_SOCKETS) +
-        (sizeof (uint16_t) * GRID_MAX_SOCKETS), "socket table");
-    alloc_assert (self.socks);
-    for (i = 0; i != GRID_MAX_SOCKETS; ++i)
-        self.socks [i] = NULL;
+    /*  The table of SP sockets survives from the previous initialisation,
+        if any, with all the slots empty. Otherwise, allocate its first
+        chunk. */
+    if (self.nchunks == 0) {
+        rc = grid_global_grow ();
+        errnum_assert (rc == 0, -rc);
+    }
+    grid_assert (self.nunused == self.nchunks * GRID_SOCKS_CHUNK);
     self.nsocks = 0;
     self.flags = 0;
+    self.initialised = 1;
 
     /*  Print connection and accepting errors to the stderr  */
     envvar = getenv("GRID_PRINT_ERRORS");
@@ -218,12 +244,6 @@ static void grid_global_init (void)
     envvar = getenv("GRID_PRINT_STATISTICS");
     self.print_statistics = envvar && *envvar;
 
-    /*  Allocate the stack of unused file descriptors. */
-    self.unused = (uint16_t*) (self.socks + GRID_MAX_SOCKETS);
-    alloc_assert (self.unused);
-    for (i = 0; i != GRID_MAX_SOCKETS; ++i)
-        self.unused [i] = GRID_MAX_SOCKETS - i - 1;
-
     /*  Initialise other parts of the global state. */
     grid_list_init (&self.transports);
     grid_list_init (&self.socktypes);
@@ -232,6 +252,7 @@ static void grid_global_init (void)
     grid_global_add_transport (grid_inproc);
     grid_global_add_transport (grid_ipc);
     grid_global_add_transport (grid_tcp);
+    grid_global_add_transport (grid_tcpmux);
 
     /*  Plug in individual socktypes. */
     grid_global_add_socktype (grid_pair_socktype);
@@ -262,6 +283,7 @@ static void grid_global_init (void)
     grid_fsm_init_root (&self.fsm, grid_global_handler, grid_global_shutdown,
         &self.ctx);
     self.state = GRID_GLOBAL_STATE_IDLE;
+    grid_fsm_trace_state (&self.fsm, &self.state);
 
     grid_ctx_init (&self.ctx, grid_global_getpool (), NULL);
     grid_timer_init (&self.stat_timer, GRID_GLOBAL_SRC_STAT_TIMER, &self.fsm);
@@ -272,12 +294,21 @@ static void grid_global_init (void)
         self.statistics_socket = grid_global_create_socket (AF_SP, GRID_PUB);
         errno_assert (self.statistics_socket >= 0);
 
-        rc = grid_global_create_ep (self.socks[self.statistics_socket], addr, 0);
+        rc = grid_global_create_ep (
+            grid_global_slot (self.statistics_socket)->sock, addr, 0);
         errno_assert (rc >= 0);
     } else {
         self.statistics_socket = -1;
     }
 
+    addr = getenv ("GRID_STATISTICS_FORMAT");
+    if (addr && strcmp (addr, "json") == 0)
+        self.statistics_format = GRID_STATS_JSON;
+    else if (addr && strcmp (addr, "prometheus") == 0)
+        self.statistics_format = GRID_STATS_PROMETHEUS;
+    else
+        self.statistics_format = 0;
+
     addr = getenv ("GRID_APPLICATION_NAME");
     if (addr) {
         strncpy (self.appname, addr, 63);
@@ -301,11 +332,12 @@ static void grid_global_init (void)
 
 static void grid_global_term (void)
 {
+    const char *path;
     struct grid_list_item *it;
     struct grid_transport *tp;
 
     /*  If there are no sockets remaining, uninitialise the global context. */
-    grid_assert (self.socks);
+    grid_assert (self.initialised);
     if (self.nsocks > 0)
         return;
 
@@ -317,6 +349,11 @@ static void grid_global_term (void)
     /*  Shut down the worker threads. */
     grid_pool_term (&self.pool);
 
+    /*  Now that the worker threads are gone, the trace is complete. */
+    path = getenv ("GRID_TRACE_FILE");
+    if (path && *path)
+        (void) grid_trace_write (path);
+
     /* Terminate ctx mutex */
     grid_ctx_term (&self.ctx);
 
@@ -337,10 +374,13 @@ static void grid_global_term (void)
     /*  Final deallocation of the grid_global object itself. */
     grid_list_term (&self.socktypes);
     grid_list_term (&self.transports);
-    grid_free (self.socks);
+
+    /*  The socket table is left intact. Other threads may still be looking
+        up stale socket descriptors in it. As all the slots are empty, such
+        lookups fail with EBADF. */
 
     /*  This marks the global state as uninitialised. */
-    self.socks = NULL;
+    self.initialised = 0;
 
     /*  Shut down the memory allocation subsystem. */
     grid_alloc_term ();
@@ -356,10 +396,10 @@ void grid_term (void)
     self.flags |= GRID_CTX_FLAG_ZOMBIE;
 
     /*  Mark all open sockets as terminating. */
-    if (self.socks && self.nsocks) {
-        for (i = 0; i != GRID_MAX_SOCKETS; ++i)
-            if (self.socks [i])
-                grid_sock_zombify (self.socks [i]);
+    if (self.initialised && self.nsocks) {
+        for (i = 0; i != self.nchunks * GRID_SOCKS_CHUNK; ++i)
+            if (grid_global_slot (i)->sock)
+                grid_sock_zombify (grid_global_slot (i)->sock);
     }
 
     grid_glock_unlock ();
@@ -446,6 +486,7 @@ int grid_global_create_socket (int domain, int protocol)
     struct grid_list_item *it;
     struct grid_socktype *socktype;
     struct grid_sock *sock;
+    struct grid_global_slot *slot;
     /* The function is called with grid_glock held */
 
     /*  Only AF_SP and AF_SP_RAW domains are supported. */
@@ -453,13 +494,16 @@ int grid_global_create_socket (int domain, int protocol)
         return -EAFNOSUPPORT;
     }
 
-    /*  If socket limit was reached, report error. */
-    if (grid_slow (self.nsocks >= GRID_MAX_SOCKETS)) {
-        return -EMFILE;
+    /*  If there's no free slot in the socket table, try to enlarge it.
+        If socket limit was reached, report error. */
+    if (grid_slow (self.nunused == 0)) {
+        rc = grid_global_grow ();
+        if (grid_slow (rc < 0))
+            return rc;
     }
 
     /*  Find an empty socket slot. */
-    s = self.unused [GRID_MAX_SOCKETS - self.nsocks - 1];
+    s = self.unused [self.nunused - 1];
 
     /*  Find the appropriate socket type. */
     for (it = grid_list_begin (&self.socktypes);
@@ -475,8 +519,14 @@ int grid_global_create_socket (int domain, int protocol)
             if (rc < 0)
                 return rc;
 
-            /*  Adjust the global socket table. */
-            self.socks [s] = sock;
+            /*  Adjust the global socket table. Switching the hold count from
+                GRID_SOCK_HOLDS_CLOSING to 1 (the caller's hold) makes the
+                socket available to other threads. */
+            slot = grid_global_slot (s);
+            slot->sock = sock;
+            sock->holds = &slot->holds;
+            grid_atomic_dec (&slot->holds, GRID_SOCK_HOLDS_CLOSING - 1);
+            --self.nunused;
             ++self.nsocks;
             return s;
         }
@@ -485,6 +535,51 @@ int grid_global_create_socket (int domain, int protocol)
     return -EINVAL;
 }
 
+/*  Adds one more chunk to the socket table. */
+static int grid_global_grow (void)
+{
+    int i;
+    struct grid_global_slot *chunk;
+    int *unused;
+
+    if (grid_slow (self.nchunks == GRID_SOCKS_MAXCHUNKS))
+        return -EMFILE;
+
+    /*  Use plain malloc rather than grid_alloc as the chunk is never
+        deallocated and would show up as a memory leak. */
+    chunk = malloc (sizeof (struct grid_global_slot) * GRID_SOCKS_CHUNK);
+    alloc_assert (chunk);
+    for (i = 0; i != GRID_SOCKS_CHUNK; ++i) {
+        chunk [i].sock = NULL;
+        grid_atomic_init (&chunk [i].holds, GRID_SOCK_HOLDS_CLOSING);
+    }
+
+    /*  All the slots in the table may become unused at some point. Make
+        sure there's enough space to store them in the stack. */
+    unused = realloc (self.unused,
+        sizeof (int) * (self.nchunks + 1) * GRID_SOCKS_CHUNK);
+    alloc_assert (unused);
+    self.unused = unused;
+
+    /*  Push the new slots so that the lowest one is used first. */
+    for (i = GRID_SOCKS_CHUNK - 1; i >= 0; --i) {
+        self.unused [self.nunused] = self.nchunks * GRID_SOCKS_CHUNK + i;
+        ++self.nunused;
+    }
+
+    /*  Publish the chunk to the threads looking up sockets without locking.
+        The release store makes sure they see the slots initialised. */
+    grid_atomic_store_release (&self.socks [self.nchunks], chunk);
+    ++self.nchunks;
+
+    return 0;
+}
+
+static struct grid_global_slot *grid_global_slot (int s)
+{
+    return &self.socks [s / GRID_SOCKS_CHUNK] [s % GRID_SOCKS_CHUNK];
+}
+
 int grid_socket (int domain, int protocol)
 {
     int rc;
@@ -519,21 +614,41 @@ int grid_close (int s)
 {
     int rc;
     struct grid_sock *sock;
+    struct grid_global_slot *slot;
+    uint32_t holds;
 
-    grid_glock_lock ();
-    rc = grid_global_hold_socket_locked (&sock, s);
+    rc = grid_global_hold_socket (&sock, s);
     if (grid_slow (rc < 0)) {
-        grid_glock_unlock ();
         errno = -rc;
         return -1;
     }
 
+    /*  Prevent any new holds from being placed on the socket. If some other
+        thread is already closing the socket, fail. */
+    slot = grid_global_slot (s);
+    while (1) {
+        holds = slot->holds.n;
+        if (grid_slow (holds & GRID_SOCK_HOLDS_CLOSING)) {
+            grid_sock_rele (sock);
+            errno = EBADF;
+            return -1;
+        }
+        if (grid_atomic_cas (&slot->holds, holds,
+              holds | GRID_SOCK_HOLDS_CLOSING))
+            break;
+    }
+
+    grid_glock_lock ();
+
     /*  Start the shutdown process on the socket.  This will cause
-        all other socket users, as well as endpoints, to begin cleaning up.
-        This is done with the glock held to ensure that two instances
-        of grid_close can't access the same socket. */
+        all other socket users, as well as endpoints, to begin cleaning up. */
     grid_sock_stop (sock);
 
+    /*  Make sure no pollset refers to the socket any more. As the socket is
+        stopped, grid_pollset_add can't register it again. The global lock
+        keeps grid_pollset_destroy from unregistering it at the same time. */
+    grid_sock_pollset_rmall (sock);
+
     /*  We have to drop both the hold we just acquired, as well as
         the original hold, in order for grid_sock_term to complete. */
     grid_sock_rele (sock);
@@ -544,17 +659,15 @@ int grid_close (int s)
         all other consumers of the socket have dropped their holds, and
         all endpoints have cleanly exited. */
     rc = grid_sock_term (sock);
-    if (grid_slow (rc == -EINTR)) {
-        grid_global_rele_socket (sock);
-        errno = EINTR;
-        return -1;
-    }
+    errnum_assert (rc == 0, -rc);
 
     /*  Remove the socket from the socket table, add it to unused socket
-        table. */
+        table. The hold count of the slot is left at GRID_SOCK_HOLDS_CLOSING
+        thus no holds can be placed on it till it is reused. */
     grid_glock_lock ();
-    self.socks [s] = NULL;
-    self.unused [GRID_MAX_SOCKETS - self.nsocks] = s;
+    slot->sock = NULL;
+    self.unused [self.nunused] = s;
+    ++self.nunused;
     --self.nsocks;
     grid_free (sock);
 
@@ -693,6 +806,110 @@ int grid_shutdown (int s, int how)
     return 0;
 }
 
+int grid_ep_stats (int s, struct grid_ep_stats *eps, int count)
+{
+    int rc;
+    struct grid_sock *sock;
+
+    if (grid_slow (count < 0 || (count > 0 && !eps))) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    rc = grid_global_hold_socket (&sock, s);
+    if (grid_slow (rc < 0)) {
+        errno = -rc;
+        return -1;
+    }
+
+    rc = grid_sock_ep_stats (sock, eps, count);
+    grid_global_rele_socket (sock);
+    return rc;
+}
+
+int grid_pipe_stats (int s, int eid, struct grid_pipe_stats *pipes, int count)
+{
+    int rc;
+    struct grid_sock *sock;
+
+    if (grid_slow (count < 0 || (count > 0 && !pipes))) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    rc = grid_global_hold_socket (&sock, s);
+    if (grid_slow (rc < 0)) {
+        errno = -rc;
+        return -1;
+    }
+
+    rc = grid_sock_pipe_stats (sock, eid, pipes, count);
+    grid_global_rele_socket (sock);
+    if (grid_slow (rc < 0)) {
+        errno = -rc;
+        return -1;
+    }
+    return rc;
+}
+
+int grid_stats_snapshot (int format, void *buf, size_t len)
+{
+    int rc;
+    struct grid_stats stats;
+    void *chunk;
+
+    if (grid_slow (!buf && len)) {
+        errno = EFAULT;
+        return -1;
+    }
+
+    grid_stats_init (&stats);
+    rc = grid_global_collect (&stats);
+    if (grid_fast (rc == 0))
+        rc = grid_stats_render (&stats, format, self.hostname, self.appname);
+    if (grid_slow (rc < 0)) {
+        grid_stats_term (&stats);
+        errno = -rc;
+        return -1;
+    }
+
+    /*  Same as with grid_recv, either hand over a message or truncate the
+        snapshot to fit into the user-supplied buffer. */
+    if (len == GRID_MSG) {
+        rc = grid_chunk_alloc (stats.len, 0, &chunk);
+        if (grid_slow (rc < 0)) {
+            grid_stats_term (&stats);
+            errno = -rc;
+            return -1;
+        }
+        memcpy (chunk, stats.data, stats.len);
+        *(void**) buf = chunk;
+    }
+    else if (len) {
+        memcpy (buf, stats.data, stats.len < len ? stats.len : len);
+    }
+    rc = (int) stats.len;
+    grid_stats_term (&stats);
+    return rc;
+}
+
+int grid_trace_dump (const char *path)
+{
+    int rc;
+
+    if (grid_slow (!path)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    rc = grid_trace_write (path);
+    if (grid_slow (rc < 0)) {
+        errno = -rc;
+        return -1;
+    }
+    return 0;
+}
+
 int grid_send (int s, const void *buf, size_t len, int flags)
 {
     struct grid_iovec iov;
@@ -1030,7 +1247,7 @@ static void grid_global_submit_counter (int i, struct grid_sock *s,
             s->socket_name, name, (long long unsigned int)value);
     }
 
-    if (self.statistics_socket >= 0) {
+    if (self.statistics_socket >= 0 && !self.statistics_format) {
         /*  TODO(tailhook) add HAVE_GMTIME_R ifdef  */
         time(&numtime);
 #ifdef GRID_HAVE_GMTIME_R
@@ -1071,7 +1288,7 @@ static void grid_global_submit_level (int i, struct grid_sock *s,
             s->socket_name, name, value);
     }
 
-    if (self.statistics_socket >= 0) {
+    if (self.statistics_socket >= 0 && !self.statistics_format) {
         /*  TODO(tailhook) add HAVE_GMTIME_R ifdef  */
         time(&numtime);
 #ifdef GRID_HAVE_GMTIME_R
@@ -1108,7 +1325,7 @@ static void grid_global_submit_errors (int i, struct grid_sock *s,
     struct grid_list_item *it;
     struct grid_ep *ep;
 
-    if (self.statistics_socket >= 0) {
+    if (self.statistics_socket >= 0 && !self.statistics_format) {
         /*  TODO(tailhook) add HAVE_GMTIME_R ifdef  */
         time(&numtime);
 #ifdef GRID_HAVE_GMTIME_R
@@ -1152,58 +1369,128 @@ static void grid_global_submit_errors (int i, struct grid_sock *s,
     }
 }
 
-static void grid_global_submit_statistics ()
+static void grid_global_submit_latency (int i, struct grid_sock *s,
+    char *name, int option)
+{
+    int rc;
+    char buf [64];
+    struct grid_latency latency;
+    size_t sz;
+
+    sz = sizeof (latency);
+    rc = grid_sock_getopt_inner (s, GRID_SOL_SOCKET, option, &latency, &sz);
+    errnum_assert (rc == 0, -rc);
+    if (!latency.count)
+        return;
+
+    sprintf (buf, "%s.count", name);
+    grid_global_submit_counter (i, s, buf, latency.count);
+    sprintf (buf, "%s.p50", name);
+    grid_global_submit_counter (i, s, buf, latency.p50);
+    sprintf (buf, "%s.p99", name);
+    grid_global_submit_counter (i, s, buf, latency.p99);
+    sprintf (buf, "%s.p999", name);
+    grid_global_submit_counter (i, s, buf, latency.p999);
+    sprintf (buf, "%s.max", name);
+    grid_global_submit_counter (i, s, buf, latency.max);
+}
+
+static void grid_global_submit_socket (int i, struct grid_sock *s)
 {
+    grid_ctx_enter (&s->ctx);
+    grid_global_submit_counter (i, s,
+        "established_connections", s->statistics.established_connections);
+    grid_global_submit_counter (i, s,
+        "accepted_connections", s->statistics.accepted_connections);
+    grid_global_submit_counter (i, s,
+        "dropped_connections", s->statistics.dropped_connections);
+    grid_global_submit_counter (i, s,
+        "broken_connections", s->statistics.broken_connections);
+    grid_global_submit_counter (i, s,
+        "connect_errors", s->statistics.connect_errors);
+    grid_global_submit_counter (i, s,
+        "bind_errors", s->statistics.bind_errors);
+    grid_global_submit_counter (i, s,
+        "accept_errors", s->statistics.accept_errors);
+    grid_global_submit_counter (i, s, "messages_sent",
+        grid_sock_stat_get (s, GRID_STAT_MESSAGES_SENT));
+    grid_global_submit_counter (i, s, "messages_received",
+        grid_sock_stat_get (s, GRID_STAT_MESSAGES_RECEIVED));
+    grid_global_submit_counter (i, s, "bytes_sent",
+        grid_sock_stat_get (s, GRID_STAT_BYTES_SENT));
+    grid_global_submit_counter (i, s, "bytes_received",
+        grid_sock_stat_get (s, GRID_STAT_BYTES_RECEIVED));
+    grid_global_submit_level (i, s,
+        "current_connections", s->statistics.current_connections);
+    grid_global_submit_level (i, s,
+        "inprogress_connections", s->statistics.inprogress_connections);
+    grid_global_submit_level (i, s,
+        "current_snd_priority", s->statistics.current_snd_priority);
+    grid_global_submit_errors (i, s,
+        "current_ep_errors", s->statistics.current_ep_errors);
+    grid_global_submit_latency (i, s, "send_latency", GRID_SNDLATENCY);
+    grid_global_submit_latency (i, s, "queue_latency", GRID_QUEUELATENCY);
+    grid_global_submit_latency (i, s, "rtt_latency", GRID_RTTLATENCY);
+    grid_ctx_leave (&s->ctx);
+}
+
+/*  Walks all the sockets except the statistics socket. Each socket is held
+    while being processed, so that the global lock is never taken. If 'stats'
+    is NULL, the statistics are submitted one counter at a time. */
+static int grid_global_collect (struct grid_stats *stats)
+{
+    int rc;
     int i;
+    int n;
     struct grid_sock *s;
 
-    /*  TODO(tailhook)  optimized it to use nsocks and unused  */
-    for(i = 0; i < GRID_MAX_SOCKETS; ++i) {
+    if (grid_slow (self.flags & GRID_CTX_FLAG_ZOMBIE))
+        return -ETERM;
+
+    /*  The library is not initialised, i.e. there are no sockets. */
+    if (!self.initialised)
+        return 0;
 
-        grid_glock_lock ();
-        s = self.socks [i];
-        if (!s) {
-            grid_glock_unlock ();
+    n = self.nchunks * GRID_SOCKS_CHUNK;
+    for (i = 0; i < n; ++i) {
+        if (i == self.statistics_socket)
             continue;
-        }
-        if (i == self.statistics_socket) {
-            grid_glock_unlock ();
+        rc = grid_global_hold_socket (&s, i);
+        if (grid_slow (rc == -ETERM))
+            return rc;
+        if (rc < 0)
             continue;
-        }
-        grid_ctx_enter (&s->ctx);
-        grid_glock_unlock ();
+        if (stats)
+            grid_stats_add (stats, i, s);
+        else
+            grid_global_submit_socket (i, s);
+        grid_global_rele_socket (s);
+    }
+    return 0;
+}
 
-        grid_global_submit_counter (i, s,
-            "established_connections", s->statistics.established_connections);
-        grid_global_submit_counter (i, s,
-            "accepted_connections", s->statistics.accepted_connections);
-        grid_global_submit_counter (i, s,
-            "dropped_connections", s->statistics.dropped_connections);
-        grid_global_submit_counter (i, s,
-            "broken_connections", s->statistics.broken_connections);
-        grid_global_submit_counter (i, s,
-            "connect_errors", s->statistics.connect_errors);
-        grid_global_submit_counter (i, s,
-            "bind_errors", s->statistics.bind_errors);
-        grid_global_submit_counter (i, s,
-            "accept_errors", s->statistics.accept_errors);
-        grid_global_submit_counter (i, s,
-            "messages_sent", s->statistics.messages_sent);
-        grid_global_submit_counter (i, s,
-            "messages_received", s->statistics.messages_received);
-        grid_global_submit_counter (i, s,
-            "bytes_sent", s->statistics.bytes_sent);
-        grid_global_submit_counter (i, s,
-            "bytes_received", s->statistics.bytes_received);
-        grid_global_submit_level (i, s,
-            "current_connections", s->statistics.current_connections);
-        grid_global_submit_level (i, s,
-            "inprogress_connections", s->statistics.inprogress_connections);
-        grid_global_submit_level (i, s,
-            "current_snd_priority", s->statistics.current_snd_priority);
-        grid_global_submit_errors (i, s,
-            "current_ep_errors", s->statistics.current_ep_errors);
-        grid_ctx_leave (&s->ctx);
+static void grid_global_submit_statistics ()
+{
+    int rc;
+    struct grid_stats stats;
+
+    /*  Per-counter output, to stderr and/or as ESTP messages. */
+    if (self.print_statistics ||
+          (self.statistics_socket >= 0 && !self.statistics_format))
+        (void) grid_global_collect (NULL);
+
+    /*  A single snapshot of all the sockets. */
+    if (self.statistics_socket >= 0 && self.statistics_format) {
+        grid_stats_init (&stats);
+        rc = grid_global_collect (&stats);
+        if (rc == 0) {
+            rc = grid_stats_render (&stats, self.statistics_format,
+                self.hostname, self.appname);
+            errnum_assert (rc == 0, -rc);
+            (void) grid_send (self.statistics_socket, stats.data, stats.len,
+                GRID_DONTWAIT);
+        }
+        grid_stats_term (&stats);
     }
 }
 
@@ -1369,17 +1656,17 @@ int grid_global_print_errors () {
     return self.print_errors;
 }
 
-/*  Get the socket structure for a socket id.  This must be called under
-    the global lock (grid_glock_lock.)  The socket itself will not be freed
-    while the hold is active. */
-int grid_global_hold_socket_locked(struct grid_sock **sockp, int s)
+/*  Get the socket structure for a socket id.  The socket itself will not be
+    freed while the hold is active.  No locking is involved.  The socket table
+    is never deallocated, so the lookup is safe even if it runs concurrently
+    with closing of the last socket in the process. */
+int grid_global_hold_socket (struct grid_sock **sockp, int s)
 {
-    struct grid_sock *sock;
+    struct grid_global_slot *chunk;
+    struct grid_global_slot *slot;
+    uint32_t holds;
+    int rc;
 
-    if (grid_slow (self.socks == NULL)) {
-        *sockp = NULL;
-        return -ETERM;
-    }
     if (grid_slow ((self.flags & GRID_CTX_FLAG_ZOMBIE) != 0)) {
         *sockp = NULL;
         return -ETERM;
@@ -1387,30 +1674,31 @@ int grid_global_hold_socket_locked(struct grid_sock **sockp, int s)
 
     if (grid_slow (s < 0 || s >= GRID_MAX_SOCKETS))
         return -EBADF;
-
-    sock = self.socks[s];
-    if (grid_slow (sock == NULL))
+    chunk = grid_atomic_load_acquire (&self.socks [s / GRID_SOCKS_CHUNK]);
+    if (grid_slow (chunk == NULL))
         return -EBADF;
+    slot = &chunk [s % GRID_SOCKS_CHUNK];
+
+    /*  Place a hold on the slot unless the socket is being closed or the slot
+        is empty. Socket can't be deallocated while there are holds on it. */
+    while (1) {
+        holds = slot->holds.n;
+        if (grid_slow (holds & GRID_SOCK_HOLDS_CLOSING))
+            return -EBADF;
+        if (grid_fast (grid_atomic_cas (&slot->holds, holds, holds + 1)))
+            break;
+    }
 
-    if (grid_slow (grid_sock_hold (sock) != 0)) {
-        return -EBADF;
+    rc = grid_sock_hold (slot->sock);
+    if (grid_slow (rc != 0)) {
+        grid_sock_rele (slot->sock);
+        return rc;
     }
-    *sockp = sock;
+    *sockp = slot->sock;
     return 0;
 }
 
-int grid_global_hold_socket(struct grid_sock **sockp, int s)
-{
-    int rc;
-    grid_glock_lock();
-    rc = grid_global_hold_socket_locked(sockp, s);
-    grid_glock_unlock();
-    return rc;
-}
-
-void grid_global_rele_socket(struct grid_sock *sock)
+void grid_global_rele_socket (struct grid_sock *sock)
 {
-    grid_glock_lock();
-    grid_sock_rele(sock);
-    grid_glock_unlock();
+    grid_sock_rele (sock);
 }
@@ -30,4 +30,11 @@ struct grid_transport *grid_global_transport (int id);
 struct grid_pool *grid_global_getpool ();
 int grid_global_print_errors();
 
+struct grid_sock;
+
+/*  Places a hold on the socket and releases it. The socket is not
+    deallocated while there are holds on it. */
+int grid_global_hold_socket (struct grid_sock **sockp, int s);
+void grid_global_rele_socket (struct grid_sock *sock);
+
 #endif
@@ -28,6 +28,9 @@
 
 #include "../utils/err.h"
 #include "../utils/fast.h"
+#include "../utils/clock.h"
+#include "../utils/alloc.h"
+#include "../utils/histogram.h"
 
 /*  Internal pipe states. */
 #define GRID_PIPEBASE_STATE_IDLE 1
@@ -61,14 +64,21 @@ void grid_pipebase_init (struct grid_pipebase *self,
         sizeof (struct grid_ep_options));
     grid_fsm_event_init (&self->in);
     grid_fsm_event_init (&self->out);
+    self->sendstart = 0;
+    self->ep = epbase->ep;
+    grid_list_item_init (&self->item);
+    self->id = 0;
+    memset (&self->statistics, 0, sizeof (self->statistics));
 }
 
 void grid_pipebase_term (struct grid_pipebase *self)
 {
     grid_assert_state (self, GRID_PIPEBASE_STATE_IDLE);
 
+    grid_pipebase_latency_stop (self);
     grid_fsm_event_term (&self->out);
     grid_fsm_event_term (&self->in);
+    grid_list_item_term (&self->item);
     grid_fsm_term (&self->fsm);
 }
 
@@ -86,16 +96,26 @@ int grid_pipebase_start (struct grid_pipebase *self)
         self->state = GRID_PIPEBASE_STATE_FAILED;
         return rc;
     }
-    if (self->sock)
-        grid_fsm_raise (&self->fsm, &self->out, GRID_PIPE_OUT);
+
+    /*  Transports may re-use the pipe object for subsequent connections.
+        Statistics are kept for each connection separately. */
+    self->id = self->sock->pipeid++;
+    grid_pipebase_latency_stop (self);
+    memset (&self->statistics, 0, sizeof (self->statistics));
+    grid_list_insert (&self->ep->pipes, &self->item,
+        grid_list_end (&self->ep->pipes));
+    grid_fsm_raise (&self->fsm, &self->out, GRID_PIPE_OUT);
 
     return 0;
 }
 
 void grid_pipebase_stop (struct grid_pipebase *self)
 {
-    if (self->state == GRID_PIPEBASE_STATE_ACTIVE)
+    if (self->state == GRID_PIPEBASE_STATE_ACTIVE) {
+        grid_list_erase (&self->ep->pipes, &self->item);
         grid_sock_rm (self->sock, (struct grid_pipe*) self);
+        grid_pipebase_latency_stop (self);
+    }
     self->state = GRID_PIPEBASE_STATE_IDLE;
 }
 
@@ -119,6 +139,13 @@ void grid_pipebase_sent (struct grid_pipebase *self)
     }
     grid_assert (self->outstate == GRID_PIPEBASE_OUTSTATE_ASYNC);
     self->outstate = GRID_PIPEBASE_OUTSTATE_IDLE;
+    grid_pipebase_stat_latency (self, GRID_STAT_SEND_LATENCY, self->sendstart);
+    self->sendstart = 0;
+    if (self->statistics.blockstart) {
+        self->statistics.blocked += grid_clock_us () -
+            self->statistics.blockstart;
+        self->statistics.blockstart = 0;
+    }
     if (self->sock)
         grid_fsm_raise (&self->fsm, &self->out, GRID_PIPE_OUT);
 }
@@ -167,6 +194,76 @@ int grid_pipebase_ispeer (struct grid_pipebase *self, int socktype)
     return grid_sock_ispeer (self->sock, socktype);
 }
 
+uint64_t grid_pipebase_stat_now (struct grid_pipebase *self)
+{
+    return self->sock ? grid_sock_stat_now (self->sock) : 0;
+}
+
+void grid_pipebase_stat_latency (struct grid_pipebase *self, int name,
+    uint64_t start)
+{
+    uint64_t now;
+    uint64_t elapsed;
+
+    /*  Collection may have been switched on while the measurement was
+        underway, or switched off in the meantime. */
+    if (grid_fast (!start || !self->sock || !self->sock->latency))
+        return;
+    now = grid_clock_us ();
+    elapsed = now > start ? now - start : 0;
+    grid_sock_stat_record (self->sock, name, elapsed);
+
+    /*  Send latency is tracked for each pipe as well, so that a slow
+        connection stands out from the others. */
+    if (name != GRID_STAT_SEND_LATENCY)
+        return;
+    if (grid_slow (!self->statistics.latency)) {
+        self->statistics.latency = grid_alloc (sizeof (struct grid_histogram),
+            "pipe latency histogram");
+        alloc_assert (self->statistics.latency);
+        grid_histogram_init (self->statistics.latency);
+    }
+    grid_histogram_record (self->statistics.latency, elapsed);
+}
+
+void grid_pipebase_latency_stop (struct grid_pipebase *self)
+{
+    if (!self->statistics.latency)
+        return;
+    grid_histogram_term (self->statistics.latency);
+    grid_free (self->statistics.latency);
+    self->statistics.latency = NULL;
+}
+
+void grid_pipebase_stat_rcvqueue (struct grid_pipebase *self, int depth)
+{
+    self->statistics.rcvqueue = depth;
+}
+
+void grid_pipebase_stats (struct grid_pipebase *self,
+    struct grid_pipe_stats *stats)
+{
+    stats->eid = self->ep->eid;
+    stats->id = self->id;
+    stats->rcvqueue = self->statistics.rcvqueue;
+    stats->messages_sent = self->statistics.messages_sent;
+    stats->messages_received = self->statistics.messages_received;
+    stats->bytes_sent = self->statistics.bytes_sent;
+    stats->bytes_received = self->statistics.bytes_received;
+    stats->blocked = self->statistics.blocked;
+    grid_histogram_summary (self->statistics.latency, &stats->send_latency);
+
+    /*  While the pipe is sending a message asynchronously it doesn't accept
+        new messages. Account for the time spent in that state so far. */
+    if (self->outstate == GRID_PIPEBASE_OUTSTATE_ASYNC) {
+        stats->sndqueue = 1;
+        if (self->statistics.blockstart)
+            stats->blocked += grid_clock_us () - self->statistics.blockstart;
+    }
+    else
+        stats->sndqueue = 0;
+}
+
 void grid_pipe_setdata (struct grid_pipe *self, void *data)
 {
     ((struct grid_pipebase*) self)->data = data;
@@ -185,14 +282,28 @@ int grid_pipe_send (struct grid_pipe *self, struct grid_msg *msg)
     pipebase = (struct grid_pipebase*) self;
     grid_assert (pipebase->outstate == GRID_PIPEBASE_OUTSTATE_IDLE);
     pipebase->outstate = GRID_PIPEBASE_OUTSTATE_SENDING;
+
+    /*  Send latency is measured till the transport reports that the message
+        was fully written. */
+    pipebase->sendstart = grid_pipebase_stat_now (pipebase);
+    ++pipebase->statistics.messages_sent;
+    pipebase->statistics.bytes_sent += grid_chunkref_size (&msg->sphdr) +
+        grid_chunkref_size (&msg->body);
     rc = pipebase->vfptr->send (pipebase, msg);
     errnum_assert (rc >= 0, -rc);
     if (grid_fast (pipebase->outstate == GRID_PIPEBASE_OUTSTATE_SENT)) {
         pipebase->outstate = GRID_PIPEBASE_OUTSTATE_IDLE;
+        grid_pipebase_stat_latency (pipebase, GRID_STAT_SEND_LATENCY,
+            pipebase->sendstart);
+        pipebase->sendstart = 0;
         return rc;
     }
     grid_assert (pipebase->outstate == GRID_PIPEBASE_OUTSTATE_SENDING);
     pipebase->outstate = GRID_PIPEBASE_OUTSTATE_ASYNC;
+
+    /*  Like the latencies, blocked time is measured only when the socket
+        collects latency statistics. It spares reading the clock otherwise. */
+    pipebase->statistics.blockstart = grid_pipebase_stat_now (pipebase);
     return rc | GRID_PIPEBASE_RELEASE;
 }
 
@@ -206,6 +317,9 @@ int grid_pipe_recv (struct grid_pipe *self, struct grid_msg *msg)
     pipebase->instate = GRID_PIPEBASE_INSTATE_RECEIVING;
     rc = pipebase->vfptr->recv (pipebase, msg);
     errnum_assert (rc >= 0, -rc);
+    ++pipebase->statistics.messages_received;
+    pipebase->statistics.bytes_received += grid_chunkref_size (&msg->sphdr) +
+        grid_chunkref_size (&msg->body);
 
     if (grid_fast (pipebase->instate == GRID_PIPEBASE_INSTATE_RECEIVED)) {
         pipebase->instate = GRID_PIPEBASE_INSTATE_IDLE;
@@ -0,0 +1,235 @@
+/*
+    Copyright (c) 2013-2014 Martin Sustrik  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#include "pollset.h"
+#include "sock.h"
+#include "global.h"
+
+#include "../grid.h"
+
+#include "../utils/err.h"
+#include "../utils/cont.h"
+#include "../utils/fast.h"
+#include "../utils/alloc.h"
+#include "../utils/glock.h"
+
+#include <string.h>
+
+struct grid_pollset *grid_pollset_create (void)
+{
+    int rc;
+    struct grid_pollset *self;
+
+    self = grid_alloc (sizeof (struct grid_pollset), "pollset");
+    alloc_assert (self);
+    rc = grid_efd_init (&self->efd);
+    if (grid_slow (rc < 0)) {
+        grid_free (self);
+        errno = -rc;
+        return NULL;
+    }
+    grid_mutex_init (&self->sync);
+    grid_list_init (&self->items);
+    grid_list_init (&self->ready);
+    self->nready = 0;
+    grid_clock_init (&self->clock);
+
+    return self;
+}
+
+int grid_pollset_destroy (struct grid_pollset *self)
+{
+    struct grid_pollset_item *item;
+
+    /*  Unregister all the sockets. Sockets can't be deallocated while the
+        global lock is held. */
+    grid_glock_lock ();
+    while (!grid_list_empty (&self->items)) {
+        item = grid_cont (grid_list_begin (&self->items),
+            struct grid_pollset_item, item);
+        grid_sock_pollset_rm (item->sock, self);
+    }
+    grid_glock_unlock ();
+
+    grid_clock_term (&self->clock);
+    grid_list_term (&self->ready);
+    grid_list_term (&self->items);
+    grid_mutex_term (&self->sync);
+    grid_efd_term (&self->efd);
+    grid_free (self);
+
+    return 0;
+}
+
+int grid_pollset_add (struct grid_pollset *self, int s, int events)
+{
+    int rc;
+    struct grid_sock *sock;
+
+    if (grid_slow (!events || (events & ~(GRID_POLLIN | GRID_POLLOUT)))) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    rc = grid_global_hold_socket (&sock, s);
+    if (grid_slow (rc < 0)) {
+        errno = -rc;
+        return -1;
+    }
+    rc = grid_sock_pollset_add (sock, self, s, events);
+    grid_global_rele_socket (sock);
+    if (grid_slow (rc < 0)) {
+        errno = -rc;
+        return -1;
+    }
+
+    return 0;
+}
+
+int grid_pollset_rm (struct grid_pollset *self, int s)
+{
+    int rc;
+    struct grid_sock *sock;
+
+    rc = grid_global_hold_socket (&sock, s);
+    if (grid_slow (rc < 0)) {
+        errno = -rc;
+        return -1;
+    }
+    rc = grid_sock_pollset_rm (sock, self);
+    grid_global_rele_socket (sock);
+    if (grid_slow (rc < 0)) {
+        errno = -rc;
+        return -1;
+    }
+
+    return 0;
+}
+
+int grid_pollset_wait (struct grid_pollset *self, struct grid_pollfd *fds,
+    int nfds, int timeout)
+{
+    int rc;
+    int res;
+    int nready;
+    uint64_t deadline;
+    uint64_t now;
+    struct grid_list_item *it;
+    struct grid_pollset_item *item;
+
+    if (grid_slow (nfds <= 0)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    grid_mutex_lock (&self->sync);
+    deadline = timeout < 0 ? 0 : grid_clock_now (&self->clock) + timeout;
+
+    while (1) {
+
+        /*  Report the ready sockets. The reported ones are moved to the end
+            of the list so that all the sockets get reported in turns even
+            if there are more of them than the user is able to accept. */
+        res = 0;
+        nready = self->nready;
+        while (res != nfds && res != nready) {
+            it = grid_list_begin (&self->ready);
+            item = grid_cont (it, struct grid_pollset_item, readyitem);
+            fds [res].fd = item->s;
+            fds [res].events = item->events;
+            fds [res].revents = item->revents & item->events;
+            ++res;
+            grid_list_erase (&self->ready, it);
+            grid_list_insert (&self->ready, it, grid_list_end (&self->ready));
+        }
+        if (res > 0 || timeout == 0)
+            break;
+
+        /*  Wait till one of the sockets becomes ready. */
+        if (timeout < 0)
+            rc = -1;
+        else {
+            now = grid_clock_now (&self->clock);
+            if (now >= deadline)
+                break;
+            rc = (int) (deadline - now);
+        }
+        grid_mutex_unlock (&self->sync);
+        rc = grid_efd_wait (&self->efd, rc);
+        if (grid_slow (rc == -EINTR)) {
+            errno = EINTR;
+            return -1;
+        }
+        errnum_assert (rc == 0 || rc == -ETIMEDOUT, -rc);
+        grid_mutex_lock (&self->sync);
+    }
+
+    grid_mutex_unlock (&self->sync);
+    return res;
+}
+
+void grid_pollset_attach (struct grid_pollset *self,
+    struct grid_pollset_item *item)
+{
+    grid_mutex_lock (&self->sync);
+    grid_list_insert (&self->items, &item->item, grid_list_end (&self->items));
+    grid_mutex_unlock (&self->sync);
+}
+
+void grid_pollset_detach (struct grid_pollset *self,
+    struct grid_pollset_item *item)
+{
+    grid_mutex_lock (&self->sync);
+    if (grid_list_item_isinlist (&item->readyitem)) {
+        grid_list_erase (&self->ready, &item->readyitem);
+        --self->nready;
+        if (self->nready == 0)
+            grid_efd_unsignal (&self->efd);
+    }
+    grid_list_erase (&self->items, &item->item);
+    grid_mutex_unlock (&self->sync);
+}
+
+void grid_pollset_update (struct grid_pollset *self,
+    struct grid_pollset_item *item, int revents)
+{
+    grid_mutex_lock (&self->sync);
+    item->revents = revents;
+    if (revents & item->events) {
+        if (!grid_list_item_isinlist (&item->readyitem)) {
+            if (self->nready == 0)
+                grid_efd_signal (&self->efd);
+            grid_list_insert (&self->ready, &item->readyitem,
+                grid_list_end (&self->ready));
+            ++self->nready;
+        }
+    }
+    else {
+        if (grid_list_item_isinlist (&item->readyitem)) {
+            grid_list_erase (&self->ready, &item->readyitem);
+            --self->nready;
+            if (self->nready == 0)
+                grid_efd_unsignal (&self->efd);
+        }
+    }
+    grid_mutex_unlock (&self->sync);
+}
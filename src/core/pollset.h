@@ -0,0 +1,92 @@
+/*
+    Copyright (c) 2013-2014 Martin Sustrik  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#ifndef GRID_POLLSET_INCLUDED
+#define GRID_POLLSET_INCLUDED
+
+#include "../utils/efd.h"
+#include "../utils/mutex.h"
+#include "../utils/clock.h"
+#include "../utils/list.h"
+
+struct grid_sock;
+
+/*  Registration of a single socket within a pollset. The item is linked both
+    to the socket and to the pollset. Linking and unlinking is done with the
+    socket's context locked, while the socket is held or the global lock is
+    held. */
+struct grid_pollset_item {
+
+    struct grid_pollset *pollset;
+    struct grid_sock *sock;
+
+    /*  Socket handle as seen by the user. */
+    int s;
+
+    /*  Events the user is interested in. */
+    int events;
+
+    /*  Events currently signaled by the socket. */
+    int revents;
+
+    /*  Item in the socket's list of registrations. */
+    struct grid_list_item sockitem;
+
+    /*  Item in the pollset's list of all registrations. */
+    struct grid_list_item item;
+
+    /*  Item in the pollset's list of ready registrations. */
+    struct grid_list_item readyitem;
+};
+
+struct grid_pollset {
+
+    /*  Guards the lists and the clock below. */
+    struct grid_mutex sync;
+
+    /*  Signaled when there is at least one ready registration. */
+    struct grid_efd efd;
+
+    /*  All the registrations. */
+    struct grid_list items;
+
+    /*  Registrations with at least one of the requested events signaled. */
+    struct grid_list ready;
+    int nready;
+
+    struct grid_clock clock;
+};
+
+/*  Adds the item to the pollset. */
+void grid_pollset_attach (struct grid_pollset *self,
+    struct grid_pollset_item *item);
+
+/*  Removes the item from the pollset. */
+void grid_pollset_detach (struct grid_pollset *self,
+    struct grid_pollset_item *item);
+
+/*  Called by the socket, with its context locked, to report events currently
+    signaled by the socket. */
+void grid_pollset_update (struct grid_pollset *self,
+    struct grid_pollset_item *item, int revents);
+
+#endif
@@ -28,6 +28,7 @@
 #include "sock.h"
 #include "global.h"
 #include "ep.h"
+#include "pollset.h"
 
 #include "../utils/err.h"
 #include "../utils/cont.h"
@@ -36,6 +37,7 @@
 #include "../utils/msg.h"
 
 #include <limits.h>
+#include <string.h>
 
 /*  These bits specify whether individual efds are signalled or not at
     the moment. Storing this information allows us to avoid redundant signalling
@@ -58,16 +60,40 @@
 /*  Subordinated source objects. */
 #define GRID_SOCK_SRC_EP 1
 
+/*  Index of the statistics shard used by the current thread, assigned
+    round-robin when the thread first updates a counter. Without thread-local
+    storage all the threads share a single shard. */
+#if defined GRID_HAVE_TLS
+static __thread int grid_sock_shard_id = -1;
+static int grid_sock_shard_next = 0;
+#endif
+
+/*  Shards are normally written by a single thread, but the atomic update
+    is still needed when there are more threads than shards. */
+#if defined GRID_HAVE_GCC_ATOMIC_BUILTINS
+#define grid_sock_shard_add(counter, increment) \
+    ((void) __sync_fetch_and_add (&(counter), (uint64_t) (increment)))
+#else
+#define grid_sock_shard_add(counter, increment) \
+    ((void) ((counter) += (uint64_t) (increment)))
+#endif
+
 /*  Private functions. */
 static struct grid_optset *grid_sock_optset (struct grid_sock *self, int id);
 static int grid_sock_setopt_inner (struct grid_sock *self, int level,
     int option, const void *optval, size_t optvallen);
 static void grid_sock_onleave (struct grid_ctx *self);
+static void grid_sock_pollset_notify (struct grid_sock *self);
 static void grid_sock_handler (struct grid_fsm *self, int src, int type,
     void *srcptr);
 static void grid_sock_shutdown (struct grid_fsm *self, int src, int type,
     void *srcptr);
 static void grid_sock_action_zombify (struct grid_sock *self);
+static void grid_sock_latency_start (struct grid_sock *self);
+static void grid_sock_latency_stop (struct grid_sock *self);
+static void grid_sock_latency_get (struct grid_sock *self, int index,
+    struct grid_latency *latency);
+static int grid_sock_timeo_ms (int64_t timeo);
 
 /*  Initialize a socket.  A hold is placed on the initialized socket for
     the caller as well. */
@@ -87,6 +113,7 @@ int grid_sock_init (struct grid_sock *self, struct grid_socktype *socktype, int
     grid_fsm_init_root (&self->fsm, grid_sock_handler,
         grid_sock_shutdown, &self->ctx);
     self->state = GRID_SOCK_STATE_INIT;
+    grid_fsm_trace_state (&self->fsm, &self->state);
 
     /*  Open the GRID_SNDFD and GRID_RCVFD efds. Do so, only if the socket type
         supports send/recv, as appropriate. */
@@ -117,12 +144,13 @@ int grid_sock_init (struct grid_sock *self, struct grid_socktype *socktype, int
         return rc;
     }
 
-    self->holds = 1;   /*  Callers hold. */
+    self->holds = NULL;   /*  Set by the socket table. */
     self->flags = 0;
-    grid_clock_init (&self->clock);
     grid_list_init (&self->eps);
     grid_list_init (&self->sdeps);
     self->eid = 1;
+    self->pipeid = 1;
+    grid_list_init (&self->pollitems);
 
     /*  Default values for GRID_SOL_SOCKET options. */
     self->linger = 1000;
@@ -146,15 +174,13 @@ int grid_sock_init (struct grid_sock *self, struct grid_socktype *socktype, int
     self->statistics.bind_errors = 0;
     self->statistics.accept_errors = 0;
 
-    self->statistics.messages_sent = 0;
-    self->statistics.messages_received = 0;
-    self->statistics.bytes_sent = 0;
-    self->statistics.bytes_received = 0;
+    memset (self->shards, 0, sizeof (self->shards));
 
     self->statistics.current_connections = 0;
     self->statistics.inprogress_connections = 0;
     self->statistics.current_snd_priority = 0;
     self->statistics.current_ep_errors = 0;
+    self->latency = NULL;
 
     /*  Should be pretty much enough space for just the number  */
     sprintf(self->socket_name, "%d", fd);
@@ -251,10 +277,11 @@ int grid_sock_term (struct grid_sock *self)
     grid_fsm_stopped_noevent (&self->fsm);
     grid_fsm_term (&self->fsm);
     grid_sem_term (&self->termsem);
+    grid_list_term (&self->pollitems);
     grid_list_term (&self->sdeps);
     grid_list_term (&self->eps);
-    grid_clock_term (&self->clock);
     grid_ctx_term (&self->ctx);
+    grid_sock_latency_stop (self);
 
     /*  Destroy any optsets associated with the socket. */
     for (i = 0; i != GRID_MAX_TRANSPORT; ++i)
@@ -333,6 +360,35 @@ static int grid_sock_setopt_inner (struct grid_sock *self, int level,
         return -EINVAL;
     val = *(int*) optval;
 
+    /*  Timeouts are stored in microseconds. Any negative value means
+        infinite timeout. */
+    if (level == GRID_SOL_SOCKET) {
+        switch (option) {
+        case GRID_SNDTIMEO:
+            self->sndtimeo = val < 0 ? -1 : (int64_t) val * 1000;
+            return 0;
+        case GRID_RCVTIMEO:
+            self->rcvtimeo = val < 0 ? -1 : (int64_t) val * 1000;
+            return 0;
+        case GRID_SNDTIMEO_US:
+            self->sndtimeo = val < 0 ? -1 : val;
+            return 0;
+        case GRID_RCVTIMEO_US:
+            self->rcvtimeo = val < 0 ? -1 : val;
+            return 0;
+        }
+    }
+
+    /*  Switching latency collection on discards any values collected so far. */
+    if (level == GRID_SOL_SOCKET && option == GRID_LATENCY_STATS) {
+        if (grid_slow (val != 0 && val != 1))
+            return -EINVAL;
+        grid_sock_latency_stop (self);
+        if (val)
+            grid_sock_latency_start (self);
+        return 0;
+    }
+
     /*  Generic socket-level options. */
     if (level == GRID_SOL_SOCKET) {
         switch (option) {
@@ -354,12 +410,6 @@ static int grid_sock_setopt_inner (struct grid_sock *self, int level,
                 return -EINVAL;
             dst = &self->rcvmaxsize;
             break;
-        case GRID_SNDTIMEO:
-            dst = &self->sndtimeo;
-            break;
-        case GRID_RCVTIMEO:
-            dst = &self->rcvtimeo;
-            break;
         case GRID_RECONNECT_IVL:
             if (grid_slow (val < 0))
                 return -EINVAL;
@@ -419,6 +469,7 @@ int grid_sock_getopt_inner (struct grid_sock *self, int level,
     struct grid_optset *optset;
     int intval;
     grid_fd fd;
+    struct grid_latency latency;
 
     /*  Generic socket-level options. */
     if (level == GRID_SOL_SOCKET) {
@@ -442,10 +493,16 @@ int grid_sock_getopt_inner (struct grid_sock *self, int level,
             intval = self->rcvmaxsize;
             break;
         case GRID_SNDTIMEO:
-            intval = self->sndtimeo;
+            intval = grid_sock_timeo_ms (self->sndtimeo);
             break;
         case GRID_RCVTIMEO:
-            intval = self->rcvtimeo;
+            intval = grid_sock_timeo_ms (self->rcvtimeo);
+            break;
+        case GRID_SNDTIMEO_US:
+            intval = self->sndtimeo > INT_MAX ? INT_MAX : (int) self->sndtimeo;
+            break;
+        case GRID_RCVTIMEO_US:
+            intval = self->rcvtimeo > INT_MAX ? INT_MAX : (int) self->rcvtimeo;
             break;
         case GRID_RECONNECT_IVL:
             intval = self->reconnect_ivl;
@@ -482,6 +539,17 @@ int grid_sock_getopt_inner (struct grid_sock *self, int level,
             strncpy (optval, self->socket_name, *optvallen);
             *optvallen = strlen(self->socket_name);
             return 0;
+        case GRID_LATENCY_STATS:
+            intval = self->latency ? 1 : 0;
+            break;
+        case GRID_SNDLATENCY:
+        case GRID_QUEUELATENCY:
+        case GRID_RTTLATENCY:
+            grid_sock_latency_get (self, option - GRID_SNDLATENCY, &latency);
+            memcpy (optval, &latency, *optvallen < sizeof (latency) ?
+                *optvallen : sizeof (latency));
+            *optvallen = sizeof (latency);
+            return 0;
         default:
             return -ENOPROTOOPT;
         }
@@ -579,12 +647,60 @@ int grid_sock_rm_ep (struct grid_sock *self, int eid)
     return 0;
 }
 
+int grid_sock_ep_stats (struct grid_sock *self, struct grid_ep_stats *eps,
+    int count)
+{
+    int neps;
+    struct grid_list_item *it;
+    struct grid_ep *ep;
+
+    grid_ctx_enter (&self->ctx);
+    neps = 0;
+    for (it = grid_list_begin (&self->eps);
+          it != grid_list_end (&self->eps);
+          it = grid_list_next (&self->eps, it)) {
+        ep = grid_cont (it, struct grid_ep, item);
+        if (neps < count)
+            grid_ep_getstats (ep, &eps [neps], NULL, 0);
+        ++neps;
+    }
+    grid_ctx_leave (&self->ctx);
+
+    return neps;
+}
+
+int grid_sock_pipe_stats (struct grid_sock *self, int eid,
+    struct grid_pipe_stats *pipes, int count)
+{
+    int npipes;
+    int found;
+    struct grid_list_item *it;
+    struct grid_ep *ep;
+
+    grid_ctx_enter (&self->ctx);
+    npipes = 0;
+    found = 0;
+    for (it = grid_list_begin (&self->eps);
+          it != grid_list_end (&self->eps);
+          it = grid_list_next (&self->eps, it)) {
+        ep = grid_cont (it, struct grid_ep, item);
+        if (eid >= 0 && ep->eid != eid)
+            continue;
+        found = 1;
+        npipes += grid_ep_getstats (ep, NULL, pipes ? pipes + npipes : NULL,
+            count > npipes ? count - npipes : 0);
+    }
+    grid_ctx_leave (&self->ctx);
+
+    return found || eid < 0 ? npipes : -EINVAL;
+}
+
 int grid_sock_send (struct grid_sock *self, struct grid_msg *msg, int flags)
 {
     int rc;
     uint64_t deadline;
     uint64_t now;
-    int timeout;
+    int64_t timeout;
 
     /*  Some sockets types cannot be used for sending messages. */
     if (grid_slow (self->socktype->flags & GRID_SOCKTYPE_FLAG_NOSEND))
@@ -598,7 +714,7 @@ int grid_sock_send (struct grid_sock *self, struct grid_msg *msg, int flags)
         timeout = -1;
     }
     else {
-        deadline = grid_clock_now (&self->clock) + self->sndtimeo;
+        deadline = grid_clock_us () + self->sndtimeo;
         timeout = self->sndtimeo;
     }
 
@@ -651,7 +767,7 @@ int grid_sock_send (struct grid_sock *self, struct grid_msg *msg, int flags)
         /*  With blocking send, wait while there are new pipes available
             for sending. */
         grid_ctx_leave (&self->ctx);
-        rc = grid_efd_wait (&self->sndfd, timeout);
+        rc = grid_efd_wait_us (&self->sndfd, timeout);
         if (grid_slow (rc == -ETIMEDOUT))
             return -ETIMEDOUT;
         if (grid_slow (rc == -EINTR))
@@ -670,8 +786,8 @@ int grid_sock_send (struct grid_sock *self, struct grid_msg *msg, int flags)
         /*  If needed, re-compute the timeout to reflect the time that have
             already elapsed. */
         if (self->sndtimeo >= 0) {
-            now = grid_clock_now (&self->clock);
-            timeout = (int) (now > deadline ? 0 : deadline - now);
+            now = grid_clock_us ();
+            timeout = (int64_t) (now > deadline ? 0 : deadline - now);
         }
     }
 }
@@ -681,7 +797,7 @@ int grid_sock_recv (struct grid_sock *self, struct grid_msg *msg, int flags)
     int rc;
     uint64_t deadline;
     uint64_t now;
-    int timeout;
+    int64_t timeout;
 
     /*  Some sockets types cannot be used for receiving messages. */
     if (grid_slow (self->socktype->flags & GRID_SOCKTYPE_FLAG_NORECV))
@@ -695,7 +811,7 @@ int grid_sock_recv (struct grid_sock *self, struct grid_msg *msg, int flags)
         timeout = -1;
     }
     else {
-        deadline = grid_clock_now (&self->clock) + self->rcvtimeo;
+        deadline = grid_clock_us () + self->rcvtimeo;
         timeout = self->rcvtimeo;
     }
 
@@ -748,7 +864,7 @@ int grid_sock_recv (struct grid_sock *self, struct grid_msg *msg, int flags)
         /*  With blocking recv, wait while there are new pipes available
             for receiving. */
         grid_ctx_leave (&self->ctx);
-        rc = grid_efd_wait (&self->rcvfd, timeout);
+        rc = grid_efd_wait_us (&self->rcvfd, timeout);
         if (grid_slow (rc == -ETIMEDOUT))
             return -ETIMEDOUT;
         if (grid_slow (rc == -EINTR))
@@ -767,8 +883,8 @@ int grid_sock_recv (struct grid_sock *self, struct grid_msg *msg, int flags)
         /*  If needed, re-compute the timeout to reflect the time that have
             already elapsed. */
         if (self->rcvtimeo >= 0) {
-            now = grid_clock_now (&self->clock);
-            timeout = (int) (now > deadline ? 0 : deadline - now);
+            now = grid_clock_us ();
+            timeout = (int64_t) (now > deadline ? 0 : deadline - now);
         }
     }
 }
@@ -837,6 +953,125 @@ static void grid_sock_onleave (struct grid_ctx *self)
             }
         }
     }
+
+    /*  Let the pollsets know about the current state of the socket. */
+    if (grid_slow (!grid_list_empty (&sock->pollitems)))
+        grid_sock_pollset_notify (sock);
+}
+
+static int grid_sock_pollset_revents (struct grid_sock *self)
+{
+    return ((self->flags & GRID_SOCK_FLAG_IN) ? GRID_POLLIN : 0) |
+        ((self->flags & GRID_SOCK_FLAG_OUT) ? GRID_POLLOUT : 0);
+}
+
+static void grid_sock_pollset_notify (struct grid_sock *self)
+{
+    int revents;
+    struct grid_list_item *it;
+    struct grid_pollset_item *item;
+
+    revents = grid_sock_pollset_revents (self);
+    for (it = grid_list_begin (&self->pollitems);
+          it != grid_list_end (&self->pollitems);
+          it = grid_list_next (&self->pollitems, it)) {
+        item = grid_cont (it, struct grid_pollset_item, sockitem);
+        if (item->revents != revents)
+            grid_pollset_update (item->pollset, item, revents);
+    }
+}
+
+static struct grid_pollset_item *grid_sock_pollset_find (struct grid_sock *self,
+    struct grid_pollset *pollset)
+{
+    struct grid_list_item *it;
+    struct grid_pollset_item *item;
+
+    for (it = grid_list_begin (&self->pollitems);
+          it != grid_list_end (&self->pollitems);
+          it = grid_list_next (&self->pollitems, it)) {
+        item = grid_cont (it, struct grid_pollset_item, sockitem);
+        if (item->pollset == pollset)
+            return item;
+    }
+    return NULL;
+}
+
+static void grid_sock_pollset_erase (struct grid_sock *self,
+    struct grid_pollset_item *item)
+{
+    grid_list_erase (&self->pollitems, &item->sockitem);
+    grid_pollset_detach (item->pollset, item);
+    grid_list_item_term (&item->readyitem);
+    grid_list_item_term (&item->item);
+    grid_list_item_term (&item->sockitem);
+    grid_free (item);
+}
+
+int grid_sock_pollset_add (struct grid_sock *self,
+    struct grid_pollset *pollset, int s, int events)
+{
+    int rc;
+    struct grid_pollset_item *item;
+
+    grid_ctx_enter (&self->ctx);
+
+    /*  The socket may have been stopped by grid_close() while the caller was
+        placing its hold. As the socket is already unregistered from all the
+        pollsets at that point, don't register it anew. */
+    rc = grid_sock_hold (self);
+    if (grid_slow (rc < 0)) {
+        grid_ctx_leave (&self->ctx);
+        return rc;
+    }
+
+    item = grid_sock_pollset_find (self, pollset);
+    if (!item) {
+        item = grid_alloc (sizeof (struct grid_pollset_item),
+            "pollset item");
+        alloc_assert (item);
+        item->pollset = pollset;
+        item->sock = self;
+        item->s = s;
+        item->revents = 0;
+        grid_list_item_init (&item->sockitem);
+        grid_list_item_init (&item->item);
+        grid_list_item_init (&item->readyitem);
+        grid_list_insert (&self->pollitems, &item->sockitem,
+            grid_list_end (&self->pollitems));
+        grid_pollset_attach (pollset, item);
+    }
+    item->events = events;
+    grid_pollset_update (pollset, item, grid_sock_pollset_revents (self));
+    grid_ctx_leave (&self->ctx);
+
+    return 0;
+}
+
+int grid_sock_pollset_rm (struct grid_sock *self, struct grid_pollset *pollset)
+{
+    struct grid_pollset_item *item;
+
+    grid_ctx_enter (&self->ctx);
+    item = grid_sock_pollset_find (self, pollset);
+    if (grid_slow (!item)) {
+        grid_ctx_leave (&self->ctx);
+        return -ENOENT;
+    }
+    grid_sock_pollset_erase (self, item);
+    grid_ctx_leave (&self->ctx);
+
+    return 0;
+}
+
+void grid_sock_pollset_rmall (struct grid_sock *self)
+{
+    grid_ctx_enter (&self->ctx);
+    while (!grid_list_empty (&self->pollitems))
+        grid_sock_pollset_erase (self, grid_cont (
+            grid_list_begin (&self->pollitems),
+            struct grid_pollset_item, sockitem));
+    grid_ctx_leave (&self->ctx);
 }
 
 static struct grid_optset *grid_sock_optset (struct grid_sock *self, int id)
@@ -1094,6 +1329,19 @@ void grid_sock_report_error (struct grid_sock *self, struct grid_ep *ep, int err
     }
 }
 
+static struct grid_sock_shard *grid_sock_shard (struct grid_sock *self)
+{
+#if defined GRID_HAVE_TLS
+    /*  Two threads racing for the next shard may end up with the same one.
+        That's harmless, the shard is updated atomically anyway. */
+    if (grid_slow (grid_sock_shard_id < 0))
+        grid_sock_shard_id = grid_sock_shard_next++ % GRID_SOCK_SHARDS;
+    return &self->shards [grid_sock_shard_id];
+#else
+    return &self->shards [0];
+#endif
+}
+
 void grid_sock_stat_increment (struct grid_sock *self, int name, int64_t increment)
 {
     switch (name) {
@@ -1127,19 +1375,23 @@ void grid_sock_stat_increment (struct grid_sock *self, int name, int64_t increme
             break;
         case GRID_STAT_MESSAGES_SENT:
             grid_assert (increment > 0);
-            self->statistics.messages_sent += increment;
+            grid_sock_shard_add (grid_sock_shard (self)->messages_sent,
+                increment);
             break;
         case GRID_STAT_MESSAGES_RECEIVED:
             grid_assert (increment > 0);
-            self->statistics.messages_received += increment;
+            grid_sock_shard_add (grid_sock_shard (self)->messages_received,
+                increment);
             break;
         case GRID_STAT_BYTES_SENT:
             grid_assert (increment >= 0);
-            self->statistics.bytes_sent += increment;
+            grid_sock_shard_add (grid_sock_shard (self)->bytes_sent,
+                increment);
             break;
         case GRID_STAT_BYTES_RECEIVED:
             grid_assert (increment >= 0);
-            self->statistics.bytes_received += increment;
+            grid_sock_shard_add (grid_sock_shard (self)->bytes_received,
+                increment);
             break;
 
         case GRID_STAT_CURRENT_CONNECTIONS:
@@ -1168,12 +1420,106 @@ void grid_sock_stat_increment (struct grid_sock *self, int name, int64_t increme
     }
 }
 
+uint64_t grid_sock_stat_get (struct grid_sock *self, int name)
+{
+    int i;
+    uint64_t value;
+
+    value = 0;
+    for (i = 0; i != GRID_SOCK_SHARDS; ++i) {
+        switch (name) {
+        case GRID_STAT_MESSAGES_SENT:
+            value += self->shards [i].messages_sent;
+            break;
+        case GRID_STAT_MESSAGES_RECEIVED:
+            value += self->shards [i].messages_received;
+            break;
+        case GRID_STAT_BYTES_SENT:
+            value += self->shards [i].bytes_sent;
+            break;
+        case GRID_STAT_BYTES_RECEIVED:
+            value += self->shards [i].bytes_received;
+            break;
+        default:
+            grid_assert (0);
+        }
+    }
+    return value;
+}
+
+uint64_t grid_sock_stat_now (struct grid_sock *self)
+{
+    return grid_slow (self->latency != NULL) ? grid_clock_us () : 0;
+}
+
+void grid_sock_stat_latency (struct grid_sock *self, int name, uint64_t start)
+{
+    uint64_t now;
+
+    /*  Collection may have been switched on while the measurement was
+        underway, or switched off in the meantime. */
+    if (grid_fast (!start || !self->latency))
+        return;
+    now = grid_clock_us ();
+    grid_sock_stat_record (self, name, now > start ? now - start : 0);
+}
+
+void grid_sock_stat_record (struct grid_sock *self, int name, uint64_t value)
+{
+    grid_assert (name >= GRID_STAT_SEND_LATENCY &&
+        name < GRID_STAT_SEND_LATENCY + GRID_SOCK_LATENCY_COUNT);
+
+    if (grid_fast (!self->latency))
+        return;
+    grid_histogram_record (&self->latency [name - GRID_STAT_SEND_LATENCY],
+        value);
+}
+
+static void grid_sock_latency_start (struct grid_sock *self)
+{
+    int i;
+
+    grid_assert (!self->latency);
+    self->latency = grid_alloc (sizeof (struct grid_histogram) *
+        GRID_SOCK_LATENCY_COUNT, "latency histograms");
+    alloc_assert (self->latency);
+    for (i = 0; i != GRID_SOCK_LATENCY_COUNT; ++i)
+        grid_histogram_init (&self->latency [i]);
+}
+
+static void grid_sock_latency_stop (struct grid_sock *self)
+{
+    int i;
+    struct grid_list_item *it;
+
+    if (!self->latency)
+        return;
+
+    /*  Per-pipe histograms are dropped along with the socket ones. */
+    for (it = grid_list_begin (&self->eps);
+          it != grid_list_end (&self->eps);
+          it = grid_list_next (&self->eps, it))
+        grid_ep_latency_stop (grid_cont (it, struct grid_ep, item));
+    for (i = 0; i != GRID_SOCK_LATENCY_COUNT; ++i)
+        grid_histogram_term (&self->latency [i]);
+    grid_free (self->latency);
+    self->latency = NULL;
+}
+
+static void grid_sock_latency_get (struct grid_sock *self, int index,
+    struct grid_latency *latency)
+{
+    grid_assert (index >= 0 && index < GRID_SOCK_LATENCY_COUNT);
+
+    grid_histogram_summary (self->latency ? &self->latency [index] : NULL,
+        latency);
+}
+
 int grid_sock_hold (struct grid_sock *self)
 {
     switch (self->state) {
     case GRID_SOCK_STATE_ACTIVE:
     case GRID_SOCK_STATE_INIT:
-        self->holds++;
         return 0;
     case GRID_SOCK_STATE_ZOMBIE:
         return -ETERM;
@@ -1187,8 +1533,19 @@ int grid_sock_hold (struct grid_sock *self)
 
 void grid_sock_rele (struct grid_sock *self)
 {
-    self->holds--;
-    if (self->holds == 0) {
+    /*  Once the socket is being closed no new holds can be placed on it.
+        Thus, only the last hold being released can bring the count to
+        zero. */
+    if (grid_atomic_dec (self->holds, 1) == GRID_SOCK_HOLDS_CLOSING + 1)
         grid_sem_post (&self->relesem);
-    }
+}
+
+/*  Converts a timeout in microseconds to milliseconds, rounding up so that
+    a non-zero sub-millisecond timeout isn't reported as zero. */
+static int grid_sock_timeo_ms (int64_t timeo)
+{
+    if (timeo < 0)
+        return -1;
+    timeo = (timeo + 999) / 1000;
+    return timeo > INT_MAX ? INT_MAX : (int) timeo;
 }
@@ -33,11 +33,14 @@
 #include "../utils/sem.h"
 #include "../utils/clock.h"
 #include "../utils/list.h"
+#include "../utils/atomic.h"
+#include "../utils/histogram.h"
 
 struct grid_pipe;
+struct grid_pollset;
 
 /*  The maximum implemented transport ID. */
-#define GRID_MAX_TRANSPORT 4
+#define GRID_MAX_TRANSPORT 5
 
 /*  The socket-internal statistics  */
 #define GRID_STAT_MESSAGES_SENT          301
@@ -45,11 +48,43 @@ struct grid_pipe;
 #define GRID_STAT_BYTES_SENT             303
 #define GRID_STAT_BYTES_RECEIVED         304
 
+/*  Latency histograms. Values are in microseconds.  */
+#define GRID_STAT_SEND_LATENCY           501
+#define GRID_SOCK_LATENCY_COUNT 3
+
+
+/*  Number of shards the counters updated by user threads are split into.
+    Each user thread updates a single shard, the shards are summed up when
+    the counters are read. More threads than shards is OK, some of the
+    threads will merely share a shard. */
+#define GRID_SOCK_SHARDS 8
+
+/*  Distance to keep between data modified by different threads. It is twice
+    the usual cache line size, so that the data don't share a cache line even
+    though the socket is not allocated at a cache line boundary, and to
+    prevent the adjacent line prefetch from pulling in the other thread's
+    line. */
+#define GRID_SOCK_PADDING 128
+
+struct grid_sock_shard
+{
+    /*  Messages sent  */
+    uint64_t messages_sent;
+    /*  Messages received  */
+    uint64_t messages_received;
+    /*  Bytes sent (sum length of data in messages sent)  */
+    uint64_t bytes_sent;
+    /*  Bytes recevied (sum length of data in messages received)  */
+    uint64_t bytes_received;
+
+    char padding [GRID_SOCK_PADDING - 4 * sizeof (uint64_t)];
+};
 
 struct grid_sock
 {
-    /*  Socket state machine. */
-    struct grid_fsm fsm;
+    /*****  Fields read by user threads on every send and receive.  *****/
+    /*****  They rarely change once the socket is set up.           *****/
+
     int state;
 
     /*  Pointer to the instance of the specific socket type. */
@@ -58,18 +93,36 @@ struct grid_sock
     /*  Pointer to the socket type metadata. */
     struct grid_socktype *socktype;
 
-    int flags;
-
-    struct grid_ctx ctx;
     struct grid_efd sndfd;
     struct grid_efd rcvfd;
+
+    /*  Send and receive timeouts in microseconds, -1 meaning infinite. */
+    int64_t sndtimeo;
+    int64_t rcvtimeo;
+
+    /*  Count of active holds against the socket. The counter itself lives
+        in the global socket table so that it can be safely accessed without
+        locking even while the socket is being deallocated. */
+    struct grid_atomic *holds;
+
+    /*  Latency histograms, indexed by GRID_STAT_*_LATENCY - 501. NULL unless
+        collection was switched on using GRID_LATENCY_STATS option. */
+    struct grid_histogram *latency;
+
+    char padding1 [GRID_SOCK_PADDING];
+
+    /*****  Fields modified while holding the context, whether by user   *****/
+    /*****  threads or by the worker thread.                              *****/
+
+    struct grid_ctx ctx;
+    int flags;
+
+    /*  Socket state machine. */
+    struct grid_fsm fsm;
+
     struct grid_sem termsem;
     struct grid_sem relesem;
 
-    /*  TODO: This clock can be accessed from different threads. If RDTSC
-        is out-of-sync among different CPU cores, this can be a problem. */
-    struct grid_clock clock;
-
     /*  List of all endpoints associated with the socket. */
     struct grid_list eps;
 
@@ -79,16 +132,17 @@ struct grid_sock
     /*  Next endpoint ID to assign to a new endpoint. */
     int eid;
 
-    /*  Count of active holds against the socket. */
-    int holds;
+    /*  Next pipe ID to assign to a new pipe. */
+    int pipeid;
+
+    /*  List of pollsets the socket is registered with. */
+    struct grid_list pollitems;
 
     /*  Socket-level socket options. */
     int linger;
     int sndbuf;
     int rcvbuf;
     int rcvmaxsize;
-    int sndtimeo;
-    int rcvtimeo;
     int reconnect_ivl;
     int reconnect_ivl_max;
 
@@ -98,6 +152,8 @@ struct grid_sock
     /*  Transport-specific socket options. */
     struct grid_optset *optsets [GRID_MAX_TRANSPORT];
 
+    /*  Counters modified by the worker thread. Message counters are kept
+        in 'shards' instead, see grid_sock_stat_get. */
     struct {
 
         /*****  The ever-incrementing counters  *****/
@@ -117,15 +173,6 @@ struct grid_sock
         /*  Errors accepting connections at grid_bind()'ed endpoint  */
         uint64_t accept_errors;
 
-        /*  Messages sent  */
-        uint64_t messages_sent;
-        /*  Messages received  */
-        uint64_t messages_received;
-        /*  Bytes sent (sum length of data in messages sent)  */
-        uint64_t bytes_sent;
-        /*  Bytes recevied (sum length of data in messages received)  */
-        uint64_t bytes_received;
-
         /*****  Level-style values *****/
 
         /*  Number of currently established connections  */
@@ -148,6 +195,11 @@ struct grid_sock
     int outbuffersz;
     int inbuffersz;
 
+    char padding2 [GRID_SOCK_PADDING];
+
+    /*****  Counters updated by user threads without holding the context. *****/
+
+    struct grid_sock_shard shards [GRID_SOCK_SHARDS];
 };
 
 /*  Initialise the socket. */
@@ -190,6 +242,21 @@ int grid_sock_recv (struct grid_sock *self, struct grid_msg *msg, int flags);
 int grid_sock_setopt (struct grid_sock *self, int level, int option,
     const void *optval, size_t optvallen);
 
+/*  Register the socket with a pollset. If already registered, the set of
+    events to poll for is changed. To be called with a hold on the socket.
+    Fails with EBADF once the socket was stopped. */
+int grid_sock_pollset_add (struct grid_sock *self,
+    struct grid_pollset *pollset, int s, int events);
+
+/*  Unregister the socket from a pollset. To be called with a hold on the
+    socket, or with the global lock held. */
+int grid_sock_pollset_rm (struct grid_sock *self, struct grid_pollset *pollset);
+
+/*  Unregister the socket from all the pollsets. To be called by grid_close()
+    with the global lock held, after the socket was stopped so that it can't
+    be registered again. */
+void grid_sock_pollset_rmall (struct grid_sock *self);
+
 /*  Retrieve a socket option. This function is to be called from the API. */
 int grid_sock_getopt (struct grid_sock *self, int level, int option,
     void *optval, size_t *optvallen);
@@ -199,6 +266,14 @@ int grid_sock_getopt (struct grid_sock *self, int level, int option,
 int grid_sock_getopt_inner (struct grid_sock *self, int level, int option,
     void *optval, size_t *optvallen);
 
+/*  Retrieve statistics of the endpoints and pipes. Both functions return
+    the total number of items, storing at most 'count' of them. eid of -1
+    stands for all the endpoints. */
+int grid_sock_ep_stats (struct grid_sock *self, struct grid_ep_stats *eps,
+    int count);
+int grid_sock_pipe_stats (struct grid_sock *self, int eid,
+    struct grid_pipe_stats *pipes, int count);
+
 /*  Used by pipes. */
 int grid_sock_add (struct grid_sock *self, struct grid_pipe *pipe);
 void grid_sock_rm (struct grid_sock *self, struct grid_pipe *pipe);
@@ -207,7 +282,26 @@ void grid_sock_rm (struct grid_sock *self, struct grid_pipe *pipe);
 void grid_sock_report_error(struct grid_sock *self, struct grid_ep *ep,  int errnum);
 void grid_sock_stat_increment(struct grid_sock *self, int name, int64_t increment);
 
-/*  Holds and releases. */
+/*  Returns the value of a message counter (GRID_STAT_MESSAGES_SENT etc.)
+    summed up over all the shards. Can be called without holding the
+    context, in which case concurrent updates may or may not be counted. */
+uint64_t grid_sock_stat_get (struct grid_sock *self, int name);
+
+/*  Latency statistics. grid_sock_stat_now returns the current time if latency
+    collection is switched on, 0 otherwise. grid_sock_stat_latency accounts
+    for the time elapsed since 'start'; zero 'start' is ignored.
+    grid_sock_stat_record accounts for a value measured by the caller. */
+uint64_t grid_sock_stat_now (struct grid_sock *self);
+void grid_sock_stat_latency (struct grid_sock *self, int name, uint64_t start);
+void grid_sock_stat_record (struct grid_sock *self, int name, uint64_t value);
+
+/*  When this bit is set in the hold count, no new holds can be placed on
+    the socket. */
+#define GRID_SOCK_HOLDS_CLOSING 0x80000000u
+
+/*  Holds and releases. Holds are placed by the global socket table,
+    grid_sock_hold only checks whether the socket is in a state where it
+    can be used. */
 int grid_sock_hold (struct grid_sock *self);
 void grid_sock_rele (struct grid_sock *self);
 
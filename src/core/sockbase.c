@@ -60,3 +60,14 @@ void grid_sockbase_stat_increment (struct grid_sockbase *self, int name,
 {
     grid_sock_stat_increment (self->sock, name, increment);
 }
+
+uint64_t grid_sockbase_stat_now (struct grid_sockbase *self)
+{
+    return grid_sock_stat_now (self->sock);
+}
+
+void grid_sockbase_stat_latency (struct grid_sockbase *self, int name,
+    uint64_t start)
+{
+    grid_sock_stat_latency (self->sock, name, start);
+}
@@ -0,0 +1,540 @@
+/*
+    Copyright (c) 2013-2014 Martin Sustrik  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#include "stats.h"
+#include "sock.h"
+
+#include "../utils/err.h"
+#include "../utils/fast.h"
+#include "../utils/alloc.h"
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+
+static const char *grid_stats_counters [GRID_STATS_COUNTERS] = {
+    "established_connections",
+    "accepted_connections",
+    "dropped_connections",
+    "broken_connections",
+    "connect_errors",
+    "bind_errors",
+    "accept_errors",
+    "messages_sent",
+    "messages_received",
+    "bytes_sent",
+    "bytes_received"
+};
+
+static const char *grid_stats_levels [GRID_STATS_LEVELS] = {
+    "current_connections",
+    "inprogress_connections",
+    "current_snd_priority",
+    "current_ep_errors"
+};
+
+/*  Latency histograms, in the order of GRID_STAT_*_LATENCY. */
+static const char *grid_stats_latencies [GRID_SOCK_LATENCY_COUNT] = {
+    "send",
+    "queue",
+    "rtt"
+};
+static const int grid_stats_latency_options [GRID_SOCK_LATENCY_COUNT] = {
+    GRID_SNDLATENCY,
+    GRID_QUEUELATENCY,
+    GRID_RTTLATENCY
+};
+
+/*  Private functions. */
+static void grid_stats_printf (struct grid_stats *self, const char *format,
+    ...);
+static void grid_stats_string (struct grid_stats *self, const char *str,
+    int format);
+static void grid_stats_render_json (struct grid_stats *self,
+    const char *hostname, const char *appname);
+static void grid_stats_render_prometheus (struct grid_stats *self);
+
+void grid_stats_init (struct grid_stats *self)
+{
+    self->socks = NULL;
+    self->nsocks = 0;
+    self->maxsocks = 0;
+    self->data = NULL;
+    self->len = 0;
+    self->capacity = 0;
+}
+
+void grid_stats_term (struct grid_stats *self)
+{
+    int i;
+
+    for (i = 0; i != self->nsocks; ++i) {
+        grid_free (self->socks [i].eps);
+        grid_free (self->socks [i].pipes);
+    }
+    grid_free (self->socks);
+    grid_free (self->data);
+}
+
+void grid_stats_add (struct grid_stats *self, int s, struct grid_sock *sock)
+{
+    int rc;
+    int i;
+    int count;
+    size_t sz;
+    struct grid_stats_sock *ss;
+
+    if (self->nsocks == self->maxsocks) {
+        self->maxsocks = self->maxsocks ? self->maxsocks * 2 : 16;
+        self->socks = grid_realloc (self->socks,
+            self->maxsocks * sizeof (struct grid_stats_sock));
+        alloc_assert (self->socks);
+    }
+    ss = &self->socks [self->nsocks++];
+    ss->s = s;
+
+    /*  Endpoints and pipes may come and go in the meantime. Retry until
+        the whole set fits into the buffer. */
+    ss->eps = NULL;
+    count = 0;
+    while (1) {
+        ss->neps = grid_sock_ep_stats (sock, ss->eps, count);
+        if (ss->neps <= count)
+            break;
+        count = ss->neps + 4;
+        grid_free (ss->eps);
+        ss->eps = grid_alloc (count * sizeof (struct grid_ep_stats),
+            "stats eps");
+        alloc_assert (ss->eps);
+    }
+    ss->pipes = NULL;
+    count = 0;
+    while (1) {
+        ss->npipes = grid_sock_pipe_stats (sock, -1, ss->pipes, count);
+        grid_assert (ss->npipes >= 0);
+        if (ss->npipes <= count)
+            break;
+        count = ss->npipes + 4;
+        grid_free (ss->pipes);
+        ss->pipes = grid_alloc (count * sizeof (struct grid_pipe_stats),
+            "stats pipes");
+        alloc_assert (ss->pipes);
+    }
+
+    grid_ctx_enter (&sock->ctx);
+    ss->protocol = sock->socktype->protocol;
+    memcpy (ss->name, sock->socket_name, sizeof (ss->name));
+    ss->name [sizeof (ss->name) - 1] = 0;
+    ss->counters [0] = sock->statistics.established_connections;
+    ss->counters [1] = sock->statistics.accepted_connections;
+    ss->counters [2] = sock->statistics.dropped_connections;
+    ss->counters [3] = sock->statistics.broken_connections;
+    ss->counters [4] = sock->statistics.connect_errors;
+    ss->counters [5] = sock->statistics.bind_errors;
+    ss->counters [6] = sock->statistics.accept_errors;
+    ss->counters [7] = grid_sock_stat_get (sock, GRID_STAT_MESSAGES_SENT);
+    ss->counters [8] = grid_sock_stat_get (sock, GRID_STAT_MESSAGES_RECEIVED);
+    ss->counters [9] = grid_sock_stat_get (sock, GRID_STAT_BYTES_SENT);
+    ss->counters [10] = grid_sock_stat_get (sock, GRID_STAT_BYTES_RECEIVED);
+    ss->levels [0] = sock->statistics.current_connections;
+    ss->levels [1] = sock->statistics.inprogress_connections;
+    ss->levels [2] = sock->statistics.current_snd_priority;
+    ss->levels [3] = sock->statistics.current_ep_errors;
+    for (i = 0; i != GRID_SOCK_LATENCY_COUNT; ++i) {
+        sz = sizeof (struct grid_latency);
+        rc = grid_sock_getopt_inner (sock, GRID_SOL_SOCKET,
+            grid_stats_latency_options [i], &ss->latency [i], &sz);
+        errnum_assert (rc == 0, -rc);
+    }
+    grid_ctx_leave (&sock->ctx);
+}
+
+int grid_stats_render (struct grid_stats *self, int format,
+    const char *hostname, const char *appname)
+{
+    self->len = 0;
+    switch (format) {
+    case GRID_STATS_JSON:
+        grid_stats_render_json (self, hostname, appname);
+        return 0;
+    case GRID_STATS_PROMETHEUS:
+        grid_stats_render_prometheus (self);
+        return 0;
+    default:
+        return -EINVAL;
+    }
+}
+
+static void grid_stats_printf (struct grid_stats *self, const char *format,
+    ...)
+{
+    va_list ap;
+    int len;
+
+    while (1) {
+        va_start (ap, format);
+        len = vsnprintf (self->data + self->len, self->capacity - self->len,
+            format, ap);
+        va_end (ap);
+        grid_assert (len >= 0);
+        if (self->len + len < self->capacity)
+            break;
+        self->capacity = self->capacity ? self->capacity * 2 : 4096;
+        while (self->capacity <= self->len + len)
+            self->capacity *= 2;
+        self->data = grid_realloc (self->data, self->capacity);
+        alloc_assert (self->data);
+    }
+    self->len += len;
+}
+
+/*  Writes a quoted string escaped according to the format. */
+static void grid_stats_string (struct grid_stats *self, const char *str,
+    int format)
+{
+    const unsigned char *c;
+
+    grid_stats_printf (self, "\"");
+    for (c = (const unsigned char*) str; *c; ++c) {
+        if (*c == '"' || *c == '\\')
+            grid_stats_printf (self, "\\%c", *c);
+        else if (*c == '\n')
+            grid_stats_printf (self, "\\n");
+        else if (*c < 0x20 && format == GRID_STATS_JSON)
+            grid_stats_printf (self, "\\u%04x", *c);
+        else
+            grid_stats_printf (self, "%c", *c);
+    }
+    grid_stats_printf (self, "\"");
+}
+
+static void grid_stats_json_latency (struct grid_stats *self,
+    const char *name, struct grid_latency *lat, int first)
+{
+    grid_stats_printf (self, "%s\"%s\":{\"count\":%llu,\"min\":%llu,"
+        "\"max\":%llu,\"mean\":%llu,\"p50\":%llu,\"p90\":%llu,"
+        "\"p99\":%llu,\"p999\":%llu}", first ? "" : ",", name,
+        (unsigned long long) lat->count,
+        (unsigned long long) lat->min,
+        (unsigned long long) lat->max,
+        (unsigned long long) lat->mean,
+        (unsigned long long) lat->p50,
+        (unsigned long long) lat->p90,
+        (unsigned long long) lat->p99,
+        (unsigned long long) lat->p999);
+}
+
+static void grid_stats_render_json (struct grid_stats *self,
+    const char *hostname, const char *appname)
+{
+    int i;
+    int j;
+    int first;
+    struct grid_stats_sock *ss;
+    struct grid_latency *lat;
+    struct grid_ep_stats *ep;
+    struct grid_pipe_stats *pipe;
+
+    grid_stats_printf (self, "{\"hostname\":");
+    grid_stats_string (self, hostname, GRID_STATS_JSON);
+    grid_stats_printf (self, ",\"application\":");
+    grid_stats_string (self, appname, GRID_STATS_JSON);
+    grid_stats_printf (self, ",\"timestamp\":%llu,\"sockets\":[",
+        (unsigned long long) time (NULL));
+
+    for (i = 0; i != self->nsocks; ++i) {
+        ss = &self->socks [i];
+        grid_stats_printf (self, "%s{\"socket\":%d,\"name\":",
+            i ? "," : "", ss->s);
+        grid_stats_string (self, ss->name, GRID_STATS_JSON);
+        grid_stats_printf (self, ",\"protocol\":%d", ss->protocol);
+        for (j = 0; j != GRID_STATS_COUNTERS; ++j)
+            grid_stats_printf (self, ",\"%s\":%llu", grid_stats_counters [j],
+                (unsigned long long) ss->counters [j]);
+        for (j = 0; j != GRID_STATS_LEVELS; ++j)
+            grid_stats_printf (self, ",\"%s\":%d", grid_stats_levels [j],
+                ss->levels [j]);
+
+        /*  Only the histograms that have any samples are reported. */
+        grid_stats_printf (self, ",\"latency\":{");
+        first = 1;
+        for (j = 0; j != GRID_SOCK_LATENCY_COUNT; ++j) {
+            lat = &ss->latency [j];
+            if (!lat->count)
+                continue;
+            grid_stats_json_latency (self, grid_stats_latencies [j], lat,
+                first);
+            first = 0;
+        }
+
+        grid_stats_printf (self, "},\"endpoints\":[");
+        for (j = 0; j != ss->neps; ++j) {
+            ep = &ss->eps [j];
+            grid_stats_printf (self, "%s{\"eid\":%d,\"addr\":",
+                j ? "," : "", ep->eid);
+            grid_stats_string (self, ep->addr, GRID_STATS_JSON);
+            grid_stats_printf (self, ",\"bind\":%d,\"pipes\":%d,"
+                "\"connections\":%llu,\"reconnects\":%llu,\"errors\":%llu,"
+                "\"last_errno\":%d}", ep->bind, ep->pipes,
+                (unsigned long long) ep->connections,
+                (unsigned long long) ep->reconnects,
+                (unsigned long long) ep->errors, ep->last_errno);
+        }
+
+        grid_stats_printf (self, "],\"pipes\":[");
+        for (j = 0; j != ss->npipes; ++j) {
+            pipe = &ss->pipes [j];
+            grid_stats_printf (self, "%s{\"eid\":%d,\"id\":%d,"
+                "\"sndqueue\":%d,\"rcvqueue\":%d,\"messages_sent\":%llu,"
+                "\"messages_received\":%llu,\"bytes_sent\":%llu,"
+                "\"bytes_received\":%llu,\"blocked\":%llu", j ? "," : "",
+                pipe->eid, pipe->id, pipe->sndqueue, pipe->rcvqueue,
+                (unsigned long long) pipe->messages_sent,
+                (unsigned long long) pipe->messages_received,
+                (unsigned long long) pipe->bytes_sent,
+                (unsigned long long) pipe->bytes_received,
+                (unsigned long long) pipe->blocked);
+            if (pipe->send_latency.count)
+                grid_stats_json_latency (self, "send_latency",
+                    &pipe->send_latency, 0);
+            grid_stats_printf (self, "}");
+        }
+        grid_stats_printf (self, "]}");
+    }
+    grid_stats_printf (self, "]}\n");
+}
+
+/*  Prometheus requires all the samples of a metric to be grouped together,
+    so the snapshot is walked once per metric. */
+
+static void grid_stats_prometheus_socket (struct grid_stats *self,
+    struct grid_stats_sock *ss)
+{
+    grid_stats_printf (self, "{socket=");
+    grid_stats_string (self, ss->name, GRID_STATS_PROMETHEUS);
+}
+
+static void grid_stats_prometheus_ep (struct grid_stats *self,
+    struct grid_stats_sock *ss, struct grid_ep_stats *ep)
+{
+    grid_stats_prometheus_socket (self, ss);
+    grid_stats_printf (self, ",eid=\"%d\",addr=", ep->eid);
+    grid_stats_string (self, ep->addr, GRID_STATS_PROMETHEUS);
+    grid_stats_printf (self, "}");
+}
+
+static void grid_stats_prometheus_pipe (struct grid_stats *self,
+    struct grid_stats_sock *ss, struct grid_pipe_stats *pipe)
+{
+    grid_stats_prometheus_socket (self, ss);
+    grid_stats_printf (self, ",eid=\"%d\",pipe=\"%d\"}", pipe->eid, pipe->id);
+}
+
+static uint64_t grid_stats_ep_value (struct grid_ep_stats *ep, int metric)
+{
+    switch (metric) {
+    case 0:
+        return ep->pipes;
+    case 1:
+        return ep->connections;
+    case 2:
+        return ep->reconnects;
+    case 3:
+        return ep->errors;
+    case 4:
+        return ep->last_errno;
+    default:
+        grid_assert (0);
+        return 0;
+    }
+}
+
+static uint64_t grid_stats_pipe_value (struct grid_pipe_stats *pipe,
+    int metric)
+{
+    switch (metric) {
+    case 0:
+        return pipe->sndqueue;
+    case 1:
+        return pipe->rcvqueue;
+    case 2:
+        return pipe->messages_sent;
+    case 3:
+        return pipe->messages_received;
+    case 4:
+        return pipe->bytes_sent;
+    case 5:
+        return pipe->bytes_received;
+    case 6:
+        return pipe->blocked;
+    default:
+        grid_assert (0);
+        return 0;
+    }
+}
+
+static void grid_stats_render_prometheus (struct grid_stats *self)
+{
+    static const char *quantiles [4] = {"0.5", "0.9", "0.99", "0.999"};
+    static const char *epmetrics [5] = {
+        "pipes", "connections_total", "reconnects_total", "errors_total",
+        "last_errno"
+    };
+    static const char *pipemetrics [7] = {
+        "sndqueue", "rcvqueue", "messages_sent_total",
+        "messages_received_total", "bytes_sent_total", "bytes_received_total",
+        "blocked_microseconds_total"
+    };
+    int i;
+    int j;
+    int k;
+    int metric;
+    struct grid_stats_sock *ss;
+    struct grid_latency *lat;
+    uint64_t values [4];
+
+    for (metric = 0; metric != GRID_STATS_COUNTERS; ++metric) {
+        grid_stats_printf (self, "# TYPE gridmq_socket_%s_total counter\n",
+            grid_stats_counters [metric]);
+        for (i = 0; i != self->nsocks; ++i) {
+            ss = &self->socks [i];
+            grid_stats_printf (self, "gridmq_socket_%s_total",
+                grid_stats_counters [metric]);
+            grid_stats_prometheus_socket (self, ss);
+            grid_stats_printf (self, "} %llu\n",
+                (unsigned long long) ss->counters [metric]);
+        }
+    }
+
+    for (metric = 0; metric != GRID_STATS_LEVELS; ++metric) {
+        grid_stats_printf (self, "# TYPE gridmq_socket_%s gauge\n",
+            grid_stats_levels [metric]);
+        for (i = 0; i != self->nsocks; ++i) {
+            ss = &self->socks [i];
+            grid_stats_printf (self, "gridmq_socket_%s",
+                grid_stats_levels [metric]);
+            grid_stats_prometheus_socket (self, ss);
+            grid_stats_printf (self, "} %d\n", ss->levels [metric]);
+        }
+    }
+
+    for (metric = 0; metric != GRID_SOCK_LATENCY_COUNT; ++metric) {
+        grid_stats_printf (self,
+            "# TYPE gridmq_socket_%s_latency_microseconds summary\n",
+            grid_stats_latencies [metric]);
+        for (i = 0; i != self->nsocks; ++i) {
+            ss = &self->socks [i];
+            lat = &ss->latency [metric];
+            if (!lat->count)
+                continue;
+            values [0] = lat->p50;
+            values [1] = lat->p90;
+            values [2] = lat->p99;
+            values [3] = lat->p999;
+            for (k = 0; k != 4; ++k) {
+                grid_stats_printf (self, "gridmq_socket_%s_latency_microseconds",
+                    grid_stats_latencies [metric]);
+                grid_stats_prometheus_socket (self, ss);
+                grid_stats_printf (self, ",quantile=\"%s\"} %llu\n",
+                    quantiles [k], (unsigned long long) values [k]);
+            }
+            grid_stats_printf (self,
+                "gridmq_socket_%s_latency_microseconds_sum",
+                grid_stats_latencies [metric]);
+            grid_stats_prometheus_socket (self, ss);
+            grid_stats_printf (self, "} %llu\n",
+                (unsigned long long) (lat->mean * lat->count));
+            grid_stats_printf (self,
+                "gridmq_socket_%s_latency_microseconds_count",
+                grid_stats_latencies [metric]);
+            grid_stats_prometheus_socket (self, ss);
+            grid_stats_printf (self, "} %llu\n",
+                (unsigned long long) lat->count);
+        }
+    }
+
+    for (metric = 0; metric != 5; ++metric) {
+        grid_stats_printf (self, "# TYPE gridmq_endpoint_%s %s\n",
+            epmetrics [metric],
+            metric == 0 || metric == 4 ? "gauge" : "counter");
+        for (i = 0; i != self->nsocks; ++i) {
+            ss = &self->socks [i];
+            for (j = 0; j != ss->neps; ++j) {
+                grid_stats_printf (self, "gridmq_endpoint_%s",
+                    epmetrics [metric]);
+                grid_stats_prometheus_ep (self, ss, &ss->eps [j]);
+                grid_stats_printf (self, " %llu\n", (unsigned long long)
+                    grid_stats_ep_value (&ss->eps [j], metric));
+            }
+        }
+    }
+
+    for (metric = 0; metric != 7; ++metric) {
+        grid_stats_printf (self, "# TYPE gridmq_pipe_%s %s\n",
+            pipemetrics [metric], metric < 2 ? "gauge" : "counter");
+        for (i = 0; i != self->nsocks; ++i) {
+            ss = &self->socks [i];
+            for (j = 0; j != ss->npipes; ++j) {
+                grid_stats_printf (self, "gridmq_pipe_%s",
+                    pipemetrics [metric]);
+                grid_stats_prometheus_pipe (self, ss, &ss->pipes [j]);
+                grid_stats_printf (self, " %llu\n", (unsigned long long)
+                    grid_stats_pipe_value (&ss->pipes [j], metric));
+            }
+        }
+    }
+
+    grid_stats_printf (self,
+        "# TYPE gridmq_pipe_send_latency_microseconds summary\n");
+    for (i = 0; i != self->nsocks; ++i) {
+        ss = &self->socks [i];
+        for (j = 0; j != ss->npipes; ++j) {
+            lat = &ss->pipes [j].send_latency;
+            if (!lat->count)
+                continue;
+            values [0] = lat->p50;
+            values [1] = lat->p90;
+            values [2] = lat->p99;
+            values [3] = lat->p999;
+            for (k = 0; k != 4; ++k) {
+                grid_stats_printf (self,
+                    "gridmq_pipe_send_latency_microseconds");
+                grid_stats_prometheus_socket (self, ss);
+                grid_stats_printf (self, ",eid=\"%d\",pipe=\"%d\","
+                    "quantile=\"%s\"} %llu\n", ss->pipes [j].eid,
+                    ss->pipes [j].id, quantiles [k],
+                    (unsigned long long) values [k]);
+            }
+            grid_stats_printf (self,
+                "gridmq_pipe_send_latency_microseconds_sum");
+            grid_stats_prometheus_pipe (self, ss, &ss->pipes [j]);
+            grid_stats_printf (self, " %llu\n",
+                (unsigned long long) (lat->mean * lat->count));
+            grid_stats_printf (self,
+                "gridmq_pipe_send_latency_microseconds_count");
+            grid_stats_prometheus_pipe (self, ss, &ss->pipes [j]);
+            grid_stats_printf (self, " %llu\n",
+                (unsigned long long) lat->count);
+        }
+    }
+}
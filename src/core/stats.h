@@ -0,0 +1,81 @@
+/*
+    Copyright (c) 2013-2014 Martin Sustrik  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#ifndef GRID_STATS_INCLUDED
+#define GRID_STATS_INCLUDED
+
+#include "../grid.h"
+
+#include "sock.h"
+
+#include <stddef.h>
+
+/*  Number of socket-level counters and levels in the snapshot. */
+#define GRID_STATS_COUNTERS 11
+#define GRID_STATS_LEVELS 4
+
+/*  Statistics of a single socket, as captured by grid_stats_add. */
+struct grid_stats_sock {
+    int s;
+    int protocol;
+    char name [64];
+    uint64_t counters [GRID_STATS_COUNTERS];
+    int levels [GRID_STATS_LEVELS];
+    struct grid_latency latency [GRID_SOCK_LATENCY_COUNT];
+    struct grid_ep_stats *eps;
+    int neps;
+    struct grid_pipe_stats *pipes;
+    int npipes;
+};
+
+/*  Snapshot of statistics of multiple sockets, rendered into a single
+    machine-readable document. The sockets are captured one by one, each of
+    them while holding only its own context, so that neither the global
+    lock nor more than one socket is locked at any time. Rendering happens
+    after all the sockets were released. */
+struct grid_stats {
+
+    /*  The captured sockets. */
+    struct grid_stats_sock *socks;
+    int nsocks;
+    int maxsocks;
+
+    /*  The rendered document. It is not zero-terminated. */
+    char *data;
+    size_t len;
+    size_t capacity;
+};
+
+void grid_stats_init (struct grid_stats *self);
+void grid_stats_term (struct grid_stats *self);
+
+/*  Capture statistics of socket 'sock' with handle 's'. The caller must
+    hold the socket. */
+void grid_stats_add (struct grid_stats *self, int s, struct grid_sock *sock);
+
+/*  Render the captured statistics in the specified format (GRID_STATS_JSON
+    or GRID_STATS_PROMETHEUS) into self->data. Returns -EINVAL in case of
+    unknown format. */
+int grid_stats_render (struct grid_stats *self, int format,
+    const char *hostname, const char *appname);
+
+#endif
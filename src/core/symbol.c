@@ -27,6 +27,7 @@
 #include "../inproc.h"
 #include "../ipc.h"
 #include "../tcp.h"
+#include "../tcpmux.h"
 
 #include "../pair.h"
 #include "../pubsub.h"
@@ -84,6 +85,8 @@ static const struct grid_symbol_properties sym_value_names [] = {
         GRID_TYPE_NONE, GRID_UNIT_NONE},
     {GRID_UNIT_BOOLEAN, "GRID_UNIT_BOOLEAN", GRID_NS_OPTION_UNIT,
         GRID_TYPE_NONE, GRID_UNIT_NONE},
+    {GRID_UNIT_MICROSECONDS, "GRID_UNIT_MICROSECONDS", GRID_NS_OPTION_UNIT,
+        GRID_TYPE_NONE, GRID_UNIT_NONE},
 
     {GRID_VERSION_CURRENT, "GRID_VERSION_CURRENT", GRID_NS_VERSION,
         GRID_TYPE_NONE, GRID_UNIT_NONE},
@@ -103,6 +106,8 @@ static const struct grid_symbol_properties sym_value_names [] = {
         GRID_TYPE_NONE, GRID_UNIT_NONE},
     {GRID_TCP, "GRID_TCP", GRID_NS_TRANSPORT,
         GRID_TYPE_NONE, GRID_UNIT_NONE},
+    {GRID_TCPMUX, "GRID_TCPMUX", GRID_NS_TRANSPORT,
+        GRID_TYPE_NONE, GRID_UNIT_NONE},
 
     {GRID_PAIR, "GRID_PAIR", GRID_NS_PROTOCOL,
         GRID_TYPE_NONE, GRID_UNIT_NONE},
@@ -163,6 +168,12 @@ static const struct grid_symbol_properties sym_value_names [] = {
         GRID_TYPE_INT, GRID_UNIT_BOOLEAN},
     {GRID_SOCKET_NAME, "GRID_SOCKET_NAME", GRID_NS_SOCKET_OPTION,
         GRID_TYPE_STR, GRID_UNIT_NONE},
+    {GRID_LATENCY_STATS, "GRID_LATENCY_STATS", GRID_NS_SOCKET_OPTION,
+        GRID_TYPE_INT, GRID_UNIT_BOOLEAN},
+    {GRID_SNDTIMEO_US, "GRID_SNDTIMEO_US", GRID_NS_SOCKET_OPTION,
+        GRID_TYPE_INT, GRID_UNIT_MICROSECONDS},
+    {GRID_RCVTIMEO_US, "GRID_RCVTIMEO_US", GRID_NS_SOCKET_OPTION,
+        GRID_TYPE_INT, GRID_UNIT_MICROSECONDS},
 
     {GRID_SUB_SUBSCRIBE, "GRID_SUB_SUBSCRIBE", GRID_NS_TRANSPORT_OPTION,
         GRID_TYPE_STR, GRID_UNIT_NONE},
@@ -170,10 +181,42 @@ static const struct grid_symbol_properties sym_value_names [] = {
         GRID_TYPE_STR, GRID_UNIT_NONE},
     {GRID_REQ_RESEND_IVL, "GRID_REQ_RESEND_IVL", GRID_NS_TRANSPORT_OPTION,
         GRID_TYPE_INT, GRID_UNIT_MILLISECONDS},
+    {GRID_REQ_RESEND_IVL_US, "GRID_REQ_RESEND_IVL_US", GRID_NS_TRANSPORT_OPTION,
+        GRID_TYPE_INT, GRID_UNIT_MICROSECONDS},
+    {GRID_REP_CACHE_SIZE, "GRID_REP_CACHE_SIZE", GRID_NS_TRANSPORT_OPTION,
+        GRID_TYPE_INT, GRID_UNIT_NONE},
+    {GRID_REP_CACHE_MAXMEM, "GRID_REP_CACHE_MAXMEM", GRID_NS_TRANSPORT_OPTION,
+        GRID_TYPE_INT, GRID_UNIT_BYTES},
     {GRID_SURVEYOR_DEADLINE, "GRID_SURVEYOR_DEADLINE", GRID_NS_TRANSPORT_OPTION,
         GRID_TYPE_INT, GRID_UNIT_MILLISECONDS},
+    {GRID_SURVEYOR_MAXSURVEYS, "GRID_SURVEYOR_MAXSURVEYS",
+        GRID_NS_TRANSPORT_OPTION, GRID_TYPE_INT, GRID_UNIT_NONE},
+    {GRID_SURVEYOR_SURVEYID, "GRID_SURVEYOR_SURVEYID", GRID_NS_TRANSPORT_OPTION,
+        GRID_TYPE_INT, GRID_UNIT_NONE},
+    {GRID_SURVEYOR_QUORUM, "GRID_SURVEYOR_QUORUM", GRID_NS_TRANSPORT_OPTION,
+        GRID_TYPE_INT, GRID_UNIT_NONE},
+    {GRID_SURVEYOR_DEADLINE_US, "GRID_SURVEYOR_DEADLINE_US",
+        GRID_NS_TRANSPORT_OPTION, GRID_TYPE_INT, GRID_UNIT_MICROSECONDS},
+    {GRID_BUS_FORWARD, "GRID_BUS_FORWARD", GRID_NS_TRANSPORT_OPTION,
+        GRID_TYPE_INT, GRID_UNIT_BOOLEAN},
+    {GRID_BUS_TTL, "GRID_BUS_TTL", GRID_NS_TRANSPORT_OPTION,
+        GRID_TYPE_INT, GRID_UNIT_NONE},
+    {GRID_BUS_DEDUP, "GRID_BUS_DEDUP", GRID_NS_TRANSPORT_OPTION,
+        GRID_TYPE_INT, GRID_UNIT_NONE},
+    {GRID_INPROC_ZEROCOPY, "GRID_INPROC_ZEROCOPY", GRID_NS_TRANSPORT_OPTION,
+        GRID_TYPE_INT, GRID_UNIT_BOOLEAN},
     {GRID_TCP_NODELAY, "GRID_TCP_NODELAY", GRID_NS_TRANSPORT_OPTION,
         GRID_TYPE_INT, GRID_UNIT_BOOLEAN},
+    {GRID_TCP_COMPRESS, "GRID_TCP_COMPRESS", GRID_NS_TRANSPORT_OPTION,
+        GRID_TYPE_INT, GRID_UNIT_NONE},
+    {GRID_TCP_COMPRESS_THRESHOLD, "GRID_TCP_COMPRESS_THRESHOLD",
+        GRID_NS_TRANSPORT_OPTION, GRID_TYPE_INT, GRID_UNIT_BYTES},
+    {GRID_TCP_COMPRESS_DICT, "GRID_TCP_COMPRESS_DICT",
+        GRID_NS_TRANSPORT_OPTION, GRID_TYPE_STR, GRID_UNIT_NONE},
+    {GRID_TCP_LISTENERS, "GRID_TCP_LISTENERS", GRID_NS_TRANSPORT_OPTION,
+        GRID_TYPE_INT, GRID_UNIT_NONE},
+    {GRID_TCPMUX_NODELAY, "GRID_TCPMUX_NODELAY", GRID_NS_TRANSPORT_OPTION,
+        GRID_TYPE_INT, GRID_UNIT_BOOLEAN},
 
     {GRID_DONTWAIT, "GRID_DONTWAIT", GRID_NS_FLAG,
         GRID_TYPE_NONE, GRID_UNIT_NONE},
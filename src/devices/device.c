@@ -22,10 +22,16 @@
 
 #include "../grid.h"
 
+#include "../core/global.h"
+#include "../core/sock.h"
+
 #include "../utils/err.h"
 #include "../utils/fast.h"
 #include "../utils/fd.h"
 #include "../utils/attr.h"
+#include "../utils/alloc.h"
+#include "../utils/thread.h"
+#include "../utils/msg.h"
 #include "device.h"
 
 #include <string.h>
@@ -36,45 +42,18 @@
 #error
 #endif
 
-int grid_custom_device(struct grid_device_recipe *device, int s1, int s2,
-    int flags) 
-{
-    return grid_device_entry (device, s1, s2, flags);
-}
-
-int grid_device (int s1, int s2)
-{
-    return grid_custom_device (&grid_ordinary_device, s1, s2, 0);
-}
-
-int grid_device_entry (struct grid_device_recipe *device, int s1, int s2,
-    GRID_UNUSED int flags) 
+/*  Checks whether the two sockets can be joined by the device and retrieves
+    their file descriptors for polling, s1 receive, s1 send, s2 receive and
+    s2 send, in this order. The descriptors that the sockets don't have are
+    set to -1. */
+static int grid_device_getfds (struct grid_device_recipe *device,
+    int s1, int s2, grid_fd *fds)
 {
     int rc;
     int op1;
     int op2;
-    grid_fd s1rcv;
-    grid_fd s1snd;
-    grid_fd s2rcv;
-    grid_fd s2snd;
     size_t opsz;
 
-    /*  At least one socket must be specified. */
-    if (device->required_checks & GRID_CHECK_AT_LEAST_ONE_SOCKET) {
-        if (s1 < 0 && s2 < 0) {
-            errno = EBADF;
-            return -1;
-        }
-    }
-
-    /*  Handle the case when there's only one socket in the device. */
-    if (device->required_checks & GRID_CHECK_ALLOW_LOOPBACK) {
-        if (s2 < 0)
-            return grid_device_loopback (device,s1);
-        if (s1 < 0)
-            return grid_device_loopback (device,s2);
-    }
-
     /*  Check whether both sockets are "raw" sockets. */
     if (device->required_checks & GRID_CHECK_REQUIRE_RAW_SOCKETS) {
         opsz = sizeof (op1);
@@ -108,62 +87,110 @@ int grid_device_entry (struct grid_device_recipe *device, int s1, int s2,
     }
 
     /*  Get the file descriptors for polling. */
-    opsz = sizeof (s1rcv);
-    rc = grid_getsockopt (s1, GRID_SOL_SOCKET, GRID_RCVFD, &s1rcv, &opsz);
+    opsz = sizeof (fds [0]);
+    rc = grid_getsockopt (s1, GRID_SOL_SOCKET, GRID_RCVFD, &fds [0], &opsz);
     if (rc < 0 && grid_errno () == ENOPROTOOPT)
-        s1rcv = -1;
+        fds [0] = -1;
     else {
         grid_assert (rc == 0);
-        grid_assert (opsz == sizeof (s1rcv));
-        grid_assert (s1rcv >= 0);
+        grid_assert (opsz == sizeof (fds [0]));
+        grid_assert (fds [0] >= 0);
     }
-    opsz = sizeof (s1snd);
-    rc = grid_getsockopt (s1, GRID_SOL_SOCKET, GRID_SNDFD, &s1snd, &opsz);
+    opsz = sizeof (fds [1]);
+    rc = grid_getsockopt (s1, GRID_SOL_SOCKET, GRID_SNDFD, &fds [1], &opsz);
     if (rc < 0 && grid_errno () == ENOPROTOOPT)
-        s1snd = -1;
+        fds [1] = -1;
     else {
         grid_assert (rc == 0);
-        grid_assert (opsz == sizeof (s1snd));
-        grid_assert (s1snd >= 0);
+        grid_assert (opsz == sizeof (fds [1]));
+        grid_assert (fds [1] >= 0);
     }
-    opsz = sizeof (s2rcv);
-    rc = grid_getsockopt (s2, GRID_SOL_SOCKET, GRID_RCVFD, &s2rcv, &opsz);
+    opsz = sizeof (fds [2]);
+    rc = grid_getsockopt (s2, GRID_SOL_SOCKET, GRID_RCVFD, &fds [2], &opsz);
     if (rc < 0 && grid_errno () == ENOPROTOOPT)
-        s2rcv = -1;
+        fds [2] = -1;
     else {
         grid_assert (rc == 0);
-        grid_assert (opsz == sizeof (s2rcv));
-        grid_assert (s2rcv >= 0);
+        grid_assert (opsz == sizeof (fds [2]));
+        grid_assert (fds [2] >= 0);
     }
-    opsz = sizeof (s2snd);
-    rc = grid_getsockopt (s2, GRID_SOL_SOCKET, GRID_SNDFD, &s2snd, &opsz);
+    opsz = sizeof (fds [3]);
+    rc = grid_getsockopt (s2, GRID_SOL_SOCKET, GRID_SNDFD, &fds [3], &opsz);
     if (rc < 0 && grid_errno () == ENOPROTOOPT)
-        s2snd = -1;
+        fds [3] = -1;
     else {
         grid_assert (rc == 0);
-        grid_assert (opsz == sizeof (s2snd));
-        grid_assert (s2snd >= 0);
+        grid_assert (opsz == sizeof (fds [3]));
+        grid_assert (fds [3] >= 0);
     }
     if (device->required_checks & GRID_CHECK_SOCKET_DIRECTIONALITY) {
         /*  Check the directionality of the sockets. */
-        if (s1rcv != -1 && s2snd == -1) {
+        if (fds [0] != -1 && fds [3] == -1) {
             errno = EINVAL;
             return -1;
         }
-        if (s1snd != -1 && s2rcv == -1) {
+        if (fds [1] != -1 && fds [2] == -1) {
             errno = EINVAL;
             return -1;
         }
-        if (s2rcv != -1 && s1snd == -1) {
+        if (fds [2] != -1 && fds [1] == -1) {
             errno = EINVAL;
             return -1;
         }
-        if (s2snd != -1 && s1rcv == -1) {
+        if (fds [3] != -1 && fds [0] == -1) {
             errno = EINVAL;
             return -1;
         }
     }
 
+    return 0;
+}
+
+int grid_custom_device(struct grid_device_recipe *device, int s1, int s2,
+    int flags) 
+{
+    return grid_device_entry (device, s1, s2, flags);
+}
+
+int grid_device (int s1, int s2)
+{
+    return grid_custom_device (&grid_ordinary_device, s1, s2, 0);
+}
+
+int grid_device_entry (struct grid_device_recipe *device, int s1, int s2,
+    GRID_UNUSED int flags) 
+{
+    int rc;
+    grid_fd s1rcv;
+    grid_fd s1snd;
+    grid_fd s2rcv;
+    grid_fd s2snd;
+    grid_fd fds [4];
+
+    /*  At least one socket must be specified. */
+    if (device->required_checks & GRID_CHECK_AT_LEAST_ONE_SOCKET) {
+        if (s1 < 0 && s2 < 0) {
+            errno = EBADF;
+            return -1;
+        }
+    }
+
+    /*  Handle the case when there's only one socket in the device. */
+    if (device->required_checks & GRID_CHECK_ALLOW_LOOPBACK) {
+        if (s2 < 0)
+            return grid_device_loopback (device,s1);
+        if (s1 < 0)
+            return grid_device_loopback (device,s2);
+    }
+
+    rc = grid_device_getfds (device, s1, s2, fds);
+    if (grid_slow (rc < 0))
+        return -1;
+    s1rcv = fds [0];
+    s1snd = fds [1];
+    s2rcv = fds [2];
+    s2snd = fds [3];
+
     /*  Two-directional device. */
     if (device->required_checks & GRID_CHECK_ALLOW_BIDIRECTIONAL) {
         if (s1rcv != -1 && s1snd != -1 && s2rcv != -1 && s2snd != -1)
@@ -284,6 +311,88 @@ int grid_device_oneway (struct grid_device_recipe *device,
     }
 }
 
+/*  Receives a message from the socket, accounting for it in the socket
+    statistics the same way grid_recvmsg does. */
+static int grid_device_recv (struct grid_sock *sock, struct grid_msg *msg,
+    int flags)
+{
+    int rc;
+
+    rc = grid_sock_recv (sock, msg, flags);
+    if (grid_slow (rc < 0))
+        return rc;
+    grid_sock_stat_increment (sock, GRID_STAT_MESSAGES_RECEIVED, 1);
+    grid_sock_stat_increment (sock, GRID_STAT_BYTES_RECEIVED,
+        grid_chunkref_size (&msg->body));
+    return 0;
+}
+
+/*  Sends the message to the socket, accounting for it in the socket
+    statistics the same way grid_sendmsg does. If the message can't be sent
+    it is dropped. */
+static int grid_device_send (struct grid_sock *sock, struct grid_msg *msg,
+    int flags)
+{
+    int rc;
+    size_t sz;
+
+    sz = grid_chunkref_size (&msg->body);
+    rc = grid_sock_send (sock, msg, flags);
+    if (grid_slow (rc < 0)) {
+        grid_msg_term (msg);
+        return rc;
+    }
+    grid_sock_stat_increment (sock, GRID_STAT_MESSAGES_SENT, 1);
+    grid_sock_stat_increment (sock, GRID_STAT_BYTES_SENT, sz);
+    return 0;
+}
+
+/*  Sends the message to the socket with the specified handle. The socket is
+    held only for the duration of the call so that a blocked send doesn't
+    prevent any other socket from being closed. */
+static int grid_device_send_s (int s, struct grid_msg *msg, int flags)
+{
+    int rc;
+    struct grid_sock *sock;
+
+    rc = grid_global_hold_socket (&sock, s);
+    if (grid_slow (rc < 0)) {
+        grid_msg_term (msg);
+        return rc;
+    }
+    rc = grid_device_send (sock, msg, flags);
+    grid_global_rele_socket (sock);
+    return rc;
+}
+
+/*  Moves a message between the sockets inside the library. The message,
+    including its SP header, is passed on as is rather than being converted
+    to grid_msghdr and back. Only the socket being operated on is held, so
+    that the other one can be closed while the device waits for a message. */
+static int grid_device_mvmsg_direct (int from, int to, int flags)
+{
+    int rc;
+    struct grid_sock *fromsock;
+    struct grid_msg msg;
+
+    rc = grid_global_hold_socket (&fromsock, from);
+    if (grid_slow (rc < 0)) {
+        errno = -rc;
+        return -1;
+    }
+    rc = grid_device_recv (fromsock, &msg, flags);
+    grid_global_rele_socket (fromsock);
+    if (grid_fast (rc == 0))
+        rc = grid_device_send_s (to, &msg, flags);
+
+    if (grid_slow (rc == -ETERM || rc == -EBADF)) {
+        errno = -rc;
+        return -1;
+    }
+    errnum_assert (rc == 0, -rc);
+    return 0;
+}
+
 int grid_device_mvmsg (struct grid_device_recipe *device,
     int from, int to, int flags)
 {
@@ -293,6 +402,11 @@ int grid_device_mvmsg (struct grid_device_recipe *device,
     struct grid_iovec iov;
     struct grid_msghdr hdr;
 
+    /*  Unless the recipe wants to inspect the messages, there's no need
+        to convert them to grid_msghdr. */
+    if (device->grid_device_rewritemsg == grid_device_rewritemsg)
+        return grid_device_mvmsg_direct (from, to, flags);
+
     iov.iov_base = &body;
     iov.iov_len = GRID_MSG;
     memset (&hdr, 0, sizeof (hdr));
@@ -326,3 +440,157 @@ int grid_device_rewritemsg (GRID_UNUSED struct grid_device_recipe *device,
     return 1; /* always forward */
 }
 
+
+/*  Maximum number of messages moved by a worker of the threaded device
+    in one go. */
+#define GRID_DEVICE_BATCH 64
+
+struct grid_device_worker {
+    int from;
+    int to;
+    int err;
+    struct grid_thread thread;
+};
+
+/*  Moves messages in a single direction. The worker blocks until a message
+    arrives, then drains whatever else is already queued in the socket,
+    up to GRID_DEVICE_BATCH messages, without blocking, and only afterwards
+    sends the whole batch. The sends block if the peer pushes back. The
+    messages are moved between the sockets inside the library. Each socket
+    is held only while it's being operated on, so that closing either of
+    them doesn't block on a worker waiting on the other one. */
+static void grid_device_worker_routine (void *arg)
+{
+    int rc;
+    int i;
+    int nmsgs;
+    struct grid_device_worker *self;
+    struct grid_sock *from;
+    struct grid_msg msgs [GRID_DEVICE_BATCH];
+
+    self = (struct grid_device_worker*) arg;
+
+    while (1) {
+
+        /*  The hold placed for the blocking receive is kept while draining
+            the socket, as none of the following receives blocks. */
+        rc = grid_global_hold_socket (&from, self->from);
+        if (grid_slow (rc < 0))
+            break;
+        for (nmsgs = 0; nmsgs != GRID_DEVICE_BATCH; ++nmsgs) {
+            rc = grid_device_recv (from, &msgs [nmsgs],
+                nmsgs ? GRID_DONTWAIT : 0);
+            if (rc < 0)
+                break;
+        }
+        grid_global_rele_socket (from);
+        if (rc == -EAGAIN || rc == -ETIMEDOUT)
+            rc = 0;
+        if (grid_slow (rc < 0)) {
+            for (i = 0; i != nmsgs; ++i)
+                grid_msg_term (&msgs [i]);
+            break;
+        }
+
+        /*  A message that times out is dropped. */
+        for (i = 0; i != nmsgs; ++i) {
+            rc = grid_device_send_s (self->to, &msgs [i], 0);
+            if (grid_slow (rc < 0 && rc != -ETIMEDOUT))
+                break;
+            rc = 0;
+        }
+        if (grid_slow (rc < 0)) {
+            for (++i; i < nmsgs; ++i)
+                grid_msg_term (&msgs [i]);
+            break;
+        }
+    }
+
+    self->err = -rc;
+}
+
+int grid_device_threaded (const int *s1, const int *s2, int npairs)
+{
+    int rc;
+    int i;
+    int op;
+    int nworkers;
+    size_t opsz;
+    grid_fd fds [4];
+    struct grid_device_recipe *device;
+    struct grid_device_worker *workers;
+
+    if (grid_slow (npairs <= 0 || !s1 || !s2)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    /*  Each pair needs up to two workers. */
+    workers = grid_alloc (sizeof (struct grid_device_worker) * npairs * 2,
+        "device workers");
+    alloc_assert (workers);
+
+    /*  Check all the socket pairs before starting any of the threads. */
+    device = &grid_ordinary_device;
+    nworkers = 0;
+    for (i = 0; i != npairs; ++i) {
+
+        if (s1 [i] < 0 && s2 [i] < 0) {
+            errno = EBADF;
+            goto fail;
+        }
+
+        /*  Loopback device. */
+        if (s1 [i] < 0 || s2 [i] < 0) {
+            workers [nworkers].from = s1 [i] < 0 ? s2 [i] : s1 [i];
+            opsz = sizeof (op);
+            rc = grid_getsockopt (workers [nworkers].from, GRID_SOL_SOCKET,
+                GRID_DOMAIN, &op, &opsz);
+            if (grid_slow (rc < 0))
+                goto fail;
+            if (op != AF_SP_RAW) {
+                errno = EINVAL;
+                goto fail;
+            }
+            workers [nworkers].to = workers [nworkers].from;
+            ++nworkers;
+            continue;
+        }
+
+        rc = grid_device_getfds (device, s1 [i], s2 [i], fds);
+        if (grid_slow (rc < 0))
+            goto fail;
+        if (fds [0] != -1 && fds [3] != -1) {
+            workers [nworkers].from = s1 [i];
+            workers [nworkers].to = s2 [i];
+            ++nworkers;
+        }
+        if (fds [2] != -1 && fds [1] != -1) {
+            workers [nworkers].from = s2 [i];
+            workers [nworkers].to = s1 [i];
+            ++nworkers;
+        }
+    }
+
+    for (i = 0; i != nworkers; ++i) {
+        workers [i].err = 0;
+        grid_thread_init (&workers [i].thread, grid_device_worker_routine,
+            &workers [i]);
+    }
+
+    /*  The workers exit once they fail, typically because the library is
+        being terminated. Report the first error encountered. */
+    op = 0;
+    for (i = 0; i != nworkers; ++i) {
+        grid_thread_term (&workers [i].thread);
+        if (!op)
+            op = workers [i].err;
+    }
+    grid_free (workers);
+    errno = op;
+    return -1;
+
+fail:
+    grid_free (workers);
+    return -1;
+}
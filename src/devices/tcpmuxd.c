@@ -0,0 +1,446 @@
+/*
+    Copyright (c) 2013-2014 Martin Sustrik  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#include "../grid.h"
+
+#include "../transports/tcpmux/tcpmux.h"
+
+#include "../utils/err.h"
+#include "../utils/fast.h"
+#include "../utils/alloc.h"
+#include "../utils/clock.h"
+#include "../utils/closefd.h"
+#include "../utils/thread.h"
+
+#include <ctype.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+
+#if defined GRID_HAVE_POLL
+#include <poll.h>
+#else
+#error
+#endif
+
+/*  tcpmuxd accepts TCP connections on behalf of the local applications bound
+    to 'tcpmux://' endpoints. Each client names a service as specified in
+    RFC 1078 and the accepted file descriptor is then passed to the process
+    that registered that service via the IPC socket, so that the daemon never
+    touches the actual data. */
+
+/*  Time allowed to a peer to send the service name, in milliseconds. */
+#define GRID_TCPMUXD_TIMEOUT 1000
+
+#define GRID_TCPMUXD_BACKLOG 100
+
+/*  TCP connection from a client that haven't sent the service name yet. */
+#define GRID_TCPMUXD_CLIENT 1
+
+/*  IPC connection from an application that haven't registered yet. */
+#define GRID_TCPMUXD_PENDING 2
+
+/*  IPC connection from an application with a registered service. */
+#define GRID_TCPMUXD_SERVICE 3
+
+#if defined MSG_NOSIGNAL
+#define GRID_TCPMUXD_SENDFLAGS MSG_NOSIGNAL
+#else
+#define GRID_TCPMUXD_SENDFLAGS 0
+#endif
+
+struct grid_tcpmuxd_conn {
+    int type;
+    int fd;
+    uint64_t deadline;
+    size_t namelen;
+
+    /*  Space for the longest name, the trailing CR and the terminator. */
+    char name [GRID_TCPMUX_MAXNAME + 2];
+};
+
+struct grid_tcpmuxd {
+    int tcp_listener;
+    int ipc_listener;
+    struct grid_tcpmuxd_conn *conns;
+    size_t nconns;
+    size_t capacity;
+    struct pollfd *pfds;
+    struct grid_thread thread;
+};
+
+static uint64_t grid_tcpmuxd_now (void)
+{
+    return grid_clock_ns () / 1000000;
+}
+
+static int grid_tcpmuxd_nonblock (int fd)
+{
+    int flags;
+
+    flags = fcntl (fd, F_GETFL, 0);
+    if (flags == -1)
+        flags = 0;
+    return fcntl (fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+static void grid_tcpmuxd_reply (int fd, const char *reply)
+{
+    /*  Best effort. If the peer is gone, it doesn't care anyway. */
+    (void) send (fd, reply, strlen (reply), GRID_TCPMUXD_SENDFLAGS);
+}
+
+static void grid_tcpmuxd_add (struct grid_tcpmuxd *self, int type, int fd)
+{
+    struct grid_tcpmuxd_conn *conn;
+
+    if (grid_slow (grid_tcpmuxd_nonblock (fd) != 0)) {
+        grid_closefd (fd);
+        return;
+    }
+
+    if (self->nconns == self->capacity) {
+        self->capacity = self->capacity ? self->capacity * 2 : 16;
+        self->conns = grid_realloc (self->conns,
+            self->capacity * sizeof (struct grid_tcpmuxd_conn));
+        alloc_assert (self->conns);
+        self->pfds = grid_realloc (self->pfds,
+            (self->capacity + 2) * sizeof (struct pollfd));
+        alloc_assert (self->pfds);
+    }
+
+    conn = &self->conns [self->nconns++];
+    conn->type = type;
+    conn->fd = fd;
+    conn->deadline = grid_tcpmuxd_now () + GRID_TCPMUXD_TIMEOUT;
+    conn->namelen = 0;
+}
+
+static void grid_tcpmuxd_close (struct grid_tcpmuxd_conn *conn)
+{
+    /*  The entry is removed from the array at the end of the iteration. */
+    grid_closefd (conn->fd);
+    conn->fd = -1;
+}
+
+static struct grid_tcpmuxd_conn *grid_tcpmuxd_find (struct grid_tcpmuxd *self,
+    const char *name)
+{
+    size_t i;
+
+    for (i = 0; i != self->nconns; ++i)
+        if (self->conns [i].type == GRID_TCPMUXD_SERVICE &&
+              self->conns [i].fd >= 0 &&
+              strcmp (self->conns [i].name, name) == 0)
+            return &self->conns [i];
+    return NULL;
+}
+
+/*  Passes file descriptor 'fd' to the service. Returns 0 on success. */
+static int grid_tcpmuxd_pass (struct grid_tcpmuxd_conn *service, int fd)
+{
+    struct msghdr hdr;
+    struct iovec iov;
+    char c;
+    char control [CMSG_SPACE (sizeof (int))];
+    struct cmsghdr *cmsg;
+
+    c = 0;
+    iov.iov_base = &c;
+    iov.iov_len = 1;
+    memset (&hdr, 0, sizeof (hdr));
+    hdr.msg_iov = &iov;
+    hdr.msg_iovlen = 1;
+    memset (control, 0, sizeof (control));
+    hdr.msg_control = control;
+    hdr.msg_controllen = sizeof (control);
+    cmsg = CMSG_FIRSTHDR (&hdr);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN (sizeof (int));
+    memcpy (CMSG_DATA (cmsg), &fd, sizeof (int));
+
+    return sendmsg (service->fd, &hdr, GRID_TCPMUXD_SENDFLAGS) == 1 ? 0 : -1;
+}
+
+static void grid_tcpmuxd_help (struct grid_tcpmuxd *self,
+    struct grid_tcpmuxd_conn *client)
+{
+    size_t i;
+
+    for (i = 0; i != self->nconns; ++i) {
+        if (self->conns [i].type != GRID_TCPMUXD_SERVICE ||
+              self->conns [i].fd < 0)
+            continue;
+        grid_tcpmuxd_reply (client->fd, self->conns [i].name);
+        grid_tcpmuxd_reply (client->fd, "\r\n");
+    }
+}
+
+/*  The peer has sent a complete service name. */
+static void grid_tcpmuxd_named (struct grid_tcpmuxd *self,
+    struct grid_tcpmuxd_conn *conn)
+{
+    struct grid_tcpmuxd_conn *service;
+
+    service = grid_tcpmuxd_find (self, conn->name);
+
+    /*  Registration of a new service. The application is sent a single
+        byte without a file descriptor, '+' if the service was registered or
+        '-' if the same service is already registered by someone else. */
+    if (conn->type == GRID_TCPMUXD_PENDING) {
+        if (grid_slow (service != NULL)) {
+            grid_tcpmuxd_reply (conn->fd, "-");
+            grid_tcpmuxd_close (conn);
+            return;
+        }
+        grid_tcpmuxd_reply (conn->fd, "+");
+        conn->type = GRID_TCPMUXD_SERVICE;
+        return;
+    }
+
+    /*  Request from a client. */
+    grid_assert (conn->type == GRID_TCPMUXD_CLIENT);
+    if (strcmp (conn->name, "help") == 0) {
+        grid_tcpmuxd_help (self, conn);
+    }
+    else if (grid_slow (!service)) {
+        grid_tcpmuxd_reply (conn->fd, "-Service not available\r\n");
+    }
+    else if (grid_slow (grid_tcpmuxd_pass (service, conn->fd) != 0)) {
+        grid_tcpmuxd_reply (conn->fd, "-Service not available\r\n");
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+            grid_tcpmuxd_close (service);
+    }
+
+    /*  The connection is owned by the service now, if any. */
+    grid_tcpmuxd_close (conn);
+}
+
+static void grid_tcpmuxd_in (struct grid_tcpmuxd *self,
+    struct grid_tcpmuxd_conn *conn)
+{
+    ssize_t nbytes;
+    char c;
+
+    /*  Registered services never send anything. Any input means that
+        the application went away. */
+    if (conn->type == GRID_TCPMUXD_SERVICE) {
+        nbytes = recv (conn->fd, &c, 1, 0);
+        if (nbytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK ||
+              errno == EINTR))
+            return;
+        grid_tcpmuxd_close (conn);
+        return;
+    }
+
+    /*  Read the service name byte by byte so that nothing that follows it
+        is consumed by the daemon. */
+    while (1) {
+        nbytes = recv (conn->fd, &c, 1, 0);
+        if (nbytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return;
+        if (nbytes < 0 && errno == EINTR)
+            continue;
+        if (grid_slow (nbytes <= 0)) {
+            grid_tcpmuxd_close (conn);
+            return;
+        }
+        if (c == '\n')
+            break;
+        if (grid_slow (conn->namelen == GRID_TCPMUX_MAXNAME + 1)) {
+            grid_tcpmuxd_close (conn);
+            return;
+        }
+
+        /*  Service names are case-insensitive. */
+        conn->name [conn->namelen++] = tolower ((unsigned char) c);
+    }
+    if (conn->namelen > 0 && conn->name [conn->namelen - 1] == '\r')
+        --conn->namelen;
+    conn->name [conn->namelen] = 0;
+    if (grid_slow (conn->namelen == 0 ||
+          conn->namelen > GRID_TCPMUX_MAXNAME)) {
+        grid_tcpmuxd_close (conn);
+        return;
+    }
+
+    grid_tcpmuxd_named (self, conn);
+}
+
+static void grid_tcpmuxd_routine (void *arg)
+{
+    struct grid_tcpmuxd *self;
+    size_t i;
+    size_t j;
+    int rc;
+    int fd;
+    int timeout;
+    uint64_t now;
+    uint64_t deadline;
+
+    self = (struct grid_tcpmuxd*) arg;
+
+    while (1) {
+
+        /*  Wait for new connections, service names or for the nearest
+            handshake to time out. */
+        self->pfds [0].fd = self->tcp_listener;
+        self->pfds [0].events = POLLIN;
+        self->pfds [1].fd = self->ipc_listener;
+        self->pfds [1].events = POLLIN;
+        deadline = 0;
+        for (i = 0; i != self->nconns; ++i) {
+            self->pfds [i + 2].fd = self->conns [i].fd;
+            self->pfds [i + 2].events = POLLIN;
+            self->pfds [i + 2].revents = 0;
+            if (self->conns [i].type != GRID_TCPMUXD_SERVICE &&
+                  (!deadline || self->conns [i].deadline < deadline))
+                deadline = self->conns [i].deadline;
+        }
+        now = grid_tcpmuxd_now ();
+        if (!deadline)
+            timeout = -1;
+        else
+            timeout = deadline > now ? (int) (deadline - now) : 0;
+        rc = poll (self->pfds, self->nconns + 2, timeout);
+        if (grid_slow (rc < 0 && errno == EINTR))
+            continue;
+        errno_assert (rc >= 0);
+
+        /*  Handle the existing connections first as adding new ones may
+            move the arrays. */
+        now = grid_tcpmuxd_now ();
+        for (i = 0; i != self->nconns; ++i) {
+            if (self->conns [i].fd < 0)
+                continue;
+            if (self->pfds [i + 2].revents & (POLLIN | POLLERR | POLLHUP))
+                grid_tcpmuxd_in (self, &self->conns [i]);
+            else if (self->conns [i].type != GRID_TCPMUXD_SERVICE &&
+                  self->conns [i].deadline <= now)
+                grid_tcpmuxd_close (&self->conns [i]);
+        }
+
+        /*  Remove the closed connections. */
+        for (i = 0, j = 0; i != self->nconns; ++i)
+            if (self->conns [i].fd >= 0)
+                self->conns [j++] = self->conns [i];
+        self->nconns = j;
+
+        /*  New TCP connection from a client. */
+        if (self->pfds [0].revents & POLLIN) {
+            fd = accept (self->tcp_listener, NULL, NULL);
+            if (fd >= 0)
+                grid_tcpmuxd_add (self, GRID_TCPMUXD_CLIENT, fd);
+        }
+
+        /*  New IPC connection from a local application. */
+        if (self->pfds [1].revents & POLLIN) {
+            fd = accept (self->ipc_listener, NULL, NULL);
+            if (fd >= 0)
+                grid_tcpmuxd_add (self, GRID_TCPMUXD_PENDING, fd);
+        }
+    }
+}
+
+int grid_tcpmuxd (int port)
+{
+    int rc;
+    int err;
+    int opt;
+    struct grid_tcpmuxd *self;
+    struct sockaddr_in in;
+    struct sockaddr_un un;
+
+    if (grid_slow (port <= 0 || port > 0xffff)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    self = grid_alloc (sizeof (struct grid_tcpmuxd), "tcpmuxd");
+    alloc_assert (self);
+    self->ipc_listener = -1;
+    self->conns = NULL;
+    self->nconns = 0;
+    self->capacity = 0;
+    self->pfds = grid_alloc (2 * sizeof (struct pollfd), "tcpmuxd pollset");
+    alloc_assert (self->pfds);
+
+    /*  Start listening on the TCP port. If there's another instance of
+        tcpmuxd running, this will fail. */
+    self->tcp_listener = socket (AF_INET, SOCK_STREAM, 0);
+    if (grid_slow (self->tcp_listener < 0))
+        goto error;
+    opt = 1;
+    rc = setsockopt (self->tcp_listener, SOL_SOCKET, SO_REUSEADDR, &opt,
+        sizeof (opt));
+    errno_assert (rc == 0);
+    memset (&in, 0, sizeof (in));
+    in.sin_family = AF_INET;
+    in.sin_port = htons (port);
+    in.sin_addr.s_addr = htonl (INADDR_ANY);
+    rc = bind (self->tcp_listener, (struct sockaddr*) &in, sizeof (in));
+    if (grid_slow (rc != 0))
+        goto error;
+    rc = listen (self->tcp_listener, GRID_TCPMUXD_BACKLOG);
+    if (grid_slow (rc != 0))
+        goto error;
+
+    /*  Start listening for the local applications. The IPC socket may be
+        a leftover from a previous instance of the daemon. */
+    self->ipc_listener = socket (AF_UNIX, SOCK_STREAM, 0);
+    if (grid_slow (self->ipc_listener < 0))
+        goto error;
+    memset (&un, 0, sizeof (un));
+    un.sun_family = AF_UNIX;
+    rc = snprintf (un.sun_path, sizeof (un.sun_path), GRID_TCPMUX_IPCPATH,
+        port);
+    grid_assert (rc > 0 && rc < (int) sizeof (un.sun_path));
+    unlink (un.sun_path);
+    rc = bind (self->ipc_listener, (struct sockaddr*) &un, sizeof (un));
+    if (grid_slow (rc != 0))
+        goto error;
+    rc = listen (self->ipc_listener, GRID_TCPMUXD_BACKLOG);
+    if (grid_slow (rc != 0))
+        goto error;
+
+    /*  The daemon runs in a background thread for the rest of the lifetime
+        of the process. */
+    grid_thread_init (&self->thread, grid_tcpmuxd_routine, self);
+
+    return 0;
+
+error:
+    err = errno;
+    if (self->ipc_listener >= 0)
+        grid_closefd (self->ipc_listener);
+    if (self->tcp_listener >= 0)
+        grid_closefd (self->tcp_listener);
+    grid_free (self->pfds);
+    grid_free (self);
+    errno = err;
+    return -1;
+}
@@ -31,6 +31,7 @@ extern "C" {
 
 #include <errno.h>
 #include <stddef.h>
+#include <stdint.h>
 
 /*  Handle DSO symbol visibility                                             */
 #if defined GRID_NO_EXPORTS
@@ -212,6 +213,7 @@ GRID_EXPORT const char *grid_symbol (int i, int *value);
 #define GRID_UNIT_MILLISECONDS 2
 #define GRID_UNIT_PRIORITY 3
 #define GRID_UNIT_BOOLEAN 4
+#define GRID_UNIT_MICROSECONDS 5
 
 /*  Structure that is returned from grid_symbol  */
 struct grid_symbol_properties {
@@ -330,6 +332,26 @@ GRID_EXPORT  struct grid_cmsghdr *grid_cmsg_nxthdr_ (
 #define GRID_IPV4ONLY 14
 #define GRID_SOCKET_NAME 15
 #define GRID_RCVMAXSIZE 16
+#define GRID_LATENCY_STATS 17
+#define GRID_SNDLATENCY 18
+#define GRID_QUEUELATENCY 19
+#define GRID_RTTLATENCY 20
+#define GRID_SNDTIMEO_US 21
+#define GRID_RCVTIMEO_US 22
+
+/*  Summary of a latency histogram as returned by GRID_SNDLATENCY,
+    GRID_QUEUELATENCY and GRID_RTTLATENCY options. All values except for
+    'count' are in microseconds.                                              */
+struct grid_latency {
+    uint64_t count;
+    uint64_t min;
+    uint64_t max;
+    uint64_t mean;
+    uint64_t p50;
+    uint64_t p90;
+    uint64_t p99;
+    uint64_t p999;
+};
 
 /*  Send/recv options.                                                        */
 #define GRID_DONTWAIT 1
@@ -367,11 +389,64 @@ struct grid_pollfd {
 
 GRID_EXPORT int grid_poll (struct grid_pollfd *fds, int nfds, int timeout);
 
+struct grid_pollset;
+
+GRID_EXPORT struct grid_pollset *grid_pollset_create (void);
+GRID_EXPORT int grid_pollset_destroy (struct grid_pollset *ps);
+GRID_EXPORT int grid_pollset_add (struct grid_pollset *ps, int s, int events);
+GRID_EXPORT int grid_pollset_rm (struct grid_pollset *ps, int s);
+GRID_EXPORT int grid_pollset_wait (struct grid_pollset *ps,
+    struct grid_pollfd *fds, int nfds, int timeout);
+
+/******************************************************************************/
+/*  Endpoint and connection statistics.                                       */
+/******************************************************************************/
+
+struct grid_ep_stats {
+    int eid;
+    int bind;
+    int pipes;
+    int last_errno;
+    uint64_t connections;
+    uint64_t reconnects;
+    uint64_t errors;
+    char addr [GRID_SOCKADDR_MAX + 1];
+};
+
+struct grid_pipe_stats {
+    int eid;
+    int id;
+    int sndqueue;
+    int rcvqueue;
+    uint64_t messages_sent;
+    uint64_t messages_received;
+    uint64_t bytes_sent;
+    uint64_t bytes_received;
+    uint64_t blocked;
+    struct grid_latency send_latency;
+};
+
+GRID_EXPORT int grid_ep_stats (int s, struct grid_ep_stats *eps, int count);
+GRID_EXPORT int grid_pipe_stats (int s, int eid, struct grid_pipe_stats *pipes,
+    int count);
+
+/*  Formats of the statistics snapshot. */
+#define GRID_STATS_JSON 1
+#define GRID_STATS_PROMETHEUS 2
+
+GRID_EXPORT int grid_stats_snapshot (int format, void *buf, size_t len);
+
+/*  Writes the state machine event trace into a file. Available only if the
+    library was built with --enable-trace.                                   */
+GRID_EXPORT int grid_trace_dump (const char *path);
+
 /******************************************************************************/
 /*  Built-in support for devices.                                             */
 /******************************************************************************/
 
 GRID_EXPORT int grid_device (int s1, int s2);
+GRID_EXPORT int grid_device_threaded (const int *s1, const int *s2,
+    int npairs);
 
 /******************************************************************************/
 /*  Built-in support for multiplexers.                                        */
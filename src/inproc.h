@@ -29,6 +29,8 @@ extern "C" {
 
 #define GRID_INPROC -1
 
+#define GRID_INPROC_ZEROCOPY 1
+
 #ifdef __cplusplus
 }
 #endif
@@ -156,6 +156,15 @@ void grid_sockbase_stat_increment (struct grid_sockbase *self, int name,
 
 #define GRID_STAT_CURRENT_SND_PRIORITY 401
 
+/*  Returns the current time if the socket collects latency statistics,
+    0 otherwise. Pass the value to grid_sockbase_stat_latency later on to
+    account for the elapsed time. */
+uint64_t grid_sockbase_stat_now (struct grid_sockbase *self);
+void grid_sockbase_stat_latency (struct grid_sockbase *self, int name,
+    uint64_t start);
+
+#define GRID_STAT_RTT_LATENCY 503
+
 /******************************************************************************/
 /*  The socktype class.                                                       */
 /******************************************************************************/
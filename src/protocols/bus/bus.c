@@ -109,7 +109,9 @@ static int grid_bus_recv (struct grid_sockbase *self, struct grid_msg *msg)
     if (grid_slow (rc == -EAGAIN))
         return -EAGAIN;
     errnum_assert (rc == 0, -rc);
-    grid_assert (grid_chunkref_size (&msg->sphdr) == sizeof (uint64_t));
+    grid_assert (grid_chunkref_size (&msg->sphdr) == sizeof (uint64_t) ||
+        grid_chunkref_size (&msg->sphdr) ==
+        sizeof (uint64_t) + GRID_XBUS_FWDHDR_SIZE);
 
     /*  Discard the header. */
     grid_chunkref_term (&msg->sphdr);
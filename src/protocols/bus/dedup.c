@@ -0,0 +1,144 @@
+/*
+    Copyright (c) 2013-2014 Martin Sustrik  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#include "dedup.h"
+
+#include "../../utils/err.h"
+#include "../../utils/alloc.h"
+#include "../../utils/fast.h"
+
+#include <string.h>
+
+static size_t grid_dedup_slot (struct grid_dedup *self, uint64_t id);
+static void grid_dedup_erase (struct grid_dedup *self, uint64_t id);
+
+void grid_dedup_init (struct grid_dedup *self, size_t capacity)
+{
+    grid_assert (capacity > 0);
+
+    self->capacity = capacity;
+    self->ring = NULL;
+    self->head = 0;
+    self->count = 0;
+    self->table = NULL;
+
+    /*  Keep the hash table at most half full so that probe sequences
+        stay short. */
+    self->bits = 1;
+    while (((size_t) 1 << self->bits) < capacity * 2)
+        ++self->bits;
+
+    self->hits = 0;
+}
+
+void grid_dedup_term (struct grid_dedup *self)
+{
+    if (self->table)
+        grid_free (self->table);
+    if (self->ring)
+        grid_free (self->ring);
+}
+
+int grid_dedup_check (struct grid_dedup *self, uint64_t id)
+{
+    size_t slot;
+    size_t tail;
+
+    grid_assert (id != 0);
+
+    /*  Allocate the memory lazily so that sockets that don't use
+        forwarding don't pay for it. */
+    if (grid_slow (!self->ring)) {
+        self->ring = grid_alloc (self->capacity * sizeof (uint64_t),
+            "dedup ring");
+        alloc_assert (self->ring);
+        self->table = grid_alloc (((size_t) 1 << self->bits) *
+            sizeof (uint64_t), "dedup table");
+        alloc_assert (self->table);
+        memset (self->table, 0, ((size_t) 1 << self->bits) *
+            sizeof (uint64_t));
+    }
+
+    slot = grid_dedup_slot (self, id);
+    if (self->table [slot] == id) {
+        ++self->hits;
+        return 1;
+    }
+
+    /*  If the cache is full, forget the oldest ID. The slot has to be looked
+        up anew afterwards as erasing may shift the entries around. */
+    if (self->count == self->capacity) {
+        grid_dedup_erase (self, self->ring [self->head]);
+        self->head = (self->head + 1) % self->capacity;
+        --self->count;
+        slot = grid_dedup_slot (self, id);
+    }
+
+    self->table [slot] = id;
+    tail = (self->head + self->count) % self->capacity;
+    self->ring [tail] = id;
+    ++self->count;
+
+    return 0;
+}
+
+/*  Returns the slot holding the ID or, if the ID is not present, the empty
+    slot where it should be inserted. */
+static size_t grid_dedup_slot (struct grid_dedup *self, uint64_t id)
+{
+    size_t mask;
+    size_t slot;
+
+    mask = ((size_t) 1 << self->bits) - 1;
+    slot = (size_t) ((id * 0x9e3779b97f4a7c15ULL) >> (64 - self->bits));
+    while (self->table [slot] != 0 && self->table [slot] != id)
+        slot = (slot + 1) & mask;
+    return slot;
+}
+
+static void grid_dedup_erase (struct grid_dedup *self, uint64_t id)
+{
+    size_t mask;
+    size_t i;
+    size_t j;
+    size_t home;
+
+    mask = ((size_t) 1 << self->bits) - 1;
+    i = grid_dedup_slot (self, id);
+    grid_assert (self->table [i] == id);
+
+    /*  Backward-shift deletion: move subsequent entries of the probe
+        sequence into the hole so that no tombstones are needed. */
+    j = i;
+    while (1) {
+        j = (j + 1) & mask;
+        if (self->table [j] == 0)
+            break;
+        home = (size_t) ((self->table [j] * 0x9e3779b97f4a7c15ULL) >>
+            (64 - self->bits));
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            self->table [i] = self->table [j];
+            i = j;
+        }
+    }
+    self->table [i] = 0;
+}
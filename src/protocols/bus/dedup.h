@@ -0,0 +1,61 @@
+/*
+    Copyright (c) 2013-2014 Martin Sustrik  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#ifndef GRID_DEDUP_INCLUDED
+#define GRID_DEDUP_INCLUDED
+
+#include "../../utils/int.h"
+
+#include <stddef.h>
+
+/*  Remembers IDs of the last 'capacity' messages seen by a forwarding bus
+    node. Old IDs are forgotten in FIFO order. Lookup and insertion are O(1).
+    ID 0 is reserved and must never be passed to the cache. */
+
+struct grid_dedup {
+
+    /*  Maximum number of IDs remembered. */
+    size_t capacity;
+
+    /*  FIFO of remembered IDs. 'head' points to the oldest one. */
+    uint64_t *ring;
+    size_t head;
+    size_t count;
+
+    /*  Open-addressing hash set of the IDs in the ring. Empty slots are
+        marked by zero. Number of slots is a power of two. */
+    uint64_t *table;
+    int bits;
+
+    /*  Number of duplicates detected so far. */
+    uint64_t hits;
+};
+
+/*  Initialises the cache. Memory is allocated on first use. */
+void grid_dedup_init (struct grid_dedup *self, size_t capacity);
+void grid_dedup_term (struct grid_dedup *self);
+
+/*  Returns 1 if the ID was seen recently. Otherwise, remembers it and
+    returns 0. */
+int grid_dedup_check (struct grid_dedup *self, uint64_t id);
+
+#endif
@@ -32,6 +32,8 @@
 #include "../../utils/list.h"
 #include "../../utils/int.h"
 #include "../../utils/attr.h"
+#include "../../utils/wire.h"
+#include "../../utils/random.h"
 
 #include <stddef.h>
 #include <string.h>
@@ -41,6 +43,17 @@
     neccessary for the pointer to fit in 64-bit ID. */
 CT_ASSERT (sizeof (uint64_t) >= sizeof (struct grid_pipe*));
 
+/*  Default hop count and size of the deduplication cache used in
+    forwarding mode. */
+#define GRID_XBUS_DEFAULT_TTL 16
+#define GRID_XBUS_MAX_TTL 255
+#define GRID_XBUS_DEFAULT_DEDUP 4096
+#define GRID_XBUS_MAX_DEDUP 1048576
+
+/*  Private functions. */
+static void grid_xbus_fwdhdr (struct grid_chunkref *hdr, uint32_t hops,
+    uint64_t id);
+
 /*  Implementation of grid_sockbase's virtual functions. */
 static void grid_xbus_destroy (struct grid_sockbase *self);
 static const struct grid_sockbase_vfptr grid_xbus_sockbase_vfptr = {
@@ -63,10 +76,20 @@ void grid_xbus_init (struct grid_xbus *self,
     grid_sockbase_init (&self->sockbase, vfptr, hint);
     grid_dist_init (&self->outpipes);
     grid_fq_init (&self->inpipes);
+    self->forward = 0;
+    self->ttl = GRID_XBUS_DEFAULT_TTL;
+    grid_dedup_init (&self->dedup, GRID_XBUS_DEFAULT_DEDUP);
+
+    /*  Node ID has to be non-zero so that message IDs are never zero. */
+    do {
+        grid_random_generate (&self->node, sizeof (self->node));
+    } while (self->node == 0);
+    self->seq = 0;
 }
 
 void grid_xbus_term (struct grid_xbus *self)
 {
+    grid_dedup_term (&self->dedup);
     grid_fq_term (&self->inpipes);
     grid_dist_term (&self->outpipes);
     grid_sockbase_term (&self->sockbase);
@@ -149,22 +172,61 @@ int grid_xbus_events (struct grid_sockbase *self)
 
 int grid_xbus_send (struct grid_sockbase *self, struct grid_msg *msg)
 {
+    struct grid_xbus *xbus;
     size_t hdrsz;
     struct grid_pipe *exclude;
+    uint8_t *hdr;
+    uint32_t hops;
+    uint64_t id;
+
+    xbus = grid_cont (self, struct grid_xbus, sockbase);
 
     hdrsz = grid_chunkref_size (&msg->sphdr);
+    hdr = grid_chunkref_data (&msg->sphdr);
     if (hdrsz == 0)
         exclude = NULL;
-    else if (hdrsz == sizeof (uint64_t)) {
-        memcpy (&exclude, grid_chunkref_data (&msg->sphdr), sizeof (exclude));
+    else if (hdrsz == sizeof (uint64_t) ||
+          (xbus->forward &&
+          hdrsz == sizeof (uint64_t) + GRID_XBUS_FWDHDR_SIZE))
+        memcpy (&exclude, hdr, sizeof (exclude));
+    else
+        return -EINVAL;
+
+    if (!xbus->forward) {
         grid_chunkref_term (&msg->sphdr);
         grid_chunkref_init (&msg->sphdr, 0);
+        return grid_dist_send (&xbus->outpipes, msg, exclude);
+    }
+
+    /*  Message passed back to a raw socket keeps its original ID so that
+        it is not delivered twice to any node. If this socket has already
+        seen the ID, it has forwarded the message when receiving it (this is
+        the case of a loopback device) and the message is dropped. */
+    if (hdrsz == sizeof (uint64_t) + GRID_XBUS_FWDHDR_SIZE) {
+        hops = grid_getl (hdr + sizeof (uint64_t));
+        id = grid_getll (hdr + sizeof (uint64_t) + sizeof (uint32_t));
+        if (grid_slow (id == 0))
+            return -EINVAL;
+        if (hops == 0 || grid_dedup_check (&xbus->dedup, id)) {
+            grid_msg_term (msg);
+            return 0;
+        }
+    }
+
+    /*  Otherwise, the message is originated by this node. Assign it a new ID
+        and remember the ID so that the message is dropped if it loops
+        back. */
+    else {
+        ++xbus->seq;
+        if (grid_slow (xbus->seq == 0))
+            ++xbus->seq;
+        hops = xbus->ttl;
+        id = (((uint64_t) xbus->node) << 32) | xbus->seq;
+        grid_dedup_check (&xbus->dedup, id);
     }
-    else
-        return -EINVAL;
 
-    return grid_dist_send (&grid_cont (self, struct grid_xbus, sockbase)->outpipes,
-        msg, exclude);
+    grid_xbus_fwdhdr (&msg->sphdr, hops, id);
+    return grid_dist_send (&xbus->outpipes, msg, exclude);
 }
 
 int grid_xbus_recv (struct grid_sockbase *self, struct grid_msg *msg)
@@ -172,8 +234,16 @@ int grid_xbus_recv (struct grid_sockbase *self, struct grid_msg *msg)
     int rc;
     struct grid_xbus *xbus;
     struct grid_pipe *pipe;
+    int forward;
+    uint32_t hops;
+    uint64_t id;
+    struct grid_msg fwd;
+    uint8_t *hdr;
 
     xbus = grid_cont (self, struct grid_xbus, sockbase);
+    forward = xbus->forward;
+    hops = 0;
+    id = 0;
 
     while (1) {
 
@@ -182,32 +252,153 @@ int grid_xbus_recv (struct grid_sockbase *self, struct grid_msg *msg)
         if (grid_slow (rc < 0))
             return rc;
 
-        /*  The message should have no header. Drop malformed messages. */
-        if (grid_chunkref_size (&msg->sphdr) == 0)
-            break;
-        grid_msg_term (msg);
+        if (!forward) {
+
+            /*  The message should have no header. Drop malformed messages. */
+            if (grid_chunkref_size (&msg->sphdr) == 0)
+                break;
+            grid_msg_term (msg);
+            continue;
+        }
+
+        /*  Split the forwarding header from the body, if needed. */
+        if (!(rc & GRID_PIPE_PARSED)) {
+            if (grid_slow (grid_chunkref_size (&msg->body) <
+                  GRID_XBUS_FWDHDR_SIZE)) {
+                grid_msg_term (msg);
+                continue;
+            }
+            grid_assert (grid_chunkref_size (&msg->sphdr) == 0);
+            grid_chunkref_term (&msg->sphdr);
+            grid_chunkref_init (&msg->sphdr, GRID_XBUS_FWDHDR_SIZE);
+            memcpy (grid_chunkref_data (&msg->sphdr),
+                grid_chunkref_data (&msg->body), GRID_XBUS_FWDHDR_SIZE);
+            grid_chunkref_trim (&msg->body, GRID_XBUS_FWDHDR_SIZE);
+        }
+        if (grid_slow (grid_chunkref_size (&msg->sphdr) !=
+              GRID_XBUS_FWDHDR_SIZE)) {
+            grid_msg_term (msg);
+            continue;
+        }
+        hdr = grid_chunkref_data (&msg->sphdr);
+        hops = grid_getl (hdr);
+        id = grid_getll (hdr + sizeof (uint32_t));
+
+        /*  Drop malformed messages and messages that were already seen. */
+        if (grid_slow (id == 0 || hops == 0) ||
+              grid_dedup_check (&xbus->dedup, id)) {
+            grid_msg_term (msg);
+            continue;
+        }
+
+        /*  Pass the message on to all the other peers. The body is shared
+            with the copies, only the header is rewritten. */
+        --hops;
+        if (hops > 0) {
+            grid_msg_cp (&fwd, msg);
+            grid_xbus_fwdhdr (&fwd.sphdr, hops, id);
+            rc = grid_dist_send (&xbus->outpipes, &fwd, pipe);
+            errnum_assert (rc == 0, -rc);
+        }
+        break;
     }
 
-    /*  Add pipe ID to the message header. */
-    grid_chunkref_term (&msg->sphdr);
-    grid_chunkref_init (&msg->sphdr, sizeof (uint64_t));
-    memset (grid_chunkref_data (&msg->sphdr), 0, sizeof (uint64_t));
-    memcpy (grid_chunkref_data (&msg->sphdr), &pipe, sizeof (pipe));
+    /*  Add pipe ID to the message header. In forwarding mode, it is followed
+        by the forwarding header. */
+    if (forward) {
+        grid_chunkref_term (&msg->sphdr);
+        grid_chunkref_init (&msg->sphdr,
+            sizeof (uint64_t) + GRID_XBUS_FWDHDR_SIZE);
+        hdr = grid_chunkref_data (&msg->sphdr);
+        grid_putl (hdr + sizeof (uint64_t), hops);
+        grid_putll (hdr + sizeof (uint64_t) + sizeof (uint32_t), id);
+    }
+    else {
+        grid_chunkref_term (&msg->sphdr);
+        grid_chunkref_init (&msg->sphdr, sizeof (uint64_t));
+        hdr = grid_chunkref_data (&msg->sphdr);
+    }
+    memset (hdr, 0, sizeof (uint64_t));
+    memcpy (hdr, &pipe, sizeof (pipe));
 
     return 0;
 }
 
-int grid_xbus_setopt (GRID_UNUSED struct grid_sockbase *self, GRID_UNUSED int level,
-    GRID_UNUSED int option,
-    GRID_UNUSED const void *optval, GRID_UNUSED size_t optvallen)
+int grid_xbus_setopt (struct grid_sockbase *self, int level, int option,
+    const void *optval, size_t optvallen)
 {
+    struct grid_xbus *xbus;
+
+    xbus = grid_cont (self, struct grid_xbus, sockbase);
+
+    if (level != GRID_BUS)
+        return -ENOPROTOOPT;
+
+    if (option == GRID_BUS_FORWARD) {
+        if (grid_slow (optvallen != sizeof (int)))
+            return -EINVAL;
+        xbus->forward = *(int*) optval ? 1 : 0;
+        return 0;
+    }
+
+    if (option == GRID_BUS_TTL) {
+        if (grid_slow (optvallen != sizeof (int)))
+            return -EINVAL;
+        if (grid_slow (*(int*) optval < 1 ||
+              *(int*) optval > GRID_XBUS_MAX_TTL))
+            return -EINVAL;
+        xbus->ttl = *(int*) optval;
+        return 0;
+    }
+
+    if (option == GRID_BUS_DEDUP) {
+        if (grid_slow (optvallen != sizeof (int)))
+            return -EINVAL;
+        if (grid_slow (*(int*) optval < 1 ||
+              *(int*) optval > GRID_XBUS_MAX_DEDUP))
+            return -EINVAL;
+        grid_dedup_term (&xbus->dedup);
+        grid_dedup_init (&xbus->dedup, *(int*) optval);
+        return 0;
+    }
+
     return -ENOPROTOOPT;
 }
 
-int grid_xbus_getopt (GRID_UNUSED struct grid_sockbase *self, GRID_UNUSED int level,
-    GRID_UNUSED int option,
-    GRID_UNUSED void *optval, GRID_UNUSED size_t *optvallen)
+int grid_xbus_getopt (struct grid_sockbase *self, int level, int option,
+    void *optval, size_t *optvallen)
 {
+    struct grid_xbus *xbus;
+
+    xbus = grid_cont (self, struct grid_xbus, sockbase);
+
+    if (level != GRID_BUS)
+        return -ENOPROTOOPT;
+
+    if (option == GRID_BUS_FORWARD) {
+        if (grid_slow (*optvallen < sizeof (int)))
+            return -EINVAL;
+        *(int*) optval = xbus->forward;
+        *optvallen = sizeof (int);
+        return 0;
+    }
+
+    if (option == GRID_BUS_TTL) {
+        if (grid_slow (*optvallen < sizeof (int)))
+            return -EINVAL;
+        *(int*) optval = xbus->ttl;
+        *optvallen = sizeof (int);
+        return 0;
+    }
+
+    if (option == GRID_BUS_DEDUP) {
+        if (grid_slow (*optvallen < sizeof (int)))
+            return -EINVAL;
+        *(int*) optval = (int) xbus->dedup.capacity;
+        *optvallen = sizeof (int);
+        return 0;
+    }
+
     return -ENOPROTOOPT;
 }
 
@@ -239,3 +430,14 @@ static struct grid_socktype grid_xbus_socktype_struct = {
 
 struct grid_socktype *grid_xbus_socktype = &grid_xbus_socktype_struct;
 
+static void grid_xbus_fwdhdr (struct grid_chunkref *hdr, uint32_t hops,
+    uint64_t id)
+{
+    uint8_t *data;
+
+    grid_chunkref_term (hdr);
+    grid_chunkref_init (hdr, GRID_XBUS_FWDHDR_SIZE);
+    data = grid_chunkref_data (hdr);
+    grid_putl (data, hops);
+    grid_putll (data + sizeof (uint32_t), id);
+}
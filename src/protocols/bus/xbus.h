@@ -28,6 +28,8 @@
 #include "../utils/dist.h"
 #include "../utils/fq.h"
 
+#include "dedup.h"
+
 extern struct grid_socktype *grid_xbus_socktype;
 
 struct grid_xbus_data {
@@ -35,10 +37,29 @@ struct grid_xbus_data {
     struct grid_fq_data initem;
 };
 
+/*  In forwarding mode each message carries a header consisting of 32-bit
+    hop count followed by 64-bit message ID. */
+#define GRID_XBUS_FWDHDR_SIZE 12
+
 struct grid_xbus {
     struct grid_sockbase sockbase;
     struct grid_dist outpipes;
     struct grid_fq inpipes;
+
+    /*  If set, messages are tagged with IDs and forwarded to the other
+        peers of the node, so that sparse topologies can be used. */
+    int forward;
+
+    /*  Hop count assigned to messages originated by this node. */
+    int ttl;
+
+    /*  IDs of messages recently seen by this node. */
+    struct grid_dedup dedup;
+
+    /*  Message IDs originated by this node consist of random node ID in
+        the upper half and a sequence number in the lower half. */
+    uint32_t node;
+    uint32_t seq;
 };
 
 void grid_xbus_init (struct grid_xbus *self,
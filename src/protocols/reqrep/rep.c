@@ -39,6 +39,9 @@
 
 #define GRID_REP_INPROGRESS 1
 
+/*  Default memory limit for the reply cache. */
+#define GRID_REP_DEFAULT_CACHE_MAXMEM (1024 * 1024)
+
 static const struct grid_sockbase_vfptr grid_rep_sockbase_vfptr = {
     NULL,
     grid_rep_destroy,
@@ -49,8 +52,8 @@ static const struct grid_sockbase_vfptr grid_rep_sockbase_vfptr = {
     grid_rep_events,
     grid_rep_send,
     grid_rep_recv,
-    grid_xrep_setopt,
-    grid_xrep_getopt
+    grid_rep_setopt,
+    grid_rep_getopt
 };
 
 void grid_rep_init (struct grid_rep *self,
@@ -58,12 +61,15 @@ void grid_rep_init (struct grid_rep *self,
 {
     grid_xrep_init (&self->xrep, vfptr, hint);
     self->flags = 0;
+    grid_replycache_init (&self->cache);
+    grid_replycache_setlimits (&self->cache, 0, GRID_REP_DEFAULT_CACHE_MAXMEM);
 }
 
 void grid_rep_term (struct grid_rep *self)
 {
     if (self->flags & GRID_REP_INPROGRESS)
         grid_chunkref_term (&self->backtrace);
+    grid_replycache_term (&self->cache);
     grid_xrep_term (&self->xrep);
 }
 
@@ -100,6 +106,10 @@ int grid_rep_send (struct grid_sockbase *self, struct grid_msg *msg)
     if (grid_slow (!(rep->flags & GRID_REP_INPROGRESS)))
         return -EFSM;
 
+    /*  Remember the reply in case the request is resent. */
+    if (rep->cache.maxitems)
+        grid_replycache_put (&rep->cache, &rep->backtrace, msg);
+
     /*  Move the stored backtrace into the message header. */
     grid_assert (grid_chunkref_size (&msg->sphdr) == 0);
     grid_chunkref_term (&msg->sphdr);
@@ -118,6 +128,7 @@ int grid_rep_recv (struct grid_sockbase *self, struct grid_msg *msg)
 {
     int rc;
     struct grid_rep *rep;
+    struct grid_msg reply;
 
     rep = grid_cont (self, struct grid_rep, xrep.sockbase);
 
@@ -127,11 +138,27 @@ int grid_rep_recv (struct grid_sockbase *self, struct grid_msg *msg)
         rep->flags &= ~GRID_REP_INPROGRESS;
     }
 
-    /*  Receive the request. */
-    rc = grid_xrep_recv (&rep->xrep.sockbase, msg);
-    if (grid_slow (rc == -EAGAIN))
-        return -EAGAIN;
-    errnum_assert (rc == 0, -rc);
+    while (1) {
+
+        /*  Receive the request. */
+        rc = grid_xrep_recv (&rep->xrep.sockbase, msg);
+        if (grid_slow (rc == -EAGAIN))
+            return -EAGAIN;
+        errnum_assert (rc == 0, -rc);
+
+        /*  If the request was already answered, resend the cached reply
+            instead of passing the request to the user. If the reply cannot
+            be sent because of pushback, drop it silently. */
+        if (!rep->cache.maxitems ||
+              !grid_replycache_get (&rep->cache, &msg->sphdr, &reply))
+            break;
+        grid_chunkref_term (&reply.sphdr);
+        grid_chunkref_mv (&reply.sphdr, &msg->sphdr);
+        grid_chunkref_init (&msg->sphdr, 0);
+        grid_msg_term (msg);
+        rc = grid_xrep_send (&rep->xrep.sockbase, &reply);
+        errnum_assert (rc == 0 || rc == -EAGAIN, -rc);
+    }
 
     /*  Store the backtrace. */
     grid_chunkref_mv (&rep->backtrace, &msg->sphdr);
@@ -141,6 +168,68 @@ int grid_rep_recv (struct grid_sockbase *self, struct grid_msg *msg)
     return 0;
 }
 
+int grid_rep_setopt (struct grid_sockbase *self, int level, int option,
+    const void *optval, size_t optvallen)
+{
+    struct grid_rep *rep;
+
+    rep = grid_cont (self, struct grid_rep, xrep.sockbase);
+
+    if (level != GRID_REP)
+        return grid_xrep_setopt (self, level, option, optval, optvallen);
+
+    if (option == GRID_REP_CACHE_SIZE) {
+        if (grid_slow (optvallen != sizeof (int)))
+            return -EINVAL;
+        if (grid_slow (*(int*) optval < 0))
+            return -EINVAL;
+        grid_replycache_setlimits (&rep->cache, *(int*) optval,
+            rep->cache.maxmem);
+        return 0;
+    }
+
+    if (option == GRID_REP_CACHE_MAXMEM) {
+        if (grid_slow (optvallen != sizeof (int)))
+            return -EINVAL;
+        if (grid_slow (*(int*) optval < 0))
+            return -EINVAL;
+        grid_replycache_setlimits (&rep->cache, rep->cache.maxitems,
+            *(int*) optval);
+        return 0;
+    }
+
+    return -ENOPROTOOPT;
+}
+
+int grid_rep_getopt (struct grid_sockbase *self, int level, int option,
+    void *optval, size_t *optvallen)
+{
+    struct grid_rep *rep;
+
+    rep = grid_cont (self, struct grid_rep, xrep.sockbase);
+
+    if (level != GRID_REP)
+        return grid_xrep_getopt (self, level, option, optval, optvallen);
+
+    if (option == GRID_REP_CACHE_SIZE) {
+        if (grid_slow (*optvallen < sizeof (int)))
+            return -EINVAL;
+        *(int*) optval = (int) rep->cache.maxitems;
+        *optvallen = sizeof (int);
+        return 0;
+    }
+
+    if (option == GRID_REP_CACHE_MAXMEM) {
+        if (grid_slow (*optvallen < sizeof (int)))
+            return -EINVAL;
+        *(int*) optval = (int) rep->cache.maxmem;
+        *optvallen = sizeof (int);
+        return 0;
+    }
+
+    return -ENOPROTOOPT;
+}
+
 static int grid_rep_create (void *hint, struct grid_sockbase **sockbase)
 {
     struct grid_rep *self;
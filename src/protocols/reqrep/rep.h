@@ -25,6 +25,7 @@
 
 #include "../../protocol.h"
 #include "xrep.h"
+#include "replycache.h"
 
 extern struct grid_socktype *grid_rep_socktype;
 
@@ -33,6 +34,10 @@ struct grid_rep {
     struct grid_xrep xrep;
     uint32_t flags;
     struct grid_chunkref backtrace;
+
+    /*  Replies sent recently. Resent requests are answered from here
+        without passing them to the user. */
+    struct grid_replycache cache;
 };
 
 /*  Some users may want to extend the REP protocol similar to how REP extends XREP.
@@ -46,5 +51,9 @@ void grid_rep_destroy (struct grid_sockbase *self);
 int grid_rep_events (struct grid_sockbase *self);
 int grid_rep_send (struct grid_sockbase *self, struct grid_msg *msg);
 int grid_rep_recv (struct grid_sockbase *self, struct grid_msg *msg);
+int grid_rep_setopt (struct grid_sockbase *self, int level, int option,
+    const void *optval, size_t optvallen);
+int grid_rep_getopt (struct grid_sockbase *self, int level, int option,
+    void *optval, size_t *optvallen);
 
 #endif
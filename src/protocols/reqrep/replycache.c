@@ -0,0 +1,187 @@
+/*
+    Copyright (c) 2013-2014 Martin Sustrik  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#include "replycache.h"
+
+#include "../../utils/err.h"
+#include "../../utils/cont.h"
+#include "../../utils/fast.h"
+#include "../../utils/alloc.h"
+
+#include <string.h>
+
+/*  Private functions. */
+static void grid_replycache_upstream (struct grid_chunkref *backtrace,
+    uint8_t **data, size_t *sz);
+static uint32_t grid_replycache_key (uint8_t *data, size_t sz);
+static void grid_replycache_evict (struct grid_replycache *self,
+    size_t maxitems, size_t maxmem);
+static void grid_replycache_erase (struct grid_replycache *self,
+    struct grid_replycache_item *item);
+
+void grid_replycache_init (struct grid_replycache *self)
+{
+    self->maxitems = 0;
+    self->maxmem = 0;
+    grid_hash_init (&self->items);
+    grid_list_init (&self->lru);
+    self->count = 0;
+    self->mem = 0;
+}
+
+void grid_replycache_term (struct grid_replycache *self)
+{
+    grid_replycache_evict (self, 0, 0);
+    grid_list_term (&self->lru);
+    grid_hash_term (&self->items);
+}
+
+void grid_replycache_setlimits (struct grid_replycache *self,
+    size_t maxitems, size_t maxmem)
+{
+    self->maxitems = maxitems;
+    self->maxmem = maxmem;
+    grid_replycache_evict (self, maxitems, maxmem);
+}
+
+int grid_replycache_get (struct grid_replycache *self,
+    struct grid_chunkref *backtrace, struct grid_msg *reply)
+{
+    struct grid_hash_item *hitem;
+    struct grid_replycache_item *item;
+    uint8_t *data;
+    size_t sz;
+
+    if (self->count == 0)
+        return 0;
+
+    grid_replycache_upstream (backtrace, &data, &sz);
+    hitem = grid_hash_get (&self->items, grid_replycache_key (data, sz));
+    if (!hitem)
+        return 0;
+    item = grid_cont (hitem, struct grid_replycache_item, hashitem);
+
+    /*  Different backtraces can have the same hash. */
+    if (grid_slow (grid_chunkref_size (&item->backtrace) != sz ||
+          memcmp (grid_chunkref_data (&item->backtrace), data, sz) != 0))
+        return 0;
+
+    /*  Mark the reply as the most recently used one. */
+    grid_list_erase (&self->lru, &item->lruitem);
+    grid_list_insert (&self->lru, &item->lruitem, grid_list_end (&self->lru));
+
+    grid_msg_cp (reply, &item->reply);
+    return 1;
+}
+
+void grid_replycache_put (struct grid_replycache *self,
+    struct grid_chunkref *backtrace, struct grid_msg *reply)
+{
+    uint32_t key;
+    struct grid_hash_item *hitem;
+    struct grid_replycache_item *item;
+    uint8_t *data;
+    size_t sz;
+    size_t size;
+
+    grid_replycache_upstream (backtrace, &data, &sz);
+    size = sizeof (struct grid_replycache_item) + sz +
+        grid_chunkref_size (&reply->hdrs) + grid_chunkref_size (&reply->body);
+    if (self->maxitems == 0 || size > self->maxmem)
+        return;
+
+    /*  Only one reply with a particular key can be stored. If there's one
+        already, replace it. */
+    key = grid_replycache_key (data, sz);
+    hitem = grid_hash_get (&self->items, key);
+    if (hitem)
+        grid_replycache_erase (self,
+            grid_cont (hitem, struct grid_replycache_item, hashitem));
+
+    /*  Make space for the new reply. */
+    grid_replycache_evict (self, self->maxitems - 1, self->maxmem - size);
+
+    item = grid_alloc (sizeof (struct grid_replycache_item), "cached reply");
+    alloc_assert (item);
+    grid_hash_item_init (&item->hashitem);
+    grid_list_item_init (&item->lruitem);
+    grid_chunkref_init (&item->backtrace, sz);
+    memcpy (grid_chunkref_data (&item->backtrace), data, sz);
+    grid_chunkref_init (&item->reply.sphdr, 0);
+    grid_chunkref_cp (&item->reply.hdrs, &reply->hdrs);
+    grid_chunkref_cp (&item->reply.body, &reply->body);
+    item->size = size;
+
+    grid_hash_insert (&self->items, key, &item->hashitem);
+    grid_list_insert (&self->lru, &item->lruitem, grid_list_end (&self->lru));
+    ++self->count;
+    self->mem += size;
+}
+
+/*  Evicts least recently used replies until the cache fits the limits. */
+static void grid_replycache_evict (struct grid_replycache *self,
+    size_t maxitems, size_t maxmem)
+{
+    while (self->count > maxitems || self->mem > maxmem)
+        grid_replycache_erase (self, grid_cont (grid_list_begin (&self->lru),
+            struct grid_replycache_item, lruitem));
+}
+
+static void grid_replycache_erase (struct grid_replycache *self,
+    struct grid_replycache_item *item)
+{
+    grid_hash_erase (&self->items, &item->hashitem);
+    grid_list_erase (&self->lru, &item->lruitem);
+    --self->count;
+    self->mem -= item->size;
+
+    grid_msg_term (&item->reply);
+    grid_chunkref_term (&item->backtrace);
+    grid_list_item_term (&item->lruitem);
+    grid_hash_item_term (&item->hashitem);
+    grid_free (item);
+}
+
+/*  The topmost element of the backtrace is the ID of the local pipe the
+    request arrived from. It changes when the peer reconnects and IDs of
+    closed pipes are reused, so the request is identified by the rest of the
+    backtrace only, i.e. the path upstream and the request ID. */
+static void grid_replycache_upstream (struct grid_chunkref *backtrace,
+    uint8_t **data, size_t *sz)
+{
+    grid_assert (grid_chunkref_size (backtrace) >= sizeof (uint32_t));
+    *data = ((uint8_t*) grid_chunkref_data (backtrace)) + sizeof (uint32_t);
+    *sz = grid_chunkref_size (backtrace) - sizeof (uint32_t);
+}
+
+/*  FNV-1a hash of the upstream part of the backtrace. */
+static uint32_t grid_replycache_key (uint8_t *data, size_t sz)
+{
+    uint32_t key;
+
+    key = 2166136261u;
+    while (sz--) {
+        key ^= *data++;
+        key *= 16777619u;
+    }
+    return key;
+}
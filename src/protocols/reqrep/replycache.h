@@ -0,0 +1,90 @@
+/*
+    Copyright (c) 2013-2014 Martin Sustrik  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#ifndef GRID_REPLYCACHE_INCLUDED
+#define GRID_REPLYCACHE_INCLUDED
+
+#include "../../utils/msg.h"
+#include "../../utils/hash.h"
+#include "../../utils/list.h"
+#include "../../utils/int.h"
+
+#include <stddef.h>
+
+/*  Cache of recently sent replies indexed by the backtrace of the request,
+    leaving out the ID of the local pipe the request arrived from. Thus, the
+    reply is found even if the request is resent via a new connection. When the number of cached replies or the memory used exceeds the limits,
+    least recently used replies are evicted. */
+
+struct grid_replycache_item {
+
+    /*  Item in the hash table. The key is a hash of the backtrace. */
+    struct grid_hash_item hashitem;
+
+    /*  Item in the LRU list. */
+    struct grid_list_item lruitem;
+
+    /*  Backtrace of the request without the local pipe ID and the reply
+        sent. */
+    struct grid_chunkref backtrace;
+    struct grid_msg reply;
+
+    /*  Memory accounted for this item. */
+    size_t size;
+};
+
+struct grid_replycache {
+
+    /*  Maximum number of replies cached. Zero means the cache is disabled. */
+    size_t maxitems;
+
+    /*  Maximum amount of memory, in bytes, used by the cached replies. */
+    size_t maxmem;
+
+    /*  Cached replies indexed by the backtrace hash. */
+    struct grid_hash items;
+
+    /*  Cached replies, least recently used one first. */
+    struct grid_list lru;
+
+    size_t count;
+    size_t mem;
+};
+
+void grid_replycache_init (struct grid_replycache *self);
+void grid_replycache_term (struct grid_replycache *self);
+
+/*  Changes the limits. Replies exceeding the new limits are evicted. */
+void grid_replycache_setlimits (struct grid_replycache *self,
+    size_t maxitems, size_t maxmem);
+
+/*  If there's a reply cached for the backtrace, copies it to 'reply'
+    (which must not be initialised) and returns 1. Otherwise returns 0. */
+int grid_replycache_get (struct grid_replycache *self,
+    struct grid_chunkref *backtrace, struct grid_msg *reply);
+
+/*  Stores a copy of the reply sent for the request with the backtrace
+    supplied. The message header of the reply is ignored. */
+void grid_replycache_put (struct grid_replycache *self,
+    struct grid_chunkref *backtrace, struct grid_msg *reply);
+
+#endif
@@ -38,11 +38,12 @@
 #include "../../utils/int.h"
 #include "../../utils/attr.h"
 
+#include <limits.h>
 #include <stddef.h>
 #include <string.h>
 
 /*  Default re-send interval is 1 minute. */
-#define GRID_REQ_DEFAULT_RESEND_IVL 60000
+#define GRID_REQ_DEFAULT_RESEND_IVL 60000000
 
 #define GRID_REQ_STATE_IDLE 1
 #define GRID_REQ_STATE_PASSIVE 2
@@ -86,6 +87,7 @@ void grid_req_init (struct grid_req *self,
     grid_fsm_init_root (&self->fsm, grid_req_handler, grid_req_shutdown,
         grid_sockbase_getctx (&self->xreq.sockbase));
     self->state = GRID_REQ_STATE_IDLE;
+    grid_fsm_trace_state (&self->fsm, &self->state);
 
     /*  Start assigning request IDs beginning with a random number. This way
         there should be no key clashes even if the executable is re-started. */
@@ -190,6 +192,10 @@ void grid_req_in (struct grid_sockbase *self, struct grid_pipe *pipe)
         grid_chunkref_term (&req->task.reply.sphdr);
         grid_chunkref_init (&req->task.reply.sphdr, 0);
 
+        grid_sockbase_stat_latency (&req->xreq.sockbase, GRID_STAT_RTT_LATENCY,
+            req->task.sent);
+        req->task.sent = 0;
+
         /*  TODO: Deallocate the request here? */
 
         /*  Notify the state machine. */
@@ -252,6 +258,7 @@ int grid_req_csend (struct grid_sockbase *self, struct grid_msg *msg)
     grid_chunkref_term (&msg->sphdr);
     grid_chunkref_init (&msg->sphdr, 4);
     grid_putl (grid_chunkref_data (&msg->sphdr), req->task.id | 0x80000000);
+    req->task.sent = grid_sockbase_stat_now (&req->xreq.sockbase);
 
     /*  Store the message so that it can be re-sent if there's no reply. */
     grid_msg_term (&req->task.request);
@@ -305,6 +312,13 @@ int grid_req_setopt (struct grid_sockbase *self, int level, int option,
         return -ENOPROTOOPT;
 
     if (option == GRID_REQ_RESEND_IVL) {
+        if (grid_slow (optvallen != sizeof (int)))
+            return -EINVAL;
+        req->resend_ivl = (int64_t) *(int*) optval * 1000;
+        return 0;
+    }
+
+    if (option == GRID_REQ_RESEND_IVL_US) {
         if (grid_slow (optvallen != sizeof (int)))
             return -EINVAL;
         req->resend_ivl = *(int*) optval;
@@ -327,7 +341,16 @@ int grid_req_getopt (struct grid_sockbase *self, int level, int option,
     if (option == GRID_REQ_RESEND_IVL) {
         if (grid_slow (*optvallen < sizeof (int)))
             return -EINVAL;
-        *(int*) optval = req->resend_ivl;
+        *(int*) optval = (int) ((req->resend_ivl + 999) / 1000);
+        *optvallen = sizeof (int);
+        return 0;
+    }
+
+    if (option == GRID_REQ_RESEND_IVL_US) {
+        if (grid_slow (*optvallen < sizeof (int)))
+            return -EINVAL;
+        *(int*) optval = req->resend_ivl > INT_MAX ?
+            INT_MAX : (int) req->resend_ivl;
         *optvallen = sizeof (int);
         return 0;
     }
@@ -641,7 +664,7 @@ void grid_req_action_send (struct grid_req *self, int allow_delay)
         in case the request gets lost somewhere further out
         in the topology. */
     if (grid_fast (rc == 0)) {
-        grid_timer_start (&self->task.timer, self->resend_ivl);
+        grid_timer_start_us (&self->task.timer, self->resend_ivl);
         grid_assert (to);
         self->task.sent_to = to;
         self->state = GRID_REQ_STATE_ACTIVE;
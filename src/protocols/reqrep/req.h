@@ -41,8 +41,9 @@ struct grid_req {
     /*  Last request ID assigned. */
     uint32_t lastid;
 
-    /*  Protocol-specific socket options. */
-    int resend_ivl;
+    /*  Protocol-specific socket options. Resend interval is stored
+        in microseconds. */
+    int64_t resend_ivl;
 
     /*  The request being processed. */
     struct grid_task task;
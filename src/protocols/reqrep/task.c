@@ -27,6 +27,7 @@ void grid_task_init (struct grid_task *self, uint32_t id, grid_req_handle hndl)
 {
     self->id = id;
     self->hndl = hndl;
+    self->sent = 0;
 }
 
 void grid_task_term (GRID_UNUSED struct grid_task *self)
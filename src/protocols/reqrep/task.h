@@ -51,6 +51,10 @@ struct grid_task {
     /*  Pipe the current request has been sent to. This is an optimisation so
         that request can be re-sent immediately if the pipe disappears.  */
     struct grid_pipe *sent_to;
+
+    /*  Time the request was submitted by the user, used to measure the
+        round-trip time. Zero if latency statistics are not collected. */
+    uint64_t sent;
 };
 
 void grid_task_init (struct grid_task *self, uint32_t id, grid_req_handle hndl);
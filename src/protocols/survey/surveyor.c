@@ -40,24 +40,41 @@
 #include "../../utils/int.h"
 #include "../../utils/attr.h"
 
+#include <limits.h>
 #include <string.h>
 
-#define GRID_SURVEYOR_DEFAULT_DEADLINE 1000
+#define GRID_SURVEYOR_DEFAULT_DEADLINE 1000000
+
+/*  Upper bound for GRID_SURVEYOR_MAXSURVEYS option. */
+#define GRID_SURVEYOR_MAX_SURVEYS 64
 
 #define GRID_SURVEYOR_STATE_IDLE 1
 #define GRID_SURVEYOR_STATE_PASSIVE 2
 #define GRID_SURVEYOR_STATE_ACTIVE 3
-#define GRID_SURVEYOR_STATE_CANCELLING 4
-#define GRID_SURVEYOR_STATE_STOPPING_TIMER 5
-#define GRID_SURVEYOR_STATE_STOPPING 6
+#define GRID_SURVEYOR_STATE_STOPPING_TIMER 4
+#define GRID_SURVEYOR_STATE_STOPPING 5
 
 #define GRID_SURVEYOR_ACTION_START 1
-#define GRID_SURVEYOR_ACTION_CANCEL 2
+#define GRID_SURVEYOR_ACTION_DONE 2
 
 #define GRID_SURVEYOR_SRC_DEADLINE_TIMER 1
 
 #define GRID_SURVEYOR_TIMEDOUT 1
 
+/*  A survey that is still collecting responses. */
+struct grid_surveyor_survey {
+
+    /*  ID the survey was tagged with. */
+    uint32_t id;
+
+    /*  Point in time (in microseconds, as returned by grid_clock_us) when
+        the survey expires. */
+    uint64_t deadline;
+
+    /*  Number of responses delivered to the user so far. */
+    int responses;
+};
+
 struct grid_surveyor {
 
     /*  The underlying raw SP socket. */
@@ -67,17 +84,25 @@ struct grid_surveyor {
     struct grid_fsm fsm;
     int state;
 
-    /*  Survey ID of the current survey. */
+    /*  Survey ID of the most recently started survey. */
     uint32_t surveyid;
 
-    /*  Timer for timing out the survey. */
+    /*  Surveys in progress, ordered from the oldest to the newest. */
+    struct grid_surveyor_survey surveys [GRID_SURVEYOR_MAX_SURVEYS];
+    int nsurveys;
+
+    /*  Single timer shared by all the surveys in progress. It is always
+        armed for the earliest deadline, which is stored in 'timer_deadline'. */
     struct grid_timer timer;
+    uint64_t timer_deadline;
 
     /*  When starting the survey, the message is temporarily stored here. */
     struct grid_msg tosend;
 
-    /*  Protocol-specific socket options. */
-    int deadline;
+    /*  Protocol-specific socket options. Deadline is stored in microseconds. */
+    int64_t deadline;
+    int maxsurveys;
+    int quorum;
 
     /*  Flag if surveyor has timed out */
     int timedout;
@@ -92,6 +117,10 @@ static void grid_surveyor_handler (struct grid_fsm *self, int src, int type,
 static void grid_surveyor_shutdown (struct grid_fsm *self, int src, int type,
     void *srcptr);
 static int grid_surveyor_inprogress (struct grid_surveyor *self);
+static int grid_surveyor_find (struct grid_surveyor *self, uint32_t surveyid);
+static void grid_surveyor_remove (struct grid_surveyor *self, int index);
+static void grid_surveyor_expire (struct grid_surveyor *self);
+static void grid_surveyor_arm (struct grid_surveyor *self);
 static void grid_surveyor_resend (struct grid_surveyor *self);
 
 /*  Implementation of grid_sockbase's virtual functions. */
@@ -125,14 +154,19 @@ static void grid_surveyor_init (struct grid_surveyor *self,
     grid_fsm_init_root (&self->fsm, grid_surveyor_handler, grid_surveyor_shutdown,
         grid_sockbase_getctx (&self->xsurveyor.sockbase));
     self->state = GRID_SURVEYOR_STATE_IDLE;
+    grid_fsm_trace_state (&self->fsm, &self->state);
 
     /*  Start assigning survey IDs beginning with a random number. This way
         there should be no key clashes even if the executable is re-started. */
     grid_random_generate (&self->surveyid, sizeof (self->surveyid));
 
+    self->nsurveys = 0;
     grid_timer_init (&self->timer, GRID_SURVEYOR_SRC_DEADLINE_TIMER, &self->fsm);
+    self->timer_deadline = 0;
     grid_msg_init (&self->tosend, 0);
     self->deadline = GRID_SURVEYOR_DEFAULT_DEADLINE;
+    self->maxsurveys = 1;
+    self->quorum = 0;
     self->timedout = 0;
 
     /*  Start the state machine. */
@@ -169,9 +203,27 @@ void grid_surveyor_destroy (struct grid_sockbase *self)
 static int grid_surveyor_inprogress (struct grid_surveyor *self)
 {
     /*  Return 1 if there's a survey going on. 0 otherwise. */
-    return self->state == GRID_SURVEYOR_STATE_IDLE ||
-        self->state == GRID_SURVEYOR_STATE_PASSIVE ||
-        self->state == GRID_SURVEYOR_STATE_STOPPING ? 0 : 1;
+    return self->nsurveys > 0 ? 1 : 0;
+}
+
+static int grid_surveyor_find (struct grid_surveyor *self, uint32_t surveyid)
+{
+    int i;
+
+    /*  Surveys are searched from the newest one as that's the one most
+        likely to be receiving responses. */
+    for (i = self->nsurveys - 1; i >= 0; --i)
+        if (self->surveys [i].id == surveyid)
+            return i;
+    return -1;
+}
+
+static void grid_surveyor_remove (struct grid_surveyor *self, int index)
+{
+    grid_assert (index >= 0 && index < self->nsurveys);
+    memmove (&self->surveys [index], &self->surveys [index + 1],
+        (self->nsurveys - index - 1) * sizeof (struct grid_surveyor_survey));
+    --self->nsurveys;
 }
 
 static int grid_surveyor_events (struct grid_sockbase *self)
@@ -195,9 +247,17 @@ static int grid_surveyor_events (struct grid_sockbase *self)
 static int grid_surveyor_send (struct grid_sockbase *self, struct grid_msg *msg)
 {
     struct grid_surveyor *surveyor;
+    struct grid_surveyor_survey *survey;
 
     surveyor = grid_cont (self, struct grid_surveyor, xsurveyor.sockbase);
 
+    /*  If there are surveys in progress, check whether the new survey can
+        be sent at all. */
+    if (grid_slow (grid_surveyor_inprogress (surveyor) &&
+          !(grid_xsurveyor_events (&surveyor->xsurveyor.sockbase) &
+          GRID_SOCKBASE_EVENT_OUT)))
+        return -EAGAIN;
+
     /*  Generate new survey ID. */
     ++surveyor->surveyid;
     surveyor->surveyid |= 0x80000000;
@@ -213,19 +273,19 @@ static int grid_surveyor_send (struct grid_sockbase *self, struct grid_msg *msg)
     grid_msg_mv (&surveyor->tosend, msg);
     grid_msg_init (msg, 0);
 
-    /*  Cancel any ongoing survey, if any. */
-    if (grid_slow (grid_surveyor_inprogress (surveyor))) {
+    /*  If the maximum number of concurrent surveys was reached, cancel
+        the oldest one. With the default limit of one survey this means that
+        the new survey cancels the current one. */
+    if (surveyor->nsurveys >= surveyor->maxsurveys)
+        grid_surveyor_remove (surveyor, 0);
 
-        /*  First check whether the survey can be sent at all. */
-        if (!(grid_xsurveyor_events (&surveyor->xsurveyor.sockbase) &
-              GRID_SOCKBASE_EVENT_OUT))
-            return -EAGAIN;
-
-        /*  Cancel the current survey. */
-        grid_fsm_action (&surveyor->fsm, GRID_SURVEYOR_ACTION_CANCEL);
-
-        return 0;
-    }
+    /*  Register the new survey. */
+    survey = &surveyor->surveys [surveyor->nsurveys];
+    survey->id = surveyor->surveyid;
+    survey->deadline = grid_clock_us () + surveyor->deadline;
+    survey->responses = 0;
+    ++surveyor->nsurveys;
+    surveyor->timedout = 0;
 
     /*  Notify the state machine that the survey was started. */
     grid_fsm_action (&surveyor->fsm, GRID_SURVEYOR_ACTION_START);
@@ -238,6 +298,7 @@ static int grid_surveyor_recv (struct grid_sockbase *self, struct grid_msg *msg)
     int rc;
     struct grid_surveyor *surveyor;
     uint32_t surveyid;
+    int index;
 
     surveyor = grid_cont (self, struct grid_surveyor, xsurveyor.sockbase);
 
@@ -260,18 +321,39 @@ static int grid_surveyor_recv (struct grid_sockbase *self, struct grid_msg *msg)
 
         /*  Get the survey ID. Ignore any stale responses. */
         /*  TODO: This should be done asynchronously! */
-        if (grid_slow (grid_chunkref_size (&msg->sphdr) != sizeof (uint32_t)))
+        if (grid_slow (grid_chunkref_size (&msg->sphdr) != sizeof (uint32_t))) {
+            grid_msg_term (msg);
             continue;
+        }
         surveyid = grid_getl (grid_chunkref_data (&msg->sphdr));
-        if (grid_slow (surveyid != surveyor->surveyid))
+        index = grid_surveyor_find (surveyor, surveyid);
+        if (grid_slow (index < 0)) {
+            grid_msg_term (msg);
             continue;
+        }
 
-        /*  Discard the header and return the message to the user. */
-        grid_chunkref_term (&msg->sphdr);
-        grid_chunkref_init (&msg->sphdr, 0);
+        /*  If there's a single survey going on, discard the header and
+            return the message to the user. With concurrent surveys the
+            header is left in place so that the user can find out which
+            survey the response belongs to. */
+        if (surveyor->maxsurveys == 1) {
+            grid_chunkref_term (&msg->sphdr);
+            grid_chunkref_init (&msg->sphdr, 0);
+        }
         break;
     }
 
+    /*  If the survey have got all the responses it needs, it is done.
+        There's no point in waiting for its deadline. */
+    ++surveyor->surveys [index].responses;
+    if (surveyor->quorum > 0 &&
+          surveyor->surveys [index].responses >= surveyor->quorum) {
+        grid_surveyor_remove (surveyor, index);
+        if (surveyor->nsurveys == 0)
+            surveyor->timedout = GRID_SURVEYOR_TIMEDOUT;
+        grid_fsm_action (&surveyor->fsm, GRID_SURVEYOR_ACTION_DONE);
+    }
+
     return 0;
 }
 
@@ -286,12 +368,42 @@ static int grid_surveyor_setopt (struct grid_sockbase *self, int level, int opti
         return -ENOPROTOOPT;
 
     if (option == GRID_SURVEYOR_DEADLINE) {
+        if (grid_slow (optvallen != sizeof (int)))
+            return -EINVAL;
+        surveyor->deadline = (int64_t) *(int*) optval * 1000;
+        return 0;
+    }
+
+    if (option == GRID_SURVEYOR_DEADLINE_US) {
         if (grid_slow (optvallen != sizeof (int)))
             return -EINVAL;
         surveyor->deadline = *(int*) optval;
         return 0;
     }
 
+    if (option == GRID_SURVEYOR_MAXSURVEYS) {
+        if (grid_slow (optvallen != sizeof (int)))
+            return -EINVAL;
+        if (grid_slow (*(int*) optval < 1 ||
+              *(int*) optval > GRID_SURVEYOR_MAX_SURVEYS))
+            return -EINVAL;
+        surveyor->maxsurveys = *(int*) optval;
+
+        /*  Cancel the oldest surveys that don't fit into the new limit. */
+        while (surveyor->nsurveys > surveyor->maxsurveys)
+            grid_surveyor_remove (surveyor, 0);
+        return 0;
+    }
+
+    if (option == GRID_SURVEYOR_QUORUM) {
+        if (grid_slow (optvallen != sizeof (int)))
+            return -EINVAL;
+        if (grid_slow (*(int*) optval < 0))
+            return -EINVAL;
+        surveyor->quorum = *(int*) optval;
+        return 0;
+    }
+
     return -ENOPROTOOPT;
 }
 
@@ -308,7 +420,40 @@ static int grid_surveyor_getopt (struct grid_sockbase *self, int level, int opti
     if (option == GRID_SURVEYOR_DEADLINE) {
         if (grid_slow (*optvallen < sizeof (int)))
             return -EINVAL;
-        *(int*) optval = surveyor->deadline;
+        *(int*) optval = (int) ((surveyor->deadline + 999) / 1000);
+        *optvallen = sizeof (int);
+        return 0;
+    }
+
+    if (option == GRID_SURVEYOR_DEADLINE_US) {
+        if (grid_slow (*optvallen < sizeof (int)))
+            return -EINVAL;
+        *(int*) optval = surveyor->deadline > INT_MAX ?
+            INT_MAX : (int) surveyor->deadline;
+        *optvallen = sizeof (int);
+        return 0;
+    }
+
+    if (option == GRID_SURVEYOR_MAXSURVEYS) {
+        if (grid_slow (*optvallen < sizeof (int)))
+            return -EINVAL;
+        *(int*) optval = surveyor->maxsurveys;
+        *optvallen = sizeof (int);
+        return 0;
+    }
+
+    if (option == GRID_SURVEYOR_QUORUM) {
+        if (grid_slow (*optvallen < sizeof (int)))
+            return -EINVAL;
+        *(int*) optval = surveyor->quorum;
+        *optvallen = sizeof (int);
+        return 0;
+    }
+
+    if (option == GRID_SURVEYOR_SURVEYID) {
+        if (grid_slow (*optvallen < sizeof (int)))
+            return -EINVAL;
+        *(int*) optval = (int) surveyor->surveyid;
         *optvallen = sizeof (int);
         return 0;
     }
@@ -379,8 +524,7 @@ static void grid_surveyor_handler (struct grid_fsm *self, int src, int type,
             switch (type) {
             case GRID_SURVEYOR_ACTION_START:
                 grid_surveyor_resend (surveyor);
-                grid_timer_start (&surveyor->timer, surveyor->deadline);
-                surveyor->state = GRID_SURVEYOR_STATE_ACTIVE;
+                grid_surveyor_arm (surveyor);
                 return;
 
             default:
@@ -393,16 +537,35 @@ static void grid_surveyor_handler (struct grid_fsm *self, int src, int type,
 
 /******************************************************************************/
 /*  ACTIVE state.                                                             */
-/*  Survey was sent, waiting for responses.                                   */
+/*  Surveys were sent, waiting for responses. The timer is running for the    */
+/*  earliest of the survey deadlines.                                         */
 /******************************************************************************/
     case GRID_SURVEYOR_STATE_ACTIVE:
         switch (src) {
 
         case GRID_FSM_ACTION:
             switch (type) {
-            case GRID_SURVEYOR_ACTION_CANCEL:
-                grid_timer_stop (&surveyor->timer);
-                surveyor->state = GRID_SURVEYOR_STATE_CANCELLING;
+            case GRID_SURVEYOR_ACTION_START:
+                grid_surveyor_resend (surveyor);
+
+                /*  If the new survey expires before the one the timer is
+                    running for, the timer has to be re-armed. Otherwise,
+                    the new survey will be taken care of once the timer
+                    fires. */
+                if (surveyor->surveys [surveyor->nsurveys - 1].deadline <
+                      surveyor->timer_deadline) {
+                    grid_timer_stop (&surveyor->timer);
+                    surveyor->state = GRID_SURVEYOR_STATE_STOPPING_TIMER;
+                }
+                return;
+            case GRID_SURVEYOR_ACTION_DONE:
+
+                /*  A survey have collected the quorum. If there are no more
+                    surveys in progress, the timer is not needed anymore. */
+                if (surveyor->nsurveys == 0) {
+                    grid_timer_stop (&surveyor->timer);
+                    surveyor->state = GRID_SURVEYOR_STATE_STOPPING_TIMER;
+                }
                 return;
             default:
                 grid_fsm_bad_action (surveyor->state, src, type);
@@ -413,38 +576,6 @@ static void grid_surveyor_handler (struct grid_fsm *self, int src, int type,
             case GRID_TIMER_TIMEOUT:
                 grid_timer_stop (&surveyor->timer);
                 surveyor->state = GRID_SURVEYOR_STATE_STOPPING_TIMER;
-                surveyor->timedout = GRID_SURVEYOR_TIMEDOUT;
-                return;
-            default:
-                grid_fsm_bad_action (surveyor->state, src, type);
-            }
-
-        default:
-            grid_fsm_bad_source (surveyor->state, src, type);
-        }
-
-/******************************************************************************/
-/*  CANCELLING state.                                                         */
-/*  Survey was cancelled, but the old timer haven't stopped yet. The new      */
-/*  survey thus haven't been sent and is stored in 'tosend'.                  */
-/******************************************************************************/
-    case GRID_SURVEYOR_STATE_CANCELLING:
-        switch (src) {
-
-        case GRID_FSM_ACTION:
-            switch (type) {
-            case GRID_SURVEYOR_ACTION_CANCEL:
-                return;
-            default:
-                grid_fsm_bad_action (surveyor->state, src, type);
-            }
-
-        case GRID_SURVEYOR_SRC_DEADLINE_TIMER:
-            switch (type) {
-            case GRID_TIMER_STOPPED:
-                grid_surveyor_resend (surveyor);
-                grid_timer_start (&surveyor->timer, surveyor->deadline);
-                surveyor->state = GRID_SURVEYOR_STATE_ACTIVE;
                 return;
             default:
                 grid_fsm_bad_action (surveyor->state, src, type);
@@ -456,15 +587,19 @@ static void grid_surveyor_handler (struct grid_fsm *self, int src, int type,
 
 /******************************************************************************/
 /*  STOPPING_TIMER state.                                                     */
-/*  Survey timeout expired. Now we are stopping the timer.                    */
+/*  Either a deadline expired or the timer has to be re-armed for an earlier  */
+/*  deadline. Now we are stopping the timer. New surveys are sent straight    */
+/*  away; their deadlines are accounted for once the timer is stopped.        */
 /******************************************************************************/
     case GRID_SURVEYOR_STATE_STOPPING_TIMER:
         switch (src) {
 
         case GRID_FSM_ACTION:
             switch (type) {
-            case GRID_SURVEYOR_ACTION_CANCEL:
-                surveyor->state = GRID_SURVEYOR_STATE_CANCELLING;
+            case GRID_SURVEYOR_ACTION_START:
+                grid_surveyor_resend (surveyor);
+                return;
+            case GRID_SURVEYOR_ACTION_DONE:
                 return;
             default:
                 grid_fsm_bad_action (surveyor->state, src, type);
@@ -473,7 +608,8 @@ static void grid_surveyor_handler (struct grid_fsm *self, int src, int type,
         case GRID_SURVEYOR_SRC_DEADLINE_TIMER:
             switch (type) {
             case GRID_TIMER_STOPPED:
-                surveyor->state = GRID_SURVEYOR_STATE_PASSIVE;
+                grid_surveyor_expire (surveyor);
+                grid_surveyor_arm (surveyor);
                 return;
             default:
                 grid_fsm_bad_action (surveyor->state, src, type);
@@ -491,6 +627,56 @@ static void grid_surveyor_handler (struct grid_fsm *self, int src, int type,
     }
 }
 
+/******************************************************************************/
+/*  State machine actions.                                                    */
+/******************************************************************************/
+
+static void grid_surveyor_expire (struct grid_surveyor *self)
+{
+    int i;
+    int expired;
+    uint64_t now;
+
+    /*  Drop all the surveys whose deadline have already passed. */
+    now = grid_clock_us ();
+    expired = 0;
+    i = 0;
+    while (i < self->nsurveys) {
+        if (self->surveys [i].deadline <= now) {
+            grid_surveyor_remove (self, i);
+            expired = 1;
+            continue;
+        }
+        ++i;
+    }
+
+    /*  If the last survey have expired, let the user know about it. */
+    if (expired && self->nsurveys == 0)
+        self->timedout = GRID_SURVEYOR_TIMEDOUT;
+}
+
+static void grid_surveyor_arm (struct grid_surveyor *self)
+{
+    int i;
+    uint64_t now;
+
+    /*  No survey is in progress. There's no need for the timer. */
+    if (self->nsurveys == 0) {
+        self->state = GRID_SURVEYOR_STATE_PASSIVE;
+        return;
+    }
+
+    /*  Run the timer for the earliest of the deadlines. */
+    self->timer_deadline = self->surveys [0].deadline;
+    for (i = 1; i < self->nsurveys; ++i)
+        if (self->surveys [i].deadline < self->timer_deadline)
+            self->timer_deadline = self->surveys [i].deadline;
+    now = grid_clock_us ();
+    grid_timer_start_us (&self->timer, self->timer_deadline > now ?
+        (int64_t) (self->timer_deadline - now) : 0);
+    self->state = GRID_SURVEYOR_STATE_ACTIVE;
+}
+
 static void grid_surveyor_resend (struct grid_surveyor *self)
 {
     int rc;
@@ -23,86 +23,133 @@
 #include "dist.h"
 
 #include "../../utils/err.h"
-#include "../../utils/cont.h"
 #include "../../utils/fast.h"
+#include "../../utils/alloc.h"
 #include "../../utils/attr.h"
 
 #include <stddef.h>
 
+/*  Initial size of the array of ready pipes. */
+#define GRID_DIST_INITIAL_CAPACITY 4
+
+/*  Private functions. */
+static void grid_dist_erase (struct grid_dist *self,
+    struct grid_dist_data *data);
+
 void grid_dist_init (struct grid_dist *self)
 {
     self->count = 0;
-    grid_list_init (&self->pipes);
+    self->capacity = GRID_DIST_INITIAL_CAPACITY;
+    self->pipes = grid_alloc (sizeof (struct grid_dist_data*) * self->capacity,
+        "distributor");
+    alloc_assert (self->pipes);
 }
 
 void grid_dist_term (struct grid_dist *self)
 {
     grid_assert (self->count == 0);
-    grid_list_term (&self->pipes);
+    grid_free (self->pipes);
 }
 
 void grid_dist_add (GRID_UNUSED struct grid_dist *self,
     struct grid_dist_data *data, struct grid_pipe *pipe)
 {
     data->pipe = pipe;
-    grid_list_item_init (&data->item);
+    data->index = -1;
 }
 
 void grid_dist_rm (struct grid_dist *self, struct grid_dist_data *data)
 {
-    if (grid_list_item_isinlist (&data->item)) {
-        --self->count;
-        grid_list_erase (&self->pipes, &data->item);
-    }
-    grid_list_item_term (&data->item);
+    if (data->index >= 0)
+        grid_dist_erase (self, data);
 }
 
 void grid_dist_out (struct grid_dist *self, struct grid_dist_data *data)
 {
+    grid_assert (data->index < 0);
+
+    /*  If the capacity is too low to accommodate the next item, resize it. */
+    if (grid_slow (self->count >= self->capacity)) {
+        self->capacity *= 2;
+        self->pipes = grid_realloc (self->pipes,
+            sizeof (struct grid_dist_data*) * self->capacity);
+        alloc_assert (self->pipes);
+    }
+
+    data->index = (int) self->count;
+    self->pipes [self->count] = data;
     ++self->count;
-    grid_list_insert (&self->pipes, &data->item, grid_list_end (&self->pipes));
 }
 
 int grid_dist_send (struct grid_dist *self, struct grid_msg *msg,
     struct grid_pipe *exclude)
 {
     int rc;
-    struct grid_list_item *it;
+    uint32_t i;
+    uint32_t copies;
     struct grid_dist_data *data;
     struct grid_msg copy;
 
-    /*  TODO: We can optimise for the case when there's only one outbound
-        pipe here. No message copying is needed in such case. */
+    /*  Find out how many pipes the message is going to be sent to. */
+    copies = self->count;
+    if (exclude) {
+        for (i = 0; i != self->count; ++i) {
+            if (self->pipes [i]->pipe == exclude) {
+                --copies;
+                break;
+            }
+        }
+    }
 
     /*  In the specific case when there are no outbound pipes. There's nowhere
         to send the message to. Deallocate it. */
-    if (grid_slow (self->count) == 0) {
+    if (grid_slow (copies == 0)) {
         grid_msg_term (msg);
         return 0;
     }
 
-    /*  Send the message to all the subscribers. */
-    grid_msg_bulkcopy_start (msg, self->count);
-    it = grid_list_begin (&self->pipes);
-    while (it != grid_list_end (&self->pipes)) {
-       data = grid_cont (it, struct grid_dist_data, item);
-       grid_msg_bulkcopy_cp (&copy, msg);
-       if (grid_fast (data->pipe == exclude)) {
-           grid_msg_term (&copy);
-       }
-       else {
-           rc = grid_pipe_send (data->pipe, &copy);
-           errnum_assert (rc >= 0, -rc);
-           if (rc & GRID_PIPE_RELEASE) {
-               --self->count;
-               it = grid_list_erase (&self->pipes, it);
-               continue;
-           }
-       }
-       it = grid_list_next (&self->pipes, it);
+    /*  All the pipes but the last one get a copy of the message. The chunk
+        reference counts are adjusted for all of them in a single step. The
+        last pipe gets the original message. Thus, if there's only one pipe
+        to send the message to, no reference counting is done at all. */
+    if (copies > 1)
+        grid_msg_bulkcopy_start (msg, copies - 1);
+
+    /*  Iterate backwards so that pipes removed from the array while
+        sending don't interfere with the iteration. */
+    i = self->count;
+    while (i != 0) {
+        --i;
+        data = self->pipes [i];
+        if (grid_slow (data->pipe == exclude))
+            continue;
+        --copies;
+        if (copies == 0) {
+            rc = grid_pipe_send (data->pipe, msg);
+        }
+        else {
+            grid_msg_bulkcopy_cp (&copy, msg);
+            rc = grid_pipe_send (data->pipe, &copy);
+        }
+        errnum_assert (rc >= 0, -rc);
+        if (rc & GRID_PIPE_RELEASE)
+            grid_dist_erase (self, data);
+        if (copies == 0)
+            break;
     }
-    grid_msg_term (msg);
 
     return 0;
 }
 
+static void grid_dist_erase (struct grid_dist *self,
+    struct grid_dist_data *data)
+{
+    struct grid_dist_data *last;
+
+    /*  Move the last item to the place of the removed one. */
+    --self->count;
+    last = self->pipes [self->count];
+    self->pipes [data->index] = last;
+    last->index = data->index;
+    data->index = -1;
+}
@@ -25,18 +25,25 @@
 
 #include "../../protocol.h"
 
-#include "../../utils/list.h"
+#include "../../utils/int.h"
 
 /*  Distributor. Sends messages to all the pipes. */
 
 struct grid_dist_data {
-    struct grid_list_item item;
+
+    /*  Position of the pipe in the array of ready pipes or -1 if the pipe
+        is not ready for sending at the moment. */
+    int index;
+
     struct grid_pipe *pipe;
 };
 
 struct grid_dist {
+
+    /*  Compact array of pipes that are ready for sending. */
+    struct grid_dist_data **pipes;
     uint32_t count;
-    struct grid_list pipes;
+    uint32_t capacity;
 };
 
 void grid_dist_init (struct grid_dist *self);
@@ -35,6 +35,10 @@ extern "C" {
 #define GRID_REP (GRID_PROTO_REQREP * 16 + 1)
 
 #define GRID_REQ_RESEND_IVL 1
+#define GRID_REQ_RESEND_IVL_US 2
+
+#define GRID_REP_CACHE_SIZE 1
+#define GRID_REP_CACHE_MAXMEM 2
 
 typedef union grid_req_handle {
     int i;
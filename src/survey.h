@@ -37,6 +37,10 @@ extern "C" {
 #define GRID_RESPONDENT (GRID_PROTO_SURVEY * 16 + 3)
 
 #define GRID_SURVEYOR_DEADLINE 1
+#define GRID_SURVEYOR_MAXSURVEYS 2
+#define GRID_SURVEYOR_SURVEYID 3
+#define GRID_SURVEYOR_QUORUM 4
+#define GRID_SURVEYOR_DEADLINE_US 5
 
 #ifdef __cplusplus
 }
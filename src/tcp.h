@@ -30,6 +30,10 @@ extern "C" {
 #define GRID_TCP -3
 
 #define GRID_TCP_NODELAY 1
+#define GRID_TCP_COMPRESS 2
+#define GRID_TCP_COMPRESS_THRESHOLD 3
+#define GRID_TCP_COMPRESS_DICT 4
+#define GRID_TCP_LISTENERS 5
 
 #ifdef __cplusplus
 }
@@ -38,6 +38,7 @@
 
 struct grid_sock;
 struct grid_cp;
+struct grid_histogram;
 
 /******************************************************************************/
 /*  Container for transport-specific socket options.                          */
@@ -130,6 +131,8 @@ void grid_epbase_stat_increment(struct grid_epbase *self, int name, int incremen
 #define GRID_STAT_INPROGRESS_CONNECTIONS  202
 #define GRID_STAT_CURRENT_EP_ERRORS       203
 
+#define GRID_STAT_QUEUE_LATENCY           502
+
 
 /******************************************************************************/
 /*  The base class for pipes.                                                 */
@@ -186,6 +189,25 @@ struct grid_pipebase {
     struct grid_fsm_event in;
     struct grid_fsm_event out;
     struct grid_ep_options options;
+    uint64_t sendstart;
+
+    /*  The endpoint the pipe belongs to and per-pipe statistics. */
+    struct grid_ep *ep;
+    struct grid_list_item item;
+    int id;
+    struct {
+        uint64_t messages_sent;
+        uint64_t messages_received;
+        uint64_t bytes_sent;
+        uint64_t bytes_received;
+        uint64_t blocked;
+        uint64_t blockstart;
+        int rcvqueue;
+
+        /*  Send latency of the pipe. Allocated when the first value is
+            recorded, i.e. only if the socket collects latency statistics. */
+        struct grid_histogram *latency;
+    } statistics;
 };
 
 /*  Initialise the pipe.  */
@@ -215,6 +237,24 @@ void grid_pipebase_getopt (struct grid_pipebase *self, int level, int option,
     or 0 otherwise. */
 int grid_pipebase_ispeer (struct grid_pipebase *self, int socktype);
 
+/*  Returns the current time if the socket collects latency statistics,
+    0 otherwise. Pass the value to grid_pipebase_stat_latency later on to
+    account for the elapsed time. */
+uint64_t grid_pipebase_stat_now (struct grid_pipebase *self);
+void grid_pipebase_stat_latency (struct grid_pipebase *self, int name,
+    uint64_t start);
+
+/*  Reports the number of messages buffered in the pipe's inbound queue. Only
+    transports that keep such a queue need to call this function. */
+void grid_pipebase_stat_rcvqueue (struct grid_pipebase *self, int depth);
+
+/*  Retrieves the statistics of the pipe. Used by the core. */
+void grid_pipebase_stats (struct grid_pipebase *self,
+    struct grid_pipe_stats *stats);
+
+/*  Drops the latency histogram of the pipe. Used by the core. */
+void grid_pipebase_latency_stop (struct grid_pipebase *self);
+
 /******************************************************************************/
 /*  The transport class.                                                      */
 /******************************************************************************/
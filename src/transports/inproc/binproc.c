@@ -66,6 +66,7 @@ int grid_binproc_create (void *hint, struct grid_epbase **epbase)
     grid_fsm_init_root (&self->fsm, grid_binproc_handler, grid_binproc_shutdown,
         grid_epbase_getctx (&self->item.epbase));
     self->state = GRID_BINPROC_STATE_IDLE;
+    grid_fsm_trace_state (&self->fsm, &self->state);
     grid_list_init (&self->sinprocs);
 
     /*  Start the state machine. */
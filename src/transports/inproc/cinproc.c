@@ -68,6 +68,7 @@ int grid_cinproc_create (void *hint, struct grid_epbase **epbase)
     grid_fsm_init_root (&self->fsm, grid_cinproc_handler, grid_cinproc_shutdown,
         grid_epbase_getctx (&self->item.epbase));
     self->state = GRID_CINPROC_STATE_IDLE;
+    grid_fsm_trace_state (&self->fsm, &self->state);
     grid_sinproc_init (&self->sinproc, GRID_CINPROC_SRC_SINPROC,
         &self->item.epbase, &self->fsm);
 
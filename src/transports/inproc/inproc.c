@@ -28,13 +28,36 @@
 
 #include "../../inproc.h"
 
+#include "../../utils/err.h"
+#include "../../utils/alloc.h"
+#include "../../utils/cont.h"
+#include "../../utils/fast.h"
+
 #include <string.h>
 
+/*  inproc-specific socket options. */
+struct grid_inproc_optset {
+    struct grid_optset base;
+    int zerocopy;
+};
+
+static void grid_inproc_optset_destroy (struct grid_optset *self);
+static int grid_inproc_optset_setopt (struct grid_optset *self, int option,
+    const void *optval, size_t optvallen);
+static int grid_inproc_optset_getopt (struct grid_optset *self, int option,
+    void *optval, size_t *optvallen);
+static const struct grid_optset_vfptr grid_inproc_optset_vfptr = {
+    grid_inproc_optset_destroy,
+    grid_inproc_optset_setopt,
+    grid_inproc_optset_getopt
+};
+
 /*  grid_transport interface. */
 static void grid_inproc_init (void);
 static void grid_inproc_term (void);
 static int grid_inproc_bind (void *hint, struct grid_epbase **epbase);
 static int grid_inproc_connect (void *hint, struct grid_epbase **epbase);
+static struct grid_optset *grid_inproc_optset (void);
 
 static struct grid_transport grid_inproc_vfptr = {
     "inproc",
@@ -43,7 +66,7 @@ static struct grid_transport grid_inproc_vfptr = {
     grid_inproc_term,
     grid_inproc_bind,
     grid_inproc_connect,
-    NULL,
+    grid_inproc_optset,
     GRID_LIST_ITEM_INITIALIZER
 };
 
@@ -69,3 +92,71 @@ static int grid_inproc_connect (void *hint, struct grid_epbase **epbase)
     return grid_cinproc_create (hint, epbase);
 }
 
+
+static struct grid_optset *grid_inproc_optset ()
+{
+    struct grid_inproc_optset *optset;
+
+    optset = grid_alloc (sizeof (struct grid_inproc_optset),
+        "optset (inproc)");
+    alloc_assert (optset);
+    optset->base.vfptr = &grid_inproc_optset_vfptr;
+
+    /*  Default values for inproc socket options. */
+    optset->zerocopy = 0;
+
+    return &optset->base;
+}
+
+static void grid_inproc_optset_destroy (struct grid_optset *self)
+{
+    struct grid_inproc_optset *optset;
+
+    optset = grid_cont (self, struct grid_inproc_optset, base);
+    grid_free (optset);
+}
+
+static int grid_inproc_optset_setopt (struct grid_optset *self, int option,
+    const void *optval, size_t optvallen)
+{
+    struct grid_inproc_optset *optset;
+    int val;
+
+    optset = grid_cont (self, struct grid_inproc_optset, base);
+
+    /*  At this point we assume that all options are of type int. */
+    if (optvallen != sizeof (int))
+        return -EINVAL;
+    val = *(int*) optval;
+
+    switch (option) {
+    case GRID_INPROC_ZEROCOPY:
+        if (grid_slow (val != 0 && val != 1))
+            return -EINVAL;
+        optset->zerocopy = val;
+        return 0;
+    default:
+        return -ENOPROTOOPT;
+    }
+}
+
+static int grid_inproc_optset_getopt (struct grid_optset *self, int option,
+    void *optval, size_t *optvallen)
+{
+    struct grid_inproc_optset *optset;
+    int intval;
+
+    optset = grid_cont (self, struct grid_inproc_optset, base);
+
+    switch (option) {
+    case GRID_INPROC_ZEROCOPY:
+        intval = optset->zerocopy;
+        break;
+    default:
+        return -ENOPROTOOPT;
+    }
+    memcpy (optval, &intval,
+        *optvallen < sizeof (int) ? *optvallen : sizeof (int));
+    *optvallen = sizeof (int);
+    return 0;
+}
@@ -55,7 +55,7 @@ void grid_msgqueue_term (struct grid_msgqueue *self)
 
     /*  Deallocate messages in the pipe. */
     while (1) {
-        rc = grid_msgqueue_recv (self, &msg);
+        rc = grid_msgqueue_recv (self, &msg, NULL);
         if (rc == -EAGAIN)
             break;
         errnum_assert (rc >= 0, -rc);
@@ -77,7 +77,8 @@ int grid_msgqueue_empty (struct grid_msgqueue *self)
     return self->count == 0 ? 1 : 0;
 }
 
-int grid_msgqueue_send (struct grid_msgqueue *self, struct grid_msg *msg)
+int grid_msgqueue_send (struct grid_msgqueue *self, struct grid_msg *msg,
+    uint64_t stamp)
 {
     size_t msgsz;
 
@@ -94,6 +95,7 @@ int grid_msgqueue_send (struct grid_msgqueue *self, struct grid_msg *msg)
 
     /*  Move the content of the message to the pipe. */
     grid_msg_mv (&self->out.chunk->msgs [self->out.pos], msg);
+    self->out.chunk->stamps [self->out.pos] = stamp;
     ++self->out.pos;
 
     /*  If there's no space for a new message in the pipe, either re-use
@@ -114,7 +116,8 @@ int grid_msgqueue_send (struct grid_msgqueue *self, struct grid_msg *msg)
     return 0;
 }
 
-int grid_msgqueue_recv (struct grid_msgqueue *self, struct grid_msg *msg)
+int grid_msgqueue_recv (struct grid_msgqueue *self, struct grid_msg *msg,
+    uint64_t *stamp)
 {
     struct grid_msgqueue_chunk *o;
 
@@ -124,6 +127,8 @@ int grid_msgqueue_recv (struct grid_msgqueue *self, struct grid_msg *msg)
 
     /*  Move the message from the pipe to the user. */
     grid_msg_mv (msg, &self->in.chunk->msgs [self->in.pos]);
+    if (stamp)
+        *stamp = self->in.chunk->stamps [self->in.pos];
 
     /*  Move to the next position. */
     ++self->in.pos;
@@ -34,6 +34,10 @@
 
 struct grid_msgqueue_chunk {
     struct grid_msg msgs [GRID_MSGQUEUE_GRANULARITY];
+
+    /*  Time each message was enqueued at, as passed to grid_msgqueue_send. */
+    uint64_t stamps [GRID_MSGQUEUE_GRANULARITY];
+
     struct grid_msgqueue_chunk *next;
 };
 
@@ -76,11 +80,15 @@ void grid_msgqueue_term (struct grid_msgqueue *self);
 int grid_msgqueue_empty (struct grid_msgqueue *self);
 
 /*  Writes a message to the pipe. -EAGAIN is returned if the message cannot
-    be sent because the queue is full. */
-int grid_msgqueue_send (struct grid_msgqueue *self, struct grid_msg *msg);
+    be sent because the queue is full. 'stamp' is an opaque value stored
+    alongside the message, typically the time of enqueueing. */
+int grid_msgqueue_send (struct grid_msgqueue *self, struct grid_msg *msg,
+    uint64_t stamp);
 
 /*  Reads a message from the pipe. -EAGAIN is returned if there's no message
-    to receive. */
-int grid_msgqueue_recv (struct grid_msgqueue *self, struct grid_msg *msg);
+    to receive. If 'stamp' is not NULL, the value passed to grid_msgqueue_send
+    along with the message is stored there. */
+int grid_msgqueue_recv (struct grid_msgqueue *self, struct grid_msg *msg,
+    uint64_t *stamp);
 
 #endif
@@ -23,6 +23,8 @@
 
 #include "sinproc.h"
 
+#include "../../inproc.h"
+
 #include "../../utils/err.h"
 #include "../../utils/cont.h"
 #include "../../utils/attr.h"
@@ -49,6 +51,10 @@
     to the peer yet. */
 #define GRID_SINPROC_FLAG_RECEIVING 2
 
+/*  Set when the peer is in zero-copy mode, i.e. the messages it sends keep
+    the SP header separate from the body. */
+#define GRID_SINPROC_FLAG_PARSED 4
+
 /*  Private functions. */
 static void grid_sinproc_handler (struct grid_fsm *self, int src, int type,
     void *srcptr);
@@ -71,6 +77,7 @@ void grid_sinproc_init (struct grid_sinproc *self, int src,
     grid_fsm_init (&self->fsm, grid_sinproc_handler, grid_sinproc_shutdown,
         src, self, owner);
     self->state = GRID_SINPROC_STATE_IDLE;
+    grid_fsm_trace_state (&self->fsm, &self->state);
     self->flags = 0;
     self->peer = NULL;
     grid_pipebase_init (&self->pipebase, &grid_sinproc_pipebase_vfptr, epbase);
@@ -78,6 +85,10 @@ void grid_sinproc_init (struct grid_sinproc *self, int src,
     grid_epbase_getopt (epbase, GRID_SOL_SOCKET, GRID_RCVBUF, &rcvbuf, &sz);
     grid_assert (sz == sizeof (rcvbuf));
     grid_msgqueue_init (&self->msgqueue, rcvbuf);
+    sz = sizeof (self->zerocopy);
+    grid_epbase_getopt (epbase, GRID_INPROC, GRID_INPROC_ZEROCOPY,
+        &self->zerocopy, &sz);
+    grid_assert (sz == sizeof (self->zerocopy));
     grid_msg_init (&self->msg, 0);
     grid_fsm_event_init (&self->event_connect);
     grid_fsm_event_init (&self->event_sent);
@@ -117,6 +128,8 @@ void grid_sinproc_accept (struct grid_sinproc *self, struct grid_sinproc *peer)
 {
     grid_assert (!self->peer);
     self->peer = peer;
+    if (peer->zerocopy)
+        self->flags |= GRID_SINPROC_FLAG_PARSED;
 
     /*  Start the connecting handshake with the peer. */
     grid_fsm_raiseto (&self->fsm, &peer->fsm, &self->event_connect,
@@ -150,17 +163,27 @@ static int grid_sinproc_send (struct grid_pipebase *self, struct grid_msg *msg)
     grid_assert_state (sinproc, GRID_SINPROC_STATE_ACTIVE);
     grid_assert (!(sinproc->flags & GRID_SINPROC_FLAG_SENDING));
 
-    grid_msg_init (&nmsg,
-        grid_chunkref_size (&msg->sphdr) +
-        grid_chunkref_size (&msg->body));
-    memcpy (grid_chunkref_data (&nmsg.body),
-        grid_chunkref_data (&msg->sphdr),
-        grid_chunkref_size (&msg->sphdr));
-    memcpy ((char *)grid_chunkref_data (&nmsg.body) +
-        grid_chunkref_size (&msg->sphdr),
-        grid_chunkref_data (&msg->body),
-        grid_chunkref_size (&msg->body));
-    grid_msg_term (msg);
+    /*  In zero-copy mode the chunks themselves are passed to the peer. The SP
+        header is kept apart so that the peer doesn't have to parse it out of
+        the body. Transport-level headers are not forwarded either way. */
+    if (sinproc->zerocopy) {
+        grid_chunkref_term (&msg->hdrs);
+        grid_chunkref_init (&msg->hdrs, 0);
+        grid_msg_mv (&nmsg, msg);
+    }
+    else {
+        grid_msg_init (&nmsg,
+            grid_chunkref_size (&msg->sphdr) +
+            grid_chunkref_size (&msg->body));
+        memcpy (grid_chunkref_data (&nmsg.body),
+            grid_chunkref_data (&msg->sphdr),
+            grid_chunkref_size (&msg->sphdr));
+        memcpy ((char *)grid_chunkref_data (&nmsg.body) +
+            grid_chunkref_size (&msg->sphdr),
+            grid_chunkref_data (&msg->body),
+            grid_chunkref_size (&msg->body));
+        grid_msg_term (msg);
+    }
 
     /*  Expose the message to the peer. */
     grid_msg_term (&sinproc->msg);
@@ -179,6 +202,7 @@ static int grid_sinproc_recv (struct grid_pipebase *self, struct grid_msg *msg)
 {
     int rc;
     struct grid_sinproc *sinproc;
+    uint64_t stamp;
 
     sinproc = grid_cont (self, struct grid_sinproc, pipebase);
 
@@ -187,17 +211,24 @@ static int grid_sinproc_recv (struct grid_pipebase *self, struct grid_msg *msg)
         sinproc->state == GRID_SINPROC_STATE_DISCONNECTED);
 
     /*  Move the message to the caller. */
-    rc = grid_msgqueue_recv (&sinproc->msgqueue, msg);
+    rc = grid_msgqueue_recv (&sinproc->msgqueue, msg, &stamp);
     errnum_assert (rc == 0, -rc);
+    grid_pipebase_stat_latency (&sinproc->pipebase, GRID_STAT_QUEUE_LATENCY,
+        stamp);
+    grid_pipebase_stat_rcvqueue (&sinproc->pipebase,
+        (int) sinproc->msgqueue.count);
 
     /*  If there was a message from peer lingering because of the exceeded
         buffer limit, try to enqueue it once again. */
     if (sinproc->state != GRID_SINPROC_STATE_DISCONNECTED) {
         if (grid_slow (sinproc->flags & GRID_SINPROC_FLAG_RECEIVING)) {
-            rc = grid_msgqueue_send (&sinproc->msgqueue, &sinproc->peer->msg);
+            rc = grid_msgqueue_send (&sinproc->msgqueue, &sinproc->peer->msg,
+                grid_pipebase_stat_now (&sinproc->pipebase));
             grid_assert (rc == 0 || rc == -EAGAIN);
             if (rc == 0) {
                 errnum_assert (rc == 0, -rc);
+                grid_pipebase_stat_rcvqueue (&sinproc->pipebase,
+                    (int) sinproc->msgqueue.count);
                 grid_msg_init (&sinproc->peer->msg, 0);
                 grid_fsm_raiseto (&sinproc->fsm, &sinproc->peer->fsm,
                     &sinproc->peer->event_received, GRID_SINPROC_SRC_PEER,
@@ -210,7 +241,8 @@ static int grid_sinproc_recv (struct grid_pipebase *self, struct grid_msg *msg)
     if (!grid_msgqueue_empty (&sinproc->msgqueue))
        grid_pipebase_received (&sinproc->pipebase);
 
-    return 0;
+    return sinproc->flags & GRID_SINPROC_FLAG_PARSED ?
+        GRID_PIPEBASE_PARSED : 0;
 }
 
 static void grid_sinproc_shutdown_events (struct grid_sinproc *self, int src,
@@ -356,6 +388,8 @@ static void grid_sinproc_handler (struct grid_fsm *self, int src, int type,
             switch (type) {
             case GRID_SINPROC_READY:
                 sinproc->peer = (struct grid_sinproc*) srcptr;
+                if (sinproc->peer->zerocopy)
+                    sinproc->flags |= GRID_SINPROC_FLAG_PARSED;
                 rc = grid_pipebase_start (&sinproc->pipebase);
                 errnum_assert (rc == 0, -rc);
                 sinproc->state = GRID_SINPROC_STATE_ACTIVE;
@@ -414,12 +448,15 @@ static void grid_sinproc_handler (struct grid_fsm *self, int src, int type,
 
                 /*  Push the message to the inbound message queue. */
                 rc = grid_msgqueue_send (&sinproc->msgqueue,
-                    &sinproc->peer->msg);
+                    &sinproc->peer->msg,
+                    grid_pipebase_stat_now (&sinproc->pipebase));
                 if (rc == -EAGAIN) {
                     sinproc->flags |= GRID_SINPROC_FLAG_RECEIVING;
                     return;
                 }
                 errnum_assert (rc == 0, -rc);
+                grid_pipebase_stat_rcvqueue (&sinproc->pipebase,
+                    (int) sinproc->msgqueue.count);
                 grid_msg_init (&sinproc->peer->msg, 0);
 
                 /*  Notify the user that there's a message to receive. */
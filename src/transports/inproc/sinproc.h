@@ -53,6 +53,10 @@ struct grid_sinproc {
     /*  Any combination of the flags defined in the .c file. */
     int flags;
 
+    /*  If set, outbound messages are handed over to the peer without being
+        copied. Taken from GRID_INPROC_ZEROCOPY when the session is created. */
+    int zerocopy;
+
     /*  Pointer to the peer inproc session, if connected. NULL otherwise. */
     struct grid_sinproc *peer;
 
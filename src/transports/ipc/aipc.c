@@ -51,6 +51,7 @@ void grid_aipc_init (struct grid_aipc *self, int src,
     grid_fsm_init (&self->fsm, grid_aipc_handler, grid_aipc_shutdown,
         src, self, owner);
     self->state = GRID_AIPC_STATE_IDLE;
+    grid_fsm_trace_state (&self->fsm, &self->state);
     self->epbase = epbase;
     grid_usock_init (&self->usock, GRID_AIPC_SRC_USOCK, &self->fsm);
     self->listener = NULL;
@@ -110,6 +110,7 @@ int grid_bipc_create (void *hint, struct grid_epbase **epbase)
     grid_fsm_init_root (&self->fsm, grid_bipc_handler, grid_bipc_shutdown,
         grid_epbase_getctx (&self->epbase));
     self->state = GRID_BIPC_STATE_IDLE;
+    grid_fsm_trace_state (&self->fsm, &self->state);
     sz = sizeof (reconnect_ivl);
     grid_epbase_getopt (&self->epbase, GRID_SOL_SOCKET, GRID_RECONNECT_IVL,
         &reconnect_ivl, &sz);
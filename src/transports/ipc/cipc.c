@@ -104,6 +104,7 @@ int grid_cipc_create (void *hint, struct grid_epbase **epbase)
     grid_fsm_init_root (&self->fsm, grid_cipc_handler, grid_cipc_shutdown,
         grid_epbase_getctx (&self->epbase));
     self->state = GRID_CIPC_STATE_IDLE;
+    grid_fsm_trace_state (&self->fsm, &self->state);
     grid_usock_init (&self->usock, GRID_CIPC_SRC_USOCK, &self->fsm);
     sz = sizeof (reconnect_ivl);
     grid_epbase_getopt (&self->epbase, GRID_SOL_SOCKET, GRID_RECONNECT_IVL,
@@ -75,6 +75,7 @@ void grid_sipc_init (struct grid_sipc *self, int src,
     grid_fsm_init (&self->fsm, grid_sipc_handler, grid_sipc_shutdown,
         src, self, owner);
     self->state = GRID_SIPC_STATE_IDLE;
+    grid_fsm_trace_state (&self->fsm, &self->state);
     grid_streamhdr_init (&self->streamhdr, GRID_SIPC_SRC_STREAMHDR, &self->fsm);
     self->usock = NULL;
     self->usock_owner.src = -1;
@@ -225,7 +226,7 @@ static void grid_sipc_handler (struct grid_fsm *self, int src, int type,
             switch (type) {
             case GRID_FSM_START:
                 grid_streamhdr_start (&sipc->streamhdr, sipc->usock,
-                    &sipc->pipebase);
+                    &sipc->pipebase, 0);
                 sipc->state = GRID_SIPC_STATE_PROTOHDR;
                 return;
             default:
@@ -22,6 +22,8 @@
 
 #include "atcp.h"
 
+#include "../../tcp.h"
+
 #include "../../utils/err.h"
 #include "../../utils/cont.h"
 #include "../../utils/attr.h"
@@ -51,12 +53,14 @@ void grid_atcp_init (struct grid_atcp *self, int src,
     grid_fsm_init (&self->fsm, grid_atcp_handler, grid_atcp_shutdown,
         src, self, owner);
     self->state = GRID_ATCP_STATE_IDLE;
+    grid_fsm_trace_state (&self->fsm, &self->state);
     self->epbase = epbase;
     grid_usock_init (&self->usock, GRID_ATCP_SRC_USOCK, &self->fsm);
     self->listener = NULL;
     self->listener_owner.src = -1;
     self->listener_owner.fsm = NULL;
-    grid_stcp_init (&self->stcp, GRID_ATCP_SRC_STCP, epbase, &self->fsm);
+    grid_stcp_init (&self->stcp, GRID_ATCP_SRC_STCP, epbase, GRID_TCP,
+        &self->fsm);
     grid_fsm_event_init (&self->accepted);
     grid_fsm_event_init (&self->done);
     grid_list_item_init (&self->item);
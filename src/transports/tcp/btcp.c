@@ -38,8 +38,11 @@
 #include "../../utils/fast.h"
 #include "../../utils/int.h"
 
+#include "../../tcp.h"
+
 #include <string.h>
 #include <unistd.h>
+#include <sys/socket.h>
 #include <netinet/in.h>
 
 /*  The backlog is set relatively high so that there are not too many failed
@@ -60,6 +63,15 @@
 #define GRID_BTCP_SRC_ATCP 2
 #define GRID_BTCP_SRC_RECONNECT_TIMER 3
 
+struct grid_btcp_listener {
+
+    /*  The underlying listening TCP socket. */
+    struct grid_usock usock;
+
+    /*  The connection being accepted at the moment. */
+    struct grid_atcp *atcp;
+};
+
 struct grid_btcp {
 
     /*  The state machine. */
@@ -70,11 +82,11 @@ struct grid_btcp {
         Thus it is derived from epbase. */
     struct grid_epbase epbase;
 
-    /*  The underlying listening TCP socket. */
-    struct grid_usock usock;
-
-    /*  The connection being accepted at the moment. */
-    struct grid_atcp *atcp;
+    /*  Listening sockets. If GRID_TCP_LISTENERS is greater than one, all of
+        them are bound to the same address with SO_REUSEPORT and the kernel
+        spreads the incoming connections among them. */
+    struct grid_btcp_listener *listeners;
+    int nlisteners;
 
     /*  List of accepted connections. */
     struct grid_list atcps;
@@ -97,7 +109,9 @@ static void grid_btcp_handler (struct grid_fsm *self, int src, int type,
 static void grid_btcp_shutdown (struct grid_fsm *self, int src, int type,
     void *srcptr);
 static void grid_btcp_start_listening (struct grid_btcp *self);
-static void grid_btcp_start_accepting (struct grid_btcp *self);
+static void grid_btcp_start_accepting (struct grid_btcp *self,
+    struct grid_btcp_listener *listener);
+static void grid_btcp_start_closing (struct grid_btcp *self);
 
 int grid_btcp_create (void *hint, struct grid_epbase **epbase)
 {
@@ -112,6 +126,8 @@ int grid_btcp_create (void *hint, struct grid_epbase **epbase)
     size_t ipv4onlylen;
     int reconnect_ivl;
     int reconnect_ivl_max;
+    int nlisteners;
+    int i;
     size_t sz;
 
     /*  Allocate the new endpoint object. */
@@ -153,6 +169,7 @@ int grid_btcp_create (void *hint, struct grid_epbase **epbase)
     grid_fsm_init_root (&self->fsm, grid_btcp_handler, grid_btcp_shutdown,
         grid_epbase_getctx (&self->epbase));
     self->state = GRID_BTCP_STATE_IDLE;
+    grid_fsm_trace_state (&self->fsm, &self->state);
     sz = sizeof (reconnect_ivl);
     grid_epbase_getopt (&self->epbase, GRID_SOL_SOCKET, GRID_RECONNECT_IVL,
         &reconnect_ivl, &sz);
@@ -165,8 +182,20 @@ int grid_btcp_create (void *hint, struct grid_epbase **epbase)
         reconnect_ivl_max = reconnect_ivl;
     grid_backoff_init (&self->retry, GRID_BTCP_SRC_RECONNECT_TIMER,
         reconnect_ivl, reconnect_ivl_max, &self->fsm);
-    grid_usock_init (&self->usock, GRID_BTCP_SRC_USOCK, &self->fsm);
-    self->atcp = NULL;
+    sz = sizeof (nlisteners);
+    grid_epbase_getopt (&self->epbase, GRID_TCP, GRID_TCP_LISTENERS,
+        &nlisteners, &sz);
+    grid_assert (sz == sizeof (nlisteners));
+    grid_assert (nlisteners >= 1 && nlisteners <= GRID_BTCP_MAXLISTENERS);
+    self->listeners = grid_alloc (nlisteners *
+        sizeof (struct grid_btcp_listener), "btcp listeners");
+    alloc_assert (self->listeners);
+    self->nlisteners = nlisteners;
+    for (i = 0; i != nlisteners; ++i) {
+        grid_usock_init (&self->listeners [i].usock, GRID_BTCP_SRC_USOCK,
+            &self->fsm);
+        self->listeners [i].atcp = NULL;
+    }
     grid_list_init (&self->atcps);
 
     /*  Start the state machine. */
@@ -190,13 +219,17 @@ static void grid_btcp_stop (struct grid_epbase *self)
 static void grid_btcp_destroy (struct grid_epbase *self)
 {
     struct grid_btcp *btcp;
+    int i;
 
     btcp = grid_cont (self, struct grid_btcp, epbase);
 
     grid_assert_state (btcp, GRID_BTCP_STATE_IDLE);
     grid_list_term (&btcp->atcps);
-    grid_assert (btcp->atcp == NULL);
-    grid_usock_term (&btcp->usock);
+    for (i = 0; i != btcp->nlisteners; ++i) {
+        grid_assert (btcp->listeners [i].atcp == NULL);
+        grid_usock_term (&btcp->listeners [i].usock);
+    }
+    grid_free (btcp->listeners);
     grid_backoff_term (&btcp->retry);
     grid_epbase_term (&btcp->epbase);
     grid_fsm_term (&btcp->fsm);
@@ -210,31 +243,45 @@ static void grid_btcp_shutdown (struct grid_fsm *self, int src, int type,
     struct grid_btcp *btcp;
     struct grid_list_item *it;
     struct grid_atcp *atcp;
+    int i;
 
     btcp = grid_cont (self, struct grid_btcp, fsm);
 
     if (grid_slow (src == GRID_FSM_ACTION && type == GRID_FSM_STOP)) {
         grid_backoff_stop (&btcp->retry);
-        if (btcp->atcp) {
-            grid_atcp_stop (btcp->atcp);
-            btcp->state = GRID_BTCP_STATE_STOPPING_ATCP;
-        }
-        else {
-            btcp->state = GRID_BTCP_STATE_STOPPING_USOCK;
-        }
+        btcp->state = GRID_BTCP_STATE_STOPPING_ATCP;
     }
     if (grid_slow (btcp->state == GRID_BTCP_STATE_STOPPING_ATCP)) {
-        if (!grid_atcp_isidle (btcp->atcp))
+
+        /*  The atcps waiting for new connections are stopped one by one.
+            Each of them is deallocated only after its stopped event was
+            delivered. */
+        for (i = 0; i != btcp->nlisteners; ++i) {
+            if (!btcp->listeners [i].atcp)
+                continue;
+            if (src == GRID_BTCP_SRC_ATCP && type == GRID_ATCP_STOPPED &&
+                  srcptr == btcp->listeners [i].atcp) {
+                grid_atcp_term (btcp->listeners [i].atcp);
+                grid_free (btcp->listeners [i].atcp);
+                btcp->listeners [i].atcp = NULL;
+                continue;
+            }
+            grid_atcp_stop (btcp->listeners [i].atcp);
             return;
-        grid_atcp_term (btcp->atcp);
-        grid_free (btcp->atcp);
-        btcp->atcp = NULL;
-        grid_usock_stop (&btcp->usock);
+        }
         btcp->state = GRID_BTCP_STATE_STOPPING_USOCK;
     }
     if (grid_slow (btcp->state == GRID_BTCP_STATE_STOPPING_USOCK)) {
-       if (!grid_usock_isidle (&btcp->usock) ||
-             !grid_backoff_isidle (&btcp->retry))
+
+        /*  Listening sockets are closed one by one so that there's exactly
+            one stopped event to wait for at any given time. */
+        for (i = 0; i != btcp->nlisteners; ++i) {
+            if (!grid_usock_isidle (&btcp->listeners [i].usock)) {
+                grid_usock_stop (&btcp->listeners [i].usock);
+                return;
+            }
+        }
+        if (!grid_backoff_isidle (&btcp->retry))
             return;
         for (it = grid_list_begin (&btcp->atcps);
               it != grid_list_end (&btcp->atcps);
@@ -273,6 +320,7 @@ static void grid_btcp_handler (struct grid_fsm *self, int src, int type,
 {
     struct grid_btcp *btcp;
     struct grid_atcp *atcp;
+    int i;
 
     btcp = grid_cont (self, struct grid_btcp, fsm);
 
@@ -302,18 +350,21 @@ static void grid_btcp_handler (struct grid_fsm *self, int src, int type,
 /*  The execution is yielded to the atcp state machine in this state.         */
 /******************************************************************************/
     case GRID_BTCP_STATE_ACTIVE:
-        if (srcptr == btcp->atcp) {
+        for (i = 0; i != btcp->nlisteners; ++i) {
+            if (srcptr != btcp->listeners [i].atcp)
+                continue;
             switch (type) {
             case GRID_ATCP_ACCEPTED:
 
                 /*  Move the newly created connection to the list of existing
                     connections. */
-                grid_list_insert (&btcp->atcps, &btcp->atcp->item,
+                grid_list_insert (&btcp->atcps,
+                    &btcp->listeners [i].atcp->item,
                     grid_list_end (&btcp->atcps));
-                btcp->atcp = NULL;
+                btcp->listeners [i].atcp = NULL;
 
                 /*  Start waiting for a new incoming connection. */
-                grid_btcp_start_accepting (btcp);
+                grid_btcp_start_accepting (btcp, &btcp->listeners [i]);
 
                 return;
 
@@ -351,8 +402,7 @@ static void grid_btcp_handler (struct grid_fsm *self, int src, int type,
             case GRID_USOCK_SHUTDOWN:
                 return;
             case GRID_USOCK_STOPPED:
-                grid_backoff_start (&btcp->retry);
-                btcp->state = GRID_BTCP_STATE_WAITING;
+                grid_btcp_start_closing (btcp);
                 return;
             default:
                 grid_fsm_bad_action (btcp->state, src, type);
@@ -427,6 +477,8 @@ static void grid_btcp_start_listening (struct grid_btcp *self)
     const char *end;
     const char *pos;
     uint16_t port;
+    int i;
+    int opt;
 
     /*  First, resolve the IP address. */
     addr = grid_epbase_getaddr (&self->epbase);
@@ -461,41 +513,78 @@ static void grid_btcp_start_listening (struct grid_btcp *self)
     else
         grid_assert (0);
 
-    /*  Start listening for incoming connections. */
-    rc = grid_usock_start (&self->usock, ss.ss_family, SOCK_STREAM, 0);
-    if (grid_slow (rc < 0)) {
-        grid_backoff_start (&self->retry);
-        self->state = GRID_BTCP_STATE_WAITING;
-        return;
-    }
+    for (i = 0; i != self->nlisteners; ++i) {
 
-    rc = grid_usock_bind (&self->usock, (struct sockaddr*) &ss, (size_t) sslen);
-    if (grid_slow (rc < 0)) {
-        grid_usock_stop (&self->usock);
-        self->state = GRID_BTCP_STATE_CLOSING;
-        return;
-    }
+        /*  Start listening for incoming connections. */
+        rc = grid_usock_start (&self->listeners [i].usock, ss.ss_family,
+            SOCK_STREAM, 0);
+        if (grid_slow (rc < 0)) {
+            grid_btcp_start_closing (self);
+            return;
+        }
 
-    rc = grid_usock_listen (&self->usock, GRID_BTCP_BACKLOG);
-    if (grid_slow (rc < 0)) {
-        grid_usock_stop (&self->usock);
-        self->state = GRID_BTCP_STATE_CLOSING;
-        return;
+        /*  Multiple listeners share the same address. */
+        if (self->nlisteners > 1) {
+#if defined SO_REUSEPORT
+            opt = 1;
+            rc = grid_usock_setsockopt (&self->listeners [i].usock,
+                SOL_SOCKET, SO_REUSEPORT, &opt, sizeof (opt));
+#else
+            rc = -ENOTSUP;
+#endif
+            if (grid_slow (rc < 0)) {
+                grid_btcp_start_closing (self);
+                return;
+            }
+        }
+
+        rc = grid_usock_bind (&self->listeners [i].usock,
+            (struct sockaddr*) &ss, (size_t) sslen);
+        if (grid_slow (rc < 0)) {
+            grid_btcp_start_closing (self);
+            return;
+        }
+
+        rc = grid_usock_listen (&self->listeners [i].usock, GRID_BTCP_BACKLOG);
+        if (grid_slow (rc < 0)) {
+            grid_btcp_start_closing (self);
+            return;
+        }
     }
-    grid_btcp_start_accepting(self);
+
+    for (i = 0; i != self->nlisteners; ++i)
+        grid_btcp_start_accepting (self, &self->listeners [i]);
     self->state = GRID_BTCP_STATE_ACTIVE;
 }
 
-static void grid_btcp_start_accepting (struct grid_btcp *self)
+static void grid_btcp_start_accepting (struct grid_btcp *self,
+    struct grid_btcp_listener *listener)
 {
-    grid_assert (self->atcp == NULL);
+    grid_assert (listener->atcp == NULL);
 
     /*  Allocate new atcp state machine. */
-    self->atcp = grid_alloc (sizeof (struct grid_atcp), "atcp");
-    alloc_assert (self->atcp);
-    grid_atcp_init (self->atcp, GRID_BTCP_SRC_ATCP, &self->epbase, &self->fsm);
+    listener->atcp = grid_alloc (sizeof (struct grid_atcp), "atcp");
+    alloc_assert (listener->atcp);
+    grid_atcp_init (listener->atcp, GRID_BTCP_SRC_ATCP, &self->epbase,
+        &self->fsm);
 
     /*  Start waiting for a new incoming connection. */
-    grid_atcp_start (self->atcp, &self->usock);
+    grid_atcp_start (listener->atcp, &listener->usock);
 }
 
+static void grid_btcp_start_closing (struct grid_btcp *self)
+{
+    int i;
+
+    /*  Close the listening sockets that were already opened, one at a time.
+        Once all of them are closed, wait before re-bind is attempted. */
+    for (i = 0; i != self->nlisteners; ++i) {
+        if (!grid_usock_isidle (&self->listeners [i].usock)) {
+            grid_usock_stop (&self->listeners [i].usock);
+            self->state = GRID_BTCP_STATE_CLOSING;
+            return;
+        }
+    }
+    grid_backoff_start (&self->retry);
+    self->state = GRID_BTCP_STATE_WAITING;
+}
@@ -27,6 +27,9 @@
 
 /*  State machine managing bound TCP socket. */
 
+/*  Maximum number of listening sockets per bound endpoint. */
+#define GRID_BTCP_MAXLISTENERS 64
+
 int grid_btcp_create (void *hint, struct grid_epbase **epbase);
 
 #endif
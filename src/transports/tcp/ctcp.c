@@ -178,6 +178,7 @@ int grid_ctcp_create (void *hint, struct grid_epbase **epbase)
     grid_fsm_init_root (&self->fsm, grid_ctcp_handler, grid_ctcp_shutdown,
         grid_epbase_getctx (&self->epbase));
     self->state = GRID_CTCP_STATE_IDLE;
+    grid_fsm_trace_state (&self->fsm, &self->state);
     grid_usock_init (&self->usock, GRID_CTCP_SRC_USOCK, &self->fsm);
     sz = sizeof (reconnect_ivl);
     grid_epbase_getopt (&self->epbase, GRID_SOL_SOCKET, GRID_RECONNECT_IVL,
@@ -191,7 +192,8 @@ int grid_ctcp_create (void *hint, struct grid_epbase **epbase)
         reconnect_ivl_max = reconnect_ivl;
     grid_backoff_init (&self->retry, GRID_CTCP_SRC_RECONNECT_TIMER,
         reconnect_ivl, reconnect_ivl_max, &self->fsm);
-    grid_stcp_init (&self->stcp, GRID_CTCP_SRC_STCP, &self->epbase, &self->fsm);
+    grid_stcp_init (&self->stcp, GRID_CTCP_SRC_STCP, &self->epbase, GRID_TCP,
+        &self->fsm);
     grid_dns_init (&self->dns, GRID_CTCP_SRC_DNS, &self->fsm);
 
     /*  Start the state machine. */
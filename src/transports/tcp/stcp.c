@@ -22,7 +22,10 @@
 
 #include "stcp.h"
 
+#include "../../tcp.h"
+
 #include "../../utils/err.h"
+#include "../../utils/alloc.h"
 #include "../../utils/cont.h"
 #include "../../utils/fast.h"
 #include "../../utils/wire.h"
@@ -47,6 +50,10 @@
 #define GRID_STCP_OUTSTATE_IDLE 1
 #define GRID_STCP_OUTSTATE_SENDING 2
 
+/*  The most significant bit of the size field marks a compressed message.
+    It's only ever set if both peers agreed on compression. */
+#define GRID_STCP_COMPRESSED 0x8000000000000000ULL
+
 /*  Subordinate srcptr objects. */
 #define GRID_STCP_SRC_USOCK 1
 #define GRID_STCP_SRC_STREAMHDR 2
@@ -64,13 +71,15 @@ static void grid_stcp_handler (struct grid_fsm *self, int src, int type,
     void *srcptr);
 static void grid_stcp_shutdown (struct grid_fsm *self, int src, int type,
     void *srcptr);
+static int grid_stcp_compress_start (struct grid_stcp *self);
 
 void grid_stcp_init (struct grid_stcp *self, int src,
-    struct grid_epbase *epbase, struct grid_fsm *owner)
+    struct grid_epbase *epbase, int optlevel, struct grid_fsm *owner)
 {
     grid_fsm_init (&self->fsm, grid_stcp_handler, grid_stcp_shutdown,
         src, self, owner);
     self->state = GRID_STCP_STATE_IDLE;
+    grid_fsm_trace_state (&self->fsm, &self->state);
     grid_streamhdr_init (&self->streamhdr, GRID_STCP_SRC_STREAMHDR, &self->fsm);
     self->usock = NULL;
     self->usock_owner.src = -1;
@@ -78,14 +87,19 @@ void grid_stcp_init (struct grid_stcp *self, int src,
     grid_pipebase_init (&self->pipebase, &grid_stcp_pipebase_vfptr, epbase);
     self->instate = -1;
     grid_msg_init (&self->inmsg, 0);
+    self->incompressed = 0;
     self->outstate = -1;
     grid_msg_init (&self->outmsg, 0);
+    self->optlevel = optlevel;
+    self->compress = NULL;
+    self->compress_threshold = 0;
     grid_fsm_event_init (&self->done);
 }
 
 void grid_stcp_term (struct grid_stcp *self)
 {
     grid_assert_state (self, GRID_STCP_STATE_IDLE);
+    grid_assert (!self->compress);
 
     grid_fsm_event_term (&self->done);
     grid_msg_term (&self->outmsg);
@@ -122,6 +136,8 @@ static int grid_stcp_send (struct grid_pipebase *self, struct grid_msg *msg)
 {
     struct grid_stcp *stcp;
     struct grid_iovec iov [3];
+    struct grid_chunkref body;
+    uint64_t size;
 
     stcp = grid_cont (self, struct grid_stcp, pipebase);
 
@@ -131,10 +147,21 @@ static int grid_stcp_send (struct grid_pipebase *self, struct grid_msg *msg)
     /*  Move the message to the local storage. */
     grid_msg_term (&stcp->outmsg);
     grid_msg_mv (&stcp->outmsg, msg);
+    size = grid_chunkref_size (&stcp->outmsg.sphdr) +
+        grid_chunkref_size (&stcp->outmsg.body);
+
+    /*  Large enough messages are compressed, SP header included. */
+    if (stcp->compress && size >= stcp->compress_threshold &&
+          size <= UINT32_MAX) {
+        grid_compress_deflate (stcp->compress, &stcp->outmsg, &body);
+        grid_chunkref_term (&stcp->outmsg.sphdr);
+        grid_chunkref_init (&stcp->outmsg.sphdr, 0);
+        grid_msg_replace_body (&stcp->outmsg, body);
+        size = grid_chunkref_size (&stcp->outmsg.body) | GRID_STCP_COMPRESSED;
+    }
 
     /*  Serialise the message header. */
-    grid_putll (stcp->outhdr, grid_chunkref_size (&stcp->outmsg.sphdr) +
-        grid_chunkref_size (&stcp->outmsg.body));
+    grid_putll (stcp->outhdr, size);
 
     /*  Start async sending. */
     iov [0].iov_base = stcp->outhdr;
@@ -184,6 +211,10 @@ static void grid_stcp_shutdown (struct grid_fsm *self, int src, int type,
     }
     if (grid_slow (stcp->state == GRID_STCP_STATE_STOPPING)) {
         if (grid_streamhdr_isidle (&stcp->streamhdr)) {
+            if (stcp->compress) {
+                grid_compress_destroy (stcp->compress);
+                stcp->compress = NULL;
+            }
             grid_usock_swap_owner (stcp->usock, &stcp->usock_owner);
             stcp->usock = NULL;
             stcp->usock_owner.src = -1;
@@ -198,6 +229,37 @@ static void grid_stcp_shutdown (struct grid_fsm *self, int src, int type,
     grid_fsm_bad_state(stcp->state, src, type);
 }
 
+static int grid_stcp_compress_start (struct grid_stcp *self)
+{
+    int rc;
+    int level;
+    int threshold;
+    void *dict;
+    size_t sz;
+    size_t dictlen;
+
+    sz = sizeof (level);
+    grid_pipebase_getopt (&self->pipebase, self->optlevel, GRID_TCP_COMPRESS,
+        &level, &sz);
+    grid_assert (sz == sizeof (level));
+    sz = sizeof (threshold);
+    grid_pipebase_getopt (&self->pipebase, self->optlevel,
+        GRID_TCP_COMPRESS_THRESHOLD, &threshold, &sz);
+    grid_assert (sz == sizeof (threshold));
+    self->compress_threshold = (size_t) threshold;
+
+    dict = grid_alloc (GRID_COMPRESS_MAXDICT, "compression dictionary (stcp)");
+    alloc_assert (dict);
+    dictlen = GRID_COMPRESS_MAXDICT;
+    grid_pipebase_getopt (&self->pipebase, self->optlevel,
+        GRID_TCP_COMPRESS_DICT, dict, &dictlen);
+    grid_assert (dictlen <= GRID_COMPRESS_MAXDICT);
+    rc = grid_compress_create (level, dict, dictlen, &self->compress);
+    grid_free (dict);
+
+    return rc;
+}
+
 static void grid_stcp_handler (struct grid_fsm *self, int src, int type,
     GRID_UNUSED void *srcptr)
 {
@@ -206,6 +268,7 @@ static void grid_stcp_handler (struct grid_fsm *self, int src, int type,
     uint64_t size;
     int opt;
     size_t opt_sz = sizeof (opt);
+    struct grid_chunkref body;
 
     stcp = grid_cont (self, struct grid_stcp, fsm);
 
@@ -220,8 +283,12 @@ static void grid_stcp_handler (struct grid_fsm *self, int src, int type,
         case GRID_FSM_ACTION:
             switch (type) {
             case GRID_FSM_START:
+                opt = 0;
+                if (stcp->optlevel)
+                    grid_pipebase_getopt (&stcp->pipebase, stcp->optlevel,
+                        GRID_TCP_COMPRESS, &opt, &opt_sz);
                 grid_streamhdr_start (&stcp->streamhdr, stcp->usock,
-                    &stcp->pipebase);
+                    &stcp->pipebase, opt ? GRID_STREAMHDR_FLAG_COMPRESS : 0);
                 stcp->state = GRID_STCP_STATE_PROTOHDR;
                 return;
             default:
@@ -274,6 +341,18 @@ static void grid_stcp_handler (struct grid_fsm *self, int src, int type,
             switch (type) {
             case GRID_STREAMHDR_STOPPED:
 
+                 /*  Set up compression if both peers asked for it. */
+                 if (grid_streamhdr_flags (&stcp->streamhdr) &
+                       GRID_STREAMHDR_FLAG_COMPRESS) {
+                    rc = grid_stcp_compress_start (stcp);
+                    if (grid_slow (rc < 0)) {
+                        stcp->state = GRID_STCP_STATE_DONE;
+                        grid_fsm_raise (&stcp->fsm, &stcp->done,
+                            GRID_STCP_ERROR);
+                        return;
+                    }
+                 }
+
                  /*  Start the pipe. */
                  rc = grid_pipebase_start (&stcp->pipebase);
                  if (grid_slow (rc < 0)) {
@@ -329,6 +408,20 @@ static void grid_stcp_handler (struct grid_fsm *self, int src, int type,
                         if it's too large, drop the connection. */
                     size = grid_getll (stcp->inhdr);
 
+                    /*  Compressed messages are accepted only if compression
+                        was negotiated. They are never empty. */
+                    stcp->incompressed = 0;
+                    if (size & GRID_STCP_COMPRESSED) {
+                        size &= ~GRID_STCP_COMPRESSED;
+                        if (grid_slow (!stcp->compress || !size)) {
+                            stcp->state = GRID_STCP_STATE_DONE;
+                            grid_fsm_raise (&stcp->fsm, &stcp->done,
+                                GRID_STCP_ERROR);
+                            return;
+                        }
+                        stcp->incompressed = 1;
+                    }
+
                     grid_pipebase_getopt (&stcp->pipebase, GRID_SOL_SOCKET,
                         GRID_RCVMAXSIZE, &opt, &opt_sz);
 
@@ -359,6 +452,22 @@ static void grid_stcp_handler (struct grid_fsm *self, int src, int type,
 
                 case GRID_STCP_INSTATE_BODY:
 
+                    /*  Decompress the message. The size limit applies to
+                        the original message. */
+                    if (stcp->incompressed) {
+                        grid_pipebase_getopt (&stcp->pipebase, GRID_SOL_SOCKET,
+                            GRID_RCVMAXSIZE, &opt, &opt_sz);
+                        rc = grid_compress_inflate (stcp->compress,
+                            &stcp->inmsg.body, opt, &body);
+                        if (grid_slow (rc < 0)) {
+                            stcp->state = GRID_STCP_STATE_DONE;
+                            grid_fsm_raise (&stcp->fsm, &stcp->done,
+                                GRID_STCP_ERROR);
+                            return;
+                        }
+                        grid_msg_replace_body (&stcp->inmsg, body);
+                    }
+
                     /*  Message body was received. Notify the owner that it
                         can receive it. */
                     stcp->instate = GRID_STCP_INSTATE_HASMSG;
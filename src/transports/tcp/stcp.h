@@ -29,6 +29,7 @@
 #include "../../aio/usock.h"
 
 #include "../utils/streamhdr.h"
+#include "../utils/compress.h"
 
 #include "../../utils/msg.h"
 
@@ -65,6 +66,9 @@ struct grid_stcp {
     /*  Message being received at the moment. */
     struct grid_msg inmsg;
 
+    /*  1 if the message being received is compressed, 0 otherwise. */
+    int incompressed;
+
     /*  State of the outbound state machine. */
     int outstate;
 
@@ -74,12 +78,26 @@ struct grid_stcp {
     /*  Message being sent at the moment. */
     struct grid_msg outmsg;
 
+    /*  Option level to read the compression settings from, i.e. GRID_TCP.
+        Zero if the transport doesn't support compression. */
+    int optlevel;
+
+    /*  Compression context. NULL if compression wasn't negotiated for
+        the connection. */
+    struct grid_compress *compress;
+
+    /*  Messages smaller than this are sent uncompressed. */
+    size_t compress_threshold;
+
     /*  Event raised when the state machine ends. */
     struct grid_fsm_event done;
 };
 
+/*  Compression settings are read from the GRID_TCP_COMPRESS,
+    GRID_TCP_COMPRESS_THRESHOLD and GRID_TCP_COMPRESS_DICT options at level
+    'optlevel'. Zero 'optlevel' switches compression off. */
 void grid_stcp_init (struct grid_stcp *self, int src,
-    struct grid_epbase *epbase, struct grid_fsm *owner);
+    struct grid_epbase *epbase, int optlevel, struct grid_fsm *owner);
 void grid_stcp_term (struct grid_stcp *self);
 
 int grid_stcp_isidle (struct grid_stcp *self);
@@ -29,6 +29,7 @@
 
 #include "../utils/port.h"
 #include "../utils/iface.h"
+#include "../utils/compress.h"
 
 #include "../../utils/err.h"
 #include "../../utils/alloc.h"
@@ -38,12 +39,18 @@
 
 #include <string.h>
 #include <unistd.h>
+#include <sys/socket.h>
 
 /*  TCP-specific socket options. */
 
 struct grid_tcp_optset {
     struct grid_optset base;
     int nodelay;
+    int compress;
+    int compress_threshold;
+    void *compress_dict;
+    size_t compress_dictlen;
+    int listeners;
 };
 
 static void grid_tcp_optset_destroy (struct grid_optset *self);
@@ -95,6 +102,11 @@ static struct grid_optset *grid_tcp_optset ()
 
     /*  Default values for TCP socket options. */
     optset->nodelay = 0;
+    optset->compress = 0;
+    optset->compress_threshold = 512;
+    optset->compress_dict = NULL;
+    optset->compress_dictlen = 0;
+    optset->listeners = 1;
 
     return &optset->base;   
 }
@@ -104,6 +116,8 @@ static void grid_tcp_optset_destroy (struct grid_optset *self)
     struct grid_tcp_optset *optset;
 
     optset = grid_cont (self, struct grid_tcp_optset, base);
+    if (optset->compress_dict)
+        grid_free (optset->compress_dict);
     grid_free (optset);
 }
 
@@ -115,7 +129,25 @@ static int grid_tcp_optset_setopt (struct grid_optset *self, int option,
 
     optset = grid_cont (self, struct grid_tcp_optset, base);
 
-    /*  At this point we assume that all options are of type int. */
+    /*  The compression dictionary is an arbitrary binary blob. */
+    if (option == GRID_TCP_COMPRESS_DICT) {
+        if (grid_slow (optvallen > GRID_COMPRESS_MAXDICT))
+            return -EINVAL;
+        if (optset->compress_dict)
+            grid_free (optset->compress_dict);
+        optset->compress_dict = NULL;
+        optset->compress_dictlen = 0;
+        if (optvallen > 0) {
+            optset->compress_dict = grid_alloc (optvallen,
+                "compression dictionary (tcp)");
+            alloc_assert (optset->compress_dict);
+            memcpy (optset->compress_dict, optval, optvallen);
+            optset->compress_dictlen = optvallen;
+        }
+        return 0;
+    }
+
+    /*  All the remaining options are of type int. */
     if (optvallen != sizeof (int))
         return -EINVAL;
     val = *(int*) optval;
@@ -126,6 +158,27 @@ static int grid_tcp_optset_setopt (struct grid_optset *self, int option,
             return -EINVAL;
         optset->nodelay = val;
         return 0;
+    case GRID_TCP_COMPRESS:
+        if (grid_slow (val < 0 || val > 9))
+            return -EINVAL;
+        if (grid_slow (val > 0 && !grid_compress_supported ()))
+            return -ENOTSUP;
+        optset->compress = val;
+        return 0;
+    case GRID_TCP_COMPRESS_THRESHOLD:
+        if (grid_slow (val < 0))
+            return -EINVAL;
+        optset->compress_threshold = val;
+        return 0;
+    case GRID_TCP_LISTENERS:
+        if (grid_slow (val < 1 || val > GRID_BTCP_MAXLISTENERS))
+            return -EINVAL;
+#if !defined SO_REUSEPORT
+        if (grid_slow (val > 1))
+            return -ENOTSUP;
+#endif
+        optset->listeners = val;
+        return 0;
     default:
         return -ENOPROTOOPT;
     }
@@ -143,6 +196,22 @@ static int grid_tcp_optset_getopt (struct grid_optset *self, int option,
     case GRID_TCP_NODELAY:
         intval = optset->nodelay;
         break;
+    case GRID_TCP_COMPRESS:
+        intval = optset->compress;
+        break;
+    case GRID_TCP_COMPRESS_THRESHOLD:
+        intval = optset->compress_threshold;
+        break;
+    case GRID_TCP_LISTENERS:
+        intval = optset->listeners;
+        break;
+    case GRID_TCP_COMPRESS_DICT:
+        if (optset->compress_dictlen)
+            memcpy (optval, optset->compress_dict,
+                *optvallen < optset->compress_dictlen ?
+                *optvallen : optset->compress_dictlen);
+        *optvallen = optset->compress_dictlen;
+        return 0;
     default:
         return -ENOPROTOOPT;
     }
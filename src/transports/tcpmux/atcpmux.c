@@ -0,0 +1,303 @@
+/*
+    Copyright (c) 2013-2014 Martin Sustrik  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#include "atcpmux.h"
+
+#include "../../tcpmux.h"
+
+#include "../../utils/err.h"
+#include "../../utils/cont.h"
+#include "../../utils/attr.h"
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#define GRID_ATCPMUX_STATE_IDLE 1
+#define GRID_ATCPMUX_STATE_SENDING_TCPMUXHDR 2
+#define GRID_ATCPMUX_STATE_ACTIVE 3
+#define GRID_ATCPMUX_STATE_STOPPING_STCP 4
+#define GRID_ATCPMUX_STATE_STOPPING_USOCK 5
+#define GRID_ATCPMUX_STATE_DONE 6
+#define GRID_ATCPMUX_STATE_STOPPING_STCP_FINAL 7
+#define GRID_ATCPMUX_STATE_STOPPING 8
+
+#define GRID_ATCPMUX_SRC_USOCK 1
+#define GRID_ATCPMUX_SRC_STCP 2
+
+/*  Positive reply to the TCPMUX request as defined in RFC 1078. */
+static const char grid_atcpmux_ok [] = "+\r\n";
+
+/*  Private functions. */
+static void grid_atcpmux_handler (struct grid_fsm *self, int src, int type,
+    void *srcptr);
+static void grid_atcpmux_shutdown (struct grid_fsm *self, int src, int type,
+    void *srcptr);
+
+void grid_atcpmux_init (struct grid_atcpmux *self, int src,
+    struct grid_epbase *epbase, struct grid_fsm *owner)
+{
+    grid_fsm_init (&self->fsm, grid_atcpmux_handler, grid_atcpmux_shutdown,
+        src, self, owner);
+    self->state = GRID_ATCPMUX_STATE_IDLE;
+    grid_fsm_trace_state (&self->fsm, &self->state);
+    self->epbase = epbase;
+    grid_usock_init (&self->usock, GRID_ATCPMUX_SRC_USOCK, &self->fsm);
+    self->fd = -1;
+    grid_stcp_init (&self->stcp, GRID_ATCPMUX_SRC_STCP, epbase, 0,
+        &self->fsm);
+    grid_fsm_event_init (&self->done);
+    grid_list_item_init (&self->item);
+}
+
+void grid_atcpmux_term (struct grid_atcpmux *self)
+{
+    grid_assert_state (self, GRID_ATCPMUX_STATE_IDLE);
+
+    grid_list_item_term (&self->item);
+    grid_fsm_event_term (&self->done);
+    grid_stcp_term (&self->stcp);
+    grid_usock_term (&self->usock);
+    grid_fsm_term (&self->fsm);
+}
+
+int grid_atcpmux_isidle (struct grid_atcpmux *self)
+{
+    return grid_fsm_isidle (&self->fsm);
+}
+
+void grid_atcpmux_start (struct grid_atcpmux *self, int fd)
+{
+    grid_assert_state (self, GRID_ATCPMUX_STATE_IDLE);
+
+    /*  The usock takes ownership of the file descriptor once started. */
+    self->fd = fd;
+
+    /*  Start the state machine. */
+    grid_fsm_start (&self->fsm);
+}
+
+void grid_atcpmux_stop (struct grid_atcpmux *self)
+{
+    grid_fsm_stop (&self->fsm);
+}
+
+static void grid_atcpmux_shutdown (struct grid_fsm *self, int src, int type,
+    GRID_UNUSED void *srcptr)
+{
+    struct grid_atcpmux *atcpmux;
+
+    atcpmux = grid_cont (self, struct grid_atcpmux, fsm);
+
+    if (grid_slow (src == GRID_FSM_ACTION && type == GRID_FSM_STOP)) {
+        if (!grid_stcp_isidle (&atcpmux->stcp)) {
+            grid_epbase_stat_increment (atcpmux->epbase,
+                GRID_STAT_DROPPED_CONNECTIONS, 1);
+            grid_stcp_stop (&atcpmux->stcp);
+        }
+        atcpmux->state = GRID_ATCPMUX_STATE_STOPPING_STCP_FINAL;
+    }
+    if (grid_slow (atcpmux->state == GRID_ATCPMUX_STATE_STOPPING_STCP_FINAL)) {
+        if (!grid_stcp_isidle (&atcpmux->stcp))
+            return;
+        grid_usock_stop (&atcpmux->usock);
+        atcpmux->state = GRID_ATCPMUX_STATE_STOPPING;
+    }
+    if (grid_slow (atcpmux->state == GRID_ATCPMUX_STATE_STOPPING)) {
+        if (!grid_usock_isidle (&atcpmux->usock))
+            return;
+        atcpmux->state = GRID_ATCPMUX_STATE_IDLE;
+        grid_fsm_stopped (&atcpmux->fsm, GRID_ATCPMUX_STOPPED);
+        return;
+    }
+
+    grid_fsm_bad_action(atcpmux->state, src, type);
+}
+
+static void grid_atcpmux_handler (struct grid_fsm *self, int src, int type,
+    GRID_UNUSED void *srcptr)
+{
+    struct grid_atcpmux *atcpmux;
+    struct grid_iovec iovec;
+    int val;
+    size_t sz;
+
+    atcpmux = grid_cont (self, struct grid_atcpmux, fsm);
+
+    switch (atcpmux->state) {
+
+/******************************************************************************/
+/*  IDLE state.                                                               */
+/*  The state machine wasn't yet started.                                     */
+/******************************************************************************/
+    case GRID_ATCPMUX_STATE_IDLE:
+        switch (src) {
+
+        case GRID_FSM_ACTION:
+            switch (type) {
+            case GRID_FSM_START:
+
+                /*  Set the relevant socket options. The usock becomes active
+                    as soon as it is started, so they are applied directly to
+                    the file descriptor. */
+                sz = sizeof (val);
+                grid_epbase_getopt (atcpmux->epbase, GRID_SOL_SOCKET,
+                    GRID_SNDBUF, &val, &sz);
+                grid_assert (sz == sizeof (val));
+                (void) setsockopt (atcpmux->fd, SOL_SOCKET, SO_SNDBUF,
+                    &val, sizeof (val));
+                sz = sizeof (val);
+                grid_epbase_getopt (atcpmux->epbase, GRID_SOL_SOCKET,
+                    GRID_RCVBUF, &val, &sz);
+                grid_assert (sz == sizeof (val));
+                (void) setsockopt (atcpmux->fd, SOL_SOCKET, SO_RCVBUF,
+                    &val, sizeof (val));
+                sz = sizeof (val);
+                grid_epbase_getopt (atcpmux->epbase, GRID_TCPMUX,
+                    GRID_TCPMUX_NODELAY, &val, &sz);
+                grid_assert (sz == sizeof (val));
+                (void) setsockopt (atcpmux->fd, IPPROTO_TCP, TCP_NODELAY,
+                    &val, sizeof (val));
+
+                grid_usock_start_fd (&atcpmux->usock, atcpmux->fd);
+                atcpmux->fd = -1;
+
+                /*  Confirm to the client that the service is available. */
+                iovec.iov_base = (void*) grid_atcpmux_ok;
+                iovec.iov_len = sizeof (grid_atcpmux_ok) - 1;
+                grid_usock_send (&atcpmux->usock, &iovec, 1);
+                atcpmux->state = GRID_ATCPMUX_STATE_SENDING_TCPMUXHDR;
+                return;
+            default:
+                grid_fsm_bad_action (atcpmux->state, src, type);
+            }
+
+        default:
+            grid_fsm_bad_source (atcpmux->state, src, type);
+        }
+
+/******************************************************************************/
+/*  SENDING_TCPMUXHDR state.                                                  */
+/*  The reply to the TCPMUX request is being sent to the client.              */
+/******************************************************************************/
+    case GRID_ATCPMUX_STATE_SENDING_TCPMUXHDR:
+        switch (src) {
+
+        case GRID_ATCPMUX_SRC_USOCK:
+            switch (type) {
+            case GRID_USOCK_SENT:
+                grid_epbase_clear_error (atcpmux->epbase);
+                grid_stcp_start (&atcpmux->stcp, &atcpmux->usock);
+                atcpmux->state = GRID_ATCPMUX_STATE_ACTIVE;
+                grid_epbase_stat_increment (atcpmux->epbase,
+                    GRID_STAT_ACCEPTED_CONNECTIONS, 1);
+                return;
+            case GRID_USOCK_SHUTDOWN:
+                return;
+            case GRID_USOCK_ERROR:
+                grid_usock_stop (&atcpmux->usock);
+                atcpmux->state = GRID_ATCPMUX_STATE_STOPPING_USOCK;
+                grid_epbase_stat_increment (atcpmux->epbase,
+                    GRID_STAT_ACCEPT_ERRORS, 1);
+                return;
+            default:
+                grid_fsm_bad_action (atcpmux->state, src, type);
+            }
+
+        default:
+            grid_fsm_bad_source (atcpmux->state, src, type);
+        }
+
+/******************************************************************************/
+/*  ACTIVE state.                                                             */
+/******************************************************************************/
+    case GRID_ATCPMUX_STATE_ACTIVE:
+        switch (src) {
+
+        case GRID_ATCPMUX_SRC_STCP:
+            switch (type) {
+            case GRID_STCP_ERROR:
+                grid_stcp_stop (&atcpmux->stcp);
+                atcpmux->state = GRID_ATCPMUX_STATE_STOPPING_STCP;
+                grid_epbase_stat_increment (atcpmux->epbase,
+                    GRID_STAT_BROKEN_CONNECTIONS, 1);
+                return;
+            default:
+                grid_fsm_bad_action (atcpmux->state, src, type);
+            }
+
+        default:
+            grid_fsm_bad_source (atcpmux->state, src, type);
+        }
+
+/******************************************************************************/
+/*  STOPPING_STCP state.                                                      */
+/******************************************************************************/
+    case GRID_ATCPMUX_STATE_STOPPING_STCP:
+        switch (src) {
+
+        case GRID_ATCPMUX_SRC_STCP:
+            switch (type) {
+            case GRID_USOCK_SHUTDOWN:
+                return;
+            case GRID_STCP_STOPPED:
+                grid_usock_stop (&atcpmux->usock);
+                atcpmux->state = GRID_ATCPMUX_STATE_STOPPING_USOCK;
+                return;
+            default:
+                grid_fsm_bad_action (atcpmux->state, src, type);
+            }
+
+        default:
+            grid_fsm_bad_source (atcpmux->state, src, type);
+        }
+
+/******************************************************************************/
+/*  STOPPING_USOCK state.                                                     */
+/******************************************************************************/
+    case GRID_ATCPMUX_STATE_STOPPING_USOCK:
+        switch (src) {
+
+        case GRID_ATCPMUX_SRC_USOCK:
+            switch (type) {
+            case GRID_USOCK_SHUTDOWN:
+                return;
+            case GRID_USOCK_STOPPED:
+                grid_fsm_raise (&atcpmux->fsm, &atcpmux->done,
+                    GRID_ATCPMUX_ERROR);
+                atcpmux->state = GRID_ATCPMUX_STATE_DONE;
+                return;
+            default:
+                grid_fsm_bad_action (atcpmux->state, src, type);
+            }
+
+        default:
+            grid_fsm_bad_source (atcpmux->state, src, type);
+        }
+
+/******************************************************************************/
+/*  Invalid state.                                                            */
+/******************************************************************************/
+    default:
+        grid_fsm_bad_state (atcpmux->state, src, type);
+    }
+}
@@ -0,0 +1,238 @@
+/*
+    Copyright (c) 2013-2014 Martin Sustrik  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#include "compress.h"
+
+#include "../../utils/err.h"
+#include "../../utils/alloc.h"
+#include "../../utils/chunk.h"
+#include "../../utils/fast.h"
+#include "../../utils/wire.h"
+#include "../../utils/int.h"
+#include "../../utils/attr.h"
+
+#include <string.h>
+
+#if defined GRID_HAVE_ZLIB
+
+#include <zlib.h>
+
+struct grid_compress {
+
+    /*  Stream used to compress outbound messages. */
+    z_stream deflater;
+
+    /*  Stream used to decompress inbound messages. */
+    z_stream inflater;
+
+    /*  zlib asks for the dictionary only once the inbound stream starts,
+        so we have to keep a copy of it till then. */
+    void *dict;
+    size_t dictlen;
+};
+
+int grid_compress_supported (void)
+{
+    return 1;
+}
+
+int grid_compress_create (int level, const void *dict, size_t dictlen,
+    struct grid_compress **self)
+{
+    int rc;
+    struct grid_compress *compress;
+
+    grid_assert (level >= 1 && level <= 9);
+    grid_assert (dictlen <= GRID_COMPRESS_MAXDICT);
+
+    compress = grid_alloc (sizeof (struct grid_compress), "compress");
+    alloc_assert (compress);
+    memset (compress, 0, sizeof (struct grid_compress));
+
+    rc = deflateInit (&compress->deflater, level);
+    if (grid_slow (rc != Z_OK)) {
+        grid_free (compress);
+        return rc == Z_MEM_ERROR ? -ENOMEM : -EINVAL;
+    }
+    rc = inflateInit (&compress->inflater);
+    if (grid_slow (rc != Z_OK)) {
+        deflateEnd (&compress->deflater);
+        grid_free (compress);
+        return rc == Z_MEM_ERROR ? -ENOMEM : -EINVAL;
+    }
+
+    if (dictlen) {
+        rc = deflateSetDictionary (&compress->deflater, dict, (uInt) dictlen);
+        grid_assert (rc == Z_OK);
+        compress->dict = grid_alloc (dictlen, "compression dictionary");
+        alloc_assert (compress->dict);
+        memcpy (compress->dict, dict, dictlen);
+        compress->dictlen = dictlen;
+    }
+
+    *self = compress;
+    return 0;
+}
+
+void grid_compress_destroy (struct grid_compress *self)
+{
+    inflateEnd (&self->inflater);
+    deflateEnd (&self->deflater);
+    if (self->dict)
+        grid_free (self->dict);
+    grid_free (self);
+}
+
+void grid_compress_deflate (struct grid_compress *self, struct grid_msg *msg,
+    struct grid_chunkref *out)
+{
+    int rc;
+    size_t sz;
+    size_t bound;
+    void *chunk;
+    uint8_t *data;
+
+    sz = grid_chunkref_size (&msg->sphdr) + grid_chunkref_size (&msg->body);
+
+    /*  deflateBound doesn't account for the sync flush marker and the
+        bits left over from the previous block. */
+    bound = deflateBound (&self->deflater, (uLong) sz) + 16;
+
+    grid_chunkref_init (out, sizeof (uint64_t) + bound);
+    data = grid_chunkref_data (out);
+    grid_putll (data, sz);
+
+    self->deflater.next_out = data + sizeof (uint64_t);
+    self->deflater.avail_out = (uInt) bound;
+    self->deflater.next_in = grid_chunkref_data (&msg->sphdr);
+    self->deflater.avail_in = (uInt) grid_chunkref_size (&msg->sphdr);
+    rc = deflate (&self->deflater, Z_NO_FLUSH);
+    grid_assert (rc == Z_OK || rc == Z_BUF_ERROR);
+    self->deflater.next_in = grid_chunkref_data (&msg->body);
+    self->deflater.avail_in = (uInt) grid_chunkref_size (&msg->body);
+    rc = deflate (&self->deflater, Z_SYNC_FLUSH);
+    grid_assert (rc == Z_OK);
+    grid_assert (self->deflater.avail_in == 0 &&
+        self->deflater.avail_out > 0);
+
+    /*  Shrink the buffer to the actual size of the compressed data. */
+    sz = sizeof (uint64_t) + bound - self->deflater.avail_out;
+    chunk = grid_chunkref_getchunk (out);
+    rc = grid_chunk_realloc (sz, &chunk);
+    errnum_assert (rc == 0, -rc);
+    grid_chunkref_init_chunk (out, chunk);
+}
+
+int grid_compress_inflate (struct grid_compress *self, struct grid_chunkref *in,
+    int maxsize, struct grid_chunkref *out)
+{
+    int rc;
+    uint8_t *data;
+    size_t sz;
+    uint64_t origsz;
+    uint8_t scratch;
+
+    data = grid_chunkref_data (in);
+    sz = grid_chunkref_size (in);
+    if (grid_slow (sz < sizeof (uint64_t)))
+        return -EPROTO;
+    origsz = grid_getll (data);
+    if (grid_slow (maxsize >= 0 && origsz > (uint64_t) maxsize))
+        return -EMSGSIZE;
+    if (grid_slow (origsz > UINT32_MAX || sz - sizeof (uint64_t) > UINT32_MAX))
+        return -EPROTO;
+
+    grid_chunkref_init (out, (size_t) origsz);
+    self->inflater.next_in = data + sizeof (uint64_t);
+    self->inflater.avail_in = (uInt) (sz - sizeof (uint64_t));
+    self->inflater.next_out = grid_chunkref_data (out);
+    self->inflater.avail_out = (uInt) origsz;
+    rc = inflate (&self->inflater, Z_SYNC_FLUSH);
+    if (rc == Z_NEED_DICT) {
+        if (grid_slow (!self->dict))
+            goto error;
+        rc = inflateSetDictionary (&self->inflater, self->dict,
+            (uInt) self->dictlen);
+        if (grid_slow (rc != Z_OK))
+            goto error;
+        grid_free (self->dict);
+        self->dict = NULL;
+        rc = inflate (&self->inflater, Z_SYNC_FLUSH);
+    }
+    if (grid_slow (rc != Z_OK && rc != Z_BUF_ERROR))
+        goto error;
+    if (grid_slow (self->inflater.avail_out != 0))
+        goto error;
+
+    /*  The output buffer is full, but the flush marker may still be pending.
+        It must not produce any more data. */
+    if (self->inflater.avail_in) {
+        self->inflater.next_out = &scratch;
+        self->inflater.avail_out = 1;
+        rc = inflate (&self->inflater, Z_SYNC_FLUSH);
+        if (grid_slow (rc != Z_OK && rc != Z_BUF_ERROR))
+            goto error;
+        if (grid_slow (self->inflater.avail_out != 1 ||
+              self->inflater.avail_in != 0))
+            goto error;
+    }
+
+    return 0;
+
+error:
+    grid_chunkref_term (out);
+    return -EPROTO;
+}
+
+#else
+
+int grid_compress_supported (void)
+{
+    return 0;
+}
+
+int grid_compress_create (GRID_UNUSED int level, GRID_UNUSED const void *dict,
+    GRID_UNUSED size_t dictlen, GRID_UNUSED struct grid_compress **self)
+{
+    return -ENOTSUP;
+}
+
+void grid_compress_destroy (GRID_UNUSED struct grid_compress *self)
+{
+    grid_assert (0);
+}
+
+void grid_compress_deflate (GRID_UNUSED struct grid_compress *self,
+    GRID_UNUSED struct grid_msg *msg, GRID_UNUSED struct grid_chunkref *out)
+{
+    grid_assert (0);
+}
+
+int grid_compress_inflate (GRID_UNUSED struct grid_compress *self,
+    GRID_UNUSED struct grid_chunkref *in, GRID_UNUSED int maxsize,
+    GRID_UNUSED struct grid_chunkref *out)
+{
+    grid_assert (0);
+    return -ENOTSUP;
+}
+
+#endif
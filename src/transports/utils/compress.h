@@ -0,0 +1,65 @@
+/*
+    Copyright (c) 2013-2014 Martin Sustrik  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#ifndef GRID_COMPRESS_INCLUDED
+#define GRID_COMPRESS_INCLUDED
+
+#include "../../utils/msg.h"
+#include "../../utils/chunkref.h"
+
+#include <stddef.h>
+
+/*  Message compression for stream-based transports. Each connection owns one
+    compression context. Messages are compressed as a single continuous
+    stream in either direction, so that later messages can refer to the data
+    seen in the earlier ones. Each message is flushed separately, meaning
+    that it can be decompressed as soon as it arrives. The optional preset
+    dictionary primes both streams and must be the same on both peers. */
+
+/*  Only the last 32kB of the dictionary would be used anyway. */
+#define GRID_COMPRESS_MAXDICT 32768
+
+struct grid_compress;
+
+/*  Returns 1 if the library was built with compression support, 0 otherwise. */
+int grid_compress_supported (void);
+
+/*  Creates a compression context. 'level' is 1 (fastest) to 9 (best).
+    Returns -ENOTSUP if there's no compression support. */
+int grid_compress_create (int level, const void *dict, size_t dictlen,
+    struct grid_compress **self);
+void grid_compress_destroy (struct grid_compress *self);
+
+/*  Compresses the SP header and the body of the message into 'out', which
+    is initialised by the function. The output is prefixed by the original
+    size of the message. Messages of 4GB or more are not supported. */
+void grid_compress_deflate (struct grid_compress *self, struct grid_msg *msg,
+    struct grid_chunkref *out);
+
+/*  Decompresses the data produced by grid_compress_deflate on the peer into
+    'out', which is initialised by the function on success. Returns -EMSGSIZE
+    if the decompressed message would exceed 'maxsize' (negative means no
+    limit) and -EPROTO if the data are malformed. */
+int grid_compress_inflate (struct grid_compress *self, struct grid_chunkref *in,
+    int maxsize, struct grid_chunkref *out);
+
+#endif
@@ -56,6 +56,7 @@ void grid_streamhdr_init (struct grid_streamhdr *self, int src,
     grid_fsm_init (&self->fsm, grid_streamhdr_handler, grid_streamhdr_shutdown,
         src, self, owner);
     self->state = GRID_STREAMHDR_STATE_IDLE;
+    grid_fsm_trace_state (&self->fsm, &self->state);
     grid_timer_init (&self->timer, GRID_STREAMHDR_SRC_TIMER, &self->fsm);
     grid_fsm_event_init (&self->done);
 
@@ -63,6 +64,8 @@ void grid_streamhdr_init (struct grid_streamhdr *self, int src,
     self->usock_owner.src = -1;
     self->usock_owner.fsm = NULL;
     self->pipebase = NULL;
+    self->flags = 0;
+    self->peerflags = 0;
 }
 
 void grid_streamhdr_term (struct grid_streamhdr *self)
@@ -80,7 +83,7 @@ int grid_streamhdr_isidle (struct grid_streamhdr *self)
 }
 
 void grid_streamhdr_start (struct grid_streamhdr *self, struct grid_usock *usock,
-    struct grid_pipebase *pipebase)
+    struct grid_pipebase *pipebase, int flags)
 {
     size_t sz;
     int protocol;
@@ -98,9 +101,13 @@ void grid_streamhdr_start (struct grid_streamhdr *self, struct grid_usock *usock
     grid_pipebase_getopt (pipebase, GRID_SOL_SOCKET, GRID_PROTOCOL, &protocol, &sz);
     grid_assert (sz == sizeof (protocol));
 
-    /*  Compose the protocol header. */
+    /*  Compose the protocol header. The byte following the protocol ID
+        carries the optional features. Old peers send zero there. */
+    self->flags = flags;
+    self->peerflags = 0;
     memcpy (self->protohdr, "\0SP\0\0\0\0\0", 8);
     grid_puts (self->protohdr + 4, (uint16_t) protocol);
+    self->protohdr [6] = (uint8_t) flags;
 
     /*  Launch the state machine. */
     grid_fsm_start (&self->fsm);
@@ -111,6 +118,11 @@ void grid_streamhdr_stop (struct grid_streamhdr *self)
     grid_fsm_stop (&self->fsm);
 }
 
+int grid_streamhdr_flags (struct grid_streamhdr *self)
+{
+    return self->flags & self->peerflags;
+}
+
 static void grid_streamhdr_shutdown (struct grid_fsm *self, int src, int type,
     GRID_UNUSED void *srcptr)
 {
@@ -223,6 +235,7 @@ static void grid_streamhdr_handler (struct grid_fsm *self, int src, int type,
                 protocol = grid_gets (streamhdr->protohdr + 4);
                 if (!grid_pipebase_ispeer (streamhdr->pipebase, protocol))
                     goto invalidhdr;
+                streamhdr->peerflags = streamhdr->protohdr [6];
                 grid_timer_stop (&streamhdr->timer);
                 streamhdr->state = GRID_STREAMHDR_STATE_STOPPING_TIMER_DONE;
                 return;
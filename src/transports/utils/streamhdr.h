@@ -38,6 +38,10 @@
 #define GRID_STREAMHDR_ERROR 2
 #define GRID_STREAMHDR_STOPPED 3
 
+/*  Optional features advertised in the protocol header. A feature is used on
+    the connection only if both peers advertise it. */
+#define GRID_STREAMHDR_FLAG_COMPRESS 1
+
 struct grid_streamhdr {
 
     /*  The state machine. */
@@ -59,6 +63,10 @@ struct grid_streamhdr {
     /*  Protocol header. */
     uint8_t protohdr [8];
 
+    /*  Features advertised by this side and those agreed on by both peers. */
+    int flags;
+    int peerflags;
+
     /*  Event fired when the state machine ends. */
     struct grid_fsm_event done;
 };
@@ -69,7 +77,11 @@ void grid_streamhdr_term (struct grid_streamhdr *self);
 
 int grid_streamhdr_isidle (struct grid_streamhdr *self);
 void grid_streamhdr_start (struct grid_streamhdr *self, struct grid_usock *usock,
-    struct grid_pipebase *pipebase);
+    struct grid_pipebase *pipebase, int flags);
 void grid_streamhdr_stop (struct grid_streamhdr *self);
 
+/*  Returns the features agreed on by both peers. Valid once the header
+    exchange succeeded. */
+int grid_streamhdr_flags (struct grid_streamhdr *self);
+
 #endif
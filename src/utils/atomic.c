@@ -74,3 +74,21 @@ uint32_t grid_atomic_dec (struct grid_atomic *self, uint32_t n)
 #endif
 }
 
+int grid_atomic_cas (struct grid_atomic *self, uint32_t expected, uint32_t n)
+{
+#if defined GRID_ATOMIC_SOLARIS
+    return atomic_cas_32 (&self->n, expected, n) == expected ? 1 : 0;
+#elif defined GRID_ATOMIC_GCC_BUILTINS
+    return __sync_bool_compare_and_swap (&self->n, expected, n) ? 1 : 0;
+#elif defined GRID_ATOMIC_MUTEX
+    int res;
+    grid_mutex_lock (&self->sync);
+    res = self->n == expected ? 1 : 0;
+    if (res)
+        self->n = n;
+    grid_mutex_unlock (&self->sync);
+    return res;
+#else
+#error
+#endif
+}
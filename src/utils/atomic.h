@@ -54,5 +54,37 @@ uint32_t grid_atomic_inc (struct grid_atomic *self, uint32_t n);
 /*  Atomically subtract n from the object, return old value of the object. */
 uint32_t grid_atomic_dec (struct grid_atomic *self, uint32_t n);
 
+/*  Atomically set the object to 'n' if its value is 'expected'. Returns 1 if
+    the value was changed, 0 otherwise. */
+int grid_atomic_cas (struct grid_atomic *self, uint32_t expected, uint32_t n);
+
+/*  Load of the variable pointed to by 'p' with acquire semantics and store
+    to it with release semantics. A thread that loads the value stored by
+    another thread sees all the writes the other thread did before the store.
+    The variable must be an integer or a pointer. */
+#if defined __ATOMIC_ACQUIRE
+#define grid_atomic_load_acquire(p) \
+    __atomic_load_n ((p), __ATOMIC_ACQUIRE)
+#define grid_atomic_store_release(p, v) \
+    __atomic_store_n ((p), (v), __ATOMIC_RELEASE)
+#elif defined GRID_ATOMIC_GCC_BUILTINS
+#define grid_atomic_load_acquire(p) \
+    ({\
+        __typeof__ (*(p)) grid_atomic_v = *(p);\
+        __sync_synchronize ();\
+        grid_atomic_v;\
+    })
+#define grid_atomic_store_release(p, v) \
+    do {\
+        __sync_synchronize ();\
+        *(p) = (v);\
+    } while (0)
+#else
+/*  There's no portable way to order the accesses. Plain accesses are
+    sufficient on strongly ordered CPUs only. */
+#define grid_atomic_load_acquire(p) (*(p))
+#define grid_atomic_store_release(p, v) ((void) (*(p) = (v)))
+#endif
+
 #endif
 
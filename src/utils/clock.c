@@ -29,6 +29,10 @@
 #include <sys/time.h>
 #endif
 
+#if defined GRID_HAVE_CPUID && (defined __i386__ || defined __x86_64__)
+#include <cpuid.h>
+#endif
+
 #include "clock.h"
 #include "fast.h"
 #include "err.h"
@@ -38,10 +42,41 @@
    it works pretty well for CPU frequencies above 500MHz. */
 #define GRID_CLOCK_PRECISION 1000000
 
+/*  The TSC is calibrated against the monotonic clock over a window that
+    starts at the first use of the clock. The first calibration happens when
+    the window reaches GRID_CLOCK_CALIB_FIRST nanoseconds, each subsequent
+    one when the window grows tenfold, until it reaches GRID_CLOCK_CALIB_LAST.
+    Until the first calibration the monotonic clock is used. */
+#define GRID_CLOCK_CALIB_FIRST 10000000ULL
+#define GRID_CLOCK_CALIB_LAST 100000000000ULL
+
+/*  States of the TSC calibration. */
+#define GRID_CLOCK_TSC_UNKNOWN 0
+#define GRID_CLOCK_TSC_CALIBRATING 1
+#define GRID_CLOCK_TSC_UNUSABLE 2
+
 #if defined GRID_HAVE_OSX
 static mach_timebase_info_data_t grid_clock_timebase_info;
 #endif
 
+/*  Converts TSC to nanoseconds: ns0 + (tsc - tsc0) * scale. A new
+    calibration is written into the slot that is not in use and published
+    afterwards. Calibrations are far apart, so a reader never sees a slot
+    being overwritten. */
+struct grid_clock_calib {
+    uint64_t tsc0;
+    uint64_t ns0;
+    double scale;
+};
+
+static struct grid_clock_calib grid_clock_calibs [2];
+static struct grid_clock_calib *volatile grid_clock_calib = NULL;
+static volatile int grid_clock_tsc_state = GRID_CLOCK_TSC_UNKNOWN;
+static volatile int grid_clock_calibrating = 0;
+static volatile uint64_t grid_clock_next_calib = 0;
+static uint64_t grid_clock_tsc0;
+static uint64_t grid_clock_ns0;
+
 static uint64_t grid_clock_rdtsc ()
 {
 #if (defined __GNUC__ && (defined __i386__ || defined __x86_64__))
@@ -64,7 +99,30 @@ static uint64_t grid_clock_rdtsc ()
 #endif
 }
 
-static uint64_t grid_clock_time ()
+/*  Returns 1 if the TSC ticks at a constant rate regardless of frequency
+    scaling and sleep states, so that it can be used as a clock. */
+static int grid_clock_tsc_invariant ()
+{
+#if defined GRID_HAVE_CPUID && defined GRID_HAVE_GCC_ATOMIC_BUILTINS && \
+    (defined __i386__ || defined __x86_64__)
+    unsigned int eax;
+    unsigned int ebx;
+    unsigned int ecx;
+    unsigned int edx;
+
+    if (!__get_cpuid (0x80000000, &eax, &ebx, &ecx, &edx) ||
+          eax < 0x80000007)
+        return 0;
+    if (!__get_cpuid (0x80000007, &eax, &ebx, &ecx, &edx))
+        return 0;
+    return (edx & (1 << 8)) ? 1 : 0;
+#else
+    return 0;
+#endif
+}
+
+/*  Returns the monotonic time in nanoseconds as provided by the OS. */
+static uint64_t grid_clock_mono ()
 {
 #if defined GRID_HAVE_OSX
 
@@ -76,7 +134,7 @@ static uint64_t grid_clock_time ()
 
     ticks = mach_absolute_time ();
     return ticks * grid_clock_timebase_info.numer /
-        grid_clock_timebase_info.denom / 1000000;
+        grid_clock_timebase_info.denom;
 
 #elif defined GRID_HAVE_CLOCK_MONOTONIC
 
@@ -85,11 +143,11 @@ static uint64_t grid_clock_time ()
 
     rc = clock_gettime (CLOCK_MONOTONIC, &tv);
     errno_assert (rc == 0);
-    return tv.tv_sec * (uint64_t) 1000 + tv.tv_nsec / 1000000;
+    return tv.tv_sec * (uint64_t) 1000000000 + tv.tv_nsec;
 
 #elif defined GRID_HAVE_GETHRTIME
 
-    return gethrtime () / 1000000;
+    return gethrtime ();
 
 #else
 
@@ -100,15 +158,121 @@ static uint64_t grid_clock_time ()
         monotonic. Thus, it's used as a last resort mechanism. */
     rc = gettimeofday (&tv, NULL);
     errno_assert (rc == 0);
-    return tv.tv_sec * (uint64_t) 1000 + tv.tv_usec / 1000;
+    return tv.tv_sec * (uint64_t) 1000000000 + tv.tv_usec * (uint64_t) 1000;
+
+#endif
+}
+
+static uint64_t grid_clock_convert (struct grid_clock_calib *calib,
+    uint64_t tsc)
+{
+    /*  TSCs of different cores may be slightly off. Don't let the clock
+        underflow. */
+    if (grid_slow (tsc < calib->tsc0))
+        return calib->ns0;
+    return calib->ns0 + (uint64_t) ((double) (tsc - calib->tsc0) *
+        calib->scale);
+}
+
+/*  Takes a sample of TSC and monotonic time as close to each other as
+    possible. */
+static void grid_clock_sample (uint64_t *tsc, uint64_t *ns)
+{
+    uint64_t before;
+
+    before = grid_clock_rdtsc ();
+    *ns = grid_clock_mono ();
+    *tsc = before + (grid_clock_rdtsc () - before) / 2;
+}
+
+/*  Slow path of grid_clock_ns. Drives the calibration and returns the current
+    time. */
+static uint64_t grid_clock_calibrate ()
+{
+#if defined GRID_HAVE_GCC_ATOMIC_BUILTINS
+    uint64_t tsc;
+    uint64_t ns;
+    struct grid_clock_calib *calib;
+    struct grid_clock_calib *prev;
 
+    if (grid_clock_tsc_state == GRID_CLOCK_TSC_UNUSABLE)
+        return grid_clock_mono ();
+
+    /*  Only one thread at a time does the calibration. The others use the
+        monotonic clock or the previous calibration in the meantime. */
+    if (!__sync_bool_compare_and_swap (&grid_clock_calibrating, 0, 1)) {
+        calib = grid_clock_calib;
+        if (!calib)
+            return grid_clock_mono ();
+        return grid_clock_convert (calib, grid_clock_rdtsc ());
+    }
+
+    grid_clock_sample (&tsc, &ns);
+    if (grid_clock_tsc_state == GRID_CLOCK_TSC_UNKNOWN) {
+        if (!grid_clock_tsc_invariant ()) {
+            grid_clock_tsc_state = GRID_CLOCK_TSC_UNUSABLE;
+            __sync_synchronize ();
+            grid_clock_calibrating = 0;
+            return ns;
+        }
+        grid_clock_tsc0 = tsc;
+        grid_clock_ns0 = ns;
+        grid_clock_next_calib = ns + GRID_CLOCK_CALIB_FIRST;
+        grid_clock_tsc_state = GRID_CLOCK_TSC_CALIBRATING;
+    }
+    else if (ns >= grid_clock_next_calib && tsc > grid_clock_tsc0) {
+
+        /*  The rate is measured over the whole window. The new calibration
+            continues from the value the previous one yields at this point,
+            or from the monotonic time if there's none, so that the clock
+            never jumps. */
+        prev = grid_clock_calib;
+        calib = prev == &grid_clock_calibs [0] ?
+            &grid_clock_calibs [1] : &grid_clock_calibs [0];
+        calib->tsc0 = tsc;
+        calib->ns0 = prev ? grid_clock_convert (prev, tsc) : ns;
+        calib->scale = (double) (ns - grid_clock_ns0) /
+            (double) (tsc - grid_clock_tsc0);
+        __sync_synchronize ();
+        grid_clock_calib = calib;
+        grid_clock_next_calib = ns - grid_clock_ns0 >= GRID_CLOCK_CALIB_LAST ?
+            (uint64_t) -1 : grid_clock_ns0 + (ns - grid_clock_ns0) * 10;
+    }
+
+    __sync_synchronize ();
+    grid_clock_calibrating = 0;
+    calib = grid_clock_calib;
+    if (!calib)
+        return ns;
+    return grid_clock_convert (calib, tsc);
+#else
+    return grid_clock_mono ();
 #endif
 }
 
+uint64_t grid_clock_ns ()
+{
+    struct grid_clock_calib *calib;
+    uint64_t ns;
+
+    calib = grid_clock_calib;
+    if (grid_slow (!calib))
+        return grid_clock_calibrate ();
+    ns = grid_clock_convert (calib, grid_clock_rdtsc ());
+    if (grid_slow (ns >= grid_clock_next_calib))
+        return grid_clock_calibrate ();
+    return ns;
+}
+
+uint64_t grid_clock_us ()
+{
+    return grid_clock_ns () / 1000;
+}
+
 void grid_clock_init (struct grid_clock *self)
 {
     self->last_tsc = grid_clock_rdtsc ();
-    self->last_time = grid_clock_time ();
+    self->last_time = grid_clock_ns () / 1000000;
 }
 
 void grid_clock_term (GRID_UNUSED struct grid_clock *self)
@@ -117,10 +281,16 @@ void grid_clock_term (GRID_UNUSED struct grid_clock *self)
 
 uint64_t grid_clock_now (struct grid_clock *self)
 {
+    uint64_t tsc;
+
+    /*  With calibrated TSC the clock is cheap enough to be read directly. */
+    if (grid_fast (grid_clock_calib != NULL))
+        return grid_clock_ns () / 1000000;
+
     /*  If TSC is not supported, use the non-optimised time measurement. */
-    uint64_t tsc = grid_clock_rdtsc ();
+    tsc = grid_clock_rdtsc ();
     if (!tsc)
-        return grid_clock_time ();
+        return grid_clock_ns () / 1000000;
 
     /*  If tsc haven't jumped back or run away too far, we can use the cached
         time value. */
@@ -131,7 +301,7 @@ uint64_t grid_clock_now (struct grid_clock *self)
     /*  It's a long time since we've last measured the time. We'll do a new
         measurement now. */
     self->last_tsc = tsc;
-    self->last_time = grid_clock_time ();
+    self->last_time = grid_clock_ns () / 1000000;
     return self->last_time;
 }
 
@@ -139,4 +309,3 @@ uint64_t grid_clock_timestamp ()
 {
     return grid_clock_rdtsc ();
 }
-
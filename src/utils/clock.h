@@ -43,6 +43,15 @@ void grid_clock_term (struct grid_clock *self);
 /*  Returns current time in milliseconds. */
 uint64_t grid_clock_now (struct grid_clock *self);
 
+/*  Returns current monotonic time in nanoseconds. Unlike grid_clock_now
+    it doesn't need a clock object and thus can be used from any thread.
+    Where the CPU has an invariant TSC, the time is computed from the TSC
+    calibrated against CLOCK_MONOTONIC, otherwise the OS clock is used. */
+uint64_t grid_clock_ns ();
+
+/*  Same as grid_clock_ns, in microseconds. */
+uint64_t grid_clock_us ();
+
 /*  Returns an unique timestamp. If the system doesn't support producing
     timestamps the return value is zero. */
 uint64_t grid_clock_timestamp ();
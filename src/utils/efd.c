@@ -36,17 +36,33 @@
 #if defined GRID_HAVE_POLL
 
 #include <poll.h>
+#include <time.h>
 
 int grid_efd_wait (struct grid_efd *self, int timeout)
+{
+    return grid_efd_wait_us (self, timeout < 0 ? -1 : (int64_t) timeout * 1000);
+}
+
+int grid_efd_wait_us (struct grid_efd *self, int64_t timeout)
 {
     int rc;
     struct pollfd pfd;
+#if defined GRID_HAVE_PPOLL
+    struct timespec ts;
+#endif
 
     pfd.fd = grid_efd_getfd (self);
     pfd.events = POLLIN;
     if (grid_slow (pfd.fd < 0))
         return -EBADF;
-    rc = poll (&pfd, 1, timeout);
+#if defined GRID_HAVE_PPOLL
+    ts.tv_sec = timeout / 1000000;
+    ts.tv_nsec = (timeout % 1000000) * 1000;
+    rc = ppoll (&pfd, 1, timeout >= 0 ? &ts : NULL, NULL);
+#else
+    /*  Round up so that we never return before the timeout expires. */
+    rc = poll (&pfd, 1, timeout < 0 ? -1 : (int) ((timeout + 999) / 1000));
+#endif
     if (grid_slow (rc < 0 && errno == EINTR))
         return -EINTR;
     errno_assert (rc >= 0);
@@ -29,6 +29,7 @@
     you can poll on to wait for the event. */
 
 #include "fd.h"
+#include "int.h"
 
 #if defined GRID_HAVE_EVENTFD
 #include "efd_eventfd.h"
@@ -64,5 +65,8 @@ void grid_efd_unsignal (struct grid_efd *self);
     returened. In the latter, -ETIMEDOUT. */
 int grid_efd_wait (struct grid_efd *self, int timeout);
 
+/*  Same as grid_efd_wait, with timeout in microseconds. */
+int grid_efd_wait_us (struct grid_efd *self, int64_t timeout);
+
 #endif
 
@@ -0,0 +1,152 @@
+/*
+    Copyright (c) 2013-2014 Martin Sustrik  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#include "histogram.h"
+#include "fast.h"
+#include "err.h"
+#include "attr.h"
+
+#include "../grid.h"
+
+#include <string.h>
+
+#define GRID_HISTOGRAM_SUBCOUNT (1 << GRID_HISTOGRAM_SUBBITS)
+
+/*  Returns index of the highest bit set. 'value' must be non-zero. */
+static int grid_histogram_msb (uint64_t value)
+{
+#if defined __GNUC__
+    return 63 - __builtin_clzll (value);
+#else
+    int msb;
+
+    msb = 0;
+    while (value >>= 1)
+        ++msb;
+    return msb;
+#endif
+}
+
+/*  Values below 2 * SUBCOUNT map to the buckets one-to-one. Above that,
+    the value is shifted so that exactly SUBBITS + 1 significant bits remain,
+    which selects both the power of two and the sub-bucket within it. */
+static int grid_histogram_index (uint64_t value)
+{
+    int shift;
+
+    if (grid_fast (value < 2 * GRID_HISTOGRAM_SUBCOUNT))
+        return (int) value;
+    shift = grid_histogram_msb (value) - GRID_HISTOGRAM_SUBBITS;
+    if (grid_slow (shift >= GRID_HISTOGRAM_MAXBITS - GRID_HISTOGRAM_SUBBITS))
+        return GRID_HISTOGRAM_BUCKETS - 1;
+    return (shift << GRID_HISTOGRAM_SUBBITS) + (int) (value >> shift);
+}
+
+/*  Returns the highest value that maps to the specified bucket. */
+static uint64_t grid_histogram_upper (int index)
+{
+    int shift;
+    uint64_t base;
+
+    if (index < 2 * GRID_HISTOGRAM_SUBCOUNT)
+        return (uint64_t) index;
+    shift = (index >> GRID_HISTOGRAM_SUBBITS) - 1;
+    base = (uint64_t) ((index & (GRID_HISTOGRAM_SUBCOUNT - 1)) +
+        GRID_HISTOGRAM_SUBCOUNT);
+    return ((base + 1) << shift) - 1;
+}
+
+void grid_histogram_init (struct grid_histogram *self)
+{
+    grid_histogram_reset (self);
+}
+
+void grid_histogram_term (GRID_UNUSED struct grid_histogram *self)
+{
+}
+
+void grid_histogram_reset (struct grid_histogram *self)
+{
+    memset (self, 0, sizeof (struct grid_histogram));
+}
+
+void grid_histogram_record (struct grid_histogram *self, uint64_t value)
+{
+    ++self->buckets [grid_histogram_index (value)];
+    if (grid_slow (!self->count || value < self->min))
+        self->min = value;
+    if (grid_slow (value > self->max))
+        self->max = value;
+    ++self->count;
+    self->sum += value;
+}
+
+uint64_t grid_histogram_percentile (struct grid_histogram *self, int permille)
+{
+    int i;
+    uint64_t rank;
+    uint64_t seen;
+    uint64_t upper;
+
+    grid_assert (permille >= 0 && permille <= 1000);
+
+    if (!self->count)
+        return 0;
+
+    /*  Rank of the value we are looking for, counting from 1. */
+    rank = (self->count * permille + 999) / 1000;
+    if (rank == 0)
+        rank = 1;
+
+    seen = 0;
+    for (i = 0; i != GRID_HISTOGRAM_BUCKETS; ++i) {
+        seen += self->buckets [i];
+        if (seen >= rank)
+            break;
+    }
+    grid_assert (i < GRID_HISTOGRAM_BUCKETS);
+
+    /*  The bucket boundary may lie outside of the actually recorded range. */
+    upper = grid_histogram_upper (i);
+    if (upper > self->max)
+        upper = self->max;
+    if (upper < self->min)
+        upper = self->min;
+    return upper;
+}
+
+
+void grid_histogram_summary (struct grid_histogram *self,
+    struct grid_latency *latency)
+{
+    memset (latency, 0, sizeof (struct grid_latency));
+    if (!self || !self->count)
+        return;
+    latency->count = self->count;
+    latency->min = self->min;
+    latency->max = self->max;
+    latency->mean = self->sum / self->count;
+    latency->p50 = grid_histogram_percentile (self, 500);
+    latency->p90 = grid_histogram_percentile (self, 900);
+    latency->p99 = grid_histogram_percentile (self, 990);
+    latency->p999 = grid_histogram_percentile (self, 999);
+}
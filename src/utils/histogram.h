@@ -0,0 +1,75 @@
+/*
+    Copyright (c) 2013-2014 Martin Sustrik  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#ifndef GRID_HISTOGRAM_INCLUDED
+#define GRID_HISTOGRAM_INCLUDED
+
+#include "int.h"
+
+/*  Log-linear (HDR-style) histogram of 64-bit values. Each power of two is
+    split into 2^GRID_HISTOGRAM_SUBBITS linear sub-buckets, so the relative
+    error of any reported value is below 1/2^GRID_HISTOGRAM_SUBBITS. Values
+    above 2^GRID_HISTOGRAM_MAXBITS are accounted for in the last bucket.
+
+    Recording never allocates or locks. The object is not thread-safe: all
+    the writers are expected to be serialised by the caller (the owning
+    socket's context in the case of the socket statistics). */
+
+#define GRID_HISTOGRAM_SUBBITS 4
+#define GRID_HISTOGRAM_MAXBITS 36
+#define GRID_HISTOGRAM_BUCKETS \
+    ((GRID_HISTOGRAM_MAXBITS - GRID_HISTOGRAM_SUBBITS + 1) << \
+    GRID_HISTOGRAM_SUBBITS)
+
+struct grid_histogram {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t min;
+    uint64_t max;
+    uint64_t buckets [GRID_HISTOGRAM_BUCKETS];
+};
+
+/*  Initialise an empty histogram. */
+void grid_histogram_init (struct grid_histogram *self);
+
+/*  Terminate the histogram. */
+void grid_histogram_term (struct grid_histogram *self);
+
+/*  Drop all the recorded values. */
+void grid_histogram_reset (struct grid_histogram *self);
+
+/*  Account for a single value. */
+void grid_histogram_record (struct grid_histogram *self, uint64_t value);
+
+/*  Returns the value below which 'permille' thousandths of the recorded
+    values lie, e.g. 500 for median or 999 for 99.9th percentile. Returns 0
+    if the histogram is empty. */
+uint64_t grid_histogram_percentile (struct grid_histogram *self, int permille);
+
+/*  Fills in the summary of the histogram as reported by the latency socket
+    options. NULL histogram is reported as an empty one. */
+struct grid_latency;
+void grid_histogram_summary (struct grid_histogram *self,
+    struct grid_latency *latency);
+
+#endif
+
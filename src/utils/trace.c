@@ -0,0 +1,250 @@
+/*
+    Copyright (c) 2013-2014 Martin Sustrik  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#if defined GRID_HAVE_TRACE && defined GRID_HAVE_DLADDR
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <dlfcn.h>
+#endif
+
+#include "trace.h"
+#include "clock.h"
+#include "alloc.h"
+#include "err.h"
+#include "fast.h"
+#include "attr.h"
+#include "atomic.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined GRID_HAVE_TRACE
+
+struct grid_trace_ring {
+
+    /*  Rings are never deallocated so that events of the threads that have
+        already exited can still be dumped. */
+    struct grid_trace_ring *next;
+    uint32_t thread;
+
+    /*  Number of events recorded so far. Only the owner thread writes it. */
+    volatile uint64_t pos;
+
+    struct grid_trace_record records [GRID_TRACE_RING_SIZE];
+};
+
+/*  List of all the rings. New rings are pushed to the head using CAS. */
+static struct grid_trace_ring *volatile grid_trace_rings = NULL;
+static volatile uint32_t grid_trace_nthreads = 0;
+
+/*  Time at which the first ring was created. */
+static uint64_t grid_trace_tsc0 = 0;
+static uint64_t grid_trace_us0 = 0;
+
+static __thread struct grid_trace_ring *grid_trace_self = NULL;
+
+static uint64_t grid_trace_now (void)
+{
+    uint64_t tsc;
+
+    /*  Fall back to microseconds where there's no cycle counter. The decoder
+        converts both to real time using the calibration in the header. */
+    tsc = grid_clock_timestamp ();
+    return grid_fast (tsc != 0) ? tsc : grid_clock_us ();
+}
+
+static struct grid_trace_ring *grid_trace_ring_create (void)
+{
+    struct grid_trace_ring *ring;
+    struct grid_trace_ring *head;
+
+    /*  Use plain malloc rather than grid_alloc so that the rings survive
+        grid_term and don't show up as memory leaks. */
+    ring = malloc (sizeof (struct grid_trace_ring));
+    alloc_assert (ring);
+    ring->pos = 0;
+    ring->thread = __sync_add_and_fetch (&grid_trace_nthreads, 1);
+
+    if (ring->thread == 1) {
+        grid_trace_us0 = grid_clock_us ();
+        grid_trace_tsc0 = grid_trace_now ();
+    }
+
+    do {
+        head = grid_trace_rings;
+        ring->next = head;
+    } while (!__sync_bool_compare_and_swap (&grid_trace_rings, head, ring));
+
+    return ring;
+}
+
+void grid_trace_record (uint64_t object, uint64_t kind, int src, int type,
+    int state)
+{
+    struct grid_trace_ring *ring;
+    struct grid_trace_record *record;
+
+    ring = grid_trace_self;
+    if (grid_slow (!ring)) {
+        ring = grid_trace_ring_create ();
+        grid_trace_self = ring;
+    }
+
+    record = &ring->records [ring->pos & (GRID_TRACE_RING_SIZE - 1)];
+    record->timestamp = grid_trace_now ();
+    record->object = object;
+    record->kind = kind;
+    record->src = src;
+    record->type = type;
+    record->state = state;
+    record->reserved = 0;
+
+    /*  Publish the record. The release store makes sure that the record is
+        complete when a dumping thread sees the new position. Only the owner
+        thread writes the position, thus no read-modify-write is needed. */
+    grid_atomic_store_release (&ring->pos, ring->pos + 1);
+}
+
+/*  Stores the name of the code at the address 'kind' into 'buf'. */
+static void grid_trace_name (uint64_t kind, char *buf, size_t len)
+{
+#if defined GRID_HAVE_DLADDR
+    int rc;
+    Dl_info info;
+
+    rc = dladdr ((void*) (uintptr_t) kind, &info);
+    if (rc != 0 && info.dli_sname &&
+          (uintptr_t) info.dli_saddr == (uintptr_t) kind) {
+        snprintf (buf, len, "%s", info.dli_sname);
+        return;
+    }
+    if (rc != 0 && info.dli_fname) {
+        snprintf (buf, len, "%s+0x%llx", info.dli_fname,
+            (unsigned long long) (kind - (uintptr_t) info.dli_fbase));
+        return;
+    }
+#endif
+    snprintf (buf, len, "0x%llx", (unsigned long long) kind);
+}
+
+int grid_trace_write (const char *path)
+{
+    FILE *f;
+    struct grid_trace_ring *head;
+    struct grid_trace_ring *ring;
+    struct grid_trace_header hdr;
+    struct grid_trace_kind kindhdr;
+    struct grid_trace_ringhdr ringhdr;
+    uint64_t *kinds;
+    size_t nkinds;
+    size_t maxkinds;
+    uint64_t pos;
+    uint64_t first;
+    uint64_t i;
+    size_t j;
+    char name [512];
+
+    f = fopen (path, "wb");
+    if (!f)
+        return -errno;
+
+    /*  Collect the distinct kinds of events. There's only a small number
+        of them, so linear search will do. */
+    nkinds = 0;
+    maxkinds = 64;
+    kinds = malloc (maxkinds * sizeof (uint64_t));
+    alloc_assert (kinds);
+    memset (&hdr, 0, sizeof (hdr));
+    head = grid_trace_rings;
+    for (ring = head; ring; ring = ring->next) {
+        ++hdr.nrings;
+        pos = grid_atomic_load_acquire (&ring->pos);
+        first = pos > GRID_TRACE_RING_SIZE ? pos - GRID_TRACE_RING_SIZE : 0;
+        for (i = first; i != pos; ++i) {
+            for (j = 0; j != nkinds; ++j)
+                if (kinds [j] == ring->records [i &
+                      (GRID_TRACE_RING_SIZE - 1)].kind)
+                    break;
+            if (j < nkinds)
+                continue;
+            if (nkinds == maxkinds) {
+                maxkinds *= 2;
+                kinds = realloc (kinds, maxkinds * sizeof (uint64_t));
+                alloc_assert (kinds);
+            }
+            kinds [nkinds++] =
+                ring->records [i & (GRID_TRACE_RING_SIZE - 1)].kind;
+        }
+    }
+
+    memcpy (hdr.magic, GRID_TRACE_MAGIC, sizeof (hdr.magic));
+    hdr.tsc0 = grid_trace_tsc0;
+    hdr.us0 = grid_trace_us0;
+    hdr.us1 = grid_clock_us ();
+    hdr.tsc1 = grid_trace_now ();
+    hdr.nkinds = (uint32_t) nkinds;
+    fwrite (&hdr, sizeof (hdr), 1, f);
+
+    for (j = 0; j != nkinds; ++j) {
+        grid_trace_name (kinds [j], name, sizeof (name));
+        kindhdr.kind = kinds [j];
+        kindhdr.namelen = (uint32_t) strlen (name);
+        kindhdr.reserved = 0;
+        fwrite (&kindhdr, sizeof (kindhdr), 1, f);
+        fwrite (name, 1, kindhdr.namelen, f);
+    }
+    free (kinds);
+
+    /*  The rings are written to while being dumped. The records that are
+        overwritten in the meantime may come out garbled. */
+    for (ring = head; ring; ring = ring->next) {
+        pos = grid_atomic_load_acquire (&ring->pos);
+        first = pos > GRID_TRACE_RING_SIZE ? pos - GRID_TRACE_RING_SIZE : 0;
+        ringhdr.thread = ring->thread;
+        ringhdr.count = (uint32_t) (pos - first);
+        ringhdr.lost = first;
+        fwrite (&ringhdr, sizeof (ringhdr), 1, f);
+        for (i = first; i != pos; ++i)
+            fwrite (&ring->records [i & (GRID_TRACE_RING_SIZE - 1)],
+                sizeof (struct grid_trace_record), 1, f);
+    }
+
+    if (ferror (f)) {
+        fclose (f);
+        return -EIO;
+    }
+    if (fclose (f) != 0)
+        return -errno;
+    return 0;
+}
+
+#else
+
+int grid_trace_write (GRID_UNUSED const char *path)
+{
+    return -ENOTSUP;
+}
+
+#endif
+
@@ -0,0 +1,109 @@
+/*
+    Copyright (c) 2013-2014 Martin Sustrik  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#ifndef GRID_TRACE_INCLUDED
+#define GRID_TRACE_INCLUDED
+
+#include "int.h"
+
+/*  Optional low-overhead event tracing. When the library is configured with
+    --enable-trace, each thread records events into its own ring buffer of
+    GRID_TRACE_RING_SIZE most recent records. Recording never locks, the only
+    synchronisation happens when a thread records its very first event.
+    Otherwise, grid_trace_event compiles to nothing.
+
+    The rings can be written into a file using grid_trace_dump and decoded
+    using gridtrace tool. The file consists of grid_trace_header followed by
+    'nkinds' grid_trace_kind entries, each followed by 'namelen' bytes of the
+    name, and 'nrings' grid_trace_ringhdr entries, each followed by 'count'
+    grid_trace_record entries. All the integers are in the byte order of the
+    machine where the trace was recorded. */
+
+#define GRID_TRACE_MAGIC "GRIDTRC1"
+#define GRID_TRACE_RING_SIZE 16384
+
+struct grid_trace_header {
+    char magic [8];
+
+    /*  Two pairs of timestamp and monotonic time in microseconds, taken
+        when tracing started and when the dump was created, respectively.
+        These are used to convert the timestamps into real time. */
+    uint64_t tsc0;
+    uint64_t us0;
+    uint64_t tsc1;
+    uint64_t us1;
+
+    uint32_t nkinds;
+    uint32_t nrings;
+};
+
+/*  Describes the code that generated the event, e.g. the state machine
+    handler function. The name is either a symbol name or the name of the
+    binary followed by offset of the code within the binary. */
+struct grid_trace_kind {
+    uint64_t kind;
+    uint32_t namelen;
+    uint32_t reserved;
+};
+
+struct grid_trace_ringhdr {
+    uint32_t thread;
+    uint32_t count;
+
+    /*  Number of events that were overwritten by newer ones. */
+    uint64_t lost;
+};
+
+struct grid_trace_record {
+    uint64_t timestamp;
+    uint64_t object;
+    uint64_t kind;
+    int32_t src;
+    int32_t type;
+    int32_t state;
+    int32_t reserved;
+};
+
+#if defined GRID_HAVE_TRACE
+
+/*  Record an event. 'object' identifies the object the event was delivered
+    to, 'kind' the code that handles it. */
+#define grid_trace_event(object, kind, src, type, state) \
+    grid_trace_record ((uint64_t) (uintptr_t) (object), \
+        (uint64_t) (uintptr_t) (kind), (src), (type), (state))
+
+void grid_trace_record (uint64_t object, uint64_t kind, int src, int type,
+    int state);
+
+#else
+
+#define grid_trace_event(object, kind, src, type, state) \
+    do {} while (0)
+
+#endif
+
+/*  Write the content of all the trace rings into the file. Returns -ENOTSUP
+    if the library was built without tracing support. */
+int grid_trace_write (const char *path);
+
+#endif
+
@@ -26,6 +26,8 @@
 
 #define SOCKET_ADDRESS_A "inproc://a"
 #define SOCKET_ADDRESS_B "inproc://b"
+#define SOCKET_ADDRESS_C "inproc://c"
+#define SOCKET_ADDRESS_D "inproc://d"
 
 int main ()
 {
@@ -33,6 +35,9 @@ int main ()
     int bus1;
     int bus2;
     int bus3;
+    int bus4;
+    int val;
+    size_t sz;
     char buf [3];
 
     /*  Create a simple bus topology consisting of 3 nodes. */
@@ -77,6 +82,73 @@ int main ()
     test_close (bus2);
     test_close (bus1);
 
+    /*  Create a ring of 4 nodes in forwarding mode. Each node is connected
+        only to its two neighbours. */
+    val = 1;
+    bus1 = test_socket (AF_SP, GRID_BUS);
+    test_setsockopt (bus1, GRID_BUS, GRID_BUS_FORWARD, &val, sizeof (val));
+    test_bind (bus1, SOCKET_ADDRESS_A);
+    bus2 = test_socket (AF_SP, GRID_BUS);
+    test_setsockopt (bus2, GRID_BUS, GRID_BUS_FORWARD, &val, sizeof (val));
+    test_bind (bus2, SOCKET_ADDRESS_B);
+    bus3 = test_socket (AF_SP, GRID_BUS);
+    test_setsockopt (bus3, GRID_BUS, GRID_BUS_FORWARD, &val, sizeof (val));
+    test_bind (bus3, SOCKET_ADDRESS_C);
+    bus4 = test_socket (AF_SP, GRID_BUS);
+    test_setsockopt (bus4, GRID_BUS, GRID_BUS_FORWARD, &val, sizeof (val));
+    test_bind (bus4, SOCKET_ADDRESS_D);
+    test_connect (bus2, SOCKET_ADDRESS_A);
+    test_connect (bus3, SOCKET_ADDRESS_B);
+    test_connect (bus4, SOCKET_ADDRESS_C);
+    test_connect (bus1, SOCKET_ADDRESS_D);
+
+    sz = sizeof (val);
+    rc = grid_getsockopt (bus1, GRID_BUS, GRID_BUS_FORWARD, &val, &sz);
+    errno_assert (rc == 0);
+    grid_assert (sz == sizeof (val) && val == 1);
+    grid_sleep (10);
+
+    /*  The message reaches the opposite node via both of its neighbours,
+        yet it is delivered only once. */
+    test_send (bus1, "ABC");
+    test_recv (bus2, "ABC");
+    test_recv (bus4, "ABC");
+    test_recv (bus3, "ABC");
+    grid_sleep (10);
+    rc = grid_recv (bus1, buf, sizeof (buf), GRID_DONTWAIT);
+    grid_assert (rc < 0 && grid_errno () == EAGAIN);
+    rc = grid_recv (bus2, buf, sizeof (buf), GRID_DONTWAIT);
+    grid_assert (rc < 0 && grid_errno () == EAGAIN);
+    rc = grid_recv (bus3, buf, sizeof (buf), GRID_DONTWAIT);
+    grid_assert (rc < 0 && grid_errno () == EAGAIN);
+    rc = grid_recv (bus4, buf, sizeof (buf), GRID_DONTWAIT);
+    grid_assert (rc < 0 && grid_errno () == EAGAIN);
+
+    /*  With hop count of 1 the message doesn't travel past the
+        neighbours. */
+    val = 1;
+    test_setsockopt (bus3, GRID_BUS, GRID_BUS_TTL, &val, sizeof (val));
+    test_send (bus3, "AB");
+    test_recv (bus2, "AB");
+    test_recv (bus4, "AB");
+    grid_sleep (10);
+    rc = grid_recv (bus1, buf, sizeof (buf), GRID_DONTWAIT);
+    grid_assert (rc < 0 && grid_errno () == EAGAIN);
+
+    val = 0;
+    rc = grid_setsockopt (bus3, GRID_BUS, GRID_BUS_TTL, &val, sizeof (val));
+    grid_assert (rc < 0 && grid_errno () == EINVAL);
+    rc = grid_setsockopt (bus3, GRID_BUS, GRID_BUS_DEDUP, &val, sizeof (val));
+    grid_assert (rc < 0 && grid_errno () == EINVAL);
+    val = 0x7fffffff;
+    rc = grid_setsockopt (bus3, GRID_BUS, GRID_BUS_DEDUP, &val, sizeof (val));
+    grid_assert (rc < 0 && grid_errno () == EINVAL);
+
+    test_close (bus4);
+    test_close (bus3);
+    test_close (bus2);
+    test_close (bus1);
+
     return 0;
 }
 
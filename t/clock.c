@@ -0,0 +1,67 @@
+/*
+    Copyright (c) 2013 Martin Sustrik  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#include "../src/utils/clock.c"
+
+#include "testutil.h"
+
+/*  Tests the nanosecond clock, including the switch from the monotonic
+    clock to calibrated TSC. */
+
+int main ()
+{
+    int i;
+    uint64_t prev;
+    uint64_t now;
+    uint64_t start;
+    uint64_t elapsed;
+    struct grid_clock clock;
+
+    /*  The clock never goes back, including across the calibrations that
+        happen during the first hundreds of milliseconds. */
+    prev = grid_clock_ns ();
+    start = prev;
+    while (1) {
+        now = grid_clock_ns ();
+        grid_assert (now >= prev);
+        prev = now;
+        if (now - start > 150000000)
+            break;
+    }
+
+    /*  The clock agrees with the OS clock. */
+    for (i = 0; i != 3; ++i) {
+        start = grid_clock_ns ();
+        grid_sleep (50);
+        elapsed = grid_clock_ns () - start;
+        grid_assert (elapsed >= 45000000 && elapsed < 500000000);
+    }
+
+    /*  Millisecond and microsecond clocks are based on the same time. */
+    grid_clock_init (&clock);
+    now = grid_clock_ns ();
+    grid_assert (grid_clock_now (&clock) + 1 >= now / 1000000);
+    grid_assert (grid_clock_us () >= now / 1000);
+    grid_clock_term (&clock);
+
+    return 0;
+}
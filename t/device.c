@@ -36,6 +36,7 @@
 #define SOCKET_ADDRESS_C "inproc://c"
 #define SOCKET_ADDRESS_D "inproc://d"
 #define SOCKET_ADDRESS_E "inproc://e"
+#define SOCKET_ADDRESS_F "inproc://f"
 
 void device1 (GRID_UNUSED void *arg)
 {
@@ -96,6 +97,26 @@ void device3 (GRID_UNUSED void *arg)
     test_close (deve);
 }
 
+void device4 (GRID_UNUSED void *arg)
+{
+    int rc;
+    int devf;
+    int val;
+
+    /*  Intialise the device socket. */
+    devf = test_socket (AF_SP_RAW, GRID_BUS);
+    val = 1;
+    test_setsockopt (devf, GRID_BUS, GRID_BUS_FORWARD, &val, sizeof (val));
+    test_bind (devf, SOCKET_ADDRESS_F);
+
+    /*  Run the device. */
+    rc = grid_device (devf, -1);
+    grid_assert (rc < 0 && grid_errno () == ETERM);
+
+    /*  Clean up. */
+    test_close (devf);
+}
+
 int main ()
 {
     int enda;
@@ -107,6 +128,12 @@ int main ()
     struct grid_thread thread1;
     struct grid_thread thread2;
     struct grid_thread thread3;
+    struct grid_thread thread4;
+    int endf1;
+    int endf2;
+    int val;
+    int rc;
+    struct grid_pipe_stats pipes [1];
     int timeo;
 
     /*  Test the bi-directional device. */
@@ -178,11 +205,49 @@ int main ()
     test_close (ende2);
     test_close (ende1);
 
+    /*  Test the loopback device relaying between forwarding BUS nodes. */
+
+    /*  Start the device. */
+    grid_thread_init (&thread4, device4, NULL);
+
+    /*  Create two sockets to connect to the device. */
+    val = 1;
+    endf1 = test_socket (AF_SP, GRID_BUS);
+    test_setsockopt (endf1, GRID_BUS, GRID_BUS_FORWARD, &val, sizeof (val));
+    test_connect (endf1, SOCKET_ADDRESS_F);
+    endf2 = test_socket (AF_SP, GRID_BUS);
+    test_setsockopt (endf2, GRID_BUS, GRID_BUS_FORWARD, &val, sizeof (val));
+    test_connect (endf2, SOCKET_ADDRESS_F);
+    grid_sleep (100);
+
+    /*  Each message is passed on by the device socket when it's received.
+        Sending it back to the device socket must not relay it once more. */
+    test_send (endf1, "ABC");
+    test_send (endf1, "DEF");
+    test_recv (endf2, "ABC");
+    test_recv (endf2, "DEF");
+    grid_sleep (100);
+    rc = grid_pipe_stats (endf2, -1, pipes, 1);
+    errno_assert (rc == 1);
+    grid_assert (pipes [0].messages_received == 2);
+    timeo = 100;
+    test_setsockopt (endf1, GRID_SOL_SOCKET, GRID_RCVTIMEO,
+       &timeo, sizeof (timeo));
+    test_drop (endf1, ETIMEDOUT);
+    test_setsockopt (endf2, GRID_SOL_SOCKET, GRID_RCVTIMEO,
+       &timeo, sizeof (timeo));
+    test_drop (endf2, ETIMEDOUT);
+
+    /*  Clean up. */
+    test_close (endf2);
+    test_close (endf1);
+
     /*  Shut down the devices. */
     grid_term ();
     grid_thread_term (&thread1);
     grid_thread_term (&thread2);
     grid_thread_term (&thread3);
+    grid_thread_term (&thread4);
 
     return 0;
 }
@@ -0,0 +1,133 @@
+/*
+    Copyright (c) 2013 Martin Sustrik  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#include "../src/grid.h"
+#include "../src/reqrep.h"
+#include "../src/pipeline.h"
+
+#include "testutil.h"
+#include "../src/utils/attr.h"
+#include "../src/utils/thread.c"
+
+#include <stdio.h>
+
+/*  Tests the threaded device with one bi-directional and one uni-directional
+    pair of sockets. */
+
+#define SOCKET_ADDRESS_A "inproc://a"
+#define SOCKET_ADDRESS_B "inproc://b"
+#define SOCKET_ADDRESS_C "inproc://c"
+#define SOCKET_ADDRESS_D "inproc://d"
+
+#define BURST 1000
+
+void device8 (GRID_UNUSED void *arg)
+{
+    int rc;
+    int s1 [2];
+    int s2 [2];
+
+    /*  Intialise the device sockets. */
+    s1 [0] = test_socket (AF_SP_RAW, GRID_REP);
+    test_bind (s1 [0], SOCKET_ADDRESS_A);
+    s2 [0] = test_socket (AF_SP_RAW, GRID_REQ);
+    test_bind (s2 [0], SOCKET_ADDRESS_B);
+    s1 [1] = test_socket (AF_SP_RAW, GRID_PULL);
+    test_bind (s1 [1], SOCKET_ADDRESS_C);
+    s2 [1] = test_socket (AF_SP_RAW, GRID_PUSH);
+    test_bind (s2 [1], SOCKET_ADDRESS_D);
+
+    /*  Run the device. */
+    rc = grid_device_threaded (s1, s2, 2);
+    grid_assert (rc < 0 && grid_errno () == ETERM);
+
+    /*  Clean up. */
+    test_close (s2 [1]);
+    test_close (s1 [1]);
+    test_close (s2 [0]);
+    test_close (s1 [0]);
+}
+
+int main ()
+{
+    int rc;
+    int i;
+    int enda;
+    int endb;
+    int endc;
+    int endd;
+    int s1;
+    int s2;
+    char buf [16];
+    struct grid_thread thread;
+
+    /*  Invalid arguments. */
+    s1 = test_socket (AF_SP, GRID_PULL);
+    s2 = test_socket (AF_SP_RAW, GRID_PUSH);
+    rc = grid_device_threaded (&s1, &s2, 0);
+    grid_assert (rc < 0 && grid_errno () == EINVAL);
+    rc = grid_device_threaded (&s1, &s2, 1);
+    grid_assert (rc < 0 && grid_errno () == EINVAL);
+    test_close (s2);
+    test_close (s1);
+
+    /*  Start the device. */
+    grid_thread_init (&thread, device8, NULL);
+    grid_sleep (100);
+
+    enda = test_socket (AF_SP, GRID_REQ);
+    test_connect (enda, SOCKET_ADDRESS_A);
+    endb = test_socket (AF_SP, GRID_REP);
+    test_connect (endb, SOCKET_ADDRESS_B);
+    endc = test_socket (AF_SP, GRID_PUSH);
+    test_connect (endc, SOCKET_ADDRESS_C);
+    endd = test_socket (AF_SP, GRID_PULL);
+    test_connect (endd, SOCKET_ADDRESS_D);
+
+    /*  Request/reply through the first pair. */
+    test_send (enda, "ABC");
+    test_recv (endb, "ABC");
+    test_send (endb, "DEF");
+    test_recv (enda, "DEF");
+
+    /*  A burst through the second pair arrives complete and in order. */
+    for (i = 0; i != BURST; ++i) {
+        sprintf (buf, "%d", i);
+        test_send (endc, buf);
+    }
+    for (i = 0; i != BURST; ++i) {
+        sprintf (buf, "%d", i);
+        test_recv (endd, buf);
+    }
+
+    /*  Clean up. */
+    test_close (endd);
+    test_close (endc);
+    test_close (endb);
+    test_close (enda);
+
+    /*  Shut down the device. */
+    grid_term ();
+    grid_thread_term (&thread);
+
+    return 0;
+}
@@ -0,0 +1,86 @@
+/*
+    Copyright (c) 2013 Martin Sustrik  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#include "../src/grid.h"
+#include "../src/pipeline.h"
+
+#include "testutil.h"
+#include "../src/utils/attr.h"
+#include "../src/utils/thread.c"
+
+/*  Tests closing the sockets of a device that is blocked waiting for
+    a message. */
+
+#define SOCKET_ADDRESS_A "inproc://a"
+#define SOCKET_ADDRESS_B "inproc://b"
+
+int s1;
+int s2;
+
+void device9 (GRID_UNUSED void *arg)
+{
+    int rc;
+
+    rc = grid_device (s1, s2);
+    grid_assert (rc < 0 && grid_errno () == EBADF);
+}
+
+void device9_threaded (GRID_UNUSED void *arg)
+{
+    int rc;
+
+    rc = grid_device_threaded (&s1, &s2, 1);
+    grid_assert (rc < 0 && grid_errno () == EBADF);
+}
+
+static void test_close_blocked (grid_thread_routine *routine)
+{
+    int endb;
+    struct grid_thread thread;
+
+    s1 = test_socket (AF_SP_RAW, GRID_PULL);
+    test_bind (s1, SOCKET_ADDRESS_A);
+    s2 = test_socket (AF_SP_RAW, GRID_PUSH);
+    test_bind (s2, SOCKET_ADDRESS_B);
+    endb = test_socket (AF_SP, GRID_PULL);
+    test_connect (endb, SOCKET_ADDRESS_B);
+
+    /*  Let the device block in receiving from s1. */
+    grid_thread_init (&thread, routine, NULL);
+    grid_sleep (100);
+
+    /*  Closing the socket the device sends to must not wait for the device.
+        Closing the socket it receives from wakes the device up. */
+    test_close (s2);
+    test_close (s1);
+    grid_thread_term (&thread);
+
+    test_close (endb);
+}
+
+int main ()
+{
+    test_close_blocked (device9);
+    test_close_blocked (device9_threaded);
+
+    return 0;
+}
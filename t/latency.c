@@ -0,0 +1,162 @@
+/*
+    Copyright (c) 2013 Martin Sustrik  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#include "../src/grid.h"
+#include "../src/reqrep.h"
+
+#include "testutil.h"
+
+/*  Tests latency statistics collection. */
+
+#define SOCKET_ADDRESS_INPROC "inproc://test"
+#define SOCKET_ADDRESS_TCP "tcp://127.0.0.1:5580"
+
+static void check_latency (int s, int option, uint64_t count)
+{
+    int rc;
+    struct grid_latency latency;
+    size_t sz;
+
+    sz = sizeof (latency);
+    rc = grid_getsockopt (s, GRID_SOL_SOCKET, option, &latency, &sz);
+    errno_assert (rc == 0);
+    grid_assert (sz == sizeof (latency));
+    grid_assert (latency.count == count);
+    if (!count)
+        return;
+    grid_assert (latency.min <= latency.p50);
+    grid_assert (latency.p50 <= latency.p90);
+    grid_assert (latency.p90 <= latency.p99);
+    grid_assert (latency.p99 <= latency.p999);
+    grid_assert (latency.p999 <= latency.max);
+    grid_assert (latency.mean >= latency.min && latency.mean <= latency.max);
+}
+
+/*  Checks the send latency histogram of the only pipe of the socket. */
+static void check_pipe_latency (int s, uint64_t count)
+{
+    int rc;
+    struct grid_pipe_stats pipe;
+
+    rc = grid_pipe_stats (s, -1, &pipe, 1);
+    errno_assert (rc == 1);
+    grid_assert (pipe.send_latency.count == count);
+    if (!count)
+        return;
+    grid_assert (pipe.send_latency.min <= pipe.send_latency.p50);
+    grid_assert (pipe.send_latency.p999 <= pipe.send_latency.max);
+}
+
+static void roundtrips (int req, int rep, int count)
+{
+    int i;
+
+    for (i = 0; i != count; ++i) {
+        test_send (req, "ABC");
+        test_recv (rep, "ABC");
+        test_send (rep, "DEF");
+        test_recv (req, "DEF");
+    }
+}
+
+int main ()
+{
+    int rc;
+    int req;
+    int rep;
+    int val;
+    size_t sz;
+
+    /*  Nothing is collected unless asked for. */
+    rep = test_socket (AF_SP, GRID_REP);
+    test_bind (rep, SOCKET_ADDRESS_INPROC);
+    req = test_socket (AF_SP, GRID_REQ);
+    test_connect (req, SOCKET_ADDRESS_INPROC);
+    sz = sizeof (val);
+    rc = grid_getsockopt (req, GRID_SOL_SOCKET, GRID_LATENCY_STATS, &val, &sz);
+    errno_assert (rc == 0);
+    grid_assert (val == 0);
+    roundtrips (req, rep, 10);
+    check_latency (req, GRID_SNDLATENCY, 0);
+    check_latency (req, GRID_RTTLATENCY, 0);
+    check_latency (rep, GRID_QUEUELATENCY, 0);
+    check_pipe_latency (req, 0);
+
+    /*  Invalid values are rejected. */
+    val = 2;
+    rc = grid_setsockopt (req, GRID_SOL_SOCKET, GRID_LATENCY_STATS,
+        &val, sizeof (val));
+    grid_assert (rc < 0 && grid_errno () == EINVAL);
+
+    /*  Each message and each request is accounted for exactly once. */
+    val = 1;
+    test_setsockopt (req, GRID_SOL_SOCKET, GRID_LATENCY_STATS,
+        &val, sizeof (val));
+    test_setsockopt (rep, GRID_SOL_SOCKET, GRID_LATENCY_STATS,
+        &val, sizeof (val));
+    roundtrips (req, rep, 100);
+    check_latency (req, GRID_SNDLATENCY, 100);
+    check_latency (req, GRID_QUEUELATENCY, 100);
+    check_latency (req, GRID_RTTLATENCY, 100);
+    check_latency (rep, GRID_SNDLATENCY, 100);
+    check_latency (rep, GRID_QUEUELATENCY, 100);
+    check_latency (rep, GRID_RTTLATENCY, 0);
+    check_pipe_latency (req, 100);
+    check_pipe_latency (rep, 100);
+
+    /*  Re-enabling the collection starts from scratch. */
+    test_setsockopt (req, GRID_SOL_SOCKET, GRID_LATENCY_STATS,
+        &val, sizeof (val));
+    check_latency (req, GRID_RTTLATENCY, 0);
+    check_pipe_latency (req, 0);
+    roundtrips (req, rep, 5);
+    check_latency (req, GRID_RTTLATENCY, 5);
+    check_pipe_latency (req, 5);
+
+    /*  Switching it off drops the histograms. */
+    val = 0;
+    test_setsockopt (req, GRID_SOL_SOCKET, GRID_LATENCY_STATS,
+        &val, sizeof (val));
+    check_latency (req, GRID_RTTLATENCY, 0);
+    check_pipe_latency (req, 0);
+
+    test_close (req);
+    test_close (rep);
+
+    /*  Send latency is measured over asynchronous transports as well. */
+    rep = test_socket (AF_SP, GRID_REP);
+    test_bind (rep, SOCKET_ADDRESS_TCP);
+    req = test_socket (AF_SP, GRID_REQ);
+    val = 1;
+    test_setsockopt (req, GRID_SOL_SOCKET, GRID_LATENCY_STATS,
+        &val, sizeof (val));
+    test_connect (req, SOCKET_ADDRESS_TCP);
+    roundtrips (req, rep, 50);
+    check_latency (req, GRID_SNDLATENCY, 50);
+    check_latency (req, GRID_RTTLATENCY, 50);
+    check_latency (req, GRID_QUEUELATENCY, 0);
+    check_pipe_latency (req, 50);
+    test_close (req);
+    test_close (rep);
+
+    return 0;
+}
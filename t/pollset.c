@@ -0,0 +1,165 @@
+/*
+    Copyright (c) 2013 Martin Sustrik  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#include "../src/grid.h"
+#include "../src/pair.h"
+#include "../src/pubsub.h"
+
+#include "testutil.h"
+#include "../src/utils/attr.h"
+#include "../src/utils/thread.c"
+
+/*  Test of polling via grid_pollset API. */
+
+#define SOCKET_ADDRESS "inproc://a"
+
+int sc;
+struct grid_pollset *racing_ps;
+int racing_s;
+
+void routine (GRID_UNUSED void *arg)
+{
+   grid_sleep (10);
+   test_send (sc, "ABC");
+}
+
+void adder (GRID_UNUSED void *arg)
+{
+    int rc;
+
+    /*  Keep registering the socket till it gets closed. */
+    while (1) {
+        rc = grid_pollset_add (racing_ps, racing_s, GRID_POLLOUT);
+        if (rc < 0) {
+            grid_assert (grid_errno () == EBADF);
+            break;
+        }
+    }
+}
+
+int main ()
+{
+    int rc;
+    int sb;
+    struct grid_pollset *ps;
+    struct grid_pollfd pfd [2];
+    struct grid_thread thread;
+    int i;
+
+    sb = test_socket (AF_SP, GRID_PAIR);
+    test_bind (sb, SOCKET_ADDRESS);
+    sc = test_socket (AF_SP, GRID_PAIR);
+    test_connect (sc, SOCKET_ADDRESS);
+
+    ps = grid_pollset_create ();
+    grid_assert (ps);
+    rc = grid_pollset_add (ps, sb, GRID_POLLIN);
+    errno_assert (rc == 0);
+
+    /*  Nothing to receive. The call should time out. */
+    rc = grid_pollset_wait (ps, pfd, 2, 10);
+    errno_assert (rc >= 0);
+    grid_assert (rc == 0);
+
+    /*  Check that message arrival is reported. */
+    test_send (sc, "ABC");
+    grid_sleep (10);
+    rc = grid_pollset_wait (ps, pfd, 2, 0);
+    errno_assert (rc >= 0);
+    grid_assert (rc == 1);
+    grid_assert (pfd [0].fd == sb);
+    grid_assert (pfd [0].revents == GRID_POLLIN);
+
+    /*  Once the message is received the socket is not reported any more. */
+    test_recv (sb, "ABC");
+    rc = grid_pollset_wait (ps, pfd, 2, 0);
+    errno_assert (rc >= 0);
+    grid_assert (rc == 0);
+
+    /*  Check that the wait is woken up by a message arriving. */
+    grid_thread_init (&thread, routine, NULL);
+    rc = grid_pollset_wait (ps, pfd, 2, -1);
+    errno_assert (rc >= 0);
+    grid_assert (rc == 1);
+    grid_assert (pfd [0].fd == sb);
+    grid_assert (pfd [0].revents == GRID_POLLIN);
+    test_recv (sb, "ABC");
+    grid_thread_term (&thread);
+
+    /*  Check that when there are more ready sockets than space in the array,
+        all of them are reported in turns. */
+    rc = grid_pollset_add (ps, sb, GRID_POLLIN | GRID_POLLOUT);
+    errno_assert (rc == 0);
+    rc = grid_pollset_add (ps, sc, GRID_POLLOUT);
+    errno_assert (rc == 0);
+    rc = grid_pollset_wait (ps, pfd, 2, 0);
+    errno_assert (rc >= 0);
+    grid_assert (rc == 2);
+    rc = grid_pollset_wait (ps, pfd, 1, 0);
+    grid_assert (rc == 1);
+    rc = grid_pollset_wait (ps, pfd + 1, 1, 0);
+    grid_assert (rc == 1);
+    grid_assert (pfd [0].fd != pfd [1].fd);
+    grid_assert (pfd [0].revents == GRID_POLLOUT);
+    grid_assert (pfd [1].revents == GRID_POLLOUT);
+
+    /*  Check unregistering the sockets. */
+    rc = grid_pollset_rm (ps, sc);
+    errno_assert (rc == 0);
+    rc = grid_pollset_rm (ps, sc);
+    grid_assert (rc == -1 && grid_errno () == ENOENT);
+    rc = grid_pollset_add (ps, sc, 0);
+    grid_assert (rc == -1 && grid_errno () == EINVAL);
+    rc = grid_pollset_add (ps, 1000, GRID_POLLIN);
+    grid_assert (rc == -1 && grid_errno () == EBADF);
+
+    /*  Closed socket is removed from the pollset automatically. */
+    test_close (sb);
+    rc = grid_pollset_wait (ps, pfd, 2, 0);
+    errno_assert (rc >= 0);
+    grid_assert (rc == 0);
+
+    rc = grid_pollset_destroy (ps);
+    errno_assert (rc == 0);
+
+    /*  Socket being registered while it's closed by a different thread
+        doesn't stay in the pollset. PUB socket is always writable, so any
+        registration left behind would be reported. */
+    racing_ps = grid_pollset_create ();
+    grid_assert (racing_ps);
+    for (i = 0; i != 20; ++i) {
+        racing_s = test_socket (AF_SP, GRID_PUB);
+        grid_thread_init (&thread, adder, NULL);
+        grid_sleep (1);
+        test_close (racing_s);
+        grid_thread_term (&thread);
+        rc = grid_pollset_wait (racing_ps, pfd, 2, 0);
+        errno_assert (rc >= 0);
+        grid_assert (rc == 0);
+    }
+    rc = grid_pollset_destroy (racing_ps);
+    errno_assert (rc == 0);
+
+    test_close (sc);
+
+    return 0;
+}
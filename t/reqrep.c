@@ -37,6 +37,8 @@ int main ()
     int resend_ivl;
     char buf [7];
     int timeo;
+    int cache_size;
+    int eid;
 
     /*  Test req/rep with full socket types. */
     rep1 = test_socket (AF_SP, GRID_REP);
@@ -107,6 +109,62 @@ int main ()
     test_close (req1);
     test_close (rep1);
 
+    /*  Check that resent requests are answered from the reply cache. */
+    rep1 = test_socket (AF_SP, GRID_REP);
+    test_bind (rep1, SOCKET_ADDRESS);
+    req1 = test_socket (AF_SP, GRID_REQ);
+    eid = test_connect (req1, SOCKET_ADDRESS);
+    resend_ivl = 100;
+    rc = grid_setsockopt (req1, GRID_REQ, GRID_REQ_RESEND_IVL,
+        &resend_ivl, sizeof (resend_ivl));
+    errno_assert (rc == 0);
+    cache_size = 16;
+    rc = grid_setsockopt (rep1, GRID_REP, GRID_REP_CACHE_SIZE,
+        &cache_size, sizeof (cache_size));
+    errno_assert (rc == 0);
+    timeo = 100;
+    rc = grid_setsockopt (rep1, GRID_SOL_SOCKET, GRID_RCVTIMEO,
+       &timeo, sizeof (timeo));
+    errno_assert (rc == 0);
+
+    test_send (req1, "ABC");
+    test_recv (rep1, "ABC");
+    /*  Wait for the request to be resent. */
+    grid_sleep (250);
+    test_send (rep1, "DEF");
+    test_recv (req1, "DEF");
+    rc = grid_recv (rep1, buf, sizeof (buf), 0);
+    grid_assert (rc < 0 && grid_errno () == ETIMEDOUT);
+
+    /*  New request is passed to the user as usual. */
+    test_send (req1, "GHI");
+    test_recv (rep1, "GHI");
+    test_send (rep1, "JKL");
+    test_recv (req1, "JKL");
+
+    /*  Request resent via a new connection is answered from the cache. The
+        reply is lost because the connection breaks before it's sent. */
+    test_send (req1, "MNO");
+    test_recv (rep1, "MNO");
+    rc = grid_shutdown (req1, eid);
+    errno_assert (rc == 0);
+    grid_sleep (100);
+    test_send (rep1, "PQR");
+    test_connect (req1, SOCKET_ADDRESS);
+    /*  Wait for the request to be resent. */
+    grid_sleep (250);
+    rc = grid_recv (rep1, buf, sizeof (buf), 0);
+    grid_assert (rc < 0 && grid_errno () == ETIMEDOUT);
+    test_recv (req1, "PQR");
+
+    cache_size = -1;
+    rc = grid_setsockopt (rep1, GRID_REP, GRID_REP_CACHE_SIZE,
+        &cache_size, sizeof (cache_size));
+    grid_assert (rc < 0 && grid_errno () == EINVAL);
+
+    test_close (req1);
+    test_close (rep1);
+
     /*  Check sending a request when the peer is not available. (It should
         be sent immediatelly when the peer comes online rather than relying
         on the resend algorithm. */
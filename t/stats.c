@@ -0,0 +1,185 @@
+/*
+    Copyright (c) 2013 Martin Sustrik  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#include "../src/grid.h"
+#include "../src/pair.h"
+
+#include "testutil.h"
+
+#include <string.h>
+
+/*  Tests per-endpoint and per-pipe statistics. */
+
+#define SOCKET_ADDRESS_INPROC "inproc://test"
+#define SOCKET_ADDRESS_TCP "tcp://127.0.0.1:5581"
+
+int main ()
+{
+    int rc;
+    int sb;
+    int sc;
+    int eid1;
+    int eid2;
+    int i;
+    int ivl;
+    int pipeid;
+    struct grid_ep_stats eps [4];
+    struct grid_pipe_stats pipes [4];
+    char buf [8];
+    char expected [128];
+    char *snapshot;
+
+    sb = test_socket (AF_SP, GRID_PAIR);
+    eid1 = test_bind (sb, SOCKET_ADDRESS_INPROC);
+    eid2 = test_bind (sb, SOCKET_ADDRESS_TCP);
+
+    /*  Sizing query. */
+    rc = grid_ep_stats (sb, NULL, 0);
+    grid_assert (rc == 2);
+    rc = grid_pipe_stats (sb, -1, NULL, 0);
+    grid_assert (rc == 0);
+
+    /*  Invalid arguments. */
+    rc = grid_pipe_stats (sb, 1000, pipes, 4);
+    grid_assert (rc == -1 && grid_errno () == EINVAL);
+    rc = grid_ep_stats (sb, NULL, 1);
+    grid_assert (rc == -1 && grid_errno () == EINVAL);
+    rc = grid_ep_stats (1000, eps, 4);
+    grid_assert (rc == -1 && grid_errno () == EBADF);
+
+    sc = test_socket (AF_SP, GRID_PAIR);
+    test_connect (sc, SOCKET_ADDRESS_INPROC);
+    for (i = 0; i != 10; ++i) {
+        test_send (sc, "ABC");
+        test_recv (sb, "ABC");
+    }
+    test_send (sb, "DEFG");
+    test_recv (sc, "DEFG");
+
+    rc = grid_ep_stats (sb, eps, 4);
+    grid_assert (rc == 2);
+    grid_assert (eps [0].eid == eid1);
+    grid_assert (eps [0].bind == 1);
+    grid_assert (eps [0].pipes == 1);
+    grid_assert (eps [0].reconnects == 0);
+    grid_assert (strcmp (eps [0].addr, SOCKET_ADDRESS_INPROC) == 0);
+    grid_assert (eps [1].eid == eid2);
+    grid_assert (eps [1].pipes == 0);
+
+    rc = grid_pipe_stats (sb, eid1, pipes, 4);
+    grid_assert (rc == 1);
+    grid_assert (pipes [0].eid == eid1);
+    grid_assert (pipes [0].messages_received == 10);
+    grid_assert (pipes [0].bytes_received == 30);
+    grid_assert (pipes [0].messages_sent == 1);
+    grid_assert (pipes [0].bytes_sent == 4);
+    grid_assert (pipes [0].rcvqueue == 0);
+    pipeid = pipes [0].id;
+
+    rc = grid_pipe_stats (sb, eid2, pipes, 4);
+    grid_assert (rc == 0);
+
+    /*  Snapshot of all the sockets. */
+    rc = grid_stats_snapshot (GRID_STATS_JSON, &snapshot, GRID_MSG);
+    errno_assert (rc > 0);
+    grid_assert (snapshot [0] == '{' && snapshot [rc - 1] == '\n');
+    snapshot [rc - 1] = 0;
+    grid_assert (strstr (snapshot, "\"addr\":\"" SOCKET_ADDRESS_TCP "\""));
+    sprintf (expected, "{\"socket\":%d,\"name\":\"%d\",", sb, sb);
+    grid_assert (strstr (snapshot, expected));
+    grid_assert (strstr (strstr (snapshot, expected),
+        "\"messages_received\":10,"));
+    grid_freemsg (snapshot);
+
+    rc = grid_stats_snapshot (GRID_STATS_PROMETHEUS, &snapshot, GRID_MSG);
+    errno_assert (rc > 0);
+    snapshot [rc - 1] = 0;
+    sprintf (expected, "\ngridmq_socket_messages_received_total"
+        "{socket=\"%d\"} 10\n", sb);
+    grid_assert (strstr (snapshot, expected));
+    sprintf (expected, "\ngridmq_pipe_bytes_received_total"
+        "{socket=\"%d\",eid=\"%d\",pipe=\"%d\"} 30\n", sb, eid1, pipeid);
+    grid_assert (strstr (snapshot, expected));
+    grid_freemsg (snapshot);
+
+    /*  The snapshot is truncated to fit into the buffer. */
+    rc = grid_stats_snapshot (GRID_STATS_JSON, buf, sizeof (buf));
+    grid_assert (rc > (int) sizeof (buf));
+    grid_assert (memcmp (buf, "{\"hostna", sizeof (buf)) == 0);
+    rc = grid_stats_snapshot (100, buf, sizeof (buf));
+    grid_assert (rc == -1 && grid_errno () == EINVAL);
+
+    /*  Messages pending in the inbound queue are reported. */
+    for (i = 0; i != 3; ++i)
+        test_send (sc, "ABC");
+    grid_sleep (10);
+    rc = grid_pipe_stats (sb, -1, pipes, 4);
+    grid_assert (rc == 1);
+    grid_assert (pipes [0].rcvqueue == 3);
+    for (i = 0; i != 3; ++i)
+        test_recv (sb, "ABC");
+
+    test_close (sc);
+
+    /*  Reconnections of the connecting endpoint are counted. */
+    sc = test_socket (AF_SP, GRID_PAIR);
+    ivl = 10;
+    test_setsockopt (sc, GRID_SOL_SOCKET, GRID_RECONNECT_IVL, &ivl,
+        sizeof (ivl));
+    eid1 = test_connect (sc, SOCKET_ADDRESS_TCP);
+    test_send (sc, "ABC");
+    test_recv (sb, "ABC");
+    test_close (sb);
+
+    sb = test_socket (AF_SP, GRID_PAIR);
+    test_bind (sb, SOCKET_ADDRESS_TCP);
+
+    /*  Wait till the connection is re-established so that the message
+        is not sent to the old, broken connection. */
+    for (i = 0; i != 100; ++i) {
+        rc = grid_ep_stats (sc, eps, 4);
+        grid_assert (rc == 1);
+        if (eps [0].connections == 2 && eps [0].pipes == 1)
+            break;
+        grid_sleep (10);
+    }
+    test_send (sc, "ABC");
+    test_recv (sb, "ABC");
+
+    rc = grid_ep_stats (sc, eps, 4);
+    grid_assert (rc == 1);
+    grid_assert (eps [0].eid == eid1);
+    grid_assert (eps [0].bind == 0);
+    grid_assert (eps [0].pipes == 1);
+    grid_assert (eps [0].connections == 2);
+    grid_assert (eps [0].reconnects == 1);
+
+    rc = grid_pipe_stats (sc, eid1, pipes, 4);
+    grid_assert (rc == 1);
+    grid_assert (pipes [0].messages_sent == 1);
+    grid_assert (pipes [0].sndqueue == 0);
+
+    test_close (sc);
+    test_close (sb);
+
+    return 0;
+}
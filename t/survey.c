@@ -26,6 +26,10 @@
 
 #include "testutil.h"
 
+#include "../src/utils/wire.c"
+
+#include <string.h>
+
 #define SOCKET_ADDRESS "inproc://test"
 
 int main ()
@@ -36,7 +40,17 @@ int main ()
     int respondent2;
     int respondent3;
     int deadline;
+    int maxsurveys;
+    int quorum;
+    int surveyid;
+    size_t sz;
     char buf [7];
+    struct grid_msghdr hdr;
+    struct grid_iovec iovec;
+    unsigned char ctrl [256];
+    struct grid_cmsghdr *cmsg;
+    unsigned char *data;
+    uint32_t ids [2];
 
     /*  Test a simple survey with three respondents. */
     surveyor = test_socket (AF_SP, GRID_SURVEYOR);
@@ -95,6 +109,132 @@ int main ()
     test_close (respondent2);
     test_close (respondent3);
 
+    /*  Test concurrent surveys. */
+    surveyor = test_socket (AF_SP, GRID_SURVEYOR);
+    deadline = 500;
+    test_setsockopt (surveyor, GRID_SURVEYOR, GRID_SURVEYOR_DEADLINE,
+        &deadline, sizeof (deadline));
+    maxsurveys = 2;
+    test_setsockopt (surveyor, GRID_SURVEYOR, GRID_SURVEYOR_MAXSURVEYS,
+        &maxsurveys, sizeof (maxsurveys));
+    test_bind (surveyor, SOCKET_ADDRESS);
+    respondent1 = test_socket (AF_SP, GRID_RESPONDENT);
+    test_connect (respondent1, SOCKET_ADDRESS);
+    respondent2 = test_socket (AF_SP, GRID_RESPONDENT);
+    test_connect (respondent2, SOCKET_ADDRESS);
+
+    /*  Start two surveys. The second one doesn't cancel the first one. */
+    test_send (surveyor, "ABC");
+    sz = sizeof (surveyid);
+    rc = grid_getsockopt (surveyor, GRID_SURVEYOR, GRID_SURVEYOR_SURVEYID,
+        &surveyid, &sz);
+    errno_assert (rc == 0);
+    ids [0] = (uint32_t) surveyid;
+    test_send (surveyor, "DEF");
+    rc = grid_getsockopt (surveyor, GRID_SURVEYOR, GRID_SURVEYOR_SURVEYID,
+        &surveyid, &sz);
+    errno_assert (rc == 0);
+    ids [1] = (uint32_t) surveyid;
+    grid_assert (ids [0] != ids [1]);
+
+    /*  Respondent answers both surveys. */
+    test_recv (respondent1, "ABC");
+    test_send (respondent1, "GHI");
+    test_recv (respondent1, "DEF");
+    test_send (respondent1, "JKL");
+
+    /*  Surveyor gets responses to both surveys, tagged with survey IDs. */
+    iovec.iov_base = buf;
+    iovec.iov_len = sizeof (buf);
+    hdr.msg_iov = &iovec;
+    hdr.msg_iovlen = 1;
+    hdr.msg_control = ctrl;
+    hdr.msg_controllen = sizeof (ctrl);
+    rc = grid_recvmsg (surveyor, &hdr, 0);
+    errno_assert (rc == 3);
+    grid_assert (memcmp (buf, "GHI", 3) == 0);
+    cmsg = GRID_CMSG_FIRSTHDR (&hdr);
+    grid_assert (cmsg && cmsg->cmsg_level == PROTO_SP &&
+        cmsg->cmsg_type == SP_HDR);
+    data = GRID_CMSG_DATA (cmsg) + sizeof (size_t);
+    grid_assert (grid_getl (data) == ids [0]);
+    hdr.msg_controllen = sizeof (ctrl);
+    rc = grid_recvmsg (surveyor, &hdr, 0);
+    errno_assert (rc == 3);
+    grid_assert (memcmp (buf, "JKL", 3) == 0);
+    cmsg = GRID_CMSG_FIRSTHDR (&hdr);
+    grid_assert (cmsg);
+    data = GRID_CMSG_DATA (cmsg) + sizeof (size_t);
+    grid_assert (grid_getl (data) == ids [1]);
+
+    /*  Once both surveys expire, recv reports the timeout. */
+    rc = grid_recv (surveyor, buf, sizeof (buf), 0);
+    errno_assert (rc == -1 && grid_errno () == ETIMEDOUT);
+    rc = grid_recv (surveyor, buf, sizeof (buf), 0);
+    errno_assert (rc == -1 && grid_errno () == EFSM);
+
+    /*  Starting a survey over the limit cancels the oldest one. */
+    test_send (surveyor, "A");
+    test_send (surveyor, "B");
+    test_send (surveyor, "C");
+    test_recv (respondent2, "ABC");
+    test_recv (respondent2, "DEF");
+    test_recv (respondent2, "A");
+    test_send (respondent2, "X");
+    test_recv (respondent2, "B");
+    test_send (respondent2, "Y");
+    test_recv (respondent2, "C");
+    test_send (respondent2, "Z");
+    test_recv (surveyor, "Y");
+    test_recv (surveyor, "Z");
+    rc = grid_recv (surveyor, buf, sizeof (buf), 0);
+    errno_assert (rc == -1 && grid_errno () == ETIMEDOUT);
+
+    /*  Test survey completing once the quorum is reached. */
+    deadline = 10000;
+    test_setsockopt (surveyor, GRID_SURVEYOR, GRID_SURVEYOR_DEADLINE,
+        &deadline, sizeof (deadline));
+    quorum = 2;
+    test_setsockopt (surveyor, GRID_SURVEYOR, GRID_SURVEYOR_QUORUM,
+        &quorum, sizeof (quorum));
+    test_recv (respondent1, "A");
+    test_recv (respondent1, "B");
+    test_recv (respondent1, "C");
+    test_send (surveyor, "QRS");
+    test_recv (respondent1, "QRS");
+    test_send (respondent1, "TUV");
+    test_recv (respondent2, "QRS");
+    test_send (respondent2, "TUV");
+    test_recv (surveyor, "TUV");
+    test_recv (surveyor, "TUV");
+
+    /*  The survey is done without waiting for the deadline. */
+    rc = grid_recv (surveyor, buf, sizeof (buf), GRID_DONTWAIT);
+    errno_assert (rc == -1 && grid_errno () == ETIMEDOUT);
+    rc = grid_recv (surveyor, buf, sizeof (buf), GRID_DONTWAIT);
+    errno_assert (rc == -1 && grid_errno () == EFSM);
+
+    /*  Sub-millisecond deadline. */
+    quorum = 0;
+    test_setsockopt (surveyor, GRID_SURVEYOR, GRID_SURVEYOR_QUORUM,
+        &quorum, sizeof (quorum));
+    deadline = 800;
+    test_setsockopt (surveyor, GRID_SURVEYOR, GRID_SURVEYOR_DEADLINE_US,
+        &deadline, sizeof (deadline));
+    test_send (surveyor, "WXY");
+    rc = grid_recv (surveyor, buf, sizeof (buf), 0);
+    errno_assert (rc == -1 && grid_errno () == ETIMEDOUT);
+
+    /*  Invalid limits are rejected. */
+    maxsurveys = 0;
+    rc = grid_setsockopt (surveyor, GRID_SURVEYOR, GRID_SURVEYOR_MAXSURVEYS,
+        &maxsurveys, sizeof (maxsurveys));
+    errno_assert (rc == -1 && grid_errno () == EINVAL);
+
+    test_close (surveyor);
+    test_close (respondent1);
+    test_close (respondent2);
+
     return 0;
 }
 
@@ -24,6 +24,7 @@
 #include "../src/grid.h"
 #include "../src/pair.h"
 #include "../src/pubsub.h"
+#include "../src/pipeline.h"
 #include "../src/tcp.h"
 
 #include "testutil.h"
@@ -42,6 +43,7 @@ int main ()
     int opt;
     size_t sz;
     int s1, s2;
+    int pushes [8];
     void * dummy_buf;
 
     /*  Try closing bound but unconnected socket. */
@@ -226,5 +228,41 @@ int main ()
     test_close (sb);
     test_close (sc);
 
+    /*  Test GRID_TCP_LISTENERS option. */
+    sb = test_socket (AF_SP, GRID_PULL);
+    sz = sizeof (opt);
+    rc = grid_getsockopt (sb, GRID_TCP, GRID_TCP_LISTENERS, &opt, &sz);
+    errno_assert (rc == 0);
+    grid_assert (sz == sizeof (opt) && opt == 1);
+    opt = 0;
+    rc = grid_setsockopt (sb, GRID_TCP, GRID_TCP_LISTENERS, &opt, sizeof (opt));
+    grid_assert (rc < 0 && grid_errno () == EINVAL);
+    opt = 65;
+    rc = grid_setsockopt (sb, GRID_TCP, GRID_TCP_LISTENERS, &opt, sizeof (opt));
+    grid_assert (rc < 0 && grid_errno () == EINVAL);
+    opt = 4;
+    rc = grid_setsockopt (sb, GRID_TCP, GRID_TCP_LISTENERS, &opt, sizeof (opt));
+    if (rc < 0 && grid_errno () == ENOTSUP) {
+
+        /*  SO_REUSEPORT is not available on this platform. */
+        test_close (sb);
+        return 0;
+    }
+    errno_assert (rc == 0);
+
+    /*  Connections are accepted no matter which listener they arrive at. */
+    test_bind (sb, SOCKET_ADDRESS);
+    for (i = 0; i != 8; ++i) {
+        pushes [i] = test_socket (AF_SP, GRID_PUSH);
+        test_connect (pushes [i], SOCKET_ADDRESS);
+    }
+    for (i = 0; i != 8; ++i)
+        test_send (pushes [i], "ABC");
+    for (i = 0; i != 8; ++i)
+        test_recv (sb, "ABC");
+    for (i = 0; i != 8; ++i)
+        test_close (pushes [i]);
+    test_close (sb);
+
     return 0;
 }
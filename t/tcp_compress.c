@@ -0,0 +1,223 @@
+/*
+    Copyright (c) 2013 Martin Sustrik  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#include "../src/grid.h"
+#include "../src/pair.h"
+#include "../src/tcp.h"
+
+#include "testutil.h"
+
+#include <string.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+/*  Tests compression of messages on TCP connections. */
+
+#define SOCKET_ADDRESS "tcp://127.0.0.1:5591"
+#define SOCKET_PORT 5591
+
+#define MSG_SIZE 65536
+
+static char msg [MSG_SIZE];
+static char buf [MSG_SIZE];
+
+static const char dict [] =
+    "{\"id\": 0, \"name\": \"\", \"status\": \"active\", \"tags\": []}";
+
+static void set_compress (int s, int level)
+{
+    test_setsockopt (s, GRID_TCP, GRID_TCP_COMPRESS, &level, sizeof (level));
+}
+
+static void send_msg (int s, size_t sz)
+{
+    int rc;
+
+    rc = grid_send (s, msg, sz, 0);
+    errno_assert (rc >= 0);
+    grid_assert ((size_t) rc == sz);
+}
+
+static void recv_msg (int s, size_t sz)
+{
+    int rc;
+
+    rc = grid_recv (s, buf, sizeof (buf), 0);
+    errno_assert (rc >= 0);
+    grid_assert ((size_t) rc == sz);
+    grid_assert (memcmp (buf, msg, sz) == 0);
+}
+
+static void test_pingpong (int sb, int sc)
+{
+    int i;
+
+    /*  Large messages share the compression stream; small ones bypass it.
+        Mix them to make sure both sides stay in sync. */
+    for (i = 0; i != 20; ++i) {
+        send_msg (sc, MSG_SIZE);
+        recv_msg (sb, MSG_SIZE);
+        send_msg (sb, 100);
+        recv_msg (sc, 100);
+        send_msg (sb, 1000 + i);
+        recv_msg (sc, 1000 + i);
+    }
+}
+
+int main ()
+{
+    int rc;
+    int sb;
+    int sc;
+    int opt;
+    size_t sz;
+    size_t pos;
+    int i;
+    int fd;
+    struct sockaddr_in addr;
+    uint8_t hdr [8];
+    uint64_t size;
+
+    /*  Fill in a compressible message. */
+    for (pos = 0, i = 0; pos < MSG_SIZE; ++i)
+        pos += snprintf (msg + pos, MSG_SIZE - pos,
+            "{\"id\": %d, \"name\": \"item%d\", \"status\": \"active\"}, ",
+            i, i % 17);
+
+    /*  Check the socket options. */
+    sc = test_socket (AF_SP, GRID_PAIR);
+    sz = sizeof (opt);
+    rc = grid_getsockopt (sc, GRID_TCP, GRID_TCP_COMPRESS, &opt, &sz);
+    errno_assert (rc == 0);
+    grid_assert (sz == sizeof (opt) && opt == 0);
+    sz = sizeof (opt);
+    rc = grid_getsockopt (sc, GRID_TCP, GRID_TCP_COMPRESS_THRESHOLD, &opt, &sz);
+    errno_assert (rc == 0);
+    grid_assert (sz == sizeof (opt) && opt == 512);
+    sz = sizeof (buf);
+    rc = grid_getsockopt (sc, GRID_TCP, GRID_TCP_COMPRESS_DICT, buf, &sz);
+    errno_assert (rc == 0);
+    grid_assert (sz == 0);
+    opt = 10;
+    rc = grid_setsockopt (sc, GRID_TCP, GRID_TCP_COMPRESS, &opt, sizeof (opt));
+    grid_assert (rc < 0 && grid_errno () == EINVAL);
+    rc = grid_setsockopt (sc, GRID_TCP, GRID_TCP_COMPRESS_DICT, buf, 32769);
+    grid_assert (rc < 0 && grid_errno () == EINVAL);
+    opt = 1;
+    rc = grid_setsockopt (sc, GRID_TCP, GRID_TCP_COMPRESS, &opt, sizeof (opt));
+    if (rc < 0 && grid_errno () == ENOTSUP) {
+
+        /*  Built without compression support. */
+        test_close (sc);
+        return 77;
+    }
+    errno_assert (rc == 0);
+    test_setsockopt (sc, GRID_TCP, GRID_TCP_COMPRESS_DICT, dict, sizeof (dict));
+    sz = sizeof (buf);
+    rc = grid_getsockopt (sc, GRID_TCP, GRID_TCP_COMPRESS_DICT, buf, &sz);
+    errno_assert (rc == 0);
+    grid_assert (sz == sizeof (dict) && memcmp (buf, dict, sz) == 0);
+    test_close (sc);
+
+    /*  Both peers compress. */
+    sb = test_socket (AF_SP, GRID_PAIR);
+    set_compress (sb, 1);
+    test_bind (sb, SOCKET_ADDRESS);
+    sc = test_socket (AF_SP, GRID_PAIR);
+    set_compress (sc, 6);
+    test_connect (sc, SOCKET_ADDRESS);
+    test_pingpong (sb, sc);
+    test_close (sc);
+    test_close (sb);
+
+    /*  Both peers compress using the same dictionary. */
+    sb = test_socket (AF_SP, GRID_PAIR);
+    set_compress (sb, 1);
+    test_setsockopt (sb, GRID_TCP, GRID_TCP_COMPRESS_DICT, dict, sizeof (dict));
+    test_bind (sb, SOCKET_ADDRESS);
+    sc = test_socket (AF_SP, GRID_PAIR);
+    set_compress (sc, 1);
+    test_setsockopt (sc, GRID_TCP, GRID_TCP_COMPRESS_DICT, dict, sizeof (dict));
+    test_connect (sc, SOCKET_ADDRESS);
+    test_pingpong (sb, sc);
+    test_close (sc);
+    test_close (sb);
+
+    /*  Only one peer asks for compression. Messages are passed as is. */
+    sb = test_socket (AF_SP, GRID_PAIR);
+    set_compress (sb, 1);
+    test_bind (sb, SOCKET_ADDRESS);
+    sc = test_socket (AF_SP, GRID_PAIR);
+    test_connect (sc, SOCKET_ADDRESS);
+    test_pingpong (sb, sc);
+    test_close (sc);
+    test_close (sb);
+
+    /*  Check the wire format using a plain TCP socket as the peer. */
+    sb = test_socket (AF_SP, GRID_PAIR);
+    set_compress (sb, 1);
+    test_bind (sb, SOCKET_ADDRESS);
+    fd = socket (AF_INET, SOCK_STREAM, 0);
+    errno_assert (fd >= 0);
+    memset (&addr, 0, sizeof (addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons (SOCKET_PORT);
+    addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+    rc = connect (fd, (struct sockaddr*) &addr, sizeof (addr));
+    errno_assert (rc == 0);
+
+    /*  Advertise compression in the protocol header. */
+    memcpy (hdr, "\0SP\0\0\0\1\0", 8);
+    hdr [5] = GRID_PAIR;
+    rc = send (fd, hdr, sizeof (hdr), 0);
+    errno_assert (rc == sizeof (hdr));
+    rc = recv (fd, hdr, sizeof (hdr), MSG_WAITALL);
+    errno_assert (rc == sizeof (hdr));
+    grid_assert (memcmp (hdr, "\0SP\0", 4) == 0);
+    grid_assert (hdr [6] == 1);
+
+    /*  Large message is compressed, small one is not. */
+    send_msg (sb, MSG_SIZE);
+    rc = recv (fd, hdr, sizeof (hdr), MSG_WAITALL);
+    errno_assert (rc == sizeof (hdr));
+    size = 0;
+    for (i = 0; i != 8; ++i)
+        size = (size << 8) | hdr [i];
+    grid_assert (size & 0x8000000000000000ULL);
+    size &= ~0x8000000000000000ULL;
+    grid_assert (size < MSG_SIZE / 4);
+    rc = recv (fd, buf, (size_t) size, MSG_WAITALL);
+    errno_assert (rc == (int) size);
+    send_msg (sb, 100);
+    rc = recv (fd, hdr, sizeof (hdr), MSG_WAITALL);
+    errno_assert (rc == sizeof (hdr));
+    grid_assert (memcmp (hdr, "\0\0\0\0\0\0\0\144", 8) == 0);
+
+    rc = close (fd);
+    errno_assert (rc == 0);
+    test_close (sb);
+
+    return 0;
+}
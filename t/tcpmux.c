@@ -0,0 +1,224 @@
+/*
+    Copyright (c) 2013 Martin Sustrik  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#include "../src/grid.h"
+#include "../src/pair.h"
+#include "../src/tcpmux.h"
+
+#include "testutil.h"
+
+#include <string.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/*  Tests TCPMUX transport and the tcpmuxd daemon. */
+
+#define SOCKET_PORT 5592
+#define SOCKET_IPCPATH "/tmp/tcpmux-5592.ipc"
+
+/*  Longest service name allowed by RFC 1078. */
+#define MAXNAME 255
+
+/*  Connects to the daemon's TCP port directly, the way a foreign TCPMUX client
+    would do. */
+static int tcpmux_client (void)
+{
+    int rc;
+    int fd;
+    struct sockaddr_in addr;
+
+    fd = socket (AF_INET, SOCK_STREAM, 0);
+    errno_assert (fd >= 0);
+    memset (&addr, 0, sizeof (addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons (SOCKET_PORT);
+    addr.sin_addr.s_addr = inet_addr ("127.0.0.1");
+    rc = connect (fd, (struct sockaddr*) &addr, sizeof (addr));
+    errno_assert (rc == 0);
+    return fd;
+}
+
+/*  Registers a service with the daemon directly over its IPC socket. */
+static int tcpmux_service (void)
+{
+    int rc;
+    int fd;
+    struct sockaddr_un addr;
+
+    fd = socket (AF_UNIX, SOCK_STREAM, 0);
+    errno_assert (fd >= 0);
+    memset (&addr, 0, sizeof (addr));
+    addr.sun_family = AF_UNIX;
+    strcpy (addr.sun_path, SOCKET_IPCPATH);
+    rc = connect (fd, (struct sockaddr*) &addr, sizeof (addr));
+    errno_assert (rc == 0);
+    return fd;
+}
+
+int main ()
+{
+    int rc;
+    int sb1;
+    int sb2;
+    int sc1;
+    int sc2;
+    int i;
+    int opt;
+    size_t sz;
+    int sb3;
+    int fd;
+    int svc;
+    char buf [3];
+    char name [MAXNAME + 3];
+    char cbuf [CMSG_SPACE (sizeof (int))];
+    struct msghdr hdr;
+    struct iovec iov;
+    struct cmsghdr *cmsg;
+    struct grid_ep_stats eps;
+
+    /*  Start the daemon in this process. */
+    rc = grid_tcpmuxd (SOCKET_PORT);
+    errno_assert (rc == 0);
+
+    /*  Only one daemon can own the port. */
+    rc = grid_tcpmuxd (SOCKET_PORT);
+    grid_assert (rc < 0);
+
+    /*  Check NODELAY socket option. */
+    sc1 = test_socket (AF_SP, GRID_PAIR);
+    sz = sizeof (opt);
+    rc = grid_getsockopt (sc1, GRID_TCPMUX, GRID_TCPMUX_NODELAY, &opt, &sz);
+    errno_assert (rc == 0);
+    grid_assert (sz == sizeof (opt) && opt == 0);
+    opt = 2;
+    rc = grid_setsockopt (sc1, GRID_TCPMUX, GRID_TCPMUX_NODELAY, &opt,
+        sizeof (opt));
+    grid_assert (rc < 0 && grid_errno () == EINVAL);
+    opt = 1;
+    test_setsockopt (sc1, GRID_TCPMUX, GRID_TCPMUX_NODELAY, &opt, sizeof (opt));
+
+    /*  Try using invalid address strings. */
+    rc = grid_connect (sc1, "tcpmux://127.0.0.1:5592");
+    grid_assert (rc < 0 && grid_errno () == EINVAL);
+    rc = grid_connect (sc1, "tcpmux://127.0.0.1:5592/");
+    grid_assert (rc < 0 && grid_errno () == EINVAL);
+    rc = grid_connect (sc1, "tcpmux://127.0.0.1/foo");
+    grid_assert (rc < 0 && grid_errno () == EINVAL);
+    rc = grid_bind (sc1, "tcpmux://*:5592");
+    grid_assert (rc < 0 && grid_errno () == EINVAL);
+    rc = grid_bind (sc1, "tcpmux://*:100000/foo");
+    grid_assert (rc < 0 && grid_errno () == EINVAL);
+
+    /*  The daemon listens on IPv4 interfaces only. */
+    rc = grid_bind (sc1, "tcpmux://::1:5592/foo");
+    grid_assert (rc < 0 && grid_errno () == ENODEV);
+
+    /*  Two services sharing the same port. */
+    sb1 = test_socket (AF_SP, GRID_PAIR);
+    test_bind (sb1, "tcpmux://*:5592/foo");
+    sb2 = test_socket (AF_SP, GRID_PAIR);
+    test_bind (sb2, "tcpmux://*:5592/bar");
+    test_connect (sc1, "tcpmux://127.0.0.1:5592/foo");
+    sc2 = test_socket (AF_SP, GRID_PAIR);
+    test_connect (sc2, "tcpmux://127.0.0.1:5592/BAR");
+
+    for (i = 0; i != 10; ++i) {
+        test_send (sc1, "0123456789012345678901234567890123456789");
+        test_recv (sb1, "0123456789012345678901234567890123456789");
+        test_send (sb1, "foo");
+        test_recv (sc1, "foo");
+        test_send (sc2, "ABC");
+        test_recv (sb2, "ABC");
+        test_send (sb2, "bar");
+        test_recv (sc2, "bar");
+    }
+
+    /*  Unknown service is refused by the daemon itself. */
+    fd = tcpmux_client ();
+    rc = send (fd, "baz\r\n", 5, 0);
+    errno_assert (rc == 5);
+    rc = recv (fd, buf, 1, 0);
+    errno_assert (rc == 1);
+    grid_assert (buf [0] == '-');
+    close (fd);
+
+    /*  Service that is already registered is refused and the endpoint
+        reports the error while it keeps retrying. */
+    sb3 = test_socket (AF_SP, GRID_PAIR);
+    test_bind (sb3, "tcpmux://*:5592/foo");
+    grid_sleep (200);
+    rc = grid_ep_stats (sb3, &eps, 1);
+    errno_assert (rc == 1);
+    grid_assert (eps.last_errno == EADDRINUSE);
+    test_close (sb3);
+    test_send (sc1, "foo");
+    test_recv (sb1, "foo");
+
+    /*  Service name of the maximum length, which is too long to fit into
+        a gridmq address, registered and looked up by raw peers. */
+    memset (name, 'x', MAXNAME);
+    memcpy (name + MAXNAME, "\r\n", 2);
+    svc = tcpmux_service ();
+    rc = send (svc, name, MAXNAME + 2, 0);
+    errno_assert (rc == MAXNAME + 2);
+    rc = recv (svc, buf, 1, 0);
+    errno_assert (rc == 1);
+    grid_assert (buf [0] == '+');
+    fd = tcpmux_client ();
+    rc = send (fd, name, MAXNAME + 2, 0);
+    errno_assert (rc == MAXNAME + 2);
+    memset (&hdr, 0, sizeof (hdr));
+    iov.iov_base = buf;
+    iov.iov_len = 1;
+    hdr.msg_iov = &iov;
+    hdr.msg_iovlen = 1;
+    hdr.msg_control = cbuf;
+    hdr.msg_controllen = sizeof (cbuf);
+    rc = recvmsg (svc, &hdr, 0);
+    errno_assert (rc == 1);
+    cmsg = CMSG_FIRSTHDR (&hdr);
+    grid_assert (cmsg && cmsg->cmsg_type == SCM_RIGHTS);
+    close (*(int*) CMSG_DATA (cmsg));
+    close (fd);
+
+    /*  Name one character longer is dropped. */
+    fd = tcpmux_client ();
+    name [MAXNAME] = 'x';
+    memcpy (name + MAXNAME + 1, "\r\n", 2);
+    rc = send (fd, name, MAXNAME + 3, 0);
+    errno_assert (rc == MAXNAME + 3);
+    rc = recv (fd, buf, 1, 0);
+    grid_assert (rc <= 0);
+    close (fd);
+    close (svc);
+
+    test_close (sc2);
+    test_close (sb2);
+    test_close (sc1);
+    test_close (sb1);
+
+    return 0;
+}
@@ -31,9 +31,12 @@ int main ()
     int rc;
     int s;
     int timeo;
+    size_t sz;
     char buf [3];
     struct grid_stopwatch stopwatch;
     uint64_t elapsed;
+    uint64_t fastest;
+    int i;
 
     s = test_socket (AF_SP, GRID_PAIR);
 
@@ -55,6 +58,44 @@ int main ()
     errno_assert (rc < 0 && grid_errno () == ETIMEDOUT);
     time_assert (elapsed, 100000);
 
+    /*  Sub-millisecond timeout. It must never expire early. Where the wait
+        has microsecond precision it must not be rounded up to whole
+        milliseconds either. A single run can be delayed by the scheduler,
+        so the fastest of several runs is checked. */
+    timeo = 500;
+    rc = grid_setsockopt (s, GRID_SOL_SOCKET, GRID_RCVTIMEO_US, &timeo,
+        sizeof (timeo));
+    errno_assert (rc == 0);
+    fastest = UINT64_MAX;
+    for (i = 0; i != 20; ++i) {
+        grid_stopwatch_init (&stopwatch);
+        rc = grid_recv (s, buf, sizeof (buf), 0);
+        elapsed = grid_stopwatch_term (&stopwatch);
+        errno_assert (rc < 0 && grid_errno () == ETIMEDOUT);
+        grid_assert (elapsed >= 500);
+        if (elapsed < fastest)
+            fastest = elapsed;
+    }
+#if defined GRID_HAVE_PPOLL
+    grid_assert (fastest < 1000);
+#else
+    grid_assert (fastest < 50000);
+#endif
+
+    /*  Millisecond variant of the option rounds the timeout up. */
+    sz = sizeof (timeo);
+    rc = grid_getsockopt (s, GRID_SOL_SOCKET, GRID_RCVTIMEO, &timeo, &sz);
+    errno_assert (rc == 0);
+    grid_assert (timeo == 1);
+    timeo = 20;
+    rc = grid_setsockopt (s, GRID_SOL_SOCKET, GRID_SNDTIMEO, &timeo,
+        sizeof (timeo));
+    errno_assert (rc == 0);
+    sz = sizeof (timeo);
+    rc = grid_getsockopt (s, GRID_SOL_SOCKET, GRID_SNDTIMEO_US, &timeo, &sz);
+    errno_assert (rc == 0);
+    grid_assert (timeo == 20000);
+
     test_close (s);
 
     return 0;
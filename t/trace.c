@@ -0,0 +1,83 @@
+/*
+    Copyright (c) 2013 Martin Sustrik  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#include "../src/grid.h"
+#include "../src/pair.h"
+#include "../src/utils/trace.h"
+
+#include "testutil.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/*  Tests the state machine event trace. */
+
+#define SOCKET_ADDRESS "inproc://test"
+#define TRACE_FILE "trace.tmp"
+
+int main ()
+{
+    int rc;
+    int sb;
+    int sc;
+    FILE *f;
+    struct grid_trace_header hdr;
+
+    rc = grid_trace_dump (NULL);
+    grid_assert (rc == -1 && grid_errno () == EINVAL);
+
+    sb = test_socket (AF_SP, GRID_PAIR);
+    test_bind (sb, SOCKET_ADDRESS);
+    sc = test_socket (AF_SP, GRID_PAIR);
+    test_connect (sc, SOCKET_ADDRESS);
+    test_send (sc, "ABC");
+    test_recv (sb, "ABC");
+
+    rc = grid_trace_dump (TRACE_FILE);
+    if (rc == -1) {
+
+        /*  The library was built without tracing. */
+        errno_assert (grid_errno () == ENOTSUP);
+        test_close (sc);
+        test_close (sb);
+        return 0;
+    }
+    grid_assert (rc == 0);
+
+    /*  There must be at least the events that established the connection. */
+    f = fopen (TRACE_FILE, "rb");
+    grid_assert (f);
+    rc = (int) fread (&hdr, sizeof (hdr), 1, f);
+    grid_assert (rc == 1);
+    grid_assert (memcmp (hdr.magic, GRID_TRACE_MAGIC, sizeof (hdr.magic)) == 0);
+    grid_assert (hdr.nkinds > 0);
+    grid_assert (hdr.nrings > 0);
+    grid_assert (hdr.us1 >= hdr.us0);
+    fclose (f);
+    rc = remove (TRACE_FILE);
+    errno_assert (rc == 0);
+
+    test_close (sc);
+    test_close (sb);
+
+    return 0;
+}
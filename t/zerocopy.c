@@ -22,24 +22,109 @@
 */
 
 #include "../src/grid.h"
+#include "../src/inproc.h"
+#include "../src/pipeline.h"
 #include "../src/pubsub.h"
 #include "../src/reqrep.h"
 
 #include "testutil.h"
 
-/*
- * Nanomsg never zero copies anymore - it used to be an attribute of
- * the inproc transport, but frankly its a mistake for anyone to depend
- * on that.  The implementation must be free to copy, move data, etc.
- * The only thing that should be guaranteed is that the "ownership" of the
- * message on send is passed to libgridmq.  libgridmq may give that message
- * to an inproc receiver, or it can do something else (like copy the data)
- * with it.
- */
-#if 0
-
 #include <string.h>
 
+/*  By default the inproc transport is free to copy the message data. With
+    GRID_INPROC_ZEROCOPY set on the sending socket the ownership of the
+    message chunk is guaranteed to be handed over to the receiver. */
+
+#define LARGE_SIZE (10 * 1024 * 1024)
+
+static void test_zerocopy (int s)
+{
+    int zerocopy;
+
+    zerocopy = 1;
+    test_setsockopt (s, GRID_INPROC, GRID_INPROC_ZEROCOPY,
+        &zerocopy, sizeof (zerocopy));
+}
+
+void test_zerocopy_option ()
+{
+    int rc;
+    int s;
+    int val;
+    size_t sz;
+
+    s = test_socket (AF_SP, GRID_PUSH);
+
+    /*  The option is off by default. */
+    sz = sizeof (val);
+    rc = grid_getsockopt (s, GRID_INPROC, GRID_INPROC_ZEROCOPY, &val, &sz);
+    errno_assert (rc == 0);
+    grid_assert (sz == sizeof (val) && val == 0);
+
+    /*  Only boolean values are accepted. */
+    val = 2;
+    rc = grid_setsockopt (s, GRID_INPROC, GRID_INPROC_ZEROCOPY,
+        &val, sizeof (val));
+    grid_assert (rc < 0 && grid_errno () == EINVAL);
+
+    test_zerocopy (s);
+    sz = sizeof (val);
+    rc = grid_getsockopt (s, GRID_INPROC, GRID_INPROC_ZEROCOPY, &val, &sz);
+    errno_assert (rc == 0);
+    grid_assert (sz == sizeof (val) && val == 1);
+
+    test_close (s);
+}
+
+void test_zerocopy_pipeline ()
+{
+    int rc;
+    int push;
+    int pull;
+    void *p;
+    void *p2;
+
+    push = test_socket (AF_SP, GRID_PUSH);
+    test_zerocopy (push);
+    test_bind (push, "inproc://test");
+    pull = test_socket (AF_SP, GRID_PULL);
+    test_connect (pull, "inproc://test");
+
+    /*  The very same chunk arrives at the receiver. */
+    p = grid_allocmsg (12, 0);
+    grid_assert (p);
+    memcpy (p, "Hello World!", 12);
+    rc = grid_send (push, &p, GRID_MSG, 0);
+    errno_assert (rc == 12);
+    rc = grid_recv (pull, &p2, GRID_MSG, 0);
+    errno_assert (rc == 12);
+    grid_assert (p2 == p);
+    rc = memcmp (p2, "Hello World!", 12);
+    grid_assert (rc == 0);
+    rc = grid_freemsg (p2);
+    errno_assert (rc == 0);
+
+    /*  Same thing with a large message. */
+    p = grid_allocmsg (LARGE_SIZE, 0);
+    grid_assert (p);
+    memset (p, 0xab, LARGE_SIZE);
+    rc = grid_send (push, &p, GRID_MSG, 0);
+    errno_assert (rc == LARGE_SIZE);
+    rc = grid_recv (pull, &p2, GRID_MSG, 0);
+    errno_assert (rc == LARGE_SIZE);
+    grid_assert (p2 == p);
+    grid_assert (((unsigned char*) p2) [LARGE_SIZE - 1] == 0xab);
+    rc = grid_freemsg (p2);
+    errno_assert (rc == 0);
+
+    /*  Ordinary sends work as well. */
+    test_send (push, "ABC");
+    test_recv (pull, "ABC");
+
+    test_close (pull);
+    test_close (push);
+}
+
 void test_allocmsg_reqrep ()
 {
     int rc;
@@ -99,12 +184,12 @@ void test_reallocmsg_reqrep ()
     void *p2;
 
     /*  Create sockets. */
-    req = grid_socket (AF_SP, GRID_REQ);
-    rep = grid_socket (AF_SP, GRID_REP);
-    rc = grid_bind (rep, "inproc://test");
-    errno_assert (rc >= 0);
-    rc = grid_connect (req, "inproc://test");
-    errno_assert (rc >= 0);
+    req = test_socket (AF_SP, GRID_REQ);
+    test_zerocopy (req);
+    rep = test_socket (AF_SP, GRID_REP);
+    test_zerocopy (rep);
+    test_bind (rep, "inproc://test");
+    test_connect (req, "inproc://test");
 
     /*  Create message, make sure we handle overflow. */
     p = grid_allocmsg (100, 0);
@@ -120,23 +205,26 @@ void test_reallocmsg_reqrep ()
     rc = grid_send (req, &p, GRID_MSG, 0);
     errno_assert (rc == 12);
 
-    /*  Receive request and send response. */
-    rc = grid_recv (rep, &p, GRID_MSG, 0);
+    /*  Receive request and send response. The request ID travels in the SP
+        header, so the body chunk itself is passed both ways. */
+    rc = grid_recv (rep, &p2, GRID_MSG, 0);
     errno_assert (rc == 12);
-    rc = grid_send (rep, &p, GRID_MSG, 0);
+    grid_assert (p2 == p);
+    rc = grid_send (rep, &p2, GRID_MSG, 0);
     errno_assert (rc == 12);
 
     /*  Receive response and free message. */
-    rc = grid_recv (req, &p, GRID_MSG, 0);
+    rc = grid_recv (req, &p2, GRID_MSG, 0);
     errno_assert (rc == 12);
+    grid_assert (p2 == p);
     rc = memcmp (p, "Hello World!", 12);
     grid_assert (rc == 0);
     rc = grid_freemsg (p);
     errno_assert (rc == 0);
 
     /*  Clean up. */
-    grid_close (req);
-    grid_close (rep);
+    test_close (req);
+    test_close (rep);
 }
 
 void test_reallocmsg_pubsub ()
@@ -150,15 +238,13 @@ void test_reallocmsg_pubsub ()
     void *p2;
 
     /*  Create sockets. */
-    pub = grid_socket (AF_SP, GRID_PUB);
-    sub1 = grid_socket (AF_SP, GRID_SUB);
-    sub2 = grid_socket (AF_SP, GRID_SUB);
-    rc = grid_bind (pub, "inproc://test");
-    errno_assert (rc >= 0);
-    rc = grid_connect (sub1, "inproc://test");
-    errno_assert (rc >= 0);
-    rc = grid_connect (sub2, "inproc://test");
-    errno_assert (rc >= 0);
+    pub = test_socket (AF_SP, GRID_PUB);
+    test_zerocopy (pub);
+    sub1 = test_socket (AF_SP, GRID_SUB);
+    sub2 = test_socket (AF_SP, GRID_SUB);
+    test_bind (pub, "inproc://test");
+    test_connect (sub1, "inproc://test");
+    test_connect (sub2, "inproc://test");
     rc = grid_setsockopt (sub1, GRID_SUB, GRID_SUB_SUBSCRIBE, "", 0);
     errno_assert (rc == 0);
     rc = grid_setsockopt (sub2, GRID_SUB, GRID_SUB_SUBSCRIBE, "", 0);
@@ -171,12 +257,13 @@ void test_reallocmsg_pubsub ()
     rc = grid_send (pub, &p, GRID_MSG, 0);
     errno_assert (rc == 12);
 
-    /*  Receive messages, both messages are the same object with inproc. */
+    /*  Receive messages, both messages are the very object that was
+        published. */
     rc = grid_recv (sub1, &p1, GRID_MSG, 0);
     errno_assert (rc == 12);
     rc = grid_recv (sub2, &p2, GRID_MSG, 0);
     errno_assert (rc == 12);
-    grid_assert (p1 == p2);
+    grid_assert (p1 == p && p2 == p);
     rc = memcmp (p1, "Hello World!", 12);
     grid_assert (rc == 0);
     rc = memcmp (p2, "Hello World!", 12);
@@ -198,19 +285,19 @@ void test_reallocmsg_pubsub ()
     errno_assert (rc == 0);
 
     /*  Clean up. */
-    grid_close (sub2);
-    grid_close (sub1);
-    grid_close (pub);
+    test_close (sub2);
+    test_close (sub1);
+    test_close (pub);
 }
-#endif
 
 int main ()
 {
-#if 0
     test_allocmsg_reqrep ();
+    test_zerocopy_option ();
+    test_zerocopy_pipeline ();
     test_reallocmsg_reqrep ();
     test_reallocmsg_pubsub ();
-#endif
+
     return 0;
 }
 
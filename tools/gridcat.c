@@ -31,6 +31,9 @@
 #include "options.h"
 #include "../src/utils/sleep.c"
 #include "../src/utils/clock.c"
+#include "../src/utils/thread.c"
+#include "../src/utils/histogram.c"
+#include "../src/utils/wire.c"
 
 #include <stdio.h>
 #include <string.h>
@@ -38,7 +41,13 @@
 #include <stdlib.h>
 #include <time.h>
 #include <ctype.h>
+#include <limits.h>
 #include <unistd.h>
+#include <math.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 
 enum echo_format {
     GRID_NO_ECHO,
@@ -61,6 +70,7 @@ typedef struct grid_options {
     float recv_timeout;
     struct grid_string_list subscriptions;
     char *socket_name;
+    int raw_socket;
 
     /* Output options */
     float send_delay;
@@ -69,6 +79,19 @@ typedef struct grid_options {
 
     /* Input options */
     enum echo_format echo_format;
+
+    /* Load options */
+    float load_rate;
+    int load_poisson;
+    long load_count;
+    long load_threads;
+    char *load_size;
+    int load_report;
+
+    /* Capture options */
+    char *capture_file;
+    char *replay_file;
+    float replay_speed;
 } grid_options_t;
 
 /*  Constants to get address of in option declaration  */
@@ -123,6 +146,9 @@ struct grid_enum_item echo_formats[] = {
 #define GRID_MASK_SOCK_SUB 8
 #define GRID_MASK_DATA 16
 #define GRID_MASK_ENDPOINT 32
+#define GRID_MASK_LOAD 64
+#define GRID_MASK_CAPTURE 128
+#define GRID_MASK_REPLAY 256
 #define GRID_NO_PROVIDES 0
 #define GRID_NO_CONFLICTS 0
 #define GRID_NO_REQUIRES 0
@@ -228,6 +254,12 @@ struct grid_option grid_options[] = {
      GRID_OPT_STRING, offsetof (grid_options_t, socket_name), NULL,
      GRID_NO_PROVIDES, GRID_NO_CONFLICTS, GRID_NO_REQUIRES,
      "Socket Options", "NAME", "Name of the socket for statistics"},
+    {"raw-socket", 0, NULL,
+     GRID_OPT_INCREMENT, offsetof (grid_options_t, raw_socket), NULL,
+     GRID_NO_PROVIDES, GRID_NO_CONFLICTS, GRID_NO_REQUIRES,
+     "Socket Options", NULL, "Create the socket in AF_SP_RAW domain so that "
+     "the protocol headers are captured and replayed along with the "
+     "messages. Only used with --capture and --replay."},
 
     /* Pattern-specific options */
     {"subscribe", 0, NULL,
@@ -290,6 +322,59 @@ struct grid_option grid_options[] = {
      GRID_MASK_DATA, GRID_MASK_DATA, GRID_MASK_WRITEABLE,
      "Output Options", "PATH", "Same as --data but get data from file PATH"},
 
+    /* Load Options */
+    {"rate", 0, NULL,
+     GRID_OPT_FLOAT, offsetof (grid_options_t, load_rate), NULL,
+     GRID_MASK_DATA|GRID_MASK_LOAD, GRID_MASK_DATA, GRID_MASK_WRITEABLE,
+     "Load Options", "RATE", "Instead of sending DATA, generate load of RATE "
+     "messages per second. Each message carries a sequence number and a "
+     "timestamp. Zero means as fast as possible. PUB, PUSH, PAIR and BUS "
+     "sockets only."},
+    {"poisson", 0, NULL,
+     GRID_OPT_INCREMENT, offsetof (grid_options_t, load_poisson), NULL,
+     GRID_NO_PROVIDES, GRID_NO_CONFLICTS, GRID_MASK_LOAD,
+     "Load Options", NULL, "Space the messages randomly (Poisson process) "
+     "rather than evenly, keeping the average RATE"},
+    {"count", 0, NULL,
+     GRID_OPT_INT, offsetof (grid_options_t, load_count), NULL,
+     GRID_NO_PROVIDES, GRID_NO_CONFLICTS, GRID_MASK_LOAD,
+     "Load Options", "NUM", "Quit after sending NUM messages"},
+    {"threads", 0, NULL,
+     GRID_OPT_INT, offsetof (grid_options_t, load_threads), NULL,
+     GRID_NO_PROVIDES, GRID_NO_CONFLICTS, GRID_MASK_LOAD,
+     "Load Options", "NUM", "Split the load among NUM sender threads"},
+    {"size", 0, NULL,
+     GRID_OPT_STRING, offsetof (grid_options_t, load_size), NULL,
+     GRID_NO_PROVIDES, GRID_NO_CONFLICTS, GRID_MASK_LOAD,
+     "Load Options", "SIZES", "Message size in bytes: either a single "
+     "number, a range MIN-MAX to pick from uniformly or a comma-separated "
+     "list to pick from uniformly. Default is 64."},
+    {"report", 0, NULL,
+     GRID_OPT_INCREMENT, offsetof (grid_options_t, load_report), NULL,
+     GRID_NO_PROVIDES, GRID_NO_CONFLICTS, GRID_MASK_READABLE,
+     "Load Options", NULL, "Instead of printing the messages, print "
+     "throughput, lost messages and latency of messages generated "
+     "using --rate every second"},
+
+    /* Capture Options */
+    {"capture", 0, NULL,
+     GRID_OPT_STRING, offsetof (grid_options_t, capture_file), NULL,
+     GRID_MASK_CAPTURE, GRID_MASK_REPLAY, GRID_MASK_READABLE,
+     "Capture Options", "PATH", "Record the received messages along with "
+     "their arrival times and protocol headers to file PATH. Capturing "
+     "stops on SIGINT or once --recv-timeout expires."},
+    {"replay", 0, NULL,
+     GRID_OPT_STRING, offsetof (grid_options_t, replay_file), NULL,
+     GRID_MASK_DATA|GRID_MASK_REPLAY, GRID_MASK_DATA|GRID_MASK_CAPTURE,
+     GRID_MASK_WRITEABLE,
+     "Capture Options", "PATH", "Instead of sending DATA, send the messages "
+     "recorded in file PATH by --capture, keeping the original timing"},
+    {"speed", 0, NULL,
+     GRID_OPT_FLOAT, offsetof (grid_options_t, replay_speed), NULL,
+     GRID_NO_PROVIDES, GRID_NO_CONFLICTS, GRID_MASK_REPLAY,
+     "Capture Options", "FACTOR", "Replay FACTOR times faster than the "
+     "messages were captured. Zero means as fast as possible."},
+
     /* Sentinel */
     {NULL, 0, NULL,
      0, 0, NULL,
@@ -349,7 +434,8 @@ int grid_create_socket (grid_options_t *options)
     int rc;
     int millis;
 
-    sock = grid_socket (AF_SP, options->socket_type);
+    sock = grid_socket (options->raw_socket ? AF_SP_RAW : AF_SP,
+        options->socket_type);
     grid_assert_errno (sock >= 0, "Can't create socket");
 
     /* Generic initialization */
@@ -360,7 +446,7 @@ int grid_create_socket (grid_options_t *options)
         grid_assert_errno (rc == 0, "Can't set send timeout");
     }
     if (options->recv_timeout >= 0) {
-        grid_set_recv_timeout (sock, (int) options->recv_timeout);
+        grid_set_recv_timeout (sock, (int) (options->recv_timeout * 1000));
     }
     if (options->socket_name) {
         rc = grid_setsockopt (sock, GRID_SOL_SOCKET, GRID_SOCKET_NAME,
@@ -601,6 +687,732 @@ void grid_resp_loop (grid_options_t *options, int sock)
     }
 }
 
+/*  Load generator. Each message starts with a header carrying the magic
+    number, ID of the sender thread, sequence number and the time the
+    message was scheduled to be sent (CLOCK_REALTIME, in nanoseconds, so
+    that latency can be measured across hosts with synchronised clocks).
+    With a target rate the schedule is kept regardless of how long the
+    sends take. If the sender falls behind, the messages are sent back to
+    back and the timestamps still refer to the schedule, so that the stall
+    shows up in the measured latency. */
+
+#define GRID_LOAD_MAGIC 0x47434c44
+#define GRID_LOAD_HDRSIZE 24
+#define GRID_LOAD_DEFAULT_SIZE 64
+#define GRID_LOAD_MAXSENDERS 1024
+
+struct grid_load_sizes {
+    int min;
+    int max;
+    int num;
+    int *list;
+};
+
+struct grid_load_sender {
+    grid_options_t *options;
+    struct grid_load_sizes *sizes;
+    int sock;
+    uint32_t id;
+    double rate;
+    long count;
+    uint64_t sent;
+    struct grid_thread thread;
+};
+
+struct grid_load_peer {
+    uint32_t id;
+    int used;
+    uint64_t next;
+};
+
+struct grid_load_stats {
+    uint64_t msgs;
+    uint64_t bytes;
+    uint64_t lost;
+    uint64_t foreign;
+    struct grid_histogram latency;
+};
+
+static uint64_t grid_load_realtime ()
+{
+    struct timespec ts;
+
+    clock_gettime (CLOCK_REALTIME, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static uint64_t grid_load_random (uint64_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+static void grid_load_parse_sizes (const char *spec,
+    struct grid_load_sizes *sizes)
+{
+    const char *p;
+    char *end;
+    int i;
+
+    sizes->num = 0;
+    sizes->list = NULL;
+    if (!spec) {
+        sizes->min = sizes->max = GRID_LOAD_DEFAULT_SIZE;
+        return;
+    }
+
+    if (strchr (spec, ',')) {
+        sizes->num = 1;
+        for (p = spec; *p; ++p)
+            if (*p == ',')
+                ++sizes->num;
+        sizes->list = malloc (sizeof (int) * sizes->num);
+        grid_assert (sizes->list);
+        p = spec;
+        for (i = 0; i != sizes->num; ++i) {
+            sizes->list [i] = (int) strtol (p, &end, 10);
+            if (end == p || (*end != ',' && *end != 0) || sizes->list [i] < 0)
+                goto error;
+            p = end + 1;
+        }
+        return;
+    }
+
+    sizes->min = (int) strtol (spec, &end, 10);
+    if (end == spec || sizes->min < 0)
+        goto error;
+    sizes->max = sizes->min;
+    if (*end == '-') {
+        p = end + 1;
+        sizes->max = (int) strtol (p, &end, 10);
+        if (end == p || sizes->max < sizes->min)
+            goto error;
+    }
+    if (*end == 0)
+        return;
+
+error:
+    fprintf (stderr, "Invalid message size specification: %s\n", spec);
+    exit (1);
+}
+
+static int grid_load_size (struct grid_load_sizes *sizes, uint64_t *rnd)
+{
+    int size;
+
+    if (sizes->num)
+        size = sizes->list [grid_load_random (rnd) % sizes->num];
+    else
+        size = sizes->min + (int) (grid_load_random (rnd) %
+            (uint64_t) (sizes->max - sizes->min + 1));
+    return size < GRID_LOAD_HDRSIZE ? GRID_LOAD_HDRSIZE : size;
+}
+
+/*  Waits till the specified point in time (as returned by grid_clock_ns).
+    Sleeping tends to overshoot by tens of microseconds, so the last stretch
+    is spun. */
+static void grid_load_wait (uint64_t until)
+{
+    struct timespec ts;
+    uint64_t now;
+
+    now = grid_clock_ns ();
+    if (until > now + 60000) {
+        ts.tv_sec = 0;
+        ts.tv_nsec = (long) (until - now - 50000);
+        if (ts.tv_nsec >= 1000000000) {
+            ts.tv_sec = ts.tv_nsec / 1000000000;
+            ts.tv_nsec %= 1000000000;
+        }
+        nanosleep (&ts, NULL);
+    }
+    while (grid_clock_ns () < until)
+        ;
+}
+
+static void grid_load_sender_routine (void *arg)
+{
+    struct grid_load_sender *self;
+    uint64_t rnd;
+    uint64_t seq;
+    uint64_t now;
+    double next;
+    double interval;
+    double u;
+    int size;
+    int rc;
+    void *msg;
+
+    self = (struct grid_load_sender*) arg;
+    rnd = ((uint64_t) self->id << 32) | 0x9e3779b9;
+    interval = self->rate > 0 ? 1e9 / self->rate : 0;
+
+    /*  The schedule is kept in floating point so that the fractions of
+        nanosecond in the interval don't accumulate into a rate drift. */
+    next = (double) grid_clock_ns ();
+
+    for (seq = 0; self->count == 0 || seq < (uint64_t) self->count; ++seq) {
+        now = (uint64_t) next;
+        if (interval > 0) {
+            grid_load_wait (now);
+            if (self->options->load_poisson) {
+                u = (double) (grid_load_random (&rnd) >> 11) / 9007199254740992.0;
+                next += -log (1.0 - u) * interval;
+            }
+            else
+                next += interval;
+        }
+        else
+            now = grid_clock_ns ();
+
+        size = grid_load_size (self->sizes, &rnd);
+        msg = grid_allocmsg (size, 0);
+        grid_assert_errno (msg != NULL, "Can't allocate message");
+        memset ((char*) msg + GRID_LOAD_HDRSIZE, 0, size - GRID_LOAD_HDRSIZE);
+        grid_putl ((uint8_t*) msg, GRID_LOAD_MAGIC);
+        grid_putl ((uint8_t*) msg + 4, self->id);
+        grid_putll ((uint8_t*) msg + 8, seq);
+        grid_putll ((uint8_t*) msg + 16,
+            grid_load_realtime () - (grid_clock_ns () - now));
+        rc = grid_send (self->sock, &msg, GRID_MSG, 0);
+        if (rc < 0 && (errno == EAGAIN || errno == ETIMEDOUT)) {
+            grid_freemsg (msg);
+            if (self->options->verbose)
+                fprintf (stderr, "Message not sent (%s)\n",
+                    grid_strerror (errno));
+            continue;
+        }
+        if (rc < 0 && errno == ETERM)
+            break;
+        grid_assert_errno (rc >= 0, "Can't send");
+        ++self->sent;
+    }
+}
+
+void grid_load_send (grid_options_t *options, int sock)
+{
+    struct grid_load_sizes sizes;
+    struct grid_load_sender *senders;
+    uint64_t start;
+    uint64_t sent;
+    double elapsed;
+    long i;
+
+    switch (options->socket_type) {
+    case GRID_PUB:
+    case GRID_PUSH:
+    case GRID_PAIR:
+    case GRID_BUS:
+        break;
+    default:
+        fprintf (stderr, "Option --rate requires PUB, PUSH, PAIR or BUS "
+            "socket\n");
+        exit (1);
+    }
+    if (options->load_threads < 1 || options->load_count < 0) {
+        fprintf (stderr, "Invalid number of threads or messages\n");
+        exit (1);
+    }
+
+    grid_load_parse_sizes (options->load_size, &sizes);
+    senders = calloc (options->load_threads, sizeof (*senders));
+    grid_assert (senders);
+
+    /*  Each thread takes its share of both the rate and the count. */
+    start = grid_clock_ns ();
+    for (i = 0; i != options->load_threads; ++i) {
+        senders [i].options = options;
+        senders [i].sizes = &sizes;
+        senders [i].sock = sock;
+        senders [i].id = (uint32_t) getpid () * 2654435761u + (uint32_t) i;
+        senders [i].rate = options->load_rate / options->load_threads;
+        senders [i].count = options->load_count / options->load_threads;
+        if (i < options->load_count % options->load_threads)
+            ++senders [i].count;
+        if (options->load_count && !senders [i].count)
+            continue;
+        grid_thread_init (&senders [i].thread, grid_load_sender_routine,
+            &senders [i]);
+    }
+    sent = 0;
+    for (i = 0; i != options->load_threads; ++i) {
+        if (options->load_count && !senders [i].count)
+            continue;
+        grid_thread_term (&senders [i].thread);
+        sent += senders [i].sent;
+    }
+    elapsed = (double) (grid_clock_ns () - start) / 1e9;
+
+    if (options->verbose)
+        fprintf (stderr, "Sent %llu messages in %.3f s (%.0f msg/s)\n",
+            (unsigned long long) sent, elapsed,
+            elapsed > 0 ? sent / elapsed : 0);
+
+    free (senders);
+    free (sizes.list);
+}
+
+static void grid_load_stats_print (struct grid_load_stats *stats,
+    const char *label, double elapsed)
+{
+    if (elapsed <= 0)
+        elapsed = 1;
+    printf ("%s %10.0f msg/s %10.3f MB/s  lost %llu  foreign %llu  "
+        "latency [us] p50 %.1f p90 %.1f p99 %.1f p99.9 %.1f max %.1f\n",
+        label, stats->msgs / elapsed, stats->bytes / elapsed / 1000000,
+        (unsigned long long) stats->lost, (unsigned long long) stats->foreign,
+        grid_histogram_percentile (&stats->latency, 500) / 1000.0,
+        grid_histogram_percentile (&stats->latency, 900) / 1000.0,
+        grid_histogram_percentile (&stats->latency, 990) / 1000.0,
+        grid_histogram_percentile (&stats->latency, 999) / 1000.0,
+        stats->latency.max / 1000.0);
+    fflush (stdout);
+}
+
+static void grid_load_stats_add (struct grid_load_stats *self,
+    struct grid_load_stats *other)
+{
+    int i;
+
+    self->msgs += other->msgs;
+    self->bytes += other->bytes;
+    self->lost += other->lost;
+    self->foreign += other->foreign;
+    if (other->latency.count == 0)
+        return;
+    if (self->latency.count == 0 || other->latency.min < self->latency.min)
+        self->latency.min = other->latency.min;
+    if (other->latency.max > self->latency.max)
+        self->latency.max = other->latency.max;
+    self->latency.count += other->latency.count;
+    self->latency.sum += other->latency.sum;
+    for (i = 0; i != GRID_HISTOGRAM_BUCKETS; ++i)
+        self->latency.buckets [i] += other->latency.buckets [i];
+}
+
+/*  Accounts for a received message. Gaps in the sequence numbers of
+    a sender are reported as lost messages. */
+static void grid_load_account (struct grid_load_stats *stats,
+    struct grid_load_peer *peers, uint8_t *buf, int len)
+{
+    uint32_t id;
+    uint64_t seq;
+    uint64_t stamp;
+    uint64_t now;
+    int i;
+    int n;
+
+    if (len < GRID_LOAD_HDRSIZE || grid_getl (buf) != GRID_LOAD_MAGIC) {
+        ++stats->foreign;
+        return;
+    }
+    id = grid_getl (buf + 4);
+    seq = grid_getll (buf + 8);
+    stamp = grid_getll (buf + 16);
+
+    /*  Find the sender. If the table is full, messages from any new sender
+        can't be tracked and are counted as foreign. */
+    i = id % GRID_LOAD_MAXSENDERS;
+    for (n = 0; n != GRID_LOAD_MAXSENDERS; ++n) {
+        if (!peers [i].used || peers [i].id == id)
+            break;
+        i = (i + 1) % GRID_LOAD_MAXSENDERS;
+    }
+    if (n == GRID_LOAD_MAXSENDERS) {
+        ++stats->foreign;
+        return;
+    }
+
+    now = grid_load_realtime ();
+    ++stats->msgs;
+    stats->bytes += len;
+    grid_histogram_record (&stats->latency, now > stamp ? now - stamp : 0);
+
+    if (!peers [i].used) {
+        peers [i].used = 1;
+        peers [i].id = id;
+        peers [i].next = seq;
+    }
+    if (seq > peers [i].next)
+        stats->lost += seq - peers [i].next;
+    if (seq >= peers [i].next)
+        peers [i].next = seq + 1;
+}
+
+void grid_load_report (grid_options_t *options, int sock)
+{
+    struct grid_load_peer *peers;
+    struct grid_load_stats total;
+    struct grid_load_stats second;
+    uint64_t start;
+    uint64_t tick;
+    uint64_t last;
+    uint64_t now;
+    int64_t timeo;
+    int64_t idle;
+    int timeo_us;
+    int rc;
+    void *buf;
+    char label [32];
+
+    switch (options->socket_type) {
+    case GRID_SUB:
+    case GRID_PULL:
+    case GRID_PAIR:
+    case GRID_BUS:
+        break;
+    default:
+        fprintf (stderr, "Option --report requires SUB, PULL, PAIR or BUS "
+            "socket\n");
+        exit (1);
+    }
+
+    peers = calloc (GRID_LOAD_MAXSENDERS, sizeof (*peers));
+    grid_assert (peers);
+    memset (&total, 0, sizeof (total));
+    memset (&second, 0, sizeof (second));
+    grid_histogram_init (&total.latency);
+    grid_histogram_init (&second.latency);
+
+    /*  Statistics are printed every second. The clock starts with the first
+        message. With --recv-timeout the report ends once no message arrives
+        for the specified time. */
+    start = 0;
+    tick = 0;
+    last = grid_clock_ns ();
+    for (;;) {
+
+        /*  The receive timeout is adjusted only if there's no message
+            waiting, i.e. not for each message under load. */
+        rc = grid_recv (sock, &buf, GRID_MSG, GRID_DONTWAIT);
+        if (rc < 0 && errno == EAGAIN) {
+            now = grid_clock_ns ();
+            timeo = -1;
+            if (start)
+                timeo = now >= tick ? 0 : (int64_t) (tick - now) / 1000;
+            if (options->recv_timeout >= 0) {
+                idle = (int64_t) (last +
+                    (uint64_t) (options->recv_timeout * 1e9) - now) / 1000;
+                if (timeo < 0 || idle < timeo)
+                    timeo = idle < 0 ? 0 : idle;
+            }
+            timeo_us = timeo > INT_MAX ? INT_MAX : (int) timeo;
+            rc = grid_setsockopt (sock, GRID_SOL_SOCKET, GRID_RCVTIMEO_US,
+                &timeo_us, sizeof (timeo_us));
+            grid_assert_errno (rc == 0, "Can't set recv timeout");
+            rc = grid_recv (sock, &buf, GRID_MSG, 0);
+        }
+        now = grid_clock_ns ();
+        if (rc >= 0) {
+            if (!start) {
+                start = now;
+                tick = now + 1000000000;
+            }
+            last = now;
+            grid_load_account (&second, peers, buf, rc);
+            grid_freemsg (buf);
+        }
+        else if (errno == ETERM)
+            break;
+        else
+            grid_assert_errno (errno == ETIMEDOUT || errno == EAGAIN,
+                "Can't recv");
+
+        if (start && now >= tick) {
+            sprintf (label, "%8.3f s", (double) (tick - start) / 1e9);
+            grid_load_stats_print (&second, label, 1.0);
+            grid_load_stats_add (&total, &second);
+            grid_histogram_reset (&second.latency);
+            second.msgs = second.bytes = second.lost = second.foreign = 0;
+            tick += 1000000000;
+        }
+        if (options->recv_timeout >= 0 &&
+              now >= last + (uint64_t) (options->recv_timeout * 1e9))
+            break;
+    }
+
+    grid_load_stats_add (&total, &second);
+    if (start)
+        grid_load_stats_print (&total, "   total",
+            (double) (last - start) / 1e9);
+
+    grid_histogram_term (&second.latency);
+    grid_histogram_term (&total.latency);
+    free (peers);
+}
+
+/*  Capture file. The file starts with a header holding the magic, version
+    of the format, domain and type of the socket the messages were captured
+    from and the wall-clock time the capture started at (in nanoseconds).
+    It is followed by one record per message: the time since the start of
+    the capture in nanoseconds, size of the SP header, size of the body,
+    the SP header and the body. Records are padded to 8 bytes so that they
+    can be accessed in place when the file is memory-mapped. All the numbers
+    are in network byte order. */
+
+#define GRID_CAP_MAGIC "GRIDCAP"
+#define GRID_CAP_VERSION 1
+#define GRID_CAP_HDRSIZE 32
+#define GRID_CAP_RECSIZE 16
+#define GRID_CAP_ALIGN(sz) (((sz) + 7) & ~((uint64_t) 7))
+
+static volatile sig_atomic_t grid_cap_stopped = 0;
+
+static void grid_cap_signal (int signo)
+{
+    (void) signo;
+    grid_cap_stopped = 1;
+}
+
+void grid_capture (grid_options_t *options, int sock)
+{
+    FILE *f;
+    struct sigaction sa;
+    struct grid_iovec iov;
+    struct grid_msghdr hdr;
+    struct grid_cmsghdr *cmsg;
+    static const uint8_t pad [8];
+    uint8_t head [GRID_CAP_HDRSIZE];
+    uint8_t rec [GRID_CAP_RECSIZE];
+    uint8_t *sphdr;
+    size_t spsz;
+    uint64_t start;
+    uint64_t count;
+    int rc;
+    void *body;
+    void *ctrl;
+
+    if (!options->raw_socket && (options->socket_type == GRID_REQ ||
+          options->socket_type == GRID_SURVEYOR)) {
+        fprintf (stderr, "Option --capture requires --raw-socket for REQ "
+            "and SURVEYOR sockets\n");
+        exit (1);
+    }
+
+    f = fopen (options->capture_file, "wb");
+    grid_assert_errno (f != NULL, "Can't open capture file");
+    setvbuf (f, NULL, _IOFBF, 1 << 20);
+
+    /*  Interrupted grid_recvmsg returns EINTR, so the capture ends
+        gracefully and the buffered records are not lost. */
+    memset (&sa, 0, sizeof (sa));
+    sa.sa_handler = grid_cap_signal;
+    sigemptyset (&sa.sa_mask);
+    sigaction (SIGINT, &sa, NULL);
+    sigaction (SIGTERM, &sa, NULL);
+
+    memset (head, 0, sizeof (head));
+    memcpy (head, GRID_CAP_MAGIC, sizeof (GRID_CAP_MAGIC));
+    grid_putl (head + 8, GRID_CAP_VERSION);
+    grid_putl (head + 12, options->raw_socket ? AF_SP_RAW : AF_SP);
+    grid_putl (head + 16, options->socket_type);
+    grid_putll (head + 24, grid_load_realtime ());
+    start = grid_clock_ns ();
+    fwrite (head, 1, sizeof (head), f);
+
+    count = 0;
+    while (!grid_cap_stopped) {
+        iov.iov_base = &body;
+        iov.iov_len = GRID_MSG;
+        memset (&hdr, 0, sizeof (hdr));
+        hdr.msg_iov = &iov;
+        hdr.msg_iovlen = 1;
+        hdr.msg_control = &ctrl;
+        hdr.msg_controllen = GRID_MSG;
+        rc = grid_recvmsg (sock, &hdr, 0);
+        if (rc < 0 && errno == EAGAIN)
+            continue;
+        if (rc < 0 && (errno == ETIMEDOUT || errno == EINTR ||
+              errno == ETERM || errno == EFSM))
+            break;
+        grid_assert_errno (rc >= 0, "Can't recv");
+
+        sphdr = NULL;
+        spsz = 0;
+        cmsg = GRID_CMSG_FIRSTHDR (&hdr);
+        while (cmsg) {
+            if (cmsg->cmsg_level == PROTO_SP && cmsg->cmsg_type == SP_HDR) {
+                memcpy (&spsz, GRID_CMSG_DATA (cmsg), sizeof (spsz));
+                sphdr = GRID_CMSG_DATA (cmsg) + sizeof (spsz);
+                break;
+            }
+            cmsg = GRID_CMSG_NXTHDR (&hdr, cmsg);
+        }
+
+        grid_putll (rec, grid_clock_ns () - start);
+        grid_putl (rec + 8, (uint32_t) spsz);
+        grid_putl (rec + 12, (uint32_t) rc);
+        fwrite (rec, 1, sizeof (rec), f);
+        if (spsz)
+            fwrite (sphdr, 1, spsz, f);
+        fwrite (body, 1, rc, f);
+        fwrite (pad, 1, GRID_CAP_ALIGN (spsz + rc) - (spsz + rc), f);
+        grid_assert_errno (!ferror (f), "Can't write capture file");
+        ++count;
+
+        grid_print_message (options, body, rc);
+        grid_freemsg (body);
+        grid_freemsg (ctrl);
+    }
+
+    rc = fclose (f);
+    grid_assert_errno (rc == 0, "Can't write capture file");
+    if (options->verbose)
+        fprintf (stderr, "Captured %llu messages\n", (unsigned long long) count);
+}
+
+/*  Replays the capture file. The file is memory-mapped and the messages
+    are streamed straight from the mapping: each body is copied once into
+    a message chunk which is then handed over to the socket as GRID_MSG,
+    the copy being done before waiting for the time the message is due. */
+void grid_replay (grid_options_t *options, int sock)
+{
+    int fd;
+    int rc;
+    struct stat st;
+    struct grid_iovec iov;
+    struct grid_msghdr hdr;
+    struct grid_cmsghdr *cmsg;
+    uint8_t *map;
+    uint8_t *pos;
+    uint8_t *end;
+    uint64_t stamp;
+    uint64_t first;
+    uint64_t start;
+    uint64_t count;
+    uint64_t bytes;
+    int truncated;
+    uint32_t spsz;
+    uint32_t sz;
+    size_t ctrlsz;
+    double elapsed;
+    void *ctrl;
+    void *body;
+
+    if (options->replay_speed < 0) {
+        fprintf (stderr, "Invalid replay speed\n");
+        exit (1);
+    }
+    if (!options->raw_socket) {
+        switch (options->socket_type) {
+        case GRID_PUB:
+        case GRID_PUSH:
+        case GRID_PAIR:
+        case GRID_BUS:
+            break;
+        default:
+            fprintf (stderr, "Option --replay requires --raw-socket or PUB, "
+                "PUSH, PAIR or BUS socket\n");
+            exit (1);
+        }
+    }
+
+    fd = open (options->replay_file, O_RDONLY);
+    grid_assert_errno (fd >= 0, "Can't open capture file");
+    rc = fstat (fd, &st);
+    grid_assert_errno (rc == 0, "Can't open capture file");
+    if (st.st_size < GRID_CAP_HDRSIZE) {
+        fprintf (stderr, "%s: not a capture file\n", options->replay_file);
+        exit (1);
+    }
+    map = mmap (NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    grid_assert_errno (map != MAP_FAILED, "Can't map capture file");
+    posix_madvise (map, (size_t) st.st_size, POSIX_MADV_SEQUENTIAL);
+    end = map + st.st_size;
+
+    if (memcmp (map, GRID_CAP_MAGIC, sizeof (GRID_CAP_MAGIC)) != 0 ||
+          grid_getl (map + 8) != GRID_CAP_VERSION) {
+        fprintf (stderr, "%s: not a capture file\n", options->replay_file);
+        exit (1);
+    }
+    if (grid_getl (map + 12) == AF_SP_RAW && !options->raw_socket &&
+          options->verbose)
+        fprintf (stderr, "Protocol headers are not replayed without "
+            "--raw-socket\n");
+
+    ctrl = NULL;
+    ctrlsz = 0;
+    count = 0;
+    bytes = 0;
+    first = 0;
+    truncated = 0;
+    start = grid_clock_ns ();
+    for (pos = map + GRID_CAP_HDRSIZE; pos < end;) {
+        if (end - pos < GRID_CAP_RECSIZE) {
+            truncated = 1;
+            break;
+        }
+        stamp = grid_getll (pos);
+        spsz = grid_getl (pos + 8);
+        sz = grid_getl (pos + 12);
+        if ((uint64_t) (end - pos - GRID_CAP_RECSIZE) <
+              GRID_CAP_ALIGN ((uint64_t) spsz + sz)) {
+            truncated = 1;
+            break;
+        }
+        if (!count)
+            first = stamp;
+
+        body = grid_allocmsg (sz, 0);
+        grid_assert_errno (body != NULL, "Can't allocate message");
+        memcpy (body, pos + GRID_CAP_RECSIZE + spsz, sz);
+        iov.iov_base = &body;
+        iov.iov_len = GRID_MSG;
+        memset (&hdr, 0, sizeof (hdr));
+        hdr.msg_iov = &iov;
+        hdr.msg_iovlen = 1;
+        if (spsz && options->raw_socket) {
+            if (GRID_CMSG_SPACE (sizeof (size_t) + spsz) > ctrlsz) {
+                ctrlsz = GRID_CMSG_SPACE (sizeof (size_t) + spsz);
+                ctrl = realloc (ctrl, ctrlsz);
+                grid_assert (ctrl);
+            }
+            cmsg = (struct grid_cmsghdr*) ctrl;
+            cmsg->cmsg_len = GRID_CMSG_SPACE (sizeof (size_t) + spsz);
+            cmsg->cmsg_level = PROTO_SP;
+            cmsg->cmsg_type = SP_HDR;
+            *(size_t*) GRID_CMSG_DATA (cmsg) = spsz;
+            memcpy (GRID_CMSG_DATA (cmsg) + sizeof (size_t),
+                pos + GRID_CAP_RECSIZE, spsz);
+            hdr.msg_control = ctrl;
+            hdr.msg_controllen = cmsg->cmsg_len;
+        }
+        pos += GRID_CAP_RECSIZE + GRID_CAP_ALIGN ((uint64_t) spsz + sz);
+
+        if (options->replay_speed > 0)
+            grid_load_wait (start +
+                (uint64_t) ((stamp - first) / options->replay_speed));
+        rc = grid_sendmsg (sock, &hdr, 0);
+        if (rc < 0 && (errno == EAGAIN || errno == ETIMEDOUT)) {
+            grid_freemsg (body);
+            if (options->verbose)
+                fprintf (stderr, "Message not sent (%s)\n",
+                    grid_strerror (errno));
+            continue;
+        }
+        if (rc < 0 && errno == ETERM) {
+            grid_freemsg (body);
+            break;
+        }
+        grid_assert_errno (rc >= 0, "Can't send");
+        ++count;
+        bytes += sz;
+    }
+    elapsed = (double) (grid_clock_ns () - start) / 1e9;
+    if (truncated)
+        fprintf (stderr, "%s: truncated capture file\n", options->replay_file);
+
+    if (options->verbose)
+        fprintf (stderr, "Replayed %llu messages (%llu bytes) in %.3f s\n",
+            (unsigned long long) count, (unsigned long long) bytes, elapsed);
+
+    free (ctrl);
+    munmap (map, (size_t) st.st_size);
+    close (fd);
+}
+
 int main (int argc, char **argv)
 {
     int sock;
@@ -613,16 +1425,55 @@ int main (int argc, char **argv)
         /* recv_timeout      */ -1.f,
         /* subscriptions     */ {NULL, NULL, 0, 0},
         /* socket_name       */ NULL,
+        /* raw_socket        */ 0,
         /* send_delay        */ 0.f,
         /* send_interval     */ -1.f,
         /* data_to_send      */ {NULL, 0, 0},
-        /* echo_format       */ GRID_NO_ECHO
+        /* echo_format       */ GRID_NO_ECHO,
+        /* load_rate         */ -1.f,
+        /* load_poisson      */ 0,
+        /* load_count        */ 0,
+        /* load_threads      */ 1,
+        /* load_size         */ NULL,
+        /* load_report       */ 0,
+        /* capture_file      */ NULL,
+        /* replay_file       */ NULL,
+        /* replay_speed      */ 1.f
     };
 
     grid_parse_options (&grid_cli, &options, argc, argv);
+    if (options.raw_socket && !options.capture_file && !options.replay_file) {
+        fprintf (stderr, "Option --raw-socket requires --capture or "
+            "--replay\n");
+        exit (1);
+    }
     sock = grid_create_socket (&options);
     grid_connect_socket (&options, sock);
     grid_sleep((int)(options.send_delay*1000));
+    if (options.load_rate >= 0) {
+        grid_load_send (&options, sock);
+        grid_close (sock);
+        grid_free_options(&grid_cli, &options);
+        return 0;
+    }
+    if (options.load_report) {
+        grid_load_report (&options, sock);
+        grid_close (sock);
+        grid_free_options(&grid_cli, &options);
+        return 0;
+    }
+    if (options.capture_file) {
+        grid_capture (&options, sock);
+        grid_close (sock);
+        grid_free_options(&grid_cli, &options);
+        return 0;
+    }
+    if (options.replay_file) {
+        grid_replay (&options, sock);
+        grid_close (sock);
+        grid_free_options(&grid_cli, &options);
+        return 0;
+    }
     switch (options.socket_type) {
     case GRID_PUB:
     case GRID_PUSH:
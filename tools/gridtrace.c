@@ -0,0 +1,173 @@
+/*
+    Copyright (c) 2013-2014 Martin Sustrik  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+/*  Decodes the event trace written by grid_trace_dump(3) and prints the events
+    of all the threads ordered by time. */
+
+#include "../src/utils/trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+struct gridtrace_kind {
+    uint64_t kind;
+    char *name;
+};
+
+struct gridtrace_event {
+    uint32_t thread;
+    struct grid_trace_record record;
+};
+
+static void gridtrace_read (FILE *f, void *buf, size_t len)
+{
+    if (len && fread (buf, len, 1, f) != 1) {
+        fprintf (stderr, "gridtrace: truncated trace file\n");
+        exit (1);
+    }
+}
+
+static int gridtrace_compare (const void *a, const void *b)
+{
+    const struct gridtrace_event *ea = a;
+    const struct gridtrace_event *eb = b;
+
+    if (ea->record.timestamp != eb->record.timestamp)
+        return ea->record.timestamp < eb->record.timestamp ? -1 : 1;
+    return ea->thread < eb->thread ? -1 : ea->thread > eb->thread;
+}
+
+static const char *gridtrace_name (struct gridtrace_kind *kinds,
+    uint32_t nkinds, uint64_t kind)
+{
+    uint32_t i;
+
+    for (i = 0; i != nkinds; ++i)
+        if (kinds [i].kind == kind)
+            return kinds [i].name;
+    return NULL;
+}
+
+int main (int argc, char *argv [])
+{
+    FILE *f;
+    struct grid_trace_header hdr;
+    struct grid_trace_kind kindhdr;
+    struct grid_trace_ringhdr ringhdr;
+    struct gridtrace_kind *kinds;
+    struct gridtrace_event *events;
+    size_t nevents;
+    size_t i;
+    uint32_t j;
+    uint32_t k;
+    double scale;
+    double us;
+    const char *name;
+
+    if (argc != 2) {
+        fprintf (stderr, "usage: gridtrace <trace-file>\n");
+        return 1;
+    }
+
+    f = fopen (argv [1], "rb");
+    if (!f) {
+        fprintf (stderr, "gridtrace: %s: %s\n", argv [1], strerror (errno));
+        return 1;
+    }
+
+    gridtrace_read (f, &hdr, sizeof (hdr));
+    if (memcmp (hdr.magic, GRID_TRACE_MAGIC, sizeof (hdr.magic)) != 0) {
+        fprintf (stderr, "gridtrace: %s: not a trace file\n", argv [1]);
+        return 1;
+    }
+
+    kinds = calloc (hdr.nkinds ? hdr.nkinds : 1, sizeof (*kinds));
+    if (!kinds) {
+        fprintf (stderr, "gridtrace: out of memory\n");
+        return 1;
+    }
+    for (j = 0; j != hdr.nkinds; ++j) {
+        gridtrace_read (f, &kindhdr, sizeof (kindhdr));
+        kinds [j].kind = kindhdr.kind;
+        kinds [j].name = malloc (kindhdr.namelen + 1);
+        if (!kinds [j].name) {
+            fprintf (stderr, "gridtrace: out of memory\n");
+            return 1;
+        }
+        gridtrace_read (f, kinds [j].name, kindhdr.namelen);
+        kinds [j].name [kindhdr.namelen] = 0;
+    }
+
+    /*  Merge the records from all the rings. */
+    events = NULL;
+    nevents = 0;
+    for (j = 0; j != hdr.nrings; ++j) {
+        gridtrace_read (f, &ringhdr, sizeof (ringhdr));
+        if (ringhdr.lost)
+            fprintf (stderr, "gridtrace: thread %u: %llu events lost\n",
+                (unsigned) ringhdr.thread,
+                (unsigned long long) ringhdr.lost);
+        events = realloc (events,
+            (nevents + ringhdr.count + 1) * sizeof (*events));
+        if (!events) {
+            fprintf (stderr, "gridtrace: out of memory\n");
+            return 1;
+        }
+        for (k = 0; k != ringhdr.count; ++k) {
+            events [nevents].thread = ringhdr.thread;
+            gridtrace_read (f, &events [nevents].record,
+                sizeof (struct grid_trace_record));
+            ++nevents;
+        }
+    }
+    fclose (f);
+
+    if (nevents)
+        qsort (events, nevents, sizeof (*events), gridtrace_compare);
+
+    /*  Convert the timestamps to microseconds since the tracing started. */
+    scale = 1.0;
+    if (hdr.tsc1 > hdr.tsc0 && hdr.us1 > hdr.us0)
+        scale = (double) (hdr.us1 - hdr.us0) / (double) (hdr.tsc1 - hdr.tsc0);
+
+    for (i = 0; i != nevents; ++i) {
+        us = (double) (int64_t) (events [i].record.timestamp - hdr.tsc0) *
+            scale;
+        name = gridtrace_name (kinds, hdr.nkinds, events [i].record.kind);
+        printf ("%14.3f %4u 0x%016llx ", us, (unsigned) events [i].thread,
+            (unsigned long long) events [i].record.object);
+        if (name)
+            printf ("%s", name);
+        else
+            printf ("0x%llx", (unsigned long long) events [i].record.kind);
+        printf (" src=%d type=%d state=%d\n", (int) events [i].record.src,
+            (int) events [i].record.type, (int) events [i].record.state);
+    }
+
+    for (j = 0; j != hdr.nkinds; ++j)
+        free (kinds [j].name);
+    free (kinds);
+    free (events);
+    return 0;
+}